@@ -77,8 +77,12 @@ namespace eval Binds {
 		}
 	}
 
+	proc ScheduleTime {{process 0}} {
+		if {$process} {ProcessTime}
+		after [expr {60000 - [clock milliseconds] % 60000}] [list Binds::ScheduleTime 1]
+	}
+
 	proc ProcessTime {} {
-		if {[clock format [clock seconds] -format "%S"] != 0} {return}
 		set time [clock format [clock seconds] -format "%M %H %d %m %Y"]
 		foreach {mi ho da mo ye} $time {}
 		# Loop bind list and execute
@@ -14,6 +14,11 @@
 #include "znc.h"
 
 #include <tcl.h>
+#include <sys/select.h>
+
+#ifndef CONST86
+#define CONST86
+#endif
 
 #define STDVAR (ClientData cd, Tcl_Interp *irp, int argc, const char *argv[])
 
@@ -27,16 +32,237 @@
 
 class CModTcl;
 
-class CModTclTimer : public CTimer {
+/**
+ * Runs due Tcl timers after every pass through the socket loop. The
+ * notifier only reports the timeout to select(), this does the work.
+ */
+class CTclTimerCron : public CCron {
 public:
+	CTclTimerCron() {
+		SetName("ModTclTimer");
+		Start(0);
+	}
+	virtual ~CTclTimerCron() {}
 
-	CModTclTimer(CModule* pModule, unsigned int uInterval, unsigned int uCycles, const CString& sLabel, const CString& sDescription) : CTimer(pModule, uInterval, uCycles, sLabel, sDescription) {}
-	virtual ~CModTclTimer() {}
 protected:
 	virtual void RunJob();
-	CModTcl*	m_pParent;
 };
 
+/**
+ * Tcl notifier that lets ZNC's socket loop drive the Tcl event loop.
+ * File handlers are watched by the CSocketManager's select() and the Tcl
+ * timer becomes the select timeout, so `after` and fileevent callbacks run
+ * as soon as they are due and an idle modtcl causes no wakeups at all.
+ */
+class CTclNotifier : public CSMonitorFD {
+public:
+	CTclNotifier() : m_bTimerSet(false), m_pCron(NULL) {}
+	virtual ~CTclNotifier() {}
+
+	static void Install() {
+		Tcl_NotifierProcs procs;
+		memset(&procs, 0, sizeof(procs));
+
+		procs.setTimerProc = SetTimer;
+		procs.waitForEventProc = WaitForEvent;
+		procs.createFileHandlerProc = CreateFileHandler;
+		procs.deleteFileHandlerProc = DeleteFileHandler;
+		procs.initNotifierProc = InitNotifier;
+		procs.finalizeNotifierProc = FinalizeNotifier;
+		procs.alertNotifierProc = AlertNotifier;
+		procs.serviceModeHookProc = ServiceModeHook;
+
+		Tcl_SetNotifier(&procs);
+	}
+
+	virtual bool GatherFDsForSelect(std::map<int, short>& miiReadyFds, long& iTimeoutMS) {
+		for (std::map<int, short>::const_iterator it = m_miiMonitorFDs.begin(); it != m_miiMonitorFDs.end(); ++it) {
+			miiReadyFds[it->first] |= it->second;
+		}
+
+		iTimeoutMS = (m_bTimerSet ? GetMSUntilTimer() : -1);
+
+		return m_bEnabled;
+	}
+
+	virtual bool FDsThatTriggered(const std::map<int, short>& miiReadyFds) {
+		for (std::map<int, short>::const_iterator it = miiReadyFds.begin(); it != miiReadyFds.end(); ++it) {
+			RunFileHandler(it->first, it->second);
+		}
+
+		Tcl_ServiceAll();
+
+		return m_bEnabled;
+	}
+
+	void RunTimer() {
+		if (m_bTimerSet && GetMSUntilTimer() == 0) {
+			m_bTimerSet = false;
+			// runs the timer and idle handlers, usually re-arms the timer via SetTimer
+			Tcl_ServiceAll();
+		}
+	}
+
+	static CTclNotifier* Get() { return m_pInstance; }
+
+private:
+	struct SFileHandler {
+		int           iMask;
+		Tcl_FileProc* pProc;
+		ClientData    pData;
+	};
+
+	std::map<int, SFileHandler> m_mHandlers;
+	bool                        m_bTimerSet;
+	struct timeval              m_tvTimer;
+	CTclTimerCron*              m_pCron;
+
+	static CTclNotifier*        m_pInstance;
+
+	long GetMSUntilTimer() const {
+		struct timeval tvNow;
+		gettimeofday(&tvNow, NULL);
+
+		long iMS = (m_tvTimer.tv_sec - tvNow.tv_sec) * 1000 + (m_tvTimer.tv_usec - tvNow.tv_usec) / 1000;
+		return (iMS > 0 ? iMS : 0);
+	}
+
+	void RunFileHandler(int iFD, short iEvents) {
+		std::map<int, SFileHandler>::const_iterator it = m_mHandlers.find(iFD);
+		if (it == m_mHandlers.end())
+			return;
+
+		int iMask = 0;
+		if (iEvents & CSockManager::ECT_Read)
+			iMask |= (it->second.iMask & (TCL_READABLE | TCL_EXCEPTION));
+		if (iEvents & CSockManager::ECT_Write)
+			iMask |= (it->second.iMask & TCL_WRITABLE);
+
+		// the handler is allowed to delete itself, so copy what we need first
+		Tcl_FileProc* pProc = it->second.pProc;
+		ClientData pData = it->second.pData;
+
+		if (iMask && pProc)
+			pProc(pData, iMask);
+	}
+
+	static void SetTimer(CONST86 Tcl_Time* pTime) {
+		if (!m_pInstance)
+			return;
+
+		if (!pTime) {
+			m_pInstance->m_bTimerSet = false;
+			return;
+		}
+
+		struct timeval& tv = m_pInstance->m_tvTimer;
+		gettimeofday(&tv, NULL);
+		tv.tv_sec += pTime->sec;
+		tv.tv_usec += pTime->usec;
+		if (tv.tv_usec >= 1000000) {
+			tv.tv_sec += tv.tv_usec / 1000000;
+			tv.tv_usec %= 1000000;
+		}
+
+		m_pInstance->m_bTimerSet = true;
+	}
+
+	// Only used when a script blocks on its own (vwait, update); ZNC's
+	// main loop never calls into Tcl_DoOneEvent anymore.
+	static int WaitForEvent(CONST86 Tcl_Time* pTime) {
+		if (!m_pInstance)
+			return -1;
+
+		fd_set rfds, wfds;
+		int iMaxFD = -1;
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+
+		for (std::map<int, SFileHandler>::const_iterator it = m_pInstance->m_mHandlers.begin(); it != m_pInstance->m_mHandlers.end(); ++it) {
+			if (it->second.iMask & (TCL_READABLE | TCL_EXCEPTION))
+				FD_SET(it->first, &rfds);
+			if (it->second.iMask & TCL_WRITABLE)
+				FD_SET(it->first, &wfds);
+			iMaxFD = std::max(iMaxFD, it->first);
+		}
+
+		struct timeval tv;
+		if (pTime) {
+			tv.tv_sec = pTime->sec;
+			tv.tv_usec = pTime->usec;
+		}
+
+		if (select(iMaxFD + 1, &rfds, &wfds, NULL, (pTime ? &tv : NULL)) <= 0)
+			return 0;
+
+		for (int iFD = 0; iFD <= iMaxFD; iFD++) {
+			short iEvents = 0;
+			if (FD_ISSET(iFD, &rfds))
+				iEvents |= CSockManager::ECT_Read;
+			if (FD_ISSET(iFD, &wfds))
+				iEvents |= CSockManager::ECT_Write;
+			if (iEvents)
+				m_pInstance->RunFileHandler(iFD, iEvents);
+		}
+
+		return 1;
+	}
+
+	static void CreateFileHandler(int iFD, int iMask, Tcl_FileProc* pProc, ClientData pData) {
+		if (!m_pInstance)
+			return;
+
+		SFileHandler& Handler = m_pInstance->m_mHandlers[iFD];
+		Handler.iMask = iMask;
+		Handler.pProc = pProc;
+		Handler.pData = pData;
+
+		short iEvents = 0;
+		if (iMask & (TCL_READABLE | TCL_EXCEPTION))
+			iEvents |= CSockManager::ECT_Read;
+		if (iMask & TCL_WRITABLE)
+			iEvents |= CSockManager::ECT_Write;
+		m_pInstance->Add(iFD, iEvents);
+	}
+
+	static void DeleteFileHandler(int iFD) {
+		if (!m_pInstance)
+			return;
+
+		m_pInstance->m_mHandlers.erase(iFD);
+		m_pInstance->Remove(iFD);
+	}
+
+	static ClientData InitNotifier() {
+		if (!m_pInstance) {
+			m_pInstance = new CTclNotifier;
+			m_pInstance->m_pCron = new CTclTimerCron;
+			CZNC::Get().GetManager().MonitorFD(m_pInstance);
+			CZNC::Get().GetManager().AddCron(m_pInstance->m_pCron);
+		}
+		return m_pInstance;
+	}
+
+	static void FinalizeNotifier(ClientData pData) {
+		if (m_pInstance) {
+			CZNC::Get().GetManager().DelCronByAddr(m_pInstance->m_pCron);
+			// this deletes the instance
+			CZNC::Get().GetManager().UnMonitorFD(m_pInstance);
+			m_pInstance = NULL;
+		}
+	}
+
+	static void AlertNotifier(ClientData pData) {}
+	static void ServiceModeHook(int iMode) {}
+};
+
+CTclNotifier* CTclNotifier::m_pInstance = NULL;
+
+void CTclTimerCron::RunJob() {
+	if (CTclNotifier::Get())
+		CTclNotifier::Get()->RunTimer();
+}
+
 class CModTclStartTimer : public CTimer {
 public:
 
@@ -55,6 +281,8 @@ public:
 	virtual ~CModTcl() {
 		if (interp) {
 			Tcl_DeleteInterp(interp);
+			// tears down the notifier, so no callbacks into this module remain
+			Tcl_Finalize();
 		}
 	}
 
@@ -67,6 +295,9 @@ public:
 	void Start() {
 		CString sMyArgs = GetArgs();
 
+		// must be in place before the interpreter initializes the notifier
+		CTclNotifier::Install();
+
 		interp = Tcl_CreateInterp();
 		Tcl_Init(interp);
 		Tcl_CreateCommand(interp, "Binds::ProcessPubm", tcl_Bind, this, NULL);
@@ -103,7 +334,8 @@ public:
 			}
 		}
 
-		AddTimer(new CModTclTimer(this, 1, 0, "ModTclUpdate", "Timer for modtcl to process pending events and idle callbacks."));
+		// time binds are driven by a Tcl timer aligned to full minutes
+		Tcl_Eval(interp, "if {[info commands Binds::ScheduleTime] ne {}} {Binds::ScheduleTime}");
 	}
 
 	virtual void OnModCommand(const CString& sCommand) {
@@ -128,15 +360,6 @@ public:
 		}
 	}
 
-	virtual void TclUpdate() {
-		while (Tcl_DoOneEvent(TCL_DONT_WAIT)) {}
-		i = Tcl_Eval(interp,"Binds::ProcessTime");
-		if (i != TCL_OK) {
-			result = interp->result;
-			PutModule(CString(result));
-		}
-	}
-
 	CString TclEscape(CString sLine) {
 		sLine.Replace("\\","\\\\");
 		sLine.Replace("{","\\{");
@@ -544,12 +767,6 @@ private:
 	}
 };
 
-void CModTclTimer::RunJob() {
-	CModTcl *p = (CModTcl *)m_pModule;
-	if (p)
-		p->TclUpdate();
-}
-
 void CModTclStartTimer::RunJob() {
 	CModTcl *p = (CModTcl *)m_pModule;
 	if (p)
@@ -36,6 +36,7 @@ private:
 	TColorsEnabledMap m_coloredChans;
 	TTriggerCharMap m_triggerChars;
 	int m_colorOne, m_colorTwo;
+	CHTTPClient m_HTTP;
 
 	static const char* TRIGGERS[NR_OF_TRIGGERS];
 	static const char* TRIGGERS_STR;
@@ -49,7 +50,7 @@ private:
 	void SaveSettings();
 	void LoadSettings();
 public:
-	MODCONSTRUCTOR(CInfoBotModule)
+	MODCONSTRUCTOR(CInfoBotModule), m_HTTP(this)
 	{
 		m_colorOne = 7;
 		m_colorTwo = 14;
@@ -59,6 +60,7 @@ public:
 	char TriggerChar(const CString& sChan);
 	void SendMessage(const CString& sSendTo, const CString& sMsg);
 	static CString Do8Ball();
+	CHTTPClient& GetHTTPClient() { return m_HTTP; }
 
 	bool OnLoad(const CString& sArgsi, CString& sMessage);
 	void OnModCommand(const CString& sCommand);
@@ -253,82 +255,54 @@ static CString StripHTML(const CString& sFrom)
 }
 
 
-class CSimpleHTTPSock : protected CSocket
+class CSimpleHTTPSock : public CHTTPRequest
 {
-private:
-	CString m_request;
-	CString m_buffer;
-
 protected:
 	CInfoBotModule *m_pMod;
 
 	void Get(const CString& sHost, const CString& sPath, unsigned short iPort = 80, bool bSSL = false)
 	{
-		m_request = "GET " + sPath + " HTTP/1.0\r\n";
-		m_request += "Host: " + sHost + ((iPort == 80 && !bSSL) || (iPort == 443 && bSSL) ? CString("") : ":" + CString(iPort)) + "\r\n";
-		m_request += "User-Agent: Mozilla/5.0 (" + CZNC::GetTag() + ")\r\n";
-		m_request += "Connection: close\r\n";
-		m_request += "\r\n";
+		SetURL(CString(bSSL ? "https://" : "http://") + sHost + ":" + CString(iPort) + sPath);
+		AddHeader("User-Agent", "Mozilla/5.0 (" + CZNC::GetTag() + ")");
 
-		Connect(sHost, iPort, bSSL);
-	}
-
-	void Connected()
-	{
-		m_buffer.clear();
-		Write(m_request);
-		m_request.clear();
-	}
-
-	virtual void Timeout()
-	{
-		m_request.clear();
-		Close();
+		// the client owns us from here on:
+		m_pMod->GetHTTPClient().Request(this);
 	}
 
-	void Disconnected()
+	void OnRequestDone(unsigned int uStatus, const MCString& msHeaders, const CString& sBody)
 	{
-		OnRequestDone(m_buffer);
-		Close();
+		OnRequestDone(sBody);
 	}
 
-#if (VERSION_MAJOR == 0 && VERSION_MINOR <= 80)
-	void ReadData(const char *data, int len)
-#else
-	void ReadData(const char *data, size_t len)
-#endif
+	void OnRequestError(int iErrorCode)
 	{
-		if(m_buffer.size() + len > 1024 * 1024)
+		if(iErrorCode == ERR_TIMEOUT)
 		{
-			// make sure our buffers don't EVER take up too much memory.
-			// we just abort stuff in this case.
-			m_buffer.clear();
-			Close();
+			Timeout();
 		}
 		else
 		{
-			m_buffer.append(data, len);
+			OnRequestDone("");
 		}
 	}
 
+	virtual void Timeout()
+	{
+	}
+
 	virtual void OnRequestDone(const CString& sResponse) = 0;
 public:
 	CSimpleHTTPSock(CInfoBotModule *pModInstance)
-		: CSocket((CModule*)pModInstance)
 	{
 		m_pMod = pModInstance;
 
-		DisableReadLine();
+		// make sure our buffers don't EVER take up too much memory.
+		SetMaxResponseSize(1024 * 1024);
 	}
 
 	virtual ~CSimpleHTTPSock()
 	{
 	}
-
-	static CString URLEscape(const CString& s)
-	{
-		return s.Escape_n(CString::EASCII, CString::EURL);
-	}
 };
 
 
@@ -342,8 +316,6 @@ protected:
 	{
 		m_pMod->SendMessage(m_chan, "ERROR: Sorry " + m_nick + ", I failed to contact the server.");
 		m_timedOut = true;
-
-		CSimpleHTTPSock::Timeout();
 	}
 
 public:
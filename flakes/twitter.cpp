@@ -19,7 +19,6 @@
 #error This module needs ZNC 0.072 or newer.
 #endif
 
-#include <stack>
 #include <deque>
 #include <exception>
 #include <algorithm>
@@ -105,11 +104,12 @@ private:
 	time_t m_msgQueueLastSent;
 	time_t m_lastRateLimitedCall;
 	map<const CString, CFontStyle> m_styles;
+	CHTTPClient m_HTTP;
 
 	void SaveSettings();
 	void LoadSettings();
 public:
-	MODCONSTRUCTOR(CTwitterModule)
+	MODCONSTRUCTOR(CTwitterModule), m_HTTP(this)
 	{
 		m_waitingForPIN = m_hasAccessToken = false;
 		m_userId = 0;
@@ -127,6 +127,7 @@ public:
 	const CString& GetTokenSecret() { return m_tokenSecret; }
 	const CString& GetScreenName() { return m_screenName; }
 	bool IsAuthed() { return m_hasAccessToken; }
+	CHTTPClient& GetHTTPClient() { return m_HTTP; }
 
 	void EraseSession(bool bErrorMessage);
 	void SendTweet(CString sMessage);
@@ -170,243 +171,74 @@ static CString HMACSHA1(const CString& sInput, const CString& sKey)
 /* HTTP CLIENT SOCKET                                                   */
 /************************************************************************/
 
-class CSimpleHTTPSock : protected CSocket
+class CSimpleHTTPSock : public CHTTPRequest
 {
 public:
-	CSimpleHTTPSock(CModule *pModInstance)
-		: CSocket(pModInstance)
+	CSimpleHTTPSock(CTwitterModule *pModInstance)
 	{
 		m_pMod = pModInstance;
-		m_maxRedirs = 5;
-		m_numRedir = 0;
-		m_maxBuf = 1024 * 1024;
+		m_pClient = &pModInstance->GetHTTPClient();
 
-		DisableReadLine();
+		SetMaxRedirects(5);
+		SetMaxResponseSize(1024 * 1024);
 	}
 
 	virtual ~CSimpleHTTPSock()
 	{
 	}
 
-	static CString URLEscape(const CString& s)
-	{
-		return s.Escape_n(CString::EASCII, CString::EURL).Replace_n("+", "%20");
-	}
-
-	static bool CrackURL(const CString& sURL, CString& srHost, unsigned short& urPort, CString& srPath, bool& brSSL)
-	{
-		CString sWork(sURL);
-
-		if(sWork.substr(0, 7) == "http://")
-		{
-			brSSL = false;
-			urPort = 80;
-
-			sWork.erase(0, 7);
-		}
-		else if(sURL.substr(0, 8) == "https://")
-		{
-			brSSL = true;
-			urPort = 443;
-
-			sWork.erase(0, 8);
-		}
-		else
-			return false;
-
-		CString::size_type uPos = sWork.find('/');
-
-		if(uPos == CString::npos)
-		{
-			srHost = sWork;
-			srPath = "/";
-		}
-		else
-		{
-			srHost = sWork.substr(0, uPos);
-			srPath = sWork.substr(uPos + 1);
-		}
-
-		uPos = srHost.find(':');
-
-		if(uPos != CString::npos)
-		{
-			unsigned long long uTmp = CString(srHost.substr(uPos + 1)).ToULongLong();
-
-			if(uTmp > 0 && uTmp <= numeric_limits<unsigned short>::max())
-			{
-				urPort = (unsigned short)uTmp;
-				srHost = srHost.substr(0, uPos);
-			}
-			else
-				return false;
-		}
-
-		// validate host + path:
-		if(srHost.empty()) return false;
-
-		for(CString::size_type p = 0; p < srHost.size(); p++)
-		{
-			if(!isalnum(srHost[p]) && srHost[p] != '.' && srHost[p] != '-')
-			{
-				return false;
-			}
-		}
-
-		for(CString::size_type p = 0; p < srPath.size(); p++)
-		{
-			if(!srPath[p] || srPath[p] == '\n' || srPath[p] == '\r')
-			{
-				return false;
-			}
-		}
-
-		return true;
-	}
-
-private:
-	CString m_request;
-	CString m_buffer;
-	unsigned int m_numRedir;
-
 protected:
 	CModule *m_pMod;
-	unsigned int m_maxRedirs;
-	unsigned int m_maxBuf;
+	CHTTPClient *m_pClient;
 	MCString m_extraReqHeaders;
 
-	void MakeRequestHeaders(bool bPost, const CString& sHost, const CString& sPath, unsigned short uPort, bool bSSL)
+	void MakeRequestHeaders(const CString& sHost, const CString& sPath, unsigned short uPort, bool bSSL)
 	{
-		m_request = CString(bPost ? "POST " : "GET ") + sPath + " HTTP/1.1\r\n";
-		m_request += "Host: " + sHost + ((uPort == 80 && !bSSL) || (uPort == 443 && bSSL) ? CString("") : ":" + CString(uPort)) + "\r\n";
-		m_request += "User-Agent: Mozilla/5.0 (" + CZNC::GetTag() + ")\r\n";
+		SetURL(CString(bSSL ? "https://" : "http://") + sHost + ":" + CString(uPort) + sPath);
+		AddHeader("User-Agent", "Mozilla/5.0 (" + CZNC::GetTag() + ")");
 
 		for(MCString::const_iterator it = m_extraReqHeaders.begin(); it != m_extraReqHeaders.end(); it++)
 		{
-			m_request += it->first + ": " + it->second + "\r\n";
+			AddHeader(it->first, it->second);
 		}
-
-		m_request += "Connection: Close\r\n";
 	}
 
 	void Get(const CString& sHost, const CString& sPath, unsigned short uPort = 80, bool bSSL = false)
 	{
-		MakeRequestHeaders(false, sHost, sPath, uPort, bSSL);
-		m_request += "\r\n";
+		MakeRequestHeaders(sHost, sPath, uPort, bSSL);
+		SetMethod("GET");
 
-		DEBUG("[Twitter] Connecting to [" << sHost << "]:" << uPort << " (SSL = " << bSSL << ")");
-		Connect(sHost, uPort, bSSL);
+		DEBUG("[Twitter] Requesting [" << sHost << "]:" << uPort << sPath << " (SSL = " << bSSL << ")");
+		// the client owns us from here on:
+		m_pClient->Request(this);
 	}
 
 	void Post(const MCString& mPostData, const CString& sHost, const CString& sPath, unsigned short uPort = 80, bool bSSL = false)
 	{
-		MakeRequestHeaders(true, sHost, sPath, uPort, bSSL);
-
-		CString sPostData;
-
-		for(MCString::const_iterator it = mPostData.begin(); it != mPostData.end(); it++)
-		{
-			if(it != mPostData.begin()) sPostData += "&";
-			sPostData += URLEscape(it->first) + "=" + URLEscape(it->second);
-		}
+		MakeRequestHeaders(sHost, sPath, uPort, bSSL);
+		SetPostData(mPostData);
 
-		m_request += "Content-Type: application/x-www-form-urlencoded\r\n";
-		m_request += "Content-Length: " + CString(sPostData.size()) + "\r\n";
-		m_request += "\r\n";
-		m_request += sPostData;
-
-		DEBUG("[Twitter] Connecting to [" << sHost << "]:" << uPort << " (SSL = " << bSSL << ")");
-		Connect(sHost, uPort, bSSL);
-	}
-
-	void Connected()
-	{
-		m_buffer.clear();
-		DEBUG("[Twitter] Sending request: " << m_request);
-		Write(m_request);
-		m_request.clear();
+		DEBUG("[Twitter] Posting to [" << sHost << "]:" << uPort << sPath << " (SSL = " << bSSL << ")");
+		m_pClient->Request(this);
 	}
 
 	virtual void Timeout()
 	{
-		m_request.clear();
-		Close();
 	}
 
-	void Disconnected()
+	void OnRequestError(int iErrorCode)
 	{
-		unsigned int uResponseCode;
-
-		if(sscanf(m_buffer.c_str(), "HTTP/1.%*c %u ", &uResponseCode) == 1)
+		if(iErrorCode == ERR_TIMEOUT)
 		{
-			CString::size_type uPos = m_buffer.find("\r\n\r\n");
-			if(uPos == CString::npos) uPos = m_buffer.find("\n\n");
-
-			DEBUG("[Twitter] Response: " << m_buffer);
-
-			if(uPos != CString::npos)
-			{
-				VCString vHeadersTemp;
-				map<const CString, CString> mHeaders;
-
-				CString(m_buffer.substr(0, uPos)).Split("\n", vHeadersTemp, false, "", "", false, true);
-
-				for(VCString::const_iterator it = vHeadersTemp.begin(); it != vHeadersTemp.end(); it++)
-				{
-					CString sVal = it->Token(1, true, ":");
-					sVal.Trim();
-
-					mHeaders[it->Token(0, false, ":")] = sVal;
-				}
-
-				if(uResponseCode >= 300 && uResponseCode < 400 && mHeaders.find("Location") != mHeaders.end() && m_numRedir < m_maxRedirs)
-				{
-					bool bSSL; unsigned short uPort;
-					CString sHost, sPath;
-
-					if(CrackURL(mHeaders["Location"], sHost, uPort, sPath, bSSL))
-					{
-						m_numRedir++;
-						Get(sHost, sPath, uPort, bSSL);
-					}
-					else
-						OnRequestError(-3);
-				}
-				else
-				{
-					OnRequestDone(uResponseCode, mHeaders, m_buffer.substr(uPos + 2));
-				}
-			}
-			else
-				OnRequestError(-2);
-		}
-		else
-			OnRequestError(-1);
-
-		Close();
-	}
-
-#if (VERSION_MAJOR == 0 && VERSION_MINOR <= 80)
-	void ReadData(const char *data, int len)
-#else
-	void ReadData(const char *data, size_t len)
-#endif
-	{
-		if(m_buffer.size() + len > m_maxBuf)
-		{
-			// make sure our buffers don't EVER take up too much memory.
-			// we just abort stuff in this case.
-			m_buffer.clear();
-			Close();
+			Timeout();
 		}
 		else
 		{
-			m_buffer.append(data, len);
+			OnRequestFailed(iErrorCode);
 		}
 	}
 
-	virtual void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse) = 0;
-	virtual void OnRequestError(int iErrorCode) = 0;
+	virtual void OnRequestFailed(int iErrorCode) = 0;
 };
 
 
@@ -769,260 +601,133 @@ static CString Utf8Xml_NamedEntityDecode(const CString& sString)
 /* XML STUFF                                                            */
 /************************************************************************/
 
-class CXMLException
+class CXMLRecord
 {
-protected:
-	CString m_message;
-	size_t m_pos;
 public:
-	CXMLException(const CString& sMessage, size_t iPos)
+	CString m_name;
+	MCString m_attributes;
+	MCString m_fields;
+
+	const CString GetAttribute(const CString& sName) const
 	{
-		m_message = sMessage;
-		m_pos = iPos;
+		MCString::const_iterator it = m_attributes.find(sName);
+		return (it != m_attributes.end() ? it->second : "");
 	}
-	const CString GetMessage() const { return m_message; }
-};
 
-class CXMLParser;
-class CXMLTag;
-typedef CSmartPtr<CXMLTag> PXMLTag;
+	// sPath is relative to the record, e.g. "status/text"
+	const CString Get(const CString& sPath) const
+	{
+		MCString::const_iterator it = m_fields.find(sPath);
+		return (it != m_fields.end() ? it->second : "");
+	}
+};
 
-class CXMLTag
+// Turns every element at a given depth into a CXMLRecord holding the text of
+// the (leaf) elements below it. The document never has to be in memory as a
+// whole, so this can be fed straight from the socket.
+class CXMLRecordReader : public CXMLStreamParser
 {
-	friend class CXMLParser;
 protected:
-	CString m_name;
-	map<const CString, CString> m_attributes;
-	vector<PXMLTag> m_children;
+	unsigned int m_recordDepth;
+	set<CString> m_wantedFields;
+	vector<CXMLRecord> m_records;
+	CString m_rootName;
+	CXMLRecord m_current;
+	CString m_path;
 	CString m_text;
+	bool m_leaf;
+	bool m_collect;
 
-	CXMLTag()
+	void OnStartElement(const CStrSpan& sName, const VAttributes& vAttributes)
 	{
-	}
-public:
-	const CString& GetName() const
-	{
-		return m_name;
-	}
+		unsigned int iDepth = GetDepth();
 
-	const CString GetAttribute(const CString& sName) const
-	{
-		map<const CString, CString>::const_iterator it = m_attributes.find(sName);
-		return (it != m_attributes.end() ? it->second : "");
-	}
+		if(iDepth == 1)
+		{
+			m_rootName = sName.ToString();
+		}
 
-	const PXMLTag GetChildByName(const CString& sTagName) const
-	{
-		for(vector<PXMLTag>::const_iterator it = m_children.begin(); it != m_children.end(); it++)
+		if(iDepth == m_recordDepth)
 		{
-			if((*it)->m_name.Equals(sTagName))
+			m_current.m_name = sName.ToString();
+			m_current.m_attributes.clear();
+			m_current.m_fields.clear();
+			m_path.clear();
+
+			for(VAttributes::const_iterator it = vAttributes.begin(); it != vAttributes.end(); it++)
 			{
-				return *it;
+				m_current.m_attributes[it->first.ToString()] = Utf8Xml_Decode(it->second.ToString());
 			}
 		}
-		return PXMLTag();
-	}
-
-	const CString GetChildText(const CString& sTagName) const
-	{
-		const PXMLTag xTag = GetChildByName(sTagName);
-		return (xTag ? xTag->m_text : "");
-	}
+		else if(iDepth > m_recordDepth)
+		{
+			if(!m_path.empty()) m_path += "/";
+			m_path.append(sName.data(), sName.size());
+		}
 
-	const vector<PXMLTag>::const_iterator BeginChildren() const
-	{
-		return m_children.begin();
+		m_text.clear();
+		m_leaf = true;
+		m_collect = (iDepth > m_recordDepth && (m_wantedFields.empty() || m_wantedFields.find(m_path) != m_wantedFields.end()));
 	}
 
-	const vector<PXMLTag>::const_iterator EndChildren() const
+	void OnText(const CStrSpan& sText)
 	{
-		return m_children.end();
+		if(m_collect)
+		{
+			m_text.append(sText.data(), sText.size());
+		}
 	}
-};
 
-class CXMLParser
-{
-protected:
-	// will miss some things such as the bar in <foo lol="wat" bar>, but whatever.
-	static void ParseAttributes(const CString& sTagContents, map<const CString, CString>& mAttributes)
+	void OnEndElement(const CStrSpan& sName)
 	{
-		CString::size_type pos = sTagContents.find(" ");
-		bool bInName = true, bWaitingForVal = false, bInVal = false;
-		char cQuote = 0;
-		CString::size_type valStartPos = 0;
-		CString sName;
+		unsigned int iDepth = GetDepth();
 
-		while(pos != CString::npos && pos < sTagContents.size())
+		if(iDepth > m_recordDepth)
 		{
-			if(bInName && isspace(sTagContents[pos]))
+			// only elements without child tags carry text, the first one wins:
+			if(m_leaf && m_collect && m_current.m_fields.find(m_path) == m_current.m_fields.end())
 			{
-				pos++;
+				m_current.m_fields[m_path] = Utf8Xml_Decode(m_text);
 			}
-			else if(bInName && sTagContents[pos] == '=')
-			{
-				bInName = false;
-				bWaitingForVal = true;
-				pos = sTagContents.find_first_of("'\"", pos + 1);
-			}
-			else if(bInName)
-			{
-				sName += sTagContents[pos];
-				pos++;
-			}
-			else if(bWaitingForVal && (sTagContents[pos] == '"' || sTagContents[pos] == '\''))
-			{
-				cQuote = sTagContents[pos];
-				bInVal = true;
-				bWaitingForVal = false;
-				valStartPos = pos + 1;
-				pos = sTagContents.find(cQuote, pos + 1);
-			}
-			else if(bInVal && sTagContents[pos] == cQuote)
-			{
-				bInVal = false;
-				bInName = true;
-				mAttributes[sName] = sTagContents.substr(valStartPos, pos - valStartPos);
-				mAttributes[sName] = Utf8Xml_Decode(mAttributes[sName]);
-				sName = "";
 
-				pos++;
-			}
-			else
-				throw CXMLException("internal problem while parsing attributes", 0);
+			CString::size_type uPos = m_path.rfind('/');
+			m_path.erase(uPos == CString::npos ? 0 : uPos);
 		}
-
-		if(bInVal || bWaitingForVal)
+		else if(iDepth == m_recordDepth)
 		{
-			throw CXMLException("Couldn't parse some tag attributes: <" + sTagContents + ">", 0);
+			OnRecord(m_current);
 		}
+
+		m_text.clear();
+		m_leaf = m_collect = false;
+	}
+
+	virtual void OnRecord(const CXMLRecord& rRecord)
+	{
+		m_records.push_back(rRecord);
 	}
 public:
-	static PXMLTag ParseString(const CString& sXmlString)
+	// iRecordDepth = 1 makes the root element the (only) record.
+	CXMLRecordReader(unsigned int iRecordDepth)
 	{
-		stack<PXMLTag> m_openTags;
-		stack<PXMLTag> m_openTagParent;
-
-		PXMLTag xParent, xRoot;
-		bool bEnding = false;
-
-		CString::size_type pos = sXmlString.find("<");
-		CString::size_type iTextStartPos = CString::npos;
-		unsigned int iIteration = 0, iTextStartPosIteration = 0;
-
-		while(pos != CString::npos)
-		{
-			if(bEnding)
-			{
-				throw CXMLException("Multiple root tags?", pos);
-			}
-
-			iIteration++;
-			CString::size_type tagendpos = sXmlString.find(">", pos + 1);
-
-			if(tagendpos == CString::npos)
-			{
-				throw CXMLException("No terminating > for open <", pos);
-			}
-
-			if(tagendpos == pos + 1)
-			{
-				throw CXMLException("Empty tag", pos);
-			}
-
-			const CString sTagContents = sXmlString.substr(pos + 1, tagendpos - pos - 1);
-			CString sTagName = sTagContents.Token(0).Replace_n("\r", "").Replace_n("\n", "");
-
-			if(sTagName.substr(0, 3) == "!--")
-			{
-				// skip comments.
-				tagendpos = sXmlString.find("-->", pos) + 2;
-
-				if(tagendpos == CString::npos)
-				{
-					throw CXMLException("Unterminated comment", pos);
-				}
-			}
-			else if(sTagName[0] == '?')
-			{
-				// skip <?xml stuff without any further checks.
-			}
-			else if(sTagName[0] != '/')
-			{
-				// found start tag
-				PXMLTag xNew(new CXMLTag());
-				xNew->m_name = sTagName;
-
-				ParseAttributes(sTagContents, xNew->m_attributes);
-
-				// look out for <img /> style tags:
-				if(sTagContents[sTagContents.size() - 1] != '/')
-				{
-					m_openTags.push(xNew);
-					if(xParent) m_openTagParent.push(xParent);
-					xParent = xNew;
-
-					// save the position in case this tag has no child tags
-					// and we want to extract text from it.
-					iTextStartPos = tagendpos + 1;
-					iTextStartPosIteration = iIteration;
-				}
-				else if(xParent)
-				{
-					xParent->m_children.push_back(xNew);
-				}
-				else
-				{
-					xRoot = xNew;
-				}
-			}
-			else
-			{
-				// found end tag
-				sTagName.erase(0, 1);
-
-				if(m_openTags.size() == 0 || !m_openTags.top()->m_name.Equals(sTagName))
-				{
-					throw CXMLException("Ending tag for '" + CString(sTagName) + "', which is not open", pos);
-				}
-
-				// take the now-closed tag off the stack:
-				PXMLTag xClosedTag = m_openTags.top();
-
-				m_openTags.pop();
-
-				// if no other tags have been found inbetween, extract text:
-				if(iIteration == iTextStartPosIteration + 1)
-				{
-					xClosedTag->m_text = sXmlString.substr(iTextStartPos, pos - iTextStartPos);
-					xClosedTag->m_text = Utf8Xml_Decode(xClosedTag->m_text);
-				}
-
-				// no parent = root tag. if this happens, we've walked the tree and are done.
-				if(m_openTagParent.empty())
-				{
-					xRoot = xClosedTag;
-					bEnding = true;
-				}
-				else
-				{
-					// re-set old parent:
-					xParent = m_openTagParent.top();
-					m_openTagParent.pop();
-
-					// otherwise, save the new child and to the next tag...
-					xParent->m_children.push_back(xClosedTag);
-				}
-			}
+		m_recordDepth = iRecordDepth;
+		m_leaf = m_collect = false;
+	}
 
-			pos = sXmlString.find("<", tagendpos + 1);
-		}
+	// restricts the collected fields, by default all of them are kept.
+	void AddField(const CString& sPath)
+	{
+		m_wantedFields.insert(sPath);
+	}
 
-		if(m_openTags.size() != 0)
-		{
-			throw CXMLException("Found unclosed tags", 0);
-		}
+	const CString& GetRootName() const
+	{
+		return m_rootName;
+	}
 
-		return xRoot;
+	const vector<CXMLRecord>& GetRecords() const
+	{
+		return m_records;
 	}
 };
 
@@ -1040,11 +745,16 @@ protected:
 	CString m_host;
 	CString m_path;
 	bool m_bHideErrors;
+	// if set, successful responses are parsed while they are being received:
+	CXMLStreamParser *m_pXML;
+	bool m_streaming;
 
 	CTwitterHTTPSock(CTwitterModule *pModInstance, const CString& sMethod, bool bSilentErrors = true) :
 		CSimpleHTTPSock(pModInstance), m_method(sMethod), m_bHideErrors(bSilentErrors)
 	{
 		m_timedOut = false;
+		m_pXML = NULL;
+		m_streaming = false;
 		m_needsAuth = true;
 		m_host = "api.twitter.com";
 		m_path = "/1.1";
@@ -1054,8 +764,31 @@ protected:
 	{
 		if(!m_bHideErrors) m_pMod->PutModule("ERROR: Sorry, I failed to contact the Twitter servers. They may be down, again!");
 		m_timedOut = true;
+	}
+
+	void OnResponseHeaders(unsigned int uResponseCode, const MCString& mHeaders)
+	{
+		// error responses are still collected for HandleCommonHTTPErrors:
+		m_streaming = (m_pXML != NULL && uResponseCode == 200);
+		SetBufferBody(!m_streaming);
+
+		if(m_pXML) m_pXML->Reset();
+	}
+
+	bool OnBodyData(const char *pData, size_t uLen)
+	{
+		return (!m_streaming || m_pXML->Feed(pData, uLen));
+	}
+
+	bool FinishXML()
+	{
+		if(!m_pXML->Finish())
+		{
+			m_pMod->PutModule("ERROR: " + m_method + " (xml) " + m_pXML->GetError());
+			return false;
+		}
 
-		CSimpleHTTPSock::Timeout();
+		return true;
 	}
 
 	CString SignString(const CString& sString)
@@ -1150,7 +883,7 @@ protected:
 		}
 	}
 
-	void HandleCommonHTTPErrors(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse, bool bLogOutOn401)
+	void HandleCommonHTTPErrors(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse, bool bLogOutOn401)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
 
@@ -1170,9 +903,11 @@ protected:
 		}
 	}
 
-	virtual void OnRequestError(int iErrorCode)
+	virtual void OnRequestFailed(int iErrorCode)
 	{
-		if(!m_bHideErrors) m_pMod->PutModule("ERROR: " + m_method + " failed (" + CString(iErrorCode) + ")");
+		if(m_pXML && m_pXML->HasError())
+			m_pMod->PutModule("ERROR: " + m_method + " (xml) " + m_pXML->GetError());
+		else if(!m_bHideErrors) m_pMod->PutModule("ERROR: " + m_method + " failed (" + CString(iErrorCode) + ")");
 	}
 };
 
@@ -1207,7 +942,7 @@ public:
 		DoRequest("POST", mParams);
 	}
 
-	void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse)
+	void OnRequestDone(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
 
@@ -1296,7 +1031,7 @@ public:
 		DoRequest("POST", mParams);
 	}
 
-	void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse)
+	void OnRequestDone(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
 
@@ -1316,10 +1051,13 @@ public:
 
 class CTRUserInfo : public CTwitterHTTPSock
 {
+protected:
+	CXMLRecordReader m_reader;
 public:
 	CTRUserInfo(CTwitterModule *pModInstance) :
-		CTwitterHTTPSock(pModInstance, "users/show.xml", false)
+		CTwitterHTTPSock(pModInstance, "users/show.xml", false), m_reader(1)
 	{
+		m_pXML = &m_reader;
 	}
 
 	void Request()
@@ -1331,23 +1069,15 @@ public:
 		DoRequest("GET", mParams);
 	}
 
-	void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse)
+	void OnRequestDone(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
 
 		if(uResponseCode == 200)
 		{
-			PXMLTag xUser;
+			if(!FinishXML() || m_reader.GetRecords().empty()) return;
 
-			try
-			{
-				xUser = CXMLParser::ParseString(sResponse);
-			}
-			catch(CXMLException e)
-			{
-				pMod->PutModule("ERROR: " + m_method + " (xml) " + e.GetMessage());
-				return;
-			}
+			const CXMLRecord& xUser = m_reader.GetRecords().front();
 
 			CTable infoTable;
 
@@ -1356,29 +1086,29 @@ public:
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "URL");
-			infoTable.SetCell("Value", "http://twitter.com/" + xUser->GetChildText("screen_name"));
+			infoTable.SetCell("Value", "http://twitter.com/" + xUser.Get("screen_name"));
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Real Name");
-			infoTable.SetCell("Value", xUser->GetChildText("name"));
+			infoTable.SetCell("Value", xUser.Get("name"));
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Followers");
-			infoTable.SetCell("Value", xUser->GetChildText("followers_count"));
+			infoTable.SetCell("Value", xUser.Get("followers_count"));
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Following");
-			infoTable.SetCell("Value", xUser->GetChildText("friends_count"));
+			infoTable.SetCell("Value", xUser.Get("friends_count"));
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Tweets");
-			infoTable.SetCell("Value", xUser->GetChildText("statuses_count"));
+			infoTable.SetCell("Value", xUser.Get("statuses_count"));
 
 			pMod->PutModule(infoTable);
 
-			if(PXMLTag xStatus = xUser->GetChildByName("status"))
+			if(!xUser.Get("status/created_at").empty())
 			{
-				pMod->PutModule("Last Tweet: " + xStatus->GetChildText("text") + " [" + xStatus->GetChildText("created_at") + "]");
+				pMod->PutModule("Last Tweet: " + xUser.Get("status/text") + " [" + xUser.Get("status/created_at") + "]");
 			}
 		}
 		else
@@ -1393,10 +1123,13 @@ public:
 
 class CTRRateLimit : public CTwitterHTTPSock
 {
+protected:
+	CXMLRecordReader m_reader;
 public:
 	CTRRateLimit(CTwitterModule *pModInstance) :
-		CTwitterHTTPSock(pModInstance, "account/rate_limit_status.xml", false)
+		CTwitterHTTPSock(pModInstance, "account/rate_limit_status.xml", false), m_reader(1)
 	{
+		m_pXML = &m_reader;
 	}
 
 	void Request()
@@ -1405,23 +1138,15 @@ public:
 		DoRequest("GET", mParams);
 	}
 
-	void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse)
+	void OnRequestDone(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
 
 		if(uResponseCode == 200)
 		{
-			PXMLTag xHash;
+			if(!FinishXML() || m_reader.GetRecords().empty()) return;
 
-			try
-			{
-				xHash = CXMLParser::ParseString(sResponse);
-			}
-			catch(CXMLException e)
-			{
-				pMod->PutModule("ERROR: " + m_method + " (xml) " + e.GetMessage());
-				return;
-			}
+			const CXMLRecord& xHash = m_reader.GetRecords().front();
 
 			CTable infoTable;
 
@@ -1430,11 +1155,11 @@ public:
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Remaining Hits");
-			infoTable.SetCell("Value", xHash->GetChildText("remaining-hits") + " / " + xHash->GetChildText("hourly-limit"));
+			infoTable.SetCell("Value", xHash.Get("remaining-hits") + " / " + xHash.Get("hourly-limit"));
 
 			infoTable.AddRow();
 			infoTable.SetCell("What", "Reset Time");
-			infoTable.SetCell("Value", CTwitterModule::FormatTweetTime(strtoull(xHash->GetChildText("reset-time-in-seconds").c_str(), NULL, 10), true));
+			infoTable.SetCell("Value", CTwitterModule::FormatTweetTime(strtoull(xHash.Get("reset-time-in-seconds").c_str(), NULL, 10), true));
 
 			pMod->PutModule(infoTable);
 		}
@@ -1451,18 +1176,44 @@ public:
 class CTRFeed : public CTwitterHTTPSock
 {
 protected:
+	// hands the <entry>s to the request as soon as they have been received.
+	class CEntryReader : public CXMLRecordReader
+	{
+	protected:
+		CTRFeed *m_pReq;
+
+		void OnRecord(const CXMLRecord& rRecord)
+		{
+			if(m_rootName == "feed" && rRecord.m_name == "entry")
+			{
+				m_pReq->OnEntry(rRecord);
+			}
+		}
+	public:
+		CEntryReader(CTRFeed *pReq) : CXMLRecordReader(2), m_pReq(pReq)
+		{
+			AddField("id");
+			AddField("title");
+			AddField("published");
+		}
+	};
+
 	bool m_initial;
 	bool m_countSupported;
+	bool m_gotInitialEntry;
 	int m_feedId;
 	ETwitterFeedType m_feedType;
+	CEntryReader m_reader;
 public:
 	CTRFeed(CTwitterModule *pModInstance, ETwitterFeedType type, int iFeedId) :
-		CTwitterHTTPSock(pModInstance, "", true)
+		CTwitterHTTPSock(pModInstance, "", true), m_reader(this)
 	{
 		m_countSupported = true;
 		m_initial = false;
+		m_gotInitialEntry = false;
 		m_feedId = iFeedId;
 		m_feedType = type;
+		m_pXML = &m_reader;
 
 		if(type == TWFT_MENTIONS)
 		{
@@ -1516,25 +1267,54 @@ public:
 		DoRequest("GET", mParams);
 	}
 
-	void OnRequestDone(unsigned int uResponseCode, map<const CString, CString>& mHeaders, const CString& sResponse)
+	void OnEntry(const CXMLRecord& xTag)
 	{
 		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
+		CTwitterFeed *fFeed = pMod->GetFeedById(m_feedId);
 
-		if(uResponseCode == 200)
+		if(!fFeed || m_gotInitialEntry) return;
+
+		CString sIdTmp = xTag.Get("id");
+		CString sText = Utf8Xml_NamedEntityDecode(xTag.Get("title")); // fix twitter bug.
+		sText = sText.Replace_n("\r", "").Replace_n("\n", " ");
+
+		CString::size_type uPos = sIdTmp.find("statuses/"), uPosAdd = 9;
+		if(uPos == CString::npos) { uPos = sIdTmp.rfind(':'); uPosAdd = 1; } // for search
+
+		if(uPos != CString::npos)
 		{
-			PXMLTag xRoot;
+			sIdTmp.erase(0, uPos + uPosAdd);
+			uint64_t uId = sIdTmp.ToULongLong();
+			time_t iTime = pMod->InterpretRFC3339Time(xTag.Get("published"));
 
-			try
+			if(uId > 0 && iTime > 0)
 			{
-				xRoot = CXMLParser::ParseString(sResponse);
-			}
-			catch(CXMLException e)
-			{
-				pMod->PutModule("ERROR: " + m_method + " (xml) " + e.GetMessage());
-				return;
+				if(uId > fFeed->m_lastId)
+				{
+					fFeed->m_lastId = uId;
+				}
+
+				if(m_initial)
+				{
+					// we only want to know where to start, ignore the rest:
+					m_gotInitialEntry = true;
+					return;
+				}
+
+				pMod->QueueMessage(fFeed, iTime, sText);
 			}
+		}
+	}
 
-			if(xRoot->GetName() != "feed")
+	void OnRequestDone(unsigned int uResponseCode, const MCString& mHeaders, const CString& sResponse)
+	{
+		CTwitterModule *pMod = reinterpret_cast<CTwitterModule*>(m_pMod);
+
+		if(uResponseCode == 200)
+		{
+			if(!FinishXML()) return;
+
+			if(m_reader.GetRootName() != "feed")
 			{
 				pMod->PutModule("ERROR: " + m_method + " -> no <feed> tag...");
 				return;
@@ -1542,62 +1322,22 @@ public:
 
 			CTwitterFeed *fFeed = pMod->GetFeedById(m_feedId);
 
-			if(!fFeed) return;
-
-			for(vector<PXMLTag>::const_iterator it = xRoot->BeginChildren(); it != xRoot->EndChildren(); it++)
+			if(fFeed)
 			{
-				const PXMLTag& xTag = *it;
-
-				if(xTag->GetName() == "entry")
-				{
-					CString sIdTmp = xTag->GetChildText("id");
-					CString sText = Utf8Xml_NamedEntityDecode(xTag->GetChildText("title")); // fix twitter bug.
-					sText = sText.Replace_n("\r", "").Replace_n("\n", " ");
-
-					CString::size_type uPos = sIdTmp.find("statuses/"), uPosAdd = 9;
-					if(uPos == CString::npos) { uPos = sIdTmp.rfind(':'); uPosAdd = 1; } // for search
-
-					if(uPos != CString::npos)
-					{
-						sIdTmp.erase(0, uPos + uPosAdd);
-						uint64_t uId = sIdTmp.ToULongLong();
-						time_t iTime = pMod->InterpretRFC3339Time(xTag->GetChildText("published"));
-
-						if(uId > 0 && iTime > 0)
-						{
-							if(uId > fFeed->m_lastId)
-							{
-								fFeed->m_lastId = uId;
-							}
-
-							if(m_initial)
-							{
-								break;
-							}
-
-							pMod->QueueMessage(fFeed, iTime, sText);
-						}
-					}
-				}
+				fFeed->m_lastUpdate = time(NULL);
 			}
-
-			fFeed->m_lastUpdate = time(NULL);
 		}
 		else if(uResponseCode == 400)
 		{
-			PXMLTag xHash;
+			CXMLRecordReader xHash(1);
 
-			try
-			{
-				xHash = CXMLParser::ParseString(sResponse);
-			}
-			catch(CXMLException e)
+			if(!xHash.Feed(sResponse) || !xHash.Finish() || xHash.GetRecords().empty())
 			{
-				pMod->PutModule("ERROR: " + m_method + " (xml/error) " + e.GetMessage());
+				pMod->PutModule("ERROR: " + m_method + " (xml/error) " + xHash.GetError());
 				return;
 			}
 
-			pMod->PutModule("ERROR: Feed " + CString(m_feedId) + " returned an error: " + xHash->GetChildText("error"));
+			pMod->PutModule("ERROR: Feed " + CString(m_feedId) + " returned an error: " + xHash.GetRecords().front().Get("error"));
 			pMod->PutModule("Disabling updates on this feed for 15 minutes.");
 
 			CTwitterFeed *fFeed = pMod->GetFeedById(m_feedId);
@@ -1615,7 +1355,8 @@ public:
 			{
 				// The Retry-After header's value is the number of seconds your
 				// application should wait before submitting another query.
-				fFeed->m_lastUpdate = time(NULL) + atoi(mHeaders["Retry-After"].c_str());
+				MCString::const_iterator itRetry = mHeaders.find("retry-after");
+				fFeed->m_lastUpdate = time(NULL) + (itRetry != mHeaders.end() ? atoi(itRetry->second.c_str()) : 60);
 			}
 		}
 		else if(uResponseCode == 502) // "twitter is over capacity"
@@ -2112,24 +1853,19 @@ void CTwitterModule::LoadSettings()
 		m_token = m_tokenSecret = "";
 	}
 
-	PXMLTag xFeeds;
+	CXMLRecordReader xFeeds(2);
 
-	try
-	{
-		xFeeds = CXMLParser::ParseString(GetNV("feeds"));
-	}
-	catch (CXMLException ex)
+	if(!xFeeds.Feed(GetNV("feeds")) || !xFeeds.Finish())
 	{
 		PutModule("Warning: Couldn't read feeds from disk.");
 	}
-
-	if(xFeeds)
+	else
 	{
-		for(vector<PXMLTag>::const_iterator it = xFeeds->BeginChildren(); it != xFeeds->EndChildren(); it++)
+		for(vector<CXMLRecord>::const_iterator it = xFeeds.GetRecords().begin(); it != xFeeds.GetRecords().end(); it++)
 		{
-			const PXMLTag& xFeed = *it;
+			const CXMLRecord& xFeed = *it;
 
-			int iType = xFeed->GetAttribute("type").ToInt();
+			int iType = xFeed.GetAttribute("type").ToInt();
 
 			if(iType > 0 && iType < _TWFT_MAX)
 			{
@@ -2137,39 +1873,34 @@ void CTwitterModule::LoadSettings()
 
 				fNew.m_id = (m_nextFeedId++);
 				fNew.m_lastId = 0;
-				fNew.m_payload = xFeed->GetChildText("payload");
-				fNew.m_prefix = xFeed->GetChildText("prefix");
-				fNew.m_target = xFeed->GetChildText("target");
+				fNew.m_payload = xFeed.Get("payload");
+				fNew.m_prefix = xFeed.Get("prefix");
+				fNew.m_target = xFeed.Get("target");
 
 				m_feeds.push_back(fNew);
 			}
 		}
 	}
 
-	PXMLTag xStyles;
+	CXMLRecordReader xStyles(2);
 
-	try
-	{
-		xStyles = CXMLParser::ParseString(GetNV("styles"));
-	}
-	catch (CXMLException ex)
+	if(!xStyles.Feed(GetNV("styles")) || !xStyles.Finish())
 	{
 		PutModule("Warning: Couldn't read styles from disk.");
 	}
-
-	if(xStyles)
+	else
 	{
-		for(vector<PXMLTag>::const_iterator it = xStyles->BeginChildren(); it != xStyles->EndChildren(); it++)
+		for(vector<CXMLRecord>::const_iterator it = xStyles.GetRecords().begin(); it != xStyles.GetRecords().end(); it++)
 		{
-			const PXMLTag& xStyle = *it;
-			map<const CString, CFontStyle>::iterator found = m_styles.find((*it)->GetAttribute("name"));
+			const CXMLRecord& xStyle = *it;
+			map<const CString, CFontStyle>::iterator found = m_styles.find(xStyle.GetAttribute("name"));
 
 			if(found != m_styles.end())
 			{
-				found->second.bBold = (xStyle->GetChildText("bold") == "1");
-				found->second.bUnderline = (xStyle->GetChildText("underline") == "1");
-				found->second.iBackClr = xStyle->GetChildText("backcolor").ToInt();
-				found->second.iForeClr = xStyle->GetChildText("forecolor").ToInt();
+				found->second.bBold = (xStyle.Get("bold") == "1");
+				found->second.bUnderline = (xStyle.Get("underline") == "1");
+				found->second.iBackClr = xStyle.Get("backcolor").ToInt();
+				found->second.iForeClr = xStyle.Get("forecolor").ToInt();
 
 				if(found->second.iBackClr > 15) found->second.iBackClr = 15;
 				if(found->second.iForeClr > 15) found->second.iForeClr = 15;
@@ -14,8 +14,6 @@
 #include "util.h"
 
 int CJavaScriptMod::ms_uNumberOfInstances = 0;
-JSRuntime* CJavaScriptMod::ms_jsRuntime = NULL;
-CJSWatchDog* CJavaScriptMod::ms_pWatchDog = NULL;
 
 /************************************************************************/
 /* CONSTRUCTOR / INITIALIZERS                                           */
@@ -23,32 +21,22 @@ CJSWatchDog* CJavaScriptMod::ms_pWatchDog = NULL;
 
 MODCONSTRUCTOR(CJavaScriptMod::CJavaScriptMod)
 {
+	if(ms_uNumberOfInstances == 0)
+	{
+		// must happen before the first runtime is created:
+		JS_SetCStringsAreUTF8();
+	}
+
 	ms_uNumberOfInstances++;
 }
 
 
 bool CJavaScriptMod::OnLoad(const CString& sArgs, CString& sMessage)
 {
-	if(!ms_jsRuntime)
-	{
-		JS_SetCStringsAreUTF8();
-
-		// 8 MB RAM ought to be enough for anybody!
-		ms_jsRuntime = JS_NewRuntime(8L * 1024L * 1024L);
-		// (it's not actually a hard limit, just the number of bytes
-		// after which the GC will kick in, yo)
-	}
-
-	if(!ms_jsRuntime)
-	{
-		sMessage = "Initializing the JavaScript runtime FAILED!";
-		return false;
-	}
-
-	if(!ms_pWatchDog)
-	{
-		ms_pWatchDog = new CJSWatchDog(ms_jsRuntime);
-	}
+	// each script brings its own JSRuntime (see CZNCScript::LoadScript),
+	// so a busy or leaky script no longer slows down GC for everybody else.
+	// Collection happens from this timer instead of after every event:
+	AddTimer(new CJSGCTimer(this));
 
 	/* warning: when a script is loaded from here, error messages to PutModule
 		will most probably get lost during ZNC startup */
@@ -82,6 +70,35 @@ void CJavaScriptMod::OnModCommand(const CString& sCommand)
 
 		PutModule(tMods);
 	}
+	else if(sCmd.Equals("STATS"))
+	{
+		if(!m_pUser->IsAdmin())
+		{
+			PutModule("Access denied.");
+			return;
+		}
+
+		ListScriptStats();
+	}
+	else if(sCmd.Equals("SETHEAP"))
+	{
+		const CString sName = sCommand.Token(1);
+		unsigned int uKiB = sCommand.Token(2).ToUInt();
+
+		if(!m_pUser->IsAdmin())
+		{
+			PutModule("Access denied.");
+		}
+		else if(sName.empty() || uKiB < MIN_SCRIPT_HEAP_KIB || uKiB > MAX_SCRIPT_HEAP_KIB)
+		{
+			PutModule("Usage: SetHeap <script> <KiB> (" + CString(MIN_SCRIPT_HEAP_KIB) + " to " + CString(MAX_SCRIPT_HEAP_KIB) + ")");
+		}
+		else
+		{
+			SetNV("heap:" + sName, CString(uKiB));
+			PutModule("The heap size of " + sName + ".js will be set to " + CString(uKiB) + " KiB the next time it is loaded.");
+		}
+	}
 	else
 	{
 		PutModule("Command not understood. Please note that you can't execute any JavaScript commands from IRC.");
@@ -134,6 +151,79 @@ void CJavaScriptMod::LoadFromDisk()
 }
 
 
+/************************************************************************/
+/* GC / ACCOUNTING                                                      */
+/************************************************************************/
+
+CJSGCTimer::CJSGCTimer(CModule* pModule) :
+	CTimer(pModule, SCRIPT_GC_INTERVAL, 0, "JavaScript GC", "Runs the garbage collector of scripts that have been active.")
+{
+}
+
+
+void CJSGCTimer::RunJob()
+{
+	((CJavaScriptMod*)m_pModule)->RunScriptGC();
+}
+
+
+void CJavaScriptMod::RunScriptGC()
+{
+	for(set<CZNCScript*>::const_iterator it = m_scripts.begin(); it != m_scripts.end(); it++)
+	{
+		(*it)->MaybeGC();
+	}
+}
+
+
+uint32_t CJavaScriptMod::GetScriptHeapBytes(const CString& sName)
+{
+	const CString sKiB = GetNV("heap:" + sName);
+	unsigned int uKiB = sKiB.ToUInt();
+
+	// the registry might have been edited by hand
+	if(sKiB.empty() || uKiB < MIN_SCRIPT_HEAP_KIB || uKiB > MAX_SCRIPT_HEAP_KIB)
+	{
+		return DEFAULT_SCRIPT_HEAP_BYTES;
+	}
+
+	return uKiB * 1024;
+}
+
+
+void CJavaScriptMod::ListScriptStats()
+{
+	if(m_scripts.empty())
+	{
+		PutModule("No scripts loaded.");
+		return;
+	}
+
+	CTable tStats;
+	tStats.AddColumn("Name");
+	tStats.AddColumn("Heap used");
+	tStats.AddColumn("Heap limit");
+	tStats.AddColumn("Calls");
+	tStats.AddColumn("CPU ms");
+	tStats.AddColumn("Cached");
+
+	for(set<CZNCScript*>::const_iterator it = m_scripts.begin(); it != m_scripts.end(); it++)
+	{
+		const CZNCScript* pScript = *it;
+
+		tStats.AddRow();
+		tStats.SetCell("Name", pScript->GetName());
+		tStats.SetCell("Heap used", CString(pScript->GetUsedHeapBytes() / 1024) + " KiB");
+		tStats.SetCell("Heap limit", CString(pScript->GetHeapBytes() / 1024) + " KiB");
+		tStats.SetCell("Calls", CString(pScript->GetCallCount()));
+		tStats.SetCell("CPU ms", CString(pScript->GetCPUTimeUsec() / 1000));
+		tStats.SetCell("Cached", pScript->WasLoadedFromCache() ? "yes" : "no");
+	}
+
+	PutModule(tStats);
+}
+
+
 /************************************************************************/
 /* SCRIPT LOADING BUSINESS                                              */
 /************************************************************************/
@@ -169,7 +259,7 @@ bool CJavaScriptMod::LoadModule(const CString& sName, const CString& sArgs, CStr
 	}
 	else
 	{
-		CZNCScript *pScript = new CZNCScript(this, sName, sModPath);
+		CZNCScript *pScript = new CZNCScript(this, sName, sModPath, GetScriptHeapBytes(sName));
 
 		if(pScript->LoadScript(srErrorMessage))
 		{
@@ -193,6 +283,7 @@ bool CJavaScriptMod::UnLoadModule(const CString& sName, CString& srErrorMessage)
 	{
 		if((*it)->GetName() == sName)
 		{
+			delete *it;
 			m_scripts.erase(it);
 			return true;
 		}
@@ -203,18 +294,6 @@ bool CJavaScriptMod::UnLoadModule(const CString& sName, CString& srErrorMessage)
 }
 
 
-void CJavaScriptMod::ArmWatchDog()
-{
-	ms_pWatchDog->Arm();
-}
-
-
-void CJavaScriptMod::DisArmWatchDog()
-{
-	ms_pWatchDog->DisArm();
-}
-
-
 /************************************************************************/
 /* CLEANUP / DESTRUCTOR                                                 */
 /************************************************************************/
@@ -228,17 +307,8 @@ CJavaScriptMod::~CJavaScriptMod()
 		delete *it;
 	}
 
-	if(ms_jsRuntime)
-	{
-		JS_DestroyRuntime(ms_jsRuntime);
-		ms_jsRuntime = NULL;
-	}
-
 	if(ms_uNumberOfInstances == 0)
 	{
-		delete ms_pWatchDog;
-		ms_pWatchDog = NULL;
-
 		JS_ShutDown();
 	}
 }
@@ -12,6 +12,18 @@
 #include "znc_script.h"
 #include "znc_js_watchdog.h"
 
+// seconds between idle garbage collection runs:
+#define SCRIPT_GC_INTERVAL 5
+
+class CJSGCTimer : public CTimer
+{
+public:
+	CJSGCTimer(CModule* pModule);
+	virtual ~CJSGCTimer() {}
+protected:
+	virtual void RunJob();
+};
+
 class CJavaScriptMod : public CModule
 {
 public:
@@ -21,9 +33,7 @@ public:
 	virtual ~CJavaScriptMod();
 
 	// module specific calls:
-	JSRuntime* GetJSRuntime() const { return ms_jsRuntime; }
-	void ArmWatchDog();
-	void DisArmWatchDog();
+	void RunScriptGC();
 
 	// ZNC module call-ins:
 	bool OnLoad(const CString& sArgsi, CString& sMessage);
@@ -85,14 +95,14 @@ public:
 protected:
 	set<CZNCScript*> m_scripts;
 
-	static JSRuntime* ms_jsRuntime;
 	static int ms_uNumberOfInstances;
-	static CJSWatchDog* ms_pWatchDog;
 
 	bool LoadModule(const CString& sName, const CString& sArgs, CString& srErrorMessage);
 	bool UnLoadModule(const CString& sName, CString& srErrorMessage);
 	void SaveToDisk();
 	void LoadFromDisk();
+	uint32_t GetScriptHeapBytes(const CString& sName);
+	void ListScriptStats();
 
 	// module call-in wrappers:
 	EModRet InvokeNoArgScriptCallbacks(EModEvId eEvent, bool bModRet);
@@ -132,6 +132,7 @@ CJSWatchDog::CJSWatchDog(JSRuntime* pRuntime) :
 {
 	pthread_mutex_init(&m_mutex, NULL);
 	pthread_cond_init(&m_cond, NULL);
+	m_bStop = false;
 
 	pthread_attr_init(&m_attr);
 	pthread_attr_setdetachstate(&m_attr, PTHREAD_CREATE_JOINABLE);
@@ -142,8 +143,10 @@ bool CJSWatchDog::StartWatching()
 {
 	if(!m_bIsWatching)
 	{
+		m_bStop = false;
+
 		m_bIsWatching = 
-			(pthread_create(&m_thread, &m_attr, TimerThreadProc, NULL) == 0);
+			(pthread_create(&m_thread, &m_attr, TimerThreadProc, this) == 0);
 
 		return m_bIsWatching;
 	}
@@ -156,7 +159,14 @@ bool CJSWatchDog::StopWatching()
 {
 	if(m_bIsWatching)
 	{
-		pthread_cancel(m_thread);
+		// no pthread_cancel here: a thread cancelled inside
+		// pthread_cond_timedwait would die holding m_mutex.
+		pthread_mutex_lock(&m_mutex);
+		m_bStop = true;
+		pthread_cond_signal(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+
+		pthread_join(m_thread, NULL);
 		m_bIsWatching = false;
 
 		return true;
@@ -178,12 +188,16 @@ bool CJSWatchDog::StopWatching()
 		clock_gettime(CLOCK_REALTIME, &ts);
 		ts.tv_sec += WATCHDOG_INTERVAL_IN_SECONDS * 2;
 
-		while(pthread_cond_timedwait(&pDog->m_cond, &pDog->m_mutex, &ts) == ETIMEDOUT)
+		while(!pDog->m_bStop)
 		{
-			clock_gettime(CLOCK_REALTIME, &ts);
-			ts.tv_sec += WATCHDOG_INTERVAL_IN_SECONDS;
-
-			pDog->WatchThat();
+			// anything but a timeout is StopWatching or a spurious wakeup.
+			if(pthread_cond_timedwait(&pDog->m_cond, &pDog->m_mutex, &ts) == ETIMEDOUT && !pDog->m_bStop)
+			{
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_sec += WATCHDOG_INTERVAL_IN_SECONDS;
+
+				pDog->WatchThat();
+			}
 		}
 
 		pthread_mutex_unlock(&pDog->m_mutex);
@@ -67,6 +67,8 @@ protected:
 	pthread_cond_t m_cond;
 	pthread_t m_thread;
 	pthread_attr_t m_attr;
+	// protected by m_mutex, tells the thread to return:
+	bool m_bStop;
 
 	bool StartWatching();
 	bool StopWatching();
@@ -12,6 +12,10 @@
 #include "znc_js_mod.h"
 #include "util.h"
 
+#ifdef JS_HAS_XDR
+#include "jsxdrapi.h"
+#endif
+
 #include "znc_js_mod_events.inc"
 
 using namespace std;
@@ -21,7 +25,7 @@ using namespace std;
 /* CONSTRUCTOR                                                          */
 /************************************************************************/
 
-CZNCScript::CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString& sFilePath)
+CZNCScript::CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString& sFilePath, uint32_t uHeapBytes)
 {
 	m_sName = sName;
 	m_sFilePath = sFilePath;
@@ -30,6 +34,10 @@ CZNCScript::CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString
 	m_pUser = pMod->GetUser();
 	m_pZNC = &CZNC::Get();
 
+	m_jsRuntime = NULL;
+	m_uHeapBytes = uHeapBytes;
+	m_pWatchDog = NULL;
+
 	m_jsContext = NULL;
 	m_jsGlobalObj = NULL;
 	m_jsScript = NULL;
@@ -39,6 +47,13 @@ CZNCScript::CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString
 	m_uBranchCallbackCount = 0;
 	m_uBranchCallbackTime = 0;
 
+	m_iJSDepth = 0;
+	m_bGCPending = false;
+	m_uCallCount = 0;
+	m_uCPUTimeUsec = 0;
+	m_uEnteredJSCPUUsec = 0;
+	m_bFromCache = false;
+
 	m_nextTimerId = 1;
 }
 
@@ -55,12 +70,25 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 		return false;
 	}
 
-	/* set up JS context and global obj */
-	m_jsContext = JS_NewContext(m_pMod->GetJSRuntime(), 8192);
+	/* set up the runtime, JS context and global obj */
+	// (the heap size is not actually a hard limit, just the number
+	// of bytes after which the GC will kick in, yo)
+	m_jsRuntime = JS_NewRuntime(m_uHeapBytes);
+
+	if(!m_jsRuntime)
+	{
+		srErrorMessage = "Initializing the JavaScript runtime FAILED!";
+		return false;
+	}
+
+	m_pWatchDog = new CJSWatchDog(m_jsRuntime);
+
+	m_jsContext = JS_NewContext(m_jsRuntime, 8192);
 
 	if(!m_jsContext)
 	{
 		srErrorMessage = "Creating a script context failed!";
+		DestroyRuntime();
 		return false;
 	}
 
@@ -77,6 +105,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 	{
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 		return false;
 	}
 
@@ -85,6 +114,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 		srErrorMessage = "Unable to create user object.";
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 		return false;
 	}
 
@@ -99,6 +129,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 		JS_RemoveObjectRoot(m_jsContext, &m_jsUserObj);
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 		return false;
 	}
 	else
@@ -162,15 +193,24 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 		JS_RemoveObjectRoot(m_jsContext, &m_jsUserObj);
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 		return false;
 	}
 
 	/* load (+ run, initialize) the script */
 	jsval jvRet;
+	const CString sSourceHash = CString((char*)szBuf, uBufLen).MD5();
 
 	EnterJS();
 
-	if(bUtf16)
+	m_jsScript = LoadCachedScript(sSourceHash);
+	m_bFromCache = (m_jsScript != NULL);
+
+	if(m_bFromCache)
+	{
+		// no need to compile anything, the cached bytecode matches the file contents.
+	}
+	else if(bUtf16)
 	{
 		m_jsScript = JS_CompileUCScript(m_jsContext, m_jsGlobalObj,
 			(jschar*)szBuf, uBufLen / sizeof(jschar), m_sName.c_str(), 0);
@@ -191,6 +231,11 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 
 	free(szBuf); szBuf = 0;
 
+	if(m_jsScript && !m_bFromCache)
+	{
+		StoreCachedScript(sSourceHash);
+	}
+
 	if(!m_jsScript ||
 		!(m_jsScriptObj = JS_NewScriptObject(m_jsContext, m_jsScript)) ||
 		!JS_AddObjectRoot(m_jsContext, &m_jsScriptObj))
@@ -208,6 +253,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 		JS_RemoveObjectRoot(m_jsContext, &m_jsUserObj);
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 
 		return false;
 	}
@@ -231,6 +277,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 
 		JS_DestroyContext(m_jsContext);
 		m_jsContext = NULL;
+		DestroyRuntime();
 
 		return false;
 	}
@@ -268,9 +315,7 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 	if(!pScript)
 		return JS_TRUE;
 
-	// this will be called roughly once per second, so calling the GC should
-	// not be too much overhead for now.
-	JS_MaybeGC(cx);
+	// GC is not triggered from here anymore, CJSGCTimer takes care of that.
 
 	if(pScript->m_uBranchCallbackTime == 0)
 	{
@@ -294,6 +339,114 @@ bool CZNCScript::LoadScript(CString& srErrorMessage)
 }
 
 
+/************************************************************************/
+/* BYTECODE CACHE                                                       */
+/************************************************************************/
+
+CString CZNCScript::GetCacheFilePath(const CString& sSourceHash) const
+{
+	// the engine version is part of the key because XDR data is not portable between releases.
+	return m_pMod->GetSavePath() + "/bytecode/" + m_sName + "-" + sSourceHash + "-" + CString(JS_VERSION) + ".jsc";
+}
+
+
+JSScript* CZNCScript::LoadCachedScript(const CString& sSourceHash)
+{
+#ifdef JS_HAS_XDR
+	CFile cFile(GetCacheFilePath(sSourceHash));
+	CString sData;
+
+	if(!cFile.Open() || !cFile.ReadFile(sData) || sData.empty())
+	{
+		return NULL;
+	}
+
+	cFile.Close();
+
+	JSXDRState* xdr = JS_XDRNewMem(m_jsContext, JSXDR_DECODE);
+	JSScript* jsScript = NULL;
+
+	if(!xdr)
+	{
+		return NULL;
+	}
+
+	JS_XDRMemSetData(xdr, (void*)sData.data(), (uint32)sData.size());
+
+	if(!JS_XDRScript(xdr, &jsScript))
+	{
+		jsScript = NULL;
+		// stale or corrupt, will be replaced after compiling:
+		JS_ClearPendingException(m_jsContext);
+	}
+
+	// the buffer belongs to sData, don't let the XDR code free it:
+	JS_XDRMemSetData(xdr, NULL, 0);
+	JS_XDRDestroy(xdr);
+
+	return jsScript;
+#else
+	return NULL;
+#endif
+}
+
+
+void CZNCScript::StoreCachedScript(const CString& sSourceHash)
+{
+#ifdef JS_HAS_XDR
+	const CString sDir = m_pMod->GetSavePath() + "/bytecode";
+
+	if(!CFile::IsDir(sDir) && !CDir::MakeDir(sDir))
+	{
+		return;
+	}
+
+	// drop bytecode of older revisions of this script. The wildcard also
+	// matches scripts whose name starts with "<name>-", so only files of
+	// the exact "<name>-<md5>-<version>.jsc" form are ours:
+	CDir cDir;
+	cDir.FillByWildcard(sDir, m_sName + "-*.jsc");
+	for(CDir::const_iterator it = cDir.begin(); it != cDir.end(); it++)
+	{
+		CString sKey = (*it)->GetShortName().substr(m_sName.size() + 1);
+		sKey.RightChomp(4);
+
+		if(sKey.Token(0, false, "-").size() == 32 && sKey.Token(1, false, "-").ToUInt() > 0 &&
+			sKey.Token(2, false, "-").empty())
+		{
+			(*it)->Delete();
+		}
+	}
+
+	JSXDRState* xdr = JS_XDRNewMem(m_jsContext, JSXDR_ENCODE);
+
+	if(!xdr)
+	{
+		return;
+	}
+
+	if(JS_XDRScript(xdr, &m_jsScript))
+	{
+		uint32 uLen = 0;
+		const char* pData = (const char*)JS_XDRMemGetData(xdr, &uLen);
+		CFile cFile(GetCacheFilePath(sSourceHash));
+
+		if(pData && cFile.Open(O_WRONLY | O_CREAT | O_TRUNC, 0600))
+		{
+			cFile.Write(pData, uLen);
+			cFile.Close();
+		}
+	}
+	else
+	{
+		JS_ClearPendingException(m_jsContext);
+	}
+
+	JS_XDRDestroy(xdr);
+#endif
+}
+
+
 /************************************************************************/
 /* EVENT HANDLER METHODS                                                */
 /************************************************************************/
@@ -551,6 +704,39 @@ bool CZNCScript::ClearNV(bool bWriteToDisk)
 /* MISC UTILS                                                           */
 /************************************************************************/
 
+// CPU time (not wall clock time) used by the calling thread, which is
+// the one all scripts run on.
+static uint64_t GetThreadCPUTimeUsec()
+{
+#ifdef _WIN32
+	FILETIME ftCreation, ftExit, ftKernel, ftUser;
+	ULARGE_INTEGER uKernel, uUser;
+
+	if(!GetThreadTimes(GetCurrentThread(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+	{
+		return 0;
+	}
+
+	uKernel.LowPart = ftKernel.dwLowDateTime;
+	uKernel.HighPart = ftKernel.dwHighDateTime;
+	uUser.LowPart = ftUser.dwLowDateTime;
+	uUser.HighPart = ftUser.dwHighDateTime;
+
+	// FILETIMEs count 100 ns units:
+	return (uKernel.QuadPart + uUser.QuadPart) / 10;
+#else
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
 JSObject* CZNCScript::MakeAnonObject() const
 {
 	return JS_NewObject(m_jsContext, NULL, NULL, NULL);
@@ -559,17 +745,58 @@ JSObject* CZNCScript::MakeAnonObject() const
 
 void CZNCScript::EnterJS()
 {
+	if(m_iJSDepth++ == 0)
+	{
+		m_uEnteredJSCPUUsec = GetThreadCPUTimeUsec();
+	}
+
 	m_uBranchCallbackCount = m_uBranchCallbackTime = 0;
+	m_uCallCount++;
 
-	m_pMod->ArmWatchDog();
+	m_pWatchDog->Arm();
 }
 
 
 void CZNCScript::LeftJS()
 {
-	m_pMod->DisArmWatchDog();
+	m_pWatchDog->DisArm();
+
+	if(--m_iJSDepth == 0)
+	{
+		m_uCPUTimeUsec += GetThreadCPUTimeUsec() - m_uEnteredJSCPUUsec;
+	}
+
+	// the actual collection is deferred to CJSGCTimer:
+	m_bGCPending = true;
+}
+
+
+void CZNCScript::MaybeGC()
+{
+	if(m_jsContext && m_bGCPending && m_iJSDepth == 0)
+	{
+		m_bGCPending = false;
+		JS_MaybeGC(m_jsContext);
+	}
+}
+
 
-	JS_MaybeGC(m_jsContext);
+uint32_t CZNCScript::GetUsedHeapBytes() const
+{
+	return (m_jsRuntime ? JS_GetGCParameter(m_jsRuntime, JSGC_BYTES) : 0);
+}
+
+
+void CZNCScript::DestroyRuntime()
+{
+	delete m_pWatchDog;
+	m_pWatchDog = NULL;
+
+	if(m_jsRuntime)
+	{
+		JS_DestroyRuntime(m_jsRuntime);
+		m_jsRuntime = NULL;
+	}
 }
 
 
@@ -587,4 +814,6 @@ CZNCScript::~CZNCScript()
 		JS_RemoveObjectRoot(m_jsContext, &m_jsScriptObj);
 		JS_DestroyContext(m_jsContext);
 	}
+
+	DestroyRuntime();
 }
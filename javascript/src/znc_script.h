@@ -12,6 +12,7 @@
 #include "znc_smjs.h"
 #include "znc_js_mod_events.h"
 #include "znc_script_timer.h"
+#include "znc_js_watchdog.h"
 
 // ZNC headers:
 #include "User.h"
@@ -21,6 +22,11 @@
 class CJavaScriptMod;
 
 #define MAX_SCRIPT_EXECUTION_SECONDS 20
+// Size of a script's private runtime, can be changed per script with SetHeap.
+// This is a hard limit: allocations beyond it fail with "out of memory".
+#define DEFAULT_SCRIPT_HEAP_BYTES (8L * 1024L * 1024L)
+#define MIN_SCRIPT_HEAP_KIB 64
+#define MAX_SCRIPT_HEAP_KIB (1024 * 1024)
 
 class CZNCScript
 {
@@ -33,6 +39,11 @@ protected:
 	CJavaScriptMod* m_pMod;
 	CUser* m_pUser;
 
+	// every script gets its own runtime (and thus its own heap and GC):
+	JSRuntime* m_jsRuntime;
+	uint32_t m_uHeapBytes;
+	CJSWatchDog* m_pWatchDog;
+
 	JSContext* m_jsContext;
 	JSObject* m_jsGlobalObj;
 
@@ -48,6 +59,14 @@ protected:
 	uint64_t m_uBranchCallbackCount;
 	uint64_t m_uBranchCallbackTime;
 
+	// accounting, see GetCallCount(), GetCPUTimeUsec() and CJavaScriptMod::ListScriptStats():
+	int m_iJSDepth;
+	bool m_bGCPending;
+	uint64_t m_uEnteredJSCPUUsec;
+	uint64_t m_uCallCount;
+	uint64_t m_uCPUTimeUsec;
+	bool m_bFromCache;
+
 	MCString m_mssRegistry;
 
 	bool SetUpGlobalClasses(CString& srErrorMessage);
@@ -59,11 +78,16 @@ protected:
 	void EnterJS();
 	void LeftJS();
 
+	CString GetCacheFilePath(const CString& sSourceHash) const;
+	JSScript* LoadCachedScript(const CString& sSourceHash);
+	void StoreCachedScript(const CString& sSourceHash);
+	void DestroyRuntime();
+
 	static void ScriptErrorCallback(JSContext* cx, const char* message, JSErrorReport* report);
 	static JSBool ScriptOperationCallback(JSContext *cx);
 
 public:
-	CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString& sFilePath);
+	CZNCScript(CJavaScriptMod* pMod, const CString& sName, const CString& sFilePath, uint32_t uHeapBytes = DEFAULT_SCRIPT_HEAP_BYTES);
 	virtual ~CZNCScript();
 
 	bool LoadScript(CString& srErrorMessage);
@@ -76,6 +100,15 @@ public:
 	const CString& GetName() const { return m_sName; }
 	const CString& GetArguments() const { return m_sArguments; }
 
+	JSRuntime* GetRuntime() const { return m_jsRuntime; }
+	uint32_t GetHeapBytes() const { return m_uHeapBytes; }
+	uint32_t GetUsedHeapBytes() const;
+	uint64_t GetCallCount() const { return m_uCallCount; }
+	uint64_t GetCPUTimeUsec() const { return m_uCPUTimeUsec; }
+	bool WasLoadedFromCache() const { return m_bFromCache; }
+	// runs the GC if anything happened since the last call, invoked from CJSGCTimer:
+	void MaybeGC();
+
 	jsval* StoreEventHandler(const char* szEventName, const jsval& jvCallback);
 	int InvokeEventHandler(EModEvId eEvent, uintN argc, jsval *argv, bool bModRet);
 	bool IsEventHooked(EModEvId eEvent);
@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "AuthQueue.h"
+#include "znc.h"
+#include <deque>
+
+#ifdef _WIN32
+#include <process.h>
+#include <climits>
+#else
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/////////////////// CAuthJob ///////////////////
+// Everything a worker needs, copied so that no thread but the main one
+// ever touches a CUser or a CAuthBase.
+struct CAuthJob {
+	unsigned long    m_uId;
+	CString          m_sPassword;
+	CUser::eHashType m_eHash;
+	CString          m_sHash;
+	CString          m_sSalt;
+	// If non-zero, the password is hashed again with this many iterations
+	unsigned int     m_uNewIterations;
+	CString          m_sNewSalt;
+	bool             m_bValid;
+	CString          m_sNewHash;
+};
+
+static void RunAuthJob(CAuthJob& Job) {
+	Job.m_bValid = CUser::CheckPassHash(Job.m_sPassword, Job.m_eHash, Job.m_sHash, Job.m_sSalt);
+
+	if (Job.m_bValid && Job.m_uNewIterations) {
+		Job.m_sNewHash = CUser::PBKDF2Hash(Job.m_sPassword, Job.m_sNewSalt, Job.m_uNewIterations);
+	}
+
+	// Don't keep the password around any longer than needed
+	Job.m_sPassword.clear();
+}
+
+/////////////////// CAuthQueueWorkers ///////////////////
+class CAuthQueueWorkers {
+public:
+	CAuthQueueWorkers() {
+		m_bStop = false;
+#ifdef _WIN32
+		InitializeCriticalSection(&m_Lock);
+		m_hJobs = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+#else
+		pthread_mutex_init(&m_Mutex, NULL);
+		pthread_cond_init(&m_Cond, NULL);
+		m_iWakeup[0] = m_iWakeup[1] = -1;
+#endif
+	}
+
+	~CAuthQueueWorkers() {
+		Lock();
+		m_bStop = true;
+#ifndef _WIN32
+		pthread_cond_broadcast(&m_Cond);
+#endif
+		Unlock();
+
+#ifdef _WIN32
+		ReleaseSemaphore(m_hJobs, (LONG) m_vThreads.size(), NULL);
+
+		for (size_t a = 0; a < m_vThreads.size(); a++) {
+			WaitForSingleObject(m_vThreads[a], INFINITE);
+			CloseHandle(m_vThreads[a]);
+		}
+
+		if (m_hJobs)
+			CloseHandle(m_hJobs);
+		DeleteCriticalSection(&m_Lock);
+#else
+		for (size_t a = 0; a < m_vThreads.size(); a++) {
+			pthread_join(m_vThreads[a], NULL);
+		}
+
+		if (m_iWakeup[0] != -1) {
+			close(m_iWakeup[0]);
+			close(m_iWakeup[1]);
+		}
+
+		pthread_cond_destroy(&m_Cond);
+		pthread_mutex_destroy(&m_Mutex);
+#endif
+	}
+
+	bool Start(unsigned int uThreads) {
+#ifdef _WIN32
+		if (!m_hJobs)
+			return false;
+
+		for (unsigned int a = 0; a < uThreads; a++) {
+			HANDLE hThread = (HANDLE) _beginthreadex(NULL, 0, &CAuthQueueWorkers::Run, this, 0, NULL);
+			if (!hThread)
+				break;
+			m_vThreads.push_back(hThread);
+		}
+#else
+		if (pipe(m_iWakeup) != 0) {
+			m_iWakeup[0] = m_iWakeup[1] = -1;
+			return false;
+		}
+
+		for (int a = 0; a < 2; a++) {
+			fcntl(m_iWakeup[a], F_SETFL, fcntl(m_iWakeup[a], F_GETFL) | O_NONBLOCK);
+			fcntl(m_iWakeup[a], F_SETFD, FD_CLOEXEC);
+		}
+
+		for (unsigned int a = 0; a < uThreads; a++) {
+			pthread_t Thread;
+			if (pthread_create(&Thread, NULL, &CAuthQueueWorkers::Run, this) != 0)
+				break;
+			m_vThreads.push_back(Thread);
+		}
+#endif
+
+		return !m_vThreads.empty();
+	}
+
+	void Push(const CAuthJob& Job) {
+		Lock();
+		m_dJobs.push_back(Job);
+#ifdef _WIN32
+		Unlock();
+		ReleaseSemaphore(m_hJobs, 1, NULL);
+#else
+		pthread_cond_signal(&m_Cond);
+		Unlock();
+#endif
+	}
+
+	void TakeResults(std::deque<CAuthJob>& dResults) {
+		Lock();
+		m_dResults.swap(dResults);
+		Unlock();
+	}
+
+	//! The read end of the pipe the workers poke after each job, -1 on win32.
+	int GetWakeupFD() const {
+#ifdef _WIN32
+		return -1;
+#else
+		return m_iWakeup[0];
+#endif
+	}
+
+	void DrainWakeup() {
+#ifndef _WIN32
+		char buf[64];
+		while (read(m_iWakeup[0], buf, sizeof(buf)) > 0) {}
+#endif
+	}
+
+private:
+	void Work() {
+		while (true) {
+			CAuthJob Job;
+
+#ifdef _WIN32
+			WaitForSingleObject(m_hJobs, INFINITE);
+			Lock();
+			if (m_bStop || m_dJobs.empty()) {
+				Unlock();
+				break;
+			}
+#else
+			Lock();
+			while (!m_bStop && m_dJobs.empty()) {
+				pthread_cond_wait(&m_Cond, &m_Mutex);
+			}
+			if (m_bStop) {
+				Unlock();
+				break;
+			}
+#endif
+			Job = m_dJobs.front();
+			m_dJobs.pop_front();
+			Unlock();
+
+			RunAuthJob(Job);
+
+			Lock();
+			m_dResults.push_back(Job);
+			Unlock();
+
+#ifndef _WIN32
+			// If the pipe is full, the main loop will wake up anyway
+			ssize_t iRet = write(m_iWakeup[1], "", 1);
+			(void) iRet;
+#endif
+		}
+	}
+
+#ifdef _WIN32
+	static unsigned int __stdcall Run(void* p) {
+		((CAuthQueueWorkers*) p)->Work();
+		return 0;
+	}
+
+	void Lock() { EnterCriticalSection(&m_Lock); }
+	void Unlock() { LeaveCriticalSection(&m_Lock); }
+
+	CRITICAL_SECTION      m_Lock;
+	HANDLE                m_hJobs;
+	vector<HANDLE>        m_vThreads;
+#else
+	static void* Run(void* p) {
+		((CAuthQueueWorkers*) p)->Work();
+		return NULL;
+	}
+
+	void Lock() { pthread_mutex_lock(&m_Mutex); }
+	void Unlock() { pthread_mutex_unlock(&m_Mutex); }
+
+	pthread_mutex_t       m_Mutex;
+	pthread_cond_t        m_Cond;
+	vector<pthread_t>     m_vThreads;
+	int                   m_iWakeup[2];
+#endif
+
+	std::deque<CAuthJob>  m_dJobs;
+	std::deque<CAuthJob>  m_dResults;
+	bool                  m_bStop;
+};
+
+/////////////////// CAuthQueueMonitor ///////////////////
+class CAuthQueueMonitor : public CSMonitorFD {
+public:
+	CAuthQueueMonitor(CAuthQueue* pQueue) : CSMonitorFD() {
+		m_pQueue = pQueue;
+
+		int iFD = m_pQueue->m_pWorkers->GetWakeupFD();
+		if (iFD != -1)
+			Add(iFD, CSockManager::ECT_Read);
+	}
+
+	virtual ~CAuthQueueMonitor() {}
+
+	virtual bool GatherFDsForSelect(std::map<int, short>& miiReadyFds, long& iTimeoutMS) {
+		bool bRet = CSMonitorFD::GatherFDsForSelect(miiReadyFds, iTimeoutMS);
+
+#ifdef _WIN32
+		// select() only handles sockets here, so poll while checks are running
+		m_pQueue->ProcessResults();
+
+		if (!m_pQueue->m_mPending.empty())
+			iTimeoutMS = 20;
+#endif
+
+		return bRet;
+	}
+
+	virtual bool FDsThatTriggered(const std::map<int, short>& miiReadyFds) {
+		m_pQueue->m_pWorkers->DrainWakeup();
+		m_pQueue->ProcessResults();
+
+		return true;
+	}
+
+private:
+	CAuthQueue* m_pQueue;
+};
+
+/////////////////// CAuthQueue ///////////////////
+CAuthQueue::CAuthQueue(unsigned int uThreads) {
+	m_pWorkers = NULL;
+	m_pMonitor = NULL;
+	m_uNextId = 0;
+	m_uThreads = (uThreads > 0 ? uThreads : 1);
+	m_bFailed = false;
+}
+
+CAuthQueue::~CAuthQueue() {
+	if (m_pMonitor) {
+		// This deletes m_pMonitor
+		CZNC::Get().GetManager().UnMonitorFD(m_pMonitor);
+	}
+
+	// Joins the worker threads, which are at most busy with a single hash
+	delete m_pWorkers;
+
+	// The results are lost, but don't keep any client hanging
+	for (map<unsigned long, CSmartPtr<CAuthBase> >::iterator it = m_mPending.begin(); it != m_mPending.end(); ++it) {
+		it->second->RefuseLogin("Shutting down");
+	}
+}
+
+bool CAuthQueue::StartWorkers() {
+	if (m_pWorkers)
+		return true;
+	if (m_bFailed)
+		return false;
+
+	// Threads aren't started before they are needed, ZNC might still fork()
+	m_pWorkers = new CAuthQueueWorkers;
+
+	if (!m_pWorkers->Start(m_uThreads)) {
+		DEBUG("CAuthQueue: Could not start worker threads, checking passwords synchronously");
+		delete m_pWorkers;
+		m_pWorkers = NULL;
+		m_bFailed = true;
+		return false;
+	}
+
+	m_pMonitor = new CAuthQueueMonitor(this);
+	CZNC::Get().GetManager().MonitorFD(m_pMonitor);
+
+	return true;
+}
+
+void CAuthQueue::Check(CSmartPtr<CAuthBase> AuthClass, const CUser& User) {
+	CAuthJob Job;
+	Job.m_eHash = User.GetPassHashType();
+	Job.m_sHash = User.GetPass();
+	Job.m_sSalt = User.GetPassSalt();
+	Job.m_uNewIterations = 0;
+	Job.m_bValid = false;
+
+	unsigned int uIterations = CZNC::Get().GetPassHashIterations();
+
+	if (uIterations) {
+		switch (Job.m_eHash) {
+		case CUser::HASH_MD5:
+		case CUser::HASH_SHA256:
+			Job.m_uNewIterations = uIterations;
+			break;
+		case CUser::HASH_PBKDF2:
+			// Follow increases of PassHashIterations, but never go down
+			if (Job.m_sHash.Token(0, false, "$").ToUInt() < uIterations)
+				Job.m_uNewIterations = uIterations;
+			break;
+		case CUser::HASH_NONE:
+			break;
+		}
+	}
+
+	if ((Job.m_eHash != CUser::HASH_PBKDF2 && !Job.m_uNewIterations) || !StartWorkers()) {
+		CZNC::Get().FinishAuthUser(AuthClass, CZNC::Get().FindUser(User.GetUserName()),
+				CUser::CheckPassHash(AuthClass->GetPassword(), Job.m_eHash, Job.m_sHash, Job.m_sSalt));
+		return;
+	}
+
+	Job.m_uId = ++m_uNextId;
+	Job.m_sPassword = AuthClass->GetPassword();
+	if (Job.m_uNewIterations)
+		Job.m_sNewSalt = CUtils::GetSalt();
+
+	m_mPending[Job.m_uId] = AuthClass;
+	m_pWorkers->Push(Job);
+}
+
+void CAuthQueue::ProcessResults() {
+	if (!m_pWorkers)
+		return;
+
+	std::deque<CAuthJob> dResults;
+	m_pWorkers->TakeResults(dResults);
+
+	for (std::deque<CAuthJob>::iterator it = dResults.begin(); it != dResults.end(); ++it) {
+		const CAuthJob& Job = *it;
+		map<unsigned long, CSmartPtr<CAuthBase> >::iterator itPending = m_mPending.find(Job.m_uId);
+
+		if (itPending == m_mPending.end())
+			continue;
+
+		CSmartPtr<CAuthBase> AuthClass = itPending->second;
+		m_mPending.erase(itPending);
+
+		// The user might have been deleted or got a new password meanwhile
+		CUser* pUser = CZNC::Get().FindUser(AuthClass->GetUsername());
+
+		if (pUser && (pUser->GetPassHashType() != Job.m_eHash
+					|| !pUser->GetPass().Equals(Job.m_sHash, true)
+					|| !pUser->GetPassSalt().Equals(Job.m_sSalt, true))) {
+			Check(AuthClass, *pUser);
+			continue;
+		}
+
+		if (pUser && Job.m_bValid && !Job.m_sNewHash.empty()) {
+			DEBUG("CAuthQueue: Rehashed password of [" << pUser->GetUserName() << "] with PBKDF2");
+			pUser->SetPass(Job.m_sNewHash, CUser::HASH_PBKDF2, Job.m_sNewSalt);
+			CZNC::Get().QueueConfigWrite();
+		}
+
+		CZNC::Get().FinishAuthUser(AuthClass, pUser, Job.m_bValid);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _AUTHQUEUE_H
+#define _AUTHQUEUE_H
+
+#include "zncconfig.h"
+#include "Client.h"
+#include "User.h"
+
+class CAuthQueueMonitor;
+class CAuthQueueWorkers;
+
+/**
+ * @class CAuthQueue
+ * @brief Checks passwords on a small pool of worker threads.
+ *
+ * Password hashes which are slow on purpose (HASH_PBKDF2) would block the
+ * event loop for every login. CZNC::AuthUser() passes those logins to
+ * Check(), the password is compared on a worker thread and the result is
+ * handed to CZNC::FinishAuthUser() from the main loop.
+ *
+ * If a login succeeds with an old MD5 or SHA256 hash, the password is
+ * hashed again with PBKDF2 on the same worker and the user's hash is
+ * replaced afterwards, see CZNC::GetPassHashIterations().
+ *
+ * Cheap checks which don't need rehashing are done right away.
+ */
+class ZNC_API CAuthQueue {
+public:
+	CAuthQueue(unsigned int uThreads = 2);
+	~CAuthQueue();
+
+	//! Checks AuthClass' password against User and calls CZNC::FinishAuthUser().
+	void Check(CSmartPtr<CAuthBase> AuthClass, const CUser& User);
+
+	// Getters
+	unsigned int GetThreadCount() const { return m_uThreads; }
+	size_t GetPendingCount() const { return m_mPending.size(); }
+	// !Getters
+
+private:
+	friend class CAuthQueueMonitor;
+
+	bool StartWorkers();
+	void ProcessResults();
+
+	CAuthQueueWorkers*                         m_pWorkers;
+	CAuthQueueMonitor*                         m_pMonitor;
+	map<unsigned long, CSmartPtr<CAuthBase> >  m_mPending;
+	unsigned long                              m_uNextId;
+	unsigned int                               m_uThreads;
+	bool                                       m_bFailed;
+};
+
+#endif // !_AUTHQUEUE_H
@@ -8,6 +8,7 @@
 
 #include "stdafx.hpp"
 #include "Buffer.h"
+#include "Handoff.h"
 
 CBufLine::CBufLine(const CString& sPre, const CString& sPost, bool bIncNick=true) {
 	m_sPre = sPre;
@@ -26,6 +27,7 @@ void CBufLine::GetLine(const CString& sTarget, CString& sRet) const {
 
 CBuffer::CBuffer(unsigned int uLineCount) {
 	m_uLineCount = uLineCount;
+	m_uBytes = 0;
 }
 
 CBuffer::~CBuffer() {}
@@ -36,16 +38,18 @@ size_t CBuffer::AddLine(const CString& sPre, const CString& sPost, bool bIncNick
 	}
 
 	while (size() >= m_uLineCount) {
-		erase(begin());
+		PopFront();
 	}
 
 	push_back(CBufLine(sPre, sPost, bIncNick));
+	m_uBytes += sPre.size() + sPost.size();
 	return size();
 }
 
 size_t CBuffer::UpdateLine(const CString& sPre, const CString& sPost, bool bIncNick) {
 	for (iterator it = begin(); it != end(); ++it) {
 		if (it->GetPre() == sPre) {
+			m_uBytes = m_uBytes - it->GetPost().size() + sPost.size();
 			it->SetPost(sPost);
 			it->SetIncNick(bIncNick);
 			return size();
@@ -81,15 +85,50 @@ bool CBuffer::GetNextLine(const CString& sTarget, CString& sRet) {
 	}
 
 	begin()->GetLine(sTarget, sRet);
-	erase(begin());
+	PopFront();
 	return true;
 }
 
+void CBuffer::Trim(unsigned int uMax) {
+	while (size() > uMax) {
+		PopFront();
+	}
+}
+
+void CBuffer::SaveState(MCString& msState, const CString& sPrefix) const {
+	msState[sPrefix] = CString(Size());
+
+	for (unsigned int a = 0; a < Size(); a++) {
+		const CBufLine& Line = (*this)[a];
+		const CString sLine = sPrefix + "/" + CString(a) + "/";
+
+		msState[sLine + "pre"] = Line.GetPre();
+		msState[sLine + "post"] = Line.GetPost();
+		msState[sLine + "incnick"] = CString(Line.GetIncNick());
+	}
+}
+
+void CBuffer::LoadState(const MCString& msState, const CString& sPrefix) {
+	unsigned int uLines = CHandoff::GetValue(msState, sPrefix).ToUInt();
+
+	Clear();
+
+	for (unsigned int a = 0; a < uLines; a++) {
+		const CString sLine = sPrefix + "/" + CString(a) + "/";
+
+		AddLine(CHandoff::GetValue(msState, sLine + "pre"), CHandoff::GetValue(msState, sLine + "post"),
+				CHandoff::GetValue(msState, sLine + "incnick").ToBool());
+	}
+}
+
+void CBuffer::PopFront() {
+	m_uBytes -= front().GetPre().size() + front().GetPost().size();
+	erase(begin());
+}
+
 void CBuffer::SetLineCount(unsigned int u) {
 	m_uLineCount = u;
 
 	// We may need to shrink the buffer if the allowed size got smaller
-	while (size() > m_uLineCount) {
-		erase(begin());
-	}
+	Trim(m_uLineCount);
 }
@@ -59,7 +59,13 @@ public:
 	bool GetNextLine(const CString& sTarget, CString& sRet);
 	bool GetLine(const CString& sTarget, CString& sRet, unsigned int uIdx) const;
 	bool IsEmpty() const { return empty(); }
-	void Clear() { clear(); }
+	unsigned int Size() const { return (unsigned int) size(); }
+	void Clear() { clear(); m_uBytes = 0; }
+	//! Drops the oldest lines until at most uMax are left
+	void Trim(unsigned int uMax);
+	//! For CHandoff, the lines are stored below sPrefix
+	void SaveState(MCString& msState, const CString& sPrefix) const;
+	void LoadState(const MCString& msState, const CString& sPrefix);
 
 	// Setters
 	void SetLineCount(unsigned int u);
@@ -67,10 +73,15 @@ public:
 
 	// Getters
 	unsigned int GetLineCount() const { return m_uLineCount; }
+	//! Bytes used by the buffered lines, without any allocator overhead
+	size_t GetBytes() const { return m_uBytes; }
 	// !Getters
 private:
 protected:
+	void PopFront();
+
 	unsigned int m_uLineCount;
+	size_t       m_uBytes;
 };
 
 #endif // !_BUFFER_H
@@ -9,6 +9,7 @@
 #include "stdafx.hpp"
 #include "Chan.h"
 #include "FileUtils.h"
+#include "Handoff.h"
 #include "IRCSock.h"
 #include "User.h"
 #include "znc.h"
@@ -27,6 +28,7 @@ CChan::CChan(const CString& sName, CUser* pUser, bool bInConfig, CConfig *pConfi
 	m_Nick.SetUser(pUser);
 	m_bDetached = false;
 	m_uBufferCount = m_pUser->GetBufferCount();
+	m_uBufferBytes = 0;
 	m_bKeepBuffer = m_pUser->KeepBuffer();
 	m_bDisabled = false;
 	Reset();
@@ -67,24 +69,34 @@ void CChan::Reset() {
 }
 
 bool CChan::WriteConfig(CFile& File) {
+	CString sConfig;
+
+	if (!WriteConfig(sConfig)) {
+		return false;
+	}
+
+	return (File.Write(sConfig) > 0);
+}
+
+bool CChan::WriteConfig(CString& sConfig) {
 	if (!InConfig()) {
 		return false;
 	}
 
-	File.Write("\t<Chan " + GetName().FirstLine() + ">\n");
+	sConfig += "\t<Chan " + GetName().FirstLine() + ">\n";
 
 	if (m_pUser->GetBufferCount() != GetBufferCount())
-		m_pUser->PrintLine(File, "\tBuffer", CString(GetBufferCount()));
+		m_pUser->PrintLine(sConfig, "\tBuffer", CString(GetBufferCount()));
 	if (m_pUser->KeepBuffer() != KeepBuffer())
-		m_pUser->PrintLine(File, "\tKeepBuffer", CString(KeepBuffer()));
+		m_pUser->PrintLine(sConfig, "\tKeepBuffer", CString(KeepBuffer()));
 	if (IsDetached())
-		m_pUser->PrintLine(File, "\tDetached", "true");
+		m_pUser->PrintLine(sConfig, "\tDetached", "true");
 	if (!GetKey().empty())
-		m_pUser->PrintLine(File, "\tKey", GetKey());
+		m_pUser->PrintLine(sConfig, "\tKey", GetKey());
 	if (!GetDefaultModes().empty())
-		m_pUser->PrintLine(File, "\tModes", GetDefaultModes());
+		m_pUser->PrintLine(sConfig, "\tModes", GetDefaultModes());
 
-	File.Write("\t</Chan>\n");
+	sConfig += "\t</Chan>\n";
 	return true;
 }
 
@@ -115,9 +127,14 @@ bool CChan::SetBufferCount(size_t u, bool bForce) {
 		return false;
 	m_uBufferCount = u;
 	TrimBuffer(m_uBufferCount);
+	ConfigChanged();
 	return true;
 }
 
+void CChan::ConfigChanged() {
+	m_pUser->SetConfigChanged();
+}
+
 void CChan::Cycle() const {
 	m_pUser->PutIRC("PART " + GetName() + "\r\nJOIN " + GetName() + " " + GetKey());
 }
@@ -179,7 +196,10 @@ void CChan::JoinUser(bool bForce, const CString& sKey, CClient* pClient) {
 	}
 
 	m_pUser->PutUser(":" + m_pUser->GetIRCServer() + " 366 " + m_pUser->GetIRCNick().GetNick() + " " + GetName() + " :End of /NAMES list.", pClient);
-	m_bDetached = false;
+
+	if (m_bDetached) {
+		SetDetached(false);
+	}
 
 	// Send Buffer
 	SendBuffer(pClient);
@@ -188,14 +208,14 @@ void CChan::JoinUser(bool bForce, const CString& sKey, CClient* pClient) {
 void CChan::DetachUser() {
 	if (!m_bDetached) {
 		m_pUser->PutUser(":" + m_pUser->GetIRCNick().GetNickMask() + " PART " + GetName());
-		m_bDetached = true;
+		SetDetached(true);
 	}
 }
 
 void CChan::AttachUser() {
 	if (m_bDetached) {
 		m_pUser->PutUser(":" + m_pUser->GetIRCNick().GetNickMask() + " JOIN " + GetName());
-		m_bDetached = false;
+		SetDetached(false);
 	}
 }
 
@@ -527,20 +547,94 @@ size_t CChan::AddBuffer(const CString& sLine) {
 	}
 
 	if (m_vsBuffer.size() >= m_uBufferCount) {
+		m_uBufferBytes -= m_vsBuffer.front().size();
 		m_vsBuffer.erase(m_vsBuffer.begin());
 	}
 
 	m_vsBuffer.push_back(sLine);
+	m_uBufferBytes += sLine.size();
 	return m_vsBuffer.size();
 }
 
 void CChan::ClearBuffer() {
 	m_vsBuffer.clear();
+	m_uBufferBytes = 0;
 }
 
 void CChan::TrimBuffer(const unsigned int uMax) {
 	if (m_vsBuffer.size() > uMax) {
-		m_vsBuffer.erase(m_vsBuffer.begin(), m_vsBuffer.begin() + (m_vsBuffer.size() - uMax));
+		vector<CString>::iterator itEnd = m_vsBuffer.begin() + (m_vsBuffer.size() - uMax);
+
+		for (vector<CString>::const_iterator it = m_vsBuffer.begin(); it != itEnd; ++it) {
+			m_uBufferBytes -= it->size();
+		}
+
+		m_vsBuffer.erase(m_vsBuffer.begin(), itEnd);
+	}
+}
+
+void CChan::SaveState(MCString& msState, const CString& sPrefix) const {
+	unsigned int a = 0;
+
+	msState[sPrefix + "name"] = m_sName;
+	msState[sPrefix + "key"] = m_sKey;
+	msState[sPrefix + "ison"] = CString(m_bIsOn);
+	msState[sPrefix + "detached"] = CString(m_bDetached);
+	msState[sPrefix + "topic"] = m_sTopic;
+	msState[sPrefix + "topicowner"] = m_sTopicOwner;
+	msState[sPrefix + "topicdate"] = CString(m_ulTopicDate);
+	msState[sPrefix + "creationdate"] = CString(m_ulCreationDate);
+	msState[sPrefix + "modeknown"] = CString(m_bModeKnown);
+
+	// The first character is the mode, the rest its argument
+	msState[sPrefix + "modes"] = CString(m_musModes.size());
+	for (map<unsigned char, CString>::const_iterator it = m_musModes.begin(); it != m_musModes.end(); ++it, a++) {
+		msState[sPrefix + "mode/" + CString(a)] = CString(it->first) + it->second;
+	}
+
+	a = 0;
+	msState[sPrefix + "nicks"] = CString(m_msNicks.size());
+	for (map<CString, CNick>::const_iterator it = m_msNicks.begin(); it != m_msNicks.end(); ++it, a++) {
+		msState[sPrefix + "nick/" + CString(a)] = it->second.GetPermStr() + it->second.GetNickMask();
+	}
+
+	msState[sPrefix + "buffer"] = CString(m_vsBuffer.size());
+	for (a = 0; a < m_vsBuffer.size(); a++) {
+		msState[sPrefix + "buffer/" + CString(a)] = m_vsBuffer[a];
+	}
+}
+
+void CChan::LoadState(const MCString& msState, const CString& sPrefix) {
+	unsigned int uModes = CHandoff::GetValue(msState, sPrefix + "modes").ToUInt();
+	unsigned int uNicks = CHandoff::GetValue(msState, sPrefix + "nicks").ToUInt();
+	unsigned int uLines = CHandoff::GetValue(msState, sPrefix + "buffer").ToUInt();
+
+	Reset();
+	SetIsOn(CHandoff::GetValue(msState, sPrefix + "ison").ToBool());
+	SetDetached(CHandoff::GetValue(msState, sPrefix + "detached").ToBool());
+	SetKey(CHandoff::GetValue(msState, sPrefix + "key"));
+	SetTopic(CHandoff::GetValue(msState, sPrefix + "topic"));
+	SetTopicOwner(CHandoff::GetValue(msState, sPrefix + "topicowner"));
+	SetTopicDate(CHandoff::GetValue(msState, sPrefix + "topicdate").ToULong());
+	SetCreationDate(CHandoff::GetValue(msState, sPrefix + "creationdate").ToULong());
+
+	for (unsigned int a = 0; a < uModes; a++) {
+		const CString& sMode = CHandoff::GetValue(msState, sPrefix + "mode/" + CString(a));
+
+		if (!sMode.empty()) {
+			AddMode(sMode[0], sMode.substr(1));
+		}
+	}
+
+	SetModeKnown(CHandoff::GetValue(msState, sPrefix + "modeknown").ToBool());
+
+	for (unsigned int b = 0; b < uNicks; b++) {
+		AddNick(CHandoff::GetValue(msState, sPrefix + "nick/" + CString(b)));
+	}
+
+	ClearBuffer();
+	for (unsigned int c = 0; c < uLines; c++) {
+		AddBuffer(CHandoff::GetValue(msState, sPrefix + "buffer/" + CString(c)));
 	}
 }
 
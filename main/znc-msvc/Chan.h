@@ -57,6 +57,7 @@ public:
 
 	void Reset();
 	bool WriteConfig(CFile& File);
+	bool WriteConfig(CString& sConfig);
 	void Clone(CChan& chan);
 	void Cycle() const;
 	void JoinUser(bool bForce = false, const CString& sKey = "", CClient* pClient = NULL);
@@ -90,6 +91,10 @@ public:
 	void ClearBuffer();
 	void TrimBuffer(const unsigned int uMax);
 	void SendBuffer(CClient* pClient);
+
+	//! For CHandoff, this needs the IRC connection to be taken over already
+	void SaveState(MCString& msState, const CString& sPrefix) const;
+	void LoadState(const MCString& msState, const CString& sPrefix);
 	// !Buffer
 
 	// m_Nick wrappers
@@ -102,15 +107,15 @@ public:
 	// Setters
 	void SetModeKnown(bool b) { m_bModeKnown = b; }
 	void SetIsOn(bool b) { m_bIsOn = b; if (!b) { Reset(); } }
-	void SetKey(const CString& s) { m_sKey = s; }
+	void SetKey(const CString& s) { m_sKey = s; ConfigChanged(); }
 	void SetTopic(const CString& s) { m_sTopic = s; }
 	void SetTopicOwner(const CString& s) { m_sTopicOwner = s; }
 	void SetTopicDate(unsigned long u) { m_ulTopicDate = u; }
-	void SetDefaultModes(const CString& s) { m_sDefaultModes = s; }
+	void SetDefaultModes(const CString& s) { m_sDefaultModes = s; ConfigChanged(); }
 	bool SetBufferCount(size_t u, bool bForce = false);
-	void SetKeepBuffer(bool b) { m_bKeepBuffer = b; }
-	void SetDetached(bool b = true) { m_bDetached = b; }
-	void SetInConfig(bool b) { m_bInConfig = b; }
+	void SetKeepBuffer(bool b) { m_bKeepBuffer = b; ConfigChanged(); }
+	void SetDetached(bool b = true) { m_bDetached = b; ConfigChanged(); }
+	void SetInConfig(bool b) { m_bInConfig = b; ConfigChanged(); }
 	void SetCreationDate(unsigned long u) { m_ulCreationDate = u; }
 	void Disable() { m_bDisabled = true; }
 	void Enable();
@@ -136,6 +141,8 @@ public:
 	const map<CString,CNick>& GetNicks() const { return m_msNicks; }
 	size_t GetNickCount() const { return m_msNicks.size(); }
 	size_t GetBufferCount() const { return m_uBufferCount; }
+	//! Bytes used by the buffered lines, without any allocator overhead
+	size_t GetBufferBytes() const { return m_uBufferBytes; }
 	bool KeepBuffer() const { return m_bKeepBuffer; }
 	bool IsDetached() const { return m_bDetached; }
 	bool InConfig() const { return m_bInConfig; }
@@ -144,6 +151,8 @@ public:
 	unsigned int GetJoinTries() const { return m_uJoinTries; }
 	// !Getters
 private:
+	//! The user's config has to be serialized again
+	void ConfigChanged();
 protected:
 	bool                         m_bDetached;
 	bool                         m_bIsOn;
@@ -163,6 +172,7 @@ protected:
 	map<CString,CNick>           m_msNicks;       // Todo: make this caseless (irc style)
 	size_t                       m_uBufferCount;
 	vector<CString>              m_vsBuffer;
+	size_t                       m_uBufferBytes;
 
 	bool                         m_bModeKnown;
 	map<unsigned char, CString>  m_musModes;
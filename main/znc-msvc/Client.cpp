@@ -10,6 +10,7 @@
 #include "Client.h"
 #include "Chan.h"
 #include "FileUtils.h"
+#include "Handoff.h"
 #include "IRCSock.h"
 #include "User.h"
 #include "znc.h"
@@ -64,6 +65,7 @@ void CClient::ReadLine(const CString& sData) {
 	sLine.TrimRight("\n\r");
 
 	DEBUG("(" << ((m_pUser) ? m_pUser->GetUserName() : GetRemoteIP()) << ") CLI -> ZNC [" << sLine << "]");
+	CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_CLIENT_IN);
 
 	if (IsAttached()) {
 		MODULECALL(OnUserRaw(sLine), m_pUser, this, return);
@@ -577,6 +579,40 @@ void CClient::AcceptLogin(CUser& User) {
 	MODULECALL(OnClientLogin(), m_pUser, this, NOTHING);
 }
 
+void CClient::SaveState(MCString& msState, const CString& sPrefix) const {
+	CString sCaps;
+
+	for (SCString::const_iterator it = m_ssAcceptedCaps.begin(); it != m_ssAcceptedCaps.end(); ++it) {
+		sCaps += (sCaps.empty() ? "" : " ") + *it;
+	}
+
+	msState[sPrefix + "nick"] = m_sNick;
+	msState[sPrefix + "caps"] = sCaps;
+	msState[sPrefix + "namesx"] = CString(m_bNamesx);
+	msState[sPrefix + "uhnames"] = CString(m_bUHNames);
+}
+
+void CClient::LoadState(const MCString& msState, const CString& sPrefix, CUser& User) {
+	VCString vsCaps;
+
+	SetNick(CHandoff::GetValue(msState, sPrefix + "nick"));
+	m_bNamesx = CHandoff::GetValue(msState, sPrefix + "namesx").ToBool();
+	m_bUHNames = CHandoff::GetValue(msState, sPrefix + "uhnames").ToBool();
+
+	CHandoff::GetValue(msState, sPrefix + "caps").Split(" ", vsCaps, false);
+	m_ssAcceptedCaps.clear();
+	m_ssAcceptedCaps.insert(vsCaps.begin(), vsCaps.end());
+
+	m_bGotPass = true;
+	m_bGotNick = true;
+	m_bGotUser = true;
+
+	// Like AcceptLogin(), but the client already got its welcome
+	m_pUser = &User;
+	SetTimeout(540, TMO_READ);
+	User.GetClients().push_back(this);
+}
+
 void CClient::Timeout() {
 	PutClient("ERROR :Closing link [Timeout]");
 }
@@ -615,8 +651,32 @@ void CClient::PutIRC(const CString& sLine) {
 	m_pUser->PutIRC(sLine);
 }
 
+void CClient::CheckSendQ(size_t uSoft, size_t uHard) {
+	size_t uSendQ = GetInternalWriteBuffer().size();
+
+	if (uHard && uSendQ > uHard) {
+		DEBUG("(" << m_pUser->GetUserName() << ") client stopped reading, [" << uSendQ << "] bytes queued");
+		m_pUser->PutStatus("Disconnected a client from [" + GetRemoteIP() + "], it stopped reading and had "
+				+ CString::ToByteStr(uSendQ) + " queued", NULL, this);
+		CZNC::Get().GetPerfStats().AddStalledClient();
+		Close();
+		return;
+	}
+
+	if (uSoft && uSendQ > uSoft && !m_bSendQPaused) {
+		// It doesn't read, so it gets no chance to make us send it even more
+		PauseRead();
+		m_bSendQPaused = true;
+		CZNC::Get().GetPerfStats().AddPausedClient();
+	} else if (m_bSendQPaused && (!uSoft || uSendQ <= uSoft / 2)) {
+		UnPauseRead();
+		m_bSendQPaused = false;
+	}
+}
+
 void CClient::PutClient(const CString& sLine) {
 	DEBUG("(" << ((m_pUser) ? m_pUser->GetUserName() : GetRemoteIP()) << ") ZNC -> CLI [" << sLine << "]");
+	CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_CLIENT_OUT);
 	Write(sLine + "\r\n");
 }
 
@@ -82,6 +82,7 @@ public:
 		m_bInCap = false;
 		m_bNamesx = false;
 		m_bUHNames = false;
+		m_bSendQPaused = false;
 		EnableReadLine();
 		// RFC says a line can have 512 chars max, but we are
 		// a little more gentle ;)
@@ -102,9 +103,18 @@ public:
 
 	void UserCommand(CString& sLine);
 	void UserPortCommand(CString& sLine);
+	void PerfCommand(const CString& sLine);
 	void StatusCTCP(const CString& sCommand);
 	void BouncedOff();
 	bool IsAttached() const { return m_pUser != NULL; }
+	/** Enforces the send queue limits on a client that doesn't read what we
+	 *  send. Above uSoft we stop reading from it, above uHard it gets
+	 *  disconnected. 0 turns a limit off.
+	 */
+	void CheckSendQ(size_t uSoft, size_t uHard);
+	//! For CHandoff, LoadState() also attaches the client to User
+	void SaveState(MCString& msState, const CString& sPrefix) const;
+	void LoadState(const MCString& msState, const CString& sPrefix, CUser& User);
 
 	void PutIRC(const CString& sLine);
 	void PutClient(const CString& sLine);
@@ -141,6 +151,7 @@ protected:
 	bool                 m_bInCap;
 	bool                 m_bNamesx;
 	bool                 m_bUHNames;
+	bool                 m_bSendQPaused;
 	CUser*               m_pUser;
 	CString              m_sNick;
 	CString              m_sPass;
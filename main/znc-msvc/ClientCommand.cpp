@@ -15,6 +15,7 @@
 #include "Server.h"
 #include "User.h"
 #include "znc.h"
+#include <algorithm>
 
 void CClient::UserCommand(CString& sLine) {
 	if (!m_pUser) {
@@ -142,7 +143,15 @@ void CClient::UserCommand(CString& sLine) {
 		CString sRet;
 
 		if (CZNC::Get().RehashConfig(sRet)) {
+			const VCString& vsChanges = CZNC::Get().GetRehashChanges();
+
 			PutStatus("Rehashing succeeded!");
+			if (vsChanges.empty()) {
+				PutStatus("Nothing changed.");
+			}
+			for (VCString::const_iterator it = vsChanges.begin(); it != vsChanges.end(); ++it) {
+				PutStatus(*it);
+			}
 		} else {
 			PutStatus("Rehashing failed: " + sRet);
 		}
@@ -238,13 +247,22 @@ void CClient::UserCommand(CString& sLine) {
 		bool bRestart = sCommand.Equals("RESTART");
 		CString sMessage = sLine.Token(1, true);
 		bool bForce = false;
+		bool bLive = false;
+
+		while (true) {
+			if (sMessage.Token(0).Equals("FORCE")) {
+				bForce = true;
+			} else if (bRestart && sMessage.Token(0).Equals("LIVE")) {
+				bLive = true;
+			} else {
+				break;
+			}
 
-		if (sMessage.Token(0).Equals("FORCE")) {
-			bForce = true;
 			sMessage = sMessage.Token(1, true);
 		}
 
-		if (sMessage.empty()) {
+		// The users shouldn't notice a live restart unless we tell them
+		if (sMessage.empty() && !bLive) {
 			sMessage = (bRestart ? "ZNC is being restarted NOW!" : "ZNC is being shut down NOW!");
 		}
 
@@ -252,7 +270,14 @@ void CClient::UserCommand(CString& sLine) {
 			PutStatus("ERROR: Writing config file to disk failed! Aborting. Use " +
 				sCommand.AsUpper() + " FORCE to ignore.");
 		} else {
-			CZNC::Get().Broadcast(sMessage);
+			if (!sMessage.empty()) {
+				CZNC::Get().Broadcast(sMessage);
+			}
+
+			if (bLive) {
+				throw CException(CException::EX_RestartLive);
+			}
+
 			throw CException(bRestart ? CException::EX_Restart : CException::EX_Shutdown);
 		}
 	} else if (sCommand.Equals("JUMP") || sCommand.Equals("CONNECT")) {
@@ -898,8 +923,37 @@ void CClient::UserCommand(CString& sLine) {
 		Table.SetCell("Total", CString::ToByteStr(Total.first + Total.second));
 
 		PutStatus(Table);
+	} else if (m_pUser->IsAdmin() && sCommand.Equals("PERF")) {
+		PerfCommand(sLine);
 	} else if (sCommand.Equals("UPTIME")) {
 		PutStatus("Running for " + CZNC::Get().GetUptime());
+	} else if (sCommand.Equals("SENDQUEUE")) {
+		CIRCSock* pIRCSock = m_pUser->GetIRCSock();
+
+		if (!pIRCSock) {
+			PutStatus("You are not connected to IRC");
+			return;
+		}
+
+		CTable Table;
+		Table.AddColumn("Queue");
+		Table.AddColumn("Lines");
+
+		Table.AddRow();
+		Table.SetCell("Queue", "Interactive");
+		Table.SetCell("Lines", CString(pIRCSock->GetSendQueueSize(CIRCSock::PRIO_INTERACTIVE)));
+
+		Table.AddRow();
+		Table.SetCell("Queue", "Bulk");
+		Table.SetCell("Lines", CString(pIRCSock->GetSendQueueSize(CIRCSock::PRIO_BULK)));
+
+		PutStatus(Table);
+		PutStatus("FloodRate [" + CString(m_pUser->GetFloodRate()) + "] lines/s, FloodBurst ["
+				+ CString(m_pUser->GetFloodBurst()) + "] lines");
+		PutStatus("Queued [" + CString(pIRCSock->GetQueuedLines()) + "] lines, merged ["
+				+ CString(pIRCSock->GetCoalescedLines()) + "] more into those");
+		PutStatus("Time spent in the queue: average [" + CString(pIRCSock->GetAvgQueueLatency())
+				+ "ms], max [" + CString(pIRCSock->GetMaxQueueLatency()) + "ms]");
 	} else if (m_pUser->IsAdmin() &&
 			(sCommand.Equals("LISTPORTS") || sCommand.Equals("ADDPORT") || sCommand.Equals("DELPORT"))) {
 		UserPortCommand(sLine);
@@ -908,6 +962,194 @@ void CClient::UserCommand(CString& sLine) {
 	}
 }
 
+static CString PerfTime(unsigned long long uMicro) {
+	if (uMicro < 10000) {
+		return CString(uMicro) + "us";
+	}
+
+	return CString(uMicro / 1000) + "ms";
+}
+
+static bool SortBySendq(Csock* a, Csock* b) {
+	return a->GetInternalWriteBuffer().size() > b->GetInternalWriteBuffer().size();
+}
+
+void CClient::PerfCommand(const CString& sLine) {
+	const CString sWhat = sLine.Token(1);
+	CPerfStats& Stats = CZNC::Get().GetPerfStats();
+
+	if (sWhat.Equals("RESET")) {
+		Stats.Reset();
+		PutStatus("Performance counters reset");
+	} else if (sWhat.Equals("MODULES") || sWhat.Equals("HOOKS")) {
+		map<CString, CHookStats> mStats;
+		CPerfStats::GetModuleStats(mStats, sWhat.Equals("HOOKS"));
+
+		if (mStats.empty()) {
+			PutStatus("No module hooks were called yet");
+			return;
+		}
+
+		CTable Table;
+		Table.AddColumn("Name");
+		Table.AddColumn("Calls");
+		Table.AddColumn("Total");
+		Table.AddColumn("Avg");
+		Table.AddColumn("Max");
+
+		for (map<CString, CHookStats>::const_iterator it = mStats.begin(); it != mStats.end(); ++it) {
+			const CHookStats& Hook = it->second;
+
+			Table.AddRow();
+			Table.SetCell("Name", it->first);
+			Table.SetCell("Calls", CString(Hook.GetCalls()));
+			Table.SetCell("Total", PerfTime(Hook.GetTime()));
+			Table.SetCell("Avg", PerfTime(Hook.GetCalls() ? Hook.GetTime() / Hook.GetCalls() : 0));
+			Table.SetCell("Max", PerfTime(Hook.GetMaxTime()));
+		}
+
+		PutStatus(Table);
+	} else if (sWhat.Equals("SOCKETS")) {
+		const CSockManager& Manager = CZNC::Get().GetManager();
+		vector<Csock*> vSocks(Manager.begin(), Manager.end());
+
+		// The sockets with the most data waiting to be sent are the interesting ones
+		sort(vSocks.begin(), vSocks.end(), SortBySendq);
+
+		CTable Table;
+		Table.AddColumn("Socket");
+		Table.AddColumn("Remote");
+		Table.AddColumn("SendQ");
+		Table.AddColumn("RecvQ");
+
+		for (unsigned int a = 0; a < vSocks.size() && a < 20; a++) {
+			Csock* pSock = vSocks[a];
+
+			Table.AddRow();
+			Table.SetCell("Socket", pSock->GetSockName());
+			Table.SetCell("Remote", pSock->GetRemoteIP() + " " + CString(pSock->GetRemotePort()));
+			Table.SetCell("SendQ", CString::ToByteStr(pSock->GetInternalWriteBuffer().size()));
+			Table.SetCell("RecvQ", CString::ToByteStr(pSock->GetInternalReadBuffer().size()));
+		}
+
+		PutStatus(Table);
+		PutStatus("Showing " + CString(vSocks.size() < 20 ? vSocks.size() : 20) + " of " + CString(vSocks.size()) + " sockets");
+	} else if (sWhat.Equals("BUFFERS")) {
+		const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+		CString sUser = sLine.Token(2);
+		size_t uTotal = 0;
+
+		CTable Table;
+		Table.AddColumn("Username");
+		Table.AddColumn("Buffer");
+		Table.AddColumn("Lines");
+		Table.AddColumn("Size");
+
+		for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+			const CUser* pUser = it->second;
+			const vector<CChan*>& vChans = pUser->GetChans();
+			size_t uUser = pUser->GetBufferBytes();
+
+			// The per channel list gets long, only show it for one user
+			for (vector<CChan*>::const_iterator it2 = vChans.begin(); it2 != vChans.end() && sUser.Equals(it->first); ++it2) {
+				Table.AddRow();
+				Table.SetCell("Username", it->first);
+				Table.SetCell("Buffer", (*it2)->GetName());
+				Table.SetCell("Lines", CString((*it2)->GetBuffer().size()));
+				Table.SetCell("Size", CString::ToByteStr((*it2)->GetBufferBytes()));
+			}
+
+			Table.AddRow();
+			Table.SetCell("Username", it->first);
+			Table.SetCell("Buffer", "<Total>");
+			Table.SetCell("Size", CString::ToByteStr(uUser));
+			uTotal += uUser;
+		}
+
+		PutStatus(Table);
+		PutStatus("All buffers use " + CString::ToByteStr(uTotal));
+	} else if (sWhat.Equals("MEMORY")) {
+		const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+		unsigned long long uBuffers = 0, uClients = 0, uIRC = 0;
+
+		CTable Table;
+		Table.AddColumn("Username");
+		Table.AddColumn("Buffers");
+		Table.AddColumn("Client SendQ");
+		Table.AddColumn("IRC SendQ");
+		Table.AddColumn("IRC RecvQ");
+
+		for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+			CUser* pUser = it->second;
+			const vector<CClient*>& vClients = pUser->GetClients();
+			CIRCSock* pIRCSock = pUser->GetIRCSock();
+			size_t uSendQ = 0;
+
+			for (vector<CClient*>::const_iterator it2 = vClients.begin(); it2 != vClients.end(); ++it2) {
+				uSendQ += (*it2)->GetInternalWriteBuffer().size();
+			}
+
+			Table.AddRow();
+			Table.SetCell("Username", it->first);
+			Table.SetCell("Buffers", CString::ToByteStr(pUser->GetBufferBytes()));
+			Table.SetCell("Client SendQ", CString::ToByteStr(uSendQ));
+
+			if (pIRCSock) {
+				Table.SetCell("IRC SendQ", CString::ToByteStr(pIRCSock->GetInternalWriteBuffer().size()));
+				Table.SetCell("IRC RecvQ", CString::ToByteStr(pIRCSock->GetInternalReadBuffer().size())
+						+ (pIRCSock->IsBackpressured() ? " (paused)" : ""));
+				uIRC += pIRCSock->GetInternalWriteBuffer().size() + pIRCSock->GetInternalReadBuffer().size();
+			}
+
+			uBuffers += pUser->GetBufferBytes();
+			uClients += uSendQ;
+		}
+
+		PutStatus(Table);
+		PutStatus("Total: buffers [" + CString::ToByteStr(uBuffers) + "], client queues ["
+				+ CString::ToByteStr(uClients) + "], IRC queues [" + CString::ToByteStr(uIRC) + "]");
+		PutStatus("Limits: UserBufferLimit [" + CString(CZNC::Get().GetUserBufferLimit())
+				+ "], ClientSendQSoftLimit [" + CString(CZNC::Get().GetClientSendQSoftLimit())
+				+ "], ClientSendQHardLimit [" + CString(CZNC::Get().GetClientSendQHardLimit())
+				+ "], ClientSendQHighWater [" + CString(CZNC::Get().GetClientSendQHighWater()) + "] bytes");
+		PutStatus("Dropped [" + CString(Stats.GetDroppedLines()) + "] buffer lines, paused ["
+				+ CString(Stats.GetPausedClients()) + "] and disconnected ["
+				+ CString(Stats.GetStalledClients()) + "] clients, stopped reading from IRC ["
+				+ CString(Stats.GetIRCReadPauses()) + "] times");
+	} else if (sWhat.empty()) {
+		const CHookStats& Loops = Stats.GetLoops();
+		const CHookStats& Lag = Stats.GetTimerLag();
+
+		PutStatus("Since " + CString(time(NULL) - Stats.GetSince()) + " seconds: ["
+				+ CString(Loops.GetCalls()) + "] loop iterations, busy for avg ["
+				+ PerfTime(Loops.GetCalls() ? Loops.GetTime() / Loops.GetCalls() : 0)
+				+ "], max [" + PerfTime(Loops.GetMaxTime()) + "]");
+		PutStatus("Lines from IRC [" + CString(Stats.GetLines(CPerfStats::LINES_IRC_IN)) + "], to IRC ["
+				+ CString(Stats.GetLines(CPerfStats::LINES_IRC_OUT)) + "], from clients ["
+				+ CString(Stats.GetLines(CPerfStats::LINES_CLIENT_IN)) + "], to clients ["
+				+ CString(Stats.GetLines(CPerfStats::LINES_CLIENT_OUT)) + "]");
+		PutStatus("Timer lag: last [" + PerfTime(Stats.GetLastTimerLag()) + "], avg ["
+				+ PerfTime(Lag.GetCalls() ? Lag.GetTime() / Lag.GetCalls() : 0)
+				+ "], max [" + PerfTime(Lag.GetMaxTime()) + "]");
+
+		CTable Table;
+		Table.AddColumn("Busy");
+		Table.AddColumn("Loops");
+
+		for (unsigned int a = 0; a < CPerfStats::LOOP_BUCKETS; a++) {
+			unsigned long long uLimit = CPerfStats::GetLoopBucketLimit(a);
+
+			Table.AddRow();
+			Table.SetCell("Busy", uLimit ? "< " + PerfTime(uLimit) : ">= " + PerfTime(CPerfStats::GetLoopBucketLimit(a - 1)));
+			Table.SetCell("Loops", CString(Stats.GetLoopBucket(a)));
+		}
+
+		PutStatus(Table);
+	} else {
+		PutStatus("Usage: Perf [modules|hooks|sockets|buffers [user]|memory|reset]");
+	}
+}
+
 void CClient::UserPortCommand(CString& sLine) {
 	const CString sCommand = sLine.Token(0);
 
@@ -1142,6 +1384,10 @@ void CClient::HelpUser() {
 	Table.SetCell("Command", "Uptime");
 	Table.SetCell("Description", "Show for how long ZNC has been running");
 
+	Table.AddRow();
+	Table.SetCell("Command", "SendQueue");
+	Table.SetCell("Description", "Show the flood protection queue of your IRC connection");
+
 	if (!m_pUser->DenyLoadMod()) {
 		Table.AddRow();
 		Table.SetCell("Command", "LoadMod");
@@ -1225,6 +1471,11 @@ void CClient::HelpUser() {
 		Table.SetCell("Command", "Traffic");
 		Table.SetCell("Description", "Show basic traffic stats for all ZNC users");
 
+		Table.AddRow();
+		Table.SetCell("Command", "Perf");
+		Table.SetCell("Arguments", "[modules|hooks|sockets|buffers [user]|memory|reset]");
+		Table.SetCell("Description", "Show where ZNC spends its time and memory");
+
 		Table.AddRow();
 		Table.SetCell("Command", "Broadcast");
 		Table.SetCell("Arguments", "[message]");
@@ -1237,8 +1488,8 @@ void CClient::HelpUser() {
 
 		Table.AddRow();
 		Table.SetCell("Command", "Restart");
-		Table.SetCell("Arguments", "[message]");
-		Table.SetCell("Description", "Restart ZNC");
+		Table.SetCell("Arguments", "[live] [message]");
+		Table.SetCell("Description", "Restart ZNC, with live the non-SSL connections stay open");
 	}
 
 	PutStatus(Table);
@@ -51,18 +51,69 @@ CConfig::CConfigEntry& CConfig::CConfigEntry::operator=(const CConfigEntry& othe
 	return *this;
 }
 
+bool CConfig::operator==(const CConfig& other) const {
+	if (m_ConfigEntries != other.m_ConfigEntries)
+		return false;
+	if (m_SubConfigs.size() != other.m_SubConfigs.size())
+		return false;
+
+	SubConfigMap::const_iterator it = m_SubConfigs.begin();
+	SubConfigMap::const_iterator it2 = other.m_SubConfigs.begin();
+	for (; it != m_SubConfigs.end(); ++it, ++it2) {
+		if (it->first != it2->first || it->second.size() != it2->second.size())
+			return false;
+
+		SubConfig::const_iterator sub = it->second.begin();
+		SubConfig::const_iterator sub2 = it2->second.begin();
+		for (; sub != it->second.end(); ++sub, ++sub2) {
+			if (sub->first != sub2->first)
+				return false;
+
+			const CConfig* pConf = sub->second.m_pSubConfig;
+			const CConfig* pConf2 = sub2->second.m_pSubConfig;
+			if (!pConf || !pConf2) {
+				if (pConf != pConf2)
+					return false;
+			} else if (!(*pConf == *pConf2)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 bool CConfig::Parse(CFile& file, CString& sErrorMsg)
+{
+	CString sConfig, sLine;
+
+	if (!file.Seek(0)) {
+		sErrorMsg = "Could not seek to the beginning of the config.";
+		return false;
+	}
+
+	while (file.ReadLine(sLine)) {
+		sConfig += sLine;
+	}
+
+	return Parse(sConfig, sErrorMsg);
+}
+
+bool CConfig::Parse(const CString& sConfig, CString& sErrorMsg)
 {
 	CString sLine;
 	unsigned int uLineNum = 0;
 	CConfig *pActiveConfig = this;
 	std::stack<ConfigStackEntry> ConfigStack;
 	bool bCommented = false;     // support for /**/ style comments
-
-	if (!file.Seek(0))
-		return "Could not seek to the beginning of the config.";
-
-	while (file.ReadLine(sLine)) {
+	size_t uPos = 0;
+
+	while (uPos < sConfig.size()) {
+		size_t uEnd = sConfig.find('\n', uPos);
+		if (uEnd == CString::npos)
+			uEnd = sConfig.size();
+		sLine = sConfig.substr(uPos, uEnd - uPos);
+		uPos = uEnd + 1;
 		uLineNum++;
 
 #if defined(_WIN32) && defined(ERROR)
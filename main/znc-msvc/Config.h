@@ -84,7 +84,12 @@ public:
 		return m_ConfigEntries.empty() && m_SubConfigs.empty();
 	}
 
+	//! Compares all entries and sub configs, the order of values matters.
+	bool operator==(const CConfig& other) const;
+
 	bool Parse(CFile& file, CString& sErrorMsg);
+	//! Parses a config which is already in memory, e.g. from CUser::WriteConfig().
+	bool Parse(const CString& sConfig, CString& sErrorMsg);
 
 private:
 	EntryMap m_ConfigEntries;
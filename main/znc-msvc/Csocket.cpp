@@ -537,7 +537,7 @@ void CSAdjustTVTimeout( struct timeval & tv, long iTimeoutMS )
 		if( iCurTimeout > iTimeoutMS )
 		{
 			tv.tv_sec = iTimeoutMS / 1000;
-			tv.tv_usec = iTimeoutMS % 1000;
+			tv.tv_usec = ( iTimeoutMS % 1000 ) * 1000;
 		}
 	}
 }
@@ -692,6 +692,19 @@ void CSockCommon::CleanupFDMonitors()
 	m_vcMonitorFD.clear();
 }
 
+void CSockCommon::UnMonitorFD( CSMonitorFD * pMonitorFD )
+{
+	for( size_t uMon = 0; uMon < m_vcMonitorFD.size(); ++uMon )
+	{
+		if( m_vcMonitorFD[uMon] == pMonitorFD )
+		{
+			CS_Delete( m_vcMonitorFD[uMon] );
+			m_vcMonitorFD.erase( m_vcMonitorFD.begin() + uMon );
+			return;
+		}
+	}
+}
+
 void CSockCommon::CheckFDs( const std::map< int, short > & miiReadyFds )
 {
 	for( size_t uMon = 0; uMon < m_vcMonitorFD.size(); ++uMon )
@@ -1482,6 +1495,50 @@ bool Csock::AllowWrite( unsigned long long & iNOW ) const
 
 bool Csock::Write( const char *data, size_t len )
 {
+	if ( len > 0 && m_sSend.empty() && m_eConState == CST_OK && !m_bUseSSL
+		&& ( m_iMaxBytes == 0 || m_iMaxMilliSeconds == 0 ) )
+	{
+		// nothing is queued, so send straight from the caller's buffer and only
+		// copy what the kernel didn't take. Lines which are written to many
+		// sockets then usually aren't copied at all.
+#ifdef _WIN32
+		cs_ssize_t bytes = send( m_iWriteSock, data, len, 0 );
+#else
+		cs_ssize_t bytes = write( m_iWriteSock, data, len );
+#endif /* _WIN32 */
+
+		if ( ( bytes == -1 ) && ( GetSockError() == ECONNREFUSED ) )
+		{
+			// keep the data queued just like the path below does
+			m_sSend.append( data, len );
+			ConnectionRefused();
+			return( false );
+		}
+
+#ifdef _WIN32
+		if ( ( bytes <= 0 ) && ( GetSockError() != WSAEWOULDBLOCK ) )
+#else
+		if ( ( bytes <= 0 ) && ( GetSockError() != EAGAIN ) )
+#endif /* _WIN32 */
+		{
+			m_sSend.append( data, len );
+			return( false );
+		}
+
+		if ( bytes > 0 )
+		{
+			if ( TMO_WRITE & GetTimeoutType() )
+				ResetTimer();	// reset the timer on successful write
+			m_iBytesWritten += (unsigned long long)bytes;
+		} else
+			bytes = 0;
+
+		if ( (size_t)bytes < len )
+			m_sSend.append( data + bytes, len - bytes );
+
+		return( true );
+	}
+
 	m_sSend.append( data, len );
 
 	if ( m_sSend.empty() )
@@ -1863,7 +1920,12 @@ u_int Csock::GetMaxBufferThreshold() const { return( m_iMaxStoredBufferLength );
 int Csock::GetType() const { return( m_iConnType ); }
 void Csock::SetType( int iType ) { m_iConnType = iType; }
 const CS_STRING & Csock::GetSockName() const { return( m_sSockName ); }
-void Csock::SetSockName( const CS_STRING & sName ) { m_sSockName = sName; }
+void Csock::SetSockName( const CS_STRING & sName )
+{
+	m_sSockName = sName;
+	if ( m_pManager )
+		m_pManager->ReindexSock( this );
+}
 const CS_STRING & Csock::GetHostName() const { return( m_shostname ); }
 void Csock::SetHostName( const CS_STRING & sHostname ) { m_shostname = sHostname; }
 unsigned long long Csock::GetStartTime() const { return( m_iStartTime ); }
@@ -1872,6 +1934,8 @@ unsigned long long Csock::GetBytesRead() const { return( m_iBytesRead ); }
 void Csock::ResetBytesRead() { m_iBytesRead = 0; }
 unsigned long long Csock::GetBytesWritten() const { return( m_iBytesWritten ); }
 void Csock::ResetBytesWritten() { m_iBytesWritten = 0; }
+void Csock::AddBytesRead( unsigned long long iBytes ) { m_iBytesRead += iBytes; }
+void Csock::AddBytesWritten( unsigned long long iBytes ) { m_iBytesWritten += iBytes; }
 
 double Csock::GetAvgRead( unsigned long long iSample )
 {
@@ -2057,7 +2121,7 @@ bool Csock::ConnectFD( int iReadFD, int iWriteFD, const CS_STRING & sName, bool
 	SetType( eDirection );
 
 	// set the hostname
-	m_sSockName = sName;
+	SetSockName( sName );
 
 	// set the file descriptors
 	SetRSock( iReadFD );
@@ -2517,6 +2581,7 @@ void Csock::Init( const CS_STRING & sHostname, u_short uPort, int iTimeout )
 	m_bIsIPv6 = false;
 	m_bSkipConnect = false;
 	m_iLastCheckTimeoutTime = 0;
+	m_pManager = NULL;
 #ifdef HAVE_C_ARES
 	m_pARESChannel = NULL;
 	m_pCurrAddr = NULL;
@@ -2857,6 +2922,74 @@ void CSocketManager::AddSock( Csock *pcSock, const CS_STRING & sSockName )
 {
 	pcSock->SetSockName( sSockName );
 	this->push_back( pcSock );
+	pcSock->SetManager( this );
+	AddSockIndex( pcSock );
+}
+
+void CSocketManager::ReindexSock( Csock * pcSock )
+{
+	std::map<Csock *, CS_STRING>::iterator it = m_mSockNames.find( pcSock );
+	if ( it == m_mSockNames.end() || it->second == pcSock->GetSockName() )
+		return;
+
+	DelSockIndex( pcSock );
+	AddSockIndex( pcSock );
+}
+
+void CSocketManager::AddSockIndex( Csock * pcSock )
+{
+	m_mSockNames[pcSock] = pcSock->GetSockName();
+	m_mmSocksByName.insert( std::make_pair( pcSock->GetSockName(), pcSock ) );
+	AddFDIndex( pcSock );
+}
+
+void CSocketManager::DelSockIndex( Csock * pcSock )
+{
+	std::map<Csock *, CS_STRING>::iterator it = m_mSockNames.find( pcSock );
+	if ( it == m_mSockNames.end() )
+		return;
+
+	std::multimap<CS_STRING, Csock *>::iterator itName = m_mmSocksByName.lower_bound( it->second );
+	std::multimap<CS_STRING, Csock *>::iterator itEnd = m_mmSocksByName.upper_bound( it->second );
+	for( ; itName != itEnd; ++itName )
+	{
+		if ( itName->second == pcSock )
+		{
+			m_mmSocksByName.erase( itName );
+			break;
+		}
+	}
+
+	m_mSockNames.erase( it );
+	DelFDIndex( pcSock );
+}
+
+void CSocketManager::AddFDIndex( Csock * pcSock )
+{
+	cs_sock_t iFD = pcSock->GetRSock();
+	if ( iFD == CS_INVALID_SOCK )
+		iFD = pcSock->GetWSock();
+	if ( iFD == CS_INVALID_SOCK )
+		return;
+
+	DelFDIndex( pcSock );
+
+	std::map<cs_sock_t, Csock *>::iterator it = m_mSocksByFD.find( iFD );
+	if ( it != m_mSocksByFD.end() )
+		m_mSockFDs.erase( it->second );
+
+	m_mSocksByFD[iFD] = pcSock;
+	m_mSockFDs[pcSock] = iFD;
+}
+
+void CSocketManager::DelFDIndex( Csock * pcSock )
+{
+	std::map<Csock *, cs_sock_t>::iterator it = m_mSockFDs.find( pcSock );
+	if ( it == m_mSockFDs.end() )
+		return;
+
+	m_mSocksByFD.erase( it->second );
+	m_mSockFDs.erase( it );
 }
 
 Csock * CSocketManager::FindSockByRemotePort( u_short iPort )
@@ -2881,20 +3014,29 @@ Csock * CSocketManager::FindSockByLocalPort( u_short iPort )
 
 Csock * CSocketManager::FindSockByName( const CS_STRING & sName )
 {
-	std::vector<Csock *>::iterator it;
-	std::vector<Csock *>::iterator it_end = this->end();
-	for( it = this->begin(); it != it_end; it++ )
-		if ( (*it)->GetSockName() == sName )
-			return( *it );
+	std::multimap<CS_STRING, Csock *>::iterator it = m_mmSocksByName.find( sName );
+	if ( it != m_mmSocksByName.end() )
+		return( it->second );
 
 	return( NULL );
 }
 
 Csock * CSocketManager::FindSockByFD( cs_sock_t iFD )
 {
+	// the fd of a sock can change (e.g. when it connects), so double check the cached entry
+	std::map<cs_sock_t, Csock *>::iterator it = m_mSocksByFD.find( iFD );
+	if ( it != m_mSocksByFD.end() && ( ( it->second->GetRSock() == iFD ) || ( it->second->GetWSock() == iFD ) ) )
+		return( it->second );
+
 	for( unsigned int i = 0; i < this->size(); i++ )
+	{
 		if ( ( (*this)[i]->GetRSock() == iFD ) || ( (*this)[i]->GetWSock() == iFD ) )
+		{
+			if ( m_mSockNames.find( (*this)[i] ) != m_mSockNames.end() )
+				AddFDIndex( (*this)[i] );
 			return( (*this)[i] );
+		}
+	}
 
 	return( NULL );
 }
@@ -2902,10 +3044,11 @@ Csock * CSocketManager::FindSockByFD( cs_sock_t iFD )
 std::vector<Csock *> CSocketManager::FindSocksByName( const CS_STRING & sName )
 {
 	std::vector<Csock *> vpSocks;
+	std::multimap<CS_STRING, Csock *>::iterator it = m_mmSocksByName.lower_bound( sName );
+	std::multimap<CS_STRING, Csock *>::iterator it_end = m_mmSocksByName.upper_bound( sName );
 
-	for( unsigned int i = 0; i < this->size(); i++ )
-		if ( (*this)[i]->GetSockName() == sName )
-			vpSocks.push_back( (*this)[i] );
+	for( ; it != it_end; ++it )
+		vpSocks.push_back( it->second );
 
 	return( vpSocks );
 }
@@ -2951,6 +3094,8 @@ void CSocketManager::DelSock( u_int iPos )
 		m_iBytesWritten += pSock->GetBytesWritten();
 	}
 
+	DelSockIndex( pSock );
+	pSock->SetManager( NULL );
 	CS_Delete( pSock );
 	this->erase( this->begin() + iPos );
 }
@@ -2966,8 +3111,13 @@ bool CSocketManager::SwapSockByIdx( Csock *pNewSock, u_long iOrginalSockIdx )
 	Csock *pSock = (*this)[iOrginalSockIdx];
 	pNewSock->Copy( *pSock );
 	pSock->Dereference();
+	// only the new sock can be found from now on, the old one is just waiting to be cleaned up
+	DelSockIndex( pSock );
+	pSock->SetManager( NULL );
 	(*this)[iOrginalSockIdx] = (Csock *)pNewSock;
 	this->push_back( (Csock *)pSock ); // this allows it to get cleaned up
+	pNewSock->SetManager( this );
+	AddSockIndex( pNewSock );
 	return( true );
 }
 
@@ -288,6 +288,7 @@ private:
 };
 
 class Csock;
+class CSocketManager;
 
 /**
  * @brief this function is a wrapper around gethostbyname and getaddrinfo (for ipv6)
@@ -541,6 +542,8 @@ public:
 
 	//! add an FD set to monitor
 	void MonitorFD( CSMonitorFD * pMonitorFD ) { m_vcMonitorFD.push_back( pMonitorFD ); }
+	//! stop monitoring an FD set and delete it, use this if the monitor's code may go away (module unload)
+	void UnMonitorFD( CSMonitorFD * pMonitorFD );
 
 protected:
 	std::vector<CCron *>		m_vcCrons;
@@ -804,6 +807,10 @@ public:
 	const CS_STRING & GetSockName() const;
 	void SetSockName( const CS_STRING & sName );
 
+	//! Returns the manager this sock was added to, or NULL. Set by the manager, don't touch it yourself.
+	CSocketManager * GetManager() const { return( m_pManager ); }
+	void SetManager( CSocketManager * pManager ) { m_pManager = pManager; }
+
 	//! Returns a reference to the host name
 	const CS_STRING & GetHostName() const;
 	void SetHostName( const CS_STRING & sHostname );
@@ -822,6 +829,10 @@ public:
 	unsigned long long GetBytesWritten() const;
 	void ResetBytesWritten();
 
+	//! Accounts for data which was moved without Read()/Write(), e.g. by sendfile()
+	void AddBytesRead( unsigned long long iBytes );
+	void AddBytesWritten( unsigned long long iBytes );
+
 	//! Get Avg Read Speed in sample milliseconds (default is 1000 milliseconds or 1 second)
 	double GetAvgRead( unsigned long long iSample = 1000 );
 
@@ -1130,6 +1141,8 @@ private:
 	CSSockAddr 		m_address, m_bindhost;
 	bool			m_bIsIPv6, m_bSkipConnect;
 	time_t			m_iLastCheckTimeoutTime;
+	// not copied by Copy(), the manager sets it when it takes over a sock
+	CSocketManager *	m_pManager;
 
 #ifdef HAVE_LIBSSL
 	CS_STRING			m_sSSLBuffer;
@@ -1438,9 +1451,18 @@ public:
 	//! returns a pointer to the FIRST sock found by filedescriptor or NULL on no match
 	virtual Csock * FindSockByFD( cs_sock_t iFD );
 
+	/**
+	 * @brief updates the lookup indexes after a sock's name changed
+	 *
+	 * Csock::SetSockName() calls this for socks which were added to a manager,
+	 * there should be no need to call it yourself.
+	 */
+	void ReindexSock( Csock * pcSock );
+
 	virtual std::vector<Csock *> FindSocksByName( const CS_STRING & sName );
 
 	//! returns a vector of pointers to socks with sHostname as being connected
+	//! this isn't indexed (Csock::SetHostName() doesn't tell the manager), it scans all socks
 	virtual std::vector<Csock *> FindSocksByRemoteHost( const CS_STRING & sHostname );
 
 	//! return the last known error as set by this class
@@ -1455,7 +1477,7 @@ public:
 	void  SetSelectTimeout( u_long iTimeout ) { m_iSelectWait = iTimeout; }
 
 	//! Delete a sock by addr
-	//! its position is looked up
+	//! its position is looked up, this is a scan just like the erase from the vector is
 	//! the socket is deleted, the appropriate call backs are peformed
 	//! and its instance is removed from the manager
 	virtual void DelSockByAddr( Csock *pcSock );
@@ -1503,6 +1525,17 @@ protected:
 
 	virtual int Select( std::map< int, short > & miiReadyFds, struct timeval *tvtimeout);
 
+	/**
+	 * @brief called when a sock is added to the lookup indexes, and again after it was renamed
+	 *
+	 * Override these two to keep your own indexes, be sure to call the base class.
+	 * AddSockIndex() is only called for socks which aren't indexed already and
+	 * DelSockIndex() is only called for socks which are.
+	 */
+	virtual void AddSockIndex( Csock * pcSock );
+	//! called before a sock is removed from the lookup indexes, e.g. right before it gets deleted
+	virtual void DelSockIndex( Csock * pcSock );
+
 private:
 	/**
 	* fills a map of socks to a message for check
@@ -1527,6 +1560,16 @@ private:
 	unsigned long long			m_iBytesRead;
 	unsigned long long			m_iBytesWritten;
 	u_long						m_iSelectWait;
+
+	// The name of every indexed sock, as it was indexed
+	std::map<Csock *, CS_STRING>		m_mSockNames;
+	std::multimap<CS_STRING, Csock *>	m_mmSocksByName;
+	// A cache, entries are checked before they are used and FindSockByFD() falls back to a full scan
+	std::map<cs_sock_t, Csock *>		m_mSocksByFD;
+	std::map<Csock *, cs_sock_t>		m_mSockFDs;
+
+	void AddFDIndex( Csock * pcSock );
+	void DelFDIndex( Csock * pcSock );
 };
 
 /**
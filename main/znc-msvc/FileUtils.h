@@ -118,6 +118,8 @@ public:
 	bool UnLock();
 
 	bool IsOpen() const;
+	//! The underlying file descriptor, -1 if the file isn't open
+	int GetFD() const { return m_iFD; }
 	CString GetLongName() const;
 	CString GetShortName() const;
 	CString GetDir() const;
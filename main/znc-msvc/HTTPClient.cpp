@@ -0,0 +1,710 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "HTTPClient.h"
+#include "Modules.h"
+#include "znc.h"
+
+// status line and header lines longer than this are considered broken
+#define MAX_HEADER_LINE	16 * 1024
+
+/////////////////// CHTTPRequest ///////////////////
+CHTTPRequest::CHTTPRequest() {
+	m_sMethod = "GET";
+	m_uPort = 80;
+	m_sPath = "/";
+	m_bSSL = false;
+	m_uMaxResponseSize = 1024 * 1024;
+	m_uMaxRedirects = 5;
+	m_uRedirects = 0;
+	m_bBufferBody = true;
+	m_bRetried = false;
+	m_bURLValid = false;
+}
+
+CHTTPRequest::~CHTTPRequest() {}
+
+bool CHTTPRequest::SetURL(const CString& sURL) {
+	m_bURLValid = CrackURL(sURL, m_sHost, m_uPort, m_sPath, m_bSSL);
+
+	return m_bURLValid;
+}
+
+void CHTTPRequest::SetBody(const CString& sBody, const CString& sContentType) {
+	m_sBody = sBody;
+
+	if (!sContentType.empty()) {
+		m_msHeaders["Content-Type"] = sContentType;
+	}
+}
+
+void CHTTPRequest::SetPostData(const MCString& mPostData) {
+	CString sPostData;
+
+	for (MCString::const_iterator it = mPostData.begin(); it != mPostData.end(); ++it) {
+		if (it != mPostData.begin()) sPostData += "&";
+		sPostData += URLEscape(it->first) + "=" + URLEscape(it->second);
+	}
+
+	m_sMethod = "POST";
+	SetBody(sPostData, "application/x-www-form-urlencoded");
+}
+
+CString CHTTPRequest::GetConnectionKey() const {
+	return CString(m_bSSL ? "https://" : "http://") + m_sHost.AsLower() + ":" + CString(m_uPort);
+}
+
+CString CHTTPRequest::MakeRequest() const {
+	CString sRequest = m_sMethod + " " + m_sPath + " HTTP/1.1\r\n";
+	bool bDefaultPort = (m_bSSL ? m_uPort == 443 : m_uPort == 80);
+
+	sRequest += "Host: " + m_sHost + (bDefaultPort ? CString("") : ":" + CString(m_uPort)) + "\r\n";
+
+	if (m_msHeaders.find("User-Agent") == m_msHeaders.end()) {
+		sRequest += "User-Agent: " + CZNC::GetTag() + "\r\n";
+	}
+
+	for (MCString::const_iterator it = m_msHeaders.begin(); it != m_msHeaders.end(); ++it) {
+		sRequest += it->first + ": " + it->second + "\r\n";
+	}
+
+	if (!m_sBody.empty() || m_sMethod.Equals("POST") || m_sMethod.Equals("PUT")) {
+		sRequest += "Content-Length: " + CString(m_sBody.size()) + "\r\n";
+	}
+
+	sRequest += "\r\n";
+	sRequest += m_sBody;
+
+	return sRequest;
+}
+
+bool CHTTPRequest::Redirect(unsigned int uStatus, const CString& sLocation) {
+	const CString sOldKey = GetConnectionKey();
+
+	if (m_uRedirects >= m_uMaxRedirects || sLocation.empty()) {
+		return false;
+	}
+
+	if (sLocation.Left(1) == "/") {
+		// relative to the current host, "//host/path" would be relative to
+		// the scheme only and isn't supported
+		if (sLocation.Left(2) == "//" || !IsValidPath(sLocation)) {
+			return false;
+		}
+
+		m_sPath = sLocation;
+	} else if (!SetURL(sLocation)) {
+		return false;
+	}
+
+	// Credentials were meant for the old host, don't hand them to another
+	// one or send them over plain http after an https request
+	if (GetConnectionKey() != sOldKey) {
+		MCString::iterator it = m_msHeaders.begin();
+
+		while (it != m_msHeaders.end()) {
+			if (it->first.Equals("Authorization") || it->first.Equals("Proxy-Authorization") || it->first.Equals("Cookie")) {
+				m_msHeaders.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	if (uStatus == 303 || ((uStatus == 301 || uStatus == 302) && m_sMethod.Equals("POST"))) {
+		m_sMethod = "GET";
+		m_sBody.clear();
+		m_msHeaders.erase("Content-Type");
+	}
+
+	m_uRedirects++;
+	m_bRetried = false;
+
+	return true;
+}
+
+bool CHTTPRequest::CrackURL(const CString& sURL, CString& sHost, unsigned short& uPort, CString& sPath, bool& bSSL) {
+	// Only touch the output arguments once the whole URL checked out
+	CString sWork(sURL);
+	CString sNewHost, sNewPath;
+	unsigned short uNewPort;
+	bool bNewSSL;
+
+	if (sWork.Left(7).Equals("http://")) {
+		bNewSSL = false;
+		uNewPort = 80;
+		sWork.erase(0, 7);
+	} else if (sWork.Left(8).Equals("https://")) {
+		bNewSSL = true;
+		uNewPort = 443;
+		sWork.erase(0, 8);
+	} else {
+		return false;
+	}
+
+	CString::size_type uPos = sWork.find('/');
+
+	if (uPos == CString::npos) {
+		sNewHost = sWork;
+		sNewPath = "/";
+	} else {
+		sNewHost = sWork.substr(0, uPos);
+		sNewPath = sWork.substr(uPos);
+	}
+
+	uPos = sNewHost.find(':');
+
+	if (uPos != CString::npos) {
+		unsigned int uTmp = CString(sNewHost.substr(uPos + 1)).ToUInt();
+
+		if (uTmp == 0 || uTmp > 65535) {
+			return false;
+		}
+
+		uNewPort = (unsigned short)uTmp;
+		sNewHost = sNewHost.substr(0, uPos);
+	}
+
+	if (sNewHost.empty()) {
+		return false;
+	}
+
+	for (CString::size_type p = 0; p < sNewHost.size(); p++) {
+		if (!isalnum((unsigned char)sNewHost[p]) && sNewHost[p] != '.' && sNewHost[p] != '-') {
+			return false;
+		}
+	}
+
+	if (!IsValidPath(sNewPath)) {
+		return false;
+	}
+
+	sHost = sNewHost;
+	uPort = uNewPort;
+	sPath = sNewPath;
+	bSSL = bNewSSL;
+
+	return true;
+}
+
+bool CHTTPRequest::IsValidPath(const CString& sPath) {
+	// These would end up in (or break) the request line
+	for (CString::size_type p = 0; p < sPath.size(); p++) {
+		if (sPath[p] == '\0' || sPath[p] == '\n' || sPath[p] == '\r' || sPath[p] == ' ') {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+CString CHTTPRequest::URLEscape(const CString& s) {
+	return s.Escape_n(CString::EASCII, CString::EURL).Replace_n("+", "%20");
+}
+/////////////////// !CHTTPRequest ///////////////////
+
+/////////////////// CHTTPClientSock ///////////////////
+CHTTPClientSock::CHTTPClientSock(CHTTPClient* pClient, const CString& sKey) : CSocket(pClient->GetModule()) {
+	m_pClient = pClient;
+	m_sKey = sKey;
+	m_pRequest = NULL;
+	m_bConnected = false;
+	m_bReused = false;
+	m_eState = ST_IDLE;
+	m_uStatus = 0;
+	m_uBodySize = 0;
+	m_uRemaining = 0;
+	m_bKeepAlive = false;
+	m_bRedirect = false;
+	m_bGotData = false;
+
+	// we do our own framing, the body may be binary
+	DisableReadLine();
+	SetMaxBufferThreshold(0);
+}
+
+CHTTPClientSock::~CHTTPClientSock() {
+	if (m_pClient) {
+		m_pClient->SockGone(this);
+
+		if (m_pRequest) {
+			Abandon();
+		}
+	}
+}
+
+void CHTTPClientSock::Start(CHTTPRequest* pRequest) {
+	m_pRequest = pRequest;
+	m_bReused = m_bConnected;
+	m_eState = ST_STATUS;
+	m_sBuffer.clear();
+	m_uStatus = 0;
+	m_msHeaders.clear();
+	m_sBody.clear();
+	m_uBodySize = 0;
+	m_uRemaining = 0;
+	m_bKeepAlive = false;
+	m_bRedirect = false;
+	m_bGotData = false;
+
+	SetTimeout(m_pClient->GetRequestTimeout());
+
+	if (m_bConnected) {
+		Write(m_pRequest->MakeRequest());
+	}
+}
+
+void CHTTPClientSock::Connected() {
+	m_bConnected = true;
+
+	if (m_pRequest) {
+		Write(m_pRequest->MakeRequest());
+	}
+}
+
+void CHTTPClientSock::Disconnected() {
+	m_bConnected = false;
+
+	if (!m_pRequest) {
+		return;
+	}
+
+	if (m_eState == ST_BODY_UNTIL_CLOSE) {
+		Finish();
+	} else {
+		Abandon();
+	}
+}
+
+void CHTTPClientSock::Timeout() {
+	if (m_pRequest) {
+		Fail(CHTTPRequest::ERR_TIMEOUT);
+	} else {
+		// idle keep-alive connection, nobody needs to know
+		m_bConnected = false;
+		Close();
+	}
+}
+
+void CHTTPClientSock::ReadData(const char* data, size_t len) {
+	if (!m_pRequest) {
+		// nothing is expected on an idle connection
+		m_bConnected = false;
+		Close();
+		return;
+	}
+
+	m_bGotData = true;
+	m_sBuffer.append(data, len);
+
+	ProcessBuffer();
+}
+
+bool CHTTPClientSock::GetLine(CString& sLine) {
+	CString::size_type uPos = m_sBuffer.find('\n');
+
+	if (uPos == CString::npos) {
+		if (m_sBuffer.size() > MAX_HEADER_LINE) {
+			Fail(CHTTPRequest::ERR_PROTOCOL);
+		}
+
+		return false;
+	}
+
+	sLine = m_sBuffer.substr(0, uPos);
+	m_sBuffer.erase(0, uPos + 1);
+	sLine.TrimRight("\r");
+
+	return true;
+}
+
+bool CHTTPClientSock::ProcessBuffer() {
+	CString sLine;
+
+	while (m_pRequest) {
+		switch (m_eState) {
+		case ST_STATUS:
+			if (!GetLine(sLine)) return false;
+			if (sLine.empty()) continue;
+
+			if (sLine.Left(5) != "HTTP/" || sLine.Token(1).ToUInt() < 100) {
+				Fail(CHTTPRequest::ERR_PROTOCOL);
+				return false;
+			}
+
+			m_uStatus = sLine.Token(1).ToUInt();
+			m_bKeepAlive = !sLine.Token(0).Equals("HTTP/1.0");
+			m_eState = ST_HEADERS;
+			break;
+		case ST_HEADERS:
+			if (!GetLine(sLine)) return false;
+
+			if (sLine.empty()) {
+				if (!HeadersDone()) return false;
+			} else {
+				CString sName = sLine.Token(0, false, ":").Trim_n().AsLower();
+				CString sValue = sLine.Token(1, true, ":").Trim_n();
+				MCString::iterator it = m_msHeaders.find(sName);
+
+				if (it == m_msHeaders.end()) {
+					m_msHeaders[sName] = sValue;
+				} else {
+					it->second += ", " + sValue;
+				}
+			}
+			break;
+		case ST_BODY_LENGTH:
+		case ST_CHUNK_DATA:
+			{
+				if (m_sBuffer.empty()) return false;
+
+				size_t uLen = (size_t)std::min<unsigned long long>(m_uRemaining, m_sBuffer.size());
+				if (!DeliverBody(m_sBuffer.data(), uLen)) return false;
+
+				m_sBuffer.erase(0, uLen);
+				m_uRemaining -= uLen;
+
+				if (m_uRemaining == 0) {
+					if (m_eState == ST_CHUNK_DATA) {
+						m_eState = ST_CHUNK_END;
+					} else {
+						Finish();
+						return true;
+					}
+				}
+			}
+			break;
+		case ST_CHUNK_SIZE:
+			if (!GetLine(sLine)) return false;
+
+			// chunk extensions are ignored
+			sLine = sLine.Token(0, false, ";").Trim_n();
+
+			if (sLine.empty() || sLine.find_first_not_of("0123456789abcdefABCDEF") != CString::npos) {
+				Fail(CHTTPRequest::ERR_PROTOCOL);
+				return false;
+			}
+
+			m_uRemaining = strtoull(sLine.c_str(), NULL, 16);
+			m_eState = (m_uRemaining == 0 ? ST_TRAILER : ST_CHUNK_DATA);
+			break;
+		case ST_CHUNK_END:
+			if (!GetLine(sLine)) return false;
+
+			if (!sLine.empty()) {
+				Fail(CHTTPRequest::ERR_PROTOCOL);
+				return false;
+			}
+
+			m_eState = ST_CHUNK_SIZE;
+			break;
+		case ST_TRAILER:
+			if (!GetLine(sLine)) return false;
+
+			if (sLine.empty()) {
+				Finish();
+				return true;
+			}
+			break;
+		case ST_BODY_UNTIL_CLOSE:
+			if (!m_sBuffer.empty() && DeliverBody(m_sBuffer.data(), m_sBuffer.size())) {
+				m_sBuffer.clear();
+			}
+			return false;
+		case ST_IDLE:
+			return false;
+		}
+	}
+
+	return false;
+}
+
+bool CHTTPClientSock::HeadersDone() {
+	if (m_uStatus < 200) {
+		// interim response (100 Continue and friends), the real one follows
+		m_msHeaders.clear();
+		m_eState = ST_STATUS;
+		return true;
+	}
+
+	MCString::const_iterator it = m_msHeaders.find("connection");
+	if (it != m_msHeaders.end()) {
+		CString sConnection = it->second.AsLower();
+
+		if (sConnection.find("close") != CString::npos) {
+			m_bKeepAlive = false;
+		} else if (sConnection.find("keep-alive") != CString::npos) {
+			m_bKeepAlive = true;
+		}
+	}
+
+	m_bRedirect = (m_uStatus == 301 || m_uStatus == 302 || m_uStatus == 303 || m_uStatus == 307 || m_uStatus == 308)
+		&& m_msHeaders.find("location") != m_msHeaders.end() && m_pRequest->m_uMaxRedirects > 0;
+
+	if (!m_bRedirect) {
+		m_pRequest->OnResponseHeaders(m_uStatus, m_msHeaders);
+	}
+
+	if (m_pRequest->GetMethod().Equals("HEAD") || m_uStatus == 204 || m_uStatus == 304) {
+		Finish();
+		return false;
+	}
+
+	it = m_msHeaders.find("transfer-encoding");
+	if (it != m_msHeaders.end() && it->second.AsLower().find("chunked") != CString::npos) {
+		m_eState = ST_CHUNK_SIZE;
+		return true;
+	}
+
+	it = m_msHeaders.find("content-length");
+	if (it != m_msHeaders.end()) {
+		m_uRemaining = it->second.ToULongLong();
+		size_t uMax = m_pRequest->GetMaxResponseSize();
+
+		if (uMax > 0 && m_uRemaining > uMax) {
+			Fail(CHTTPRequest::ERR_TOOLARGE);
+			return false;
+		}
+
+		if (m_uRemaining == 0) {
+			Finish();
+			return false;
+		}
+
+		m_eState = ST_BODY_LENGTH;
+		return true;
+	}
+
+	// no framing information, the body ends with the connection
+	m_bKeepAlive = false;
+	m_eState = ST_BODY_UNTIL_CLOSE;
+
+	return true;
+}
+
+bool CHTTPClientSock::DeliverBody(const char* pData, size_t uLen) {
+	size_t uMax = m_pRequest->GetMaxResponseSize();
+	m_uBodySize += uLen;
+
+	if (uMax > 0 && m_uBodySize > uMax) {
+		Fail(CHTTPRequest::ERR_TOOLARGE);
+		return false;
+	}
+
+	if (m_bRedirect) {
+		// the body of a redirect is of no interest
+		return true;
+	}
+
+	if (!m_pRequest->OnBodyData(pData, uLen)) {
+		Fail(CHTTPRequest::ERR_ABORTED);
+		return false;
+	}
+
+	if (m_pRequest->GetBufferBody()) {
+		m_sBody.append(pData, uLen);
+	}
+
+	return true;
+}
+
+void CHTTPClientSock::Finish() {
+	CHTTPRequest* pRequest = m_pRequest;
+	unsigned int uStatus = m_uStatus;
+	bool bRedirect = m_bRedirect;
+	MCString msHeaders;
+	CString sBody;
+
+	msHeaders.swap(m_msHeaders);
+	sBody.swap(m_sBody);
+
+	m_pRequest = NULL;
+	m_eState = ST_IDLE;
+	m_sBuffer.clear();
+
+	// hand the connection back before running any callbacks, they
+	// might well want to issue the next request to the same host.
+	if (m_bKeepAlive && m_bConnected) {
+		SetTimeout(m_pClient->GetIdleTimeout());
+		m_pClient->SockIdle(this);
+	} else {
+		m_bConnected = false;
+		Close();
+	}
+
+	if (bRedirect) {
+		if (pRequest->Redirect(uStatus, msHeaders["location"])) {
+			m_pClient->Request(pRequest);
+			return;
+		}
+
+		pRequest->OnRequestError(CHTTPRequest::ERR_REDIRECT);
+	} else {
+		pRequest->OnRequestDone(uStatus, msHeaders, sBody);
+	}
+
+	delete pRequest;
+}
+
+void CHTTPClientSock::Fail(int iErrorCode) {
+	CHTTPRequest* pRequest = m_pRequest;
+
+	m_pRequest = NULL;
+	m_eState = ST_IDLE;
+	m_bConnected = false;
+	Close();
+
+	pRequest->OnRequestError(iErrorCode);
+	delete pRequest;
+}
+
+void CHTTPClientSock::Abandon() {
+	CHTTPRequest* pRequest = m_pRequest;
+
+	m_pRequest = NULL;
+	m_eState = ST_IDLE;
+
+	// A kept alive connection may have been closed by the server just
+	// before we sent the request. That's not an error, try once more.
+	if (m_bReused && !m_bGotData && !pRequest->m_bRetried) {
+		pRequest->m_bRetried = true;
+		m_pClient->Request(pRequest);
+		return;
+	}
+
+	pRequest->OnRequestError(CHTTPRequest::ERR_CONNECT);
+	delete pRequest;
+}
+/////////////////// !CHTTPClientSock ///////////////////
+
+/////////////////// CHTTPClient ///////////////////
+CHTTPClient::CHTTPClient(CModule* pModule) {
+	m_pModule = pModule;
+	m_uMaxConnsPerHost = 2;
+	m_uIdleTimeout = 60;
+	m_uRequestTimeout = 60;
+}
+
+CHTTPClient::~CHTTPClient() {
+	// Our owner is going away, so are its sockets. Don't call back into it.
+	for (map<CString, set<CHTTPClientSock*> >::iterator it = m_mSocks.begin(); it != m_mSocks.end(); ++it) {
+		for (set<CHTTPClientSock*>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+			CHTTPClientSock* pSock = *it2;
+
+			delete pSock->m_pRequest;
+			pSock->m_pRequest = NULL;
+			pSock->m_pClient = NULL;
+			pSock->Close();
+		}
+	}
+
+	for (map<CString, std::deque<CHTTPRequest*> >::iterator it = m_mQueued.begin(); it != m_mQueued.end(); ++it) {
+		for (std::deque<CHTTPRequest*>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+			delete *it2;
+		}
+	}
+}
+
+void CHTTPClient::Request(CHTTPRequest* pRequest) {
+	// No URL was set or the last SetURL() failed
+	if (!pRequest->m_bURLValid) {
+		pRequest->OnRequestError(CHTTPRequest::ERR_CONNECT);
+		delete pRequest;
+		return;
+	}
+
+	CString sKey = pRequest->GetConnectionKey();
+
+	m_mQueued[sKey].push_back(pRequest);
+	Dispatch(sKey);
+}
+
+void CHTTPClient::Dispatch(const CString& sKey) {
+	map<CString, std::deque<CHTTPRequest*> >::iterator itQueue = m_mQueued.find(sKey);
+
+	if (itQueue == m_mQueued.end()) {
+		return;
+	}
+
+	std::deque<CHTTPRequest*>& vQueue = itQueue->second;
+	set<CHTTPClientSock*>& ssSocks = m_mSocks[sKey];
+
+	while (!vQueue.empty()) {
+		CHTTPClientSock* pSock = NULL;
+
+		for (set<CHTTPClientSock*>::const_iterator it = ssSocks.begin(); it != ssSocks.end(); ++it) {
+			if ((*it)->IsIdle()) {
+				pSock = *it;
+				break;
+			}
+		}
+
+		CHTTPRequest* pRequest = vQueue.front();
+
+		if (!pSock) {
+			if (ssSocks.size() >= m_uMaxConnsPerHost) {
+				break;
+			}
+
+			pSock = new CHTTPClientSock(this, sKey);
+			ssSocks.insert(pSock);
+			pSock->Connect(pRequest->GetHost(), pRequest->GetPort(), pRequest->IsSSL(), m_uRequestTimeout);
+		}
+
+		vQueue.pop_front();
+		pSock->Start(pRequest);
+	}
+
+	if (vQueue.empty()) {
+		m_mQueued.erase(itQueue);
+	}
+
+	if (ssSocks.empty()) {
+		m_mSocks.erase(sKey);
+	}
+}
+
+void CHTTPClient::SockIdle(CHTTPClientSock* pSock) {
+	Dispatch(pSock->GetKey());
+}
+
+void CHTTPClient::SockGone(CHTTPClientSock* pSock) {
+	map<CString, set<CHTTPClientSock*> >::iterator it = m_mSocks.find(pSock->GetKey());
+
+	if (it != m_mSocks.end()) {
+		it->second.erase(pSock);
+
+		if (it->second.empty()) {
+			m_mSocks.erase(it);
+		}
+	}
+
+	Dispatch(pSock->GetKey());
+}
+
+size_t CHTTPClient::GetConnectionCount() const {
+	size_t uCount = 0;
+
+	for (map<CString, set<CHTTPClientSock*> >::const_iterator it = m_mSocks.begin(); it != m_mSocks.end(); ++it) {
+		uCount += it->second.size();
+	}
+
+	return uCount;
+}
+
+size_t CHTTPClient::GetQueuedCount() const {
+	size_t uCount = 0;
+
+	for (map<CString, std::deque<CHTTPRequest*> >::const_iterator it = m_mQueued.begin(); it != m_mQueued.end(); ++it) {
+		uCount += it->second.size();
+	}
+
+	return uCount;
+}
+/////////////////// !CHTTPClient ///////////////////
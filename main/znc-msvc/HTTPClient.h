@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _HTTPCLIENT_H
+#define _HTTPCLIENT_H
+
+#include "zncconfig.h"
+#include "Socket.h"
+#include <deque>
+
+class CModule;
+class CHTTPClient;
+class CHTTPClientSock;
+
+/**
+ * @class CHTTPRequest
+ * @brief An outgoing HTTP/1.1 request, to be run through a CHTTPClient.
+ *
+ * Subclass this and override OnRequestDone() and OnRequestError(). Once
+ * handed to CHTTPClient::Request() the client owns the instance and deletes
+ * it right after exactly one of those two hooks has been called.
+ *
+ * Response header names are passed in lower case.
+ */
+class ZNC_API CHTTPRequest {
+public:
+	enum EError {
+		ERR_CONNECT  = -1, //!< Could not connect or the connection broke down
+		ERR_TIMEOUT  = -2, //!< The server did not answer in time
+		ERR_PROTOCOL = -3, //!< The response could not be parsed
+		ERR_TOOLARGE = -4, //!< The response body exceeded SetMaxResponseSize()
+		ERR_REDIRECT = -5, //!< Too many or invalid redirects
+		ERR_ABORTED  = -6  //!< OnBodyData() returned false
+	};
+
+	CHTTPRequest();
+	virtual ~CHTTPRequest();
+
+	/** Sets scheme, host, port and path from an http:// or https:// URL.
+	 *  @return false if the URL could not be parsed. The request then fails
+	 *          with ERR_CONNECT until a valid URL is set.
+	 */
+	bool SetURL(const CString& sURL);
+	void SetMethod(const CString& sMethod) { m_sMethod = sMethod; }
+	void AddHeader(const CString& sName, const CString& sValue) { m_msHeaders[sName] = sValue; }
+	void SetBody(const CString& sBody, const CString& sContentType);
+	//! Sends mPostData as application/x-www-form-urlencoded and switches to POST.
+	void SetPostData(const MCString& mPostData);
+	//! Responses with a larger body fail with ERR_TOOLARGE, 0 means unlimited.
+	void SetMaxResponseSize(size_t uBytes) { m_uMaxResponseSize = uBytes; }
+	void SetMaxRedirects(unsigned int uRedirects) { m_uMaxRedirects = uRedirects; }
+	//! If disabled, the body is only passed to OnBodyData() and not collected for OnRequestDone().
+	void SetBufferBody(bool b) { m_bBufferBody = b; }
+
+	const CString& GetMethod() const { return m_sMethod; }
+	const CString& GetHost() const { return m_sHost; }
+	unsigned short GetPort() const { return m_uPort; }
+	const CString& GetPath() const { return m_sPath; }
+	bool IsSSL() const { return m_bSSL; }
+	size_t GetMaxResponseSize() const { return m_uMaxResponseSize; }
+	bool GetBufferBody() const { return m_bBufferBody; }
+	//! Requests with the same key can share a connection.
+	CString GetConnectionKey() const;
+
+	// Hooks
+	//! Called once the status line and all headers have been received.
+	virtual void OnResponseHeaders(unsigned int uStatus, const MCString& msHeaders) {}
+	//! Called for every piece of the (de-chunked) body as it arrives, return false to abort.
+	virtual bool OnBodyData(const char* pData, size_t uLen) { return true; }
+	virtual void OnRequestDone(unsigned int uStatus, const MCString& msHeaders, const CString& sBody) = 0;
+	virtual void OnRequestError(int iErrorCode) = 0;
+	// !Hooks
+
+	static bool CrackURL(const CString& sURL, CString& sHost, unsigned short& uPort, CString& sPath, bool& bSSL);
+	static CString URLEscape(const CString& s);
+
+private:
+	friend class CHTTPClient;
+	friend class CHTTPClientSock;
+
+	CString MakeRequest() const;
+	static bool IsValidPath(const CString& sPath);
+	bool Redirect(unsigned int uStatus, const CString& sLocation);
+
+	CString      m_sMethod;
+	CString      m_sHost;
+	unsigned short m_uPort;
+	CString      m_sPath;
+	bool         m_bSSL;
+	MCString     m_msHeaders;
+	CString      m_sBody;
+	size_t       m_uMaxResponseSize;
+	unsigned int m_uMaxRedirects;
+	unsigned int m_uRedirects;
+	bool         m_bBufferBody;
+	bool         m_bRetried;
+	bool         m_bURLValid;
+};
+
+/**
+ * @class CHTTPClientSock
+ * @brief A (possibly kept alive) connection owned by a CHTTPClient.
+ *
+ * You never need to create these yourself.
+ */
+class ZNC_API CHTTPClientSock : public CSocket {
+public:
+	CHTTPClientSock(CHTTPClient* pClient, const CString& sKey);
+	virtual ~CHTTPClientSock();
+
+	// Csocket derived members
+	virtual void ReadData(const char* data, size_t len);
+	virtual void Connected();
+	virtual void Disconnected();
+	virtual void Timeout();
+	// !Csocket derived members
+
+	void Start(CHTTPRequest* pRequest);
+	bool IsIdle() const { return m_bConnected && !m_pRequest; }
+	const CString& GetKey() const { return m_sKey; }
+
+private:
+	friend class CHTTPClient;
+
+	enum EState {
+		ST_IDLE,
+		ST_STATUS,
+		ST_HEADERS,
+		ST_BODY_LENGTH,
+		ST_CHUNK_SIZE,
+		ST_CHUNK_DATA,
+		ST_CHUNK_END,
+		ST_TRAILER,
+		ST_BODY_UNTIL_CLOSE
+	};
+
+	bool ProcessBuffer();
+	bool GetLine(CString& sLine);
+	bool HeadersDone();
+	bool DeliverBody(const char* pData, size_t uLen);
+	void Finish();
+	void Fail(int iErrorCode);
+	void Abandon();
+
+	CHTTPClient*    m_pClient;
+	CString         m_sKey;
+	CHTTPRequest*   m_pRequest;
+	bool            m_bConnected;
+	bool            m_bReused;
+	EState          m_eState;
+	CString         m_sBuffer;
+	unsigned int    m_uStatus;
+	MCString        m_msHeaders;
+	CString         m_sBody;
+	size_t          m_uBodySize;
+	unsigned long long m_uRemaining;
+	bool            m_bKeepAlive;
+	bool            m_bRedirect;
+	bool            m_bGotData;
+};
+
+/**
+ * @class CHTTPClient
+ * @brief Asynchronous HTTP/1.1 client with per-host keep-alive connection pools.
+ *
+ * Usually a member of a module:
+ * @code
+ * CHTTPClient m_HTTP; // initialized with m_HTTP(this) in the module's constructor
+ * ...
+ * CMyRequest* pReq = new CMyRequest(this);
+ * pReq->SetURL("https://example.com/feed.xml");
+ * m_HTTP.Request(pReq);
+ * @endcode
+ * Requests to the same scheme/host/port share up to GetMaxConnsPerHost()
+ * connections, everything beyond that is queued. Idle connections are
+ * closed after GetIdleTimeout() seconds.
+ */
+class ZNC_API CHTTPClient {
+public:
+	CHTTPClient(CModule* pModule);
+	~CHTTPClient();
+
+	//! Queues pRequest and takes ownership of it.
+	void Request(CHTTPRequest* pRequest);
+
+	// Setters
+	void SetMaxConnsPerHost(unsigned int u) { m_uMaxConnsPerHost = (u > 0 ? u : 1); }
+	void SetIdleTimeout(unsigned int u) { m_uIdleTimeout = u; }
+	void SetRequestTimeout(unsigned int u) { m_uRequestTimeout = u; }
+	// !Setters
+
+	// Getters
+	CModule* GetModule() const { return m_pModule; }
+	unsigned int GetMaxConnsPerHost() const { return m_uMaxConnsPerHost; }
+	unsigned int GetIdleTimeout() const { return m_uIdleTimeout; }
+	unsigned int GetRequestTimeout() const { return m_uRequestTimeout; }
+	size_t GetConnectionCount() const;
+	size_t GetQueuedCount() const;
+	// !Getters
+
+private:
+	friend class CHTTPClientSock;
+
+	void Dispatch(const CString& sKey);
+	void SockIdle(CHTTPClientSock* pSock);
+	void SockGone(CHTTPClientSock* pSock);
+
+	CModule*                                   m_pModule;
+	map<CString, std::deque<CHTTPRequest*> >   m_mQueued;
+	map<CString, set<CHTTPClientSock*> >       m_mSocks;
+	unsigned int                               m_uMaxConnsPerHost;
+	unsigned int                               m_uIdleTimeout;
+	unsigned int                               m_uRequestTimeout;
+};
+
+#endif // !_HTTPCLIENT_H
@@ -105,6 +105,8 @@ void CHTTPSock::ReadLine(const CString& sData) {
 			m_msRequestCookies[s.Token(0, false, "=").Escape_n(CString::EURL, CString::EASCII)] =
 				s.Token(1, true, "=").Escape_n(CString::EURL, CString::EASCII);
 		}
+	} else if (sName.Equals("Authorization:") && sLine.Token(1).Equals("Bearer")) {
+		m_sBearerToken = sLine.Token(2);
 	} else if (sName.Equals("Authorization:")) {
 		CString sUnhashed;
 		sLine.Token(2).Base64Decode(sUnhashed);
@@ -68,6 +68,8 @@ public:
 	const CString& GetDocRoot() const;
 	const CString& GetUser() const;
 	const CString& GetPass() const;
+	//! From an "Authorization: Bearer" header, used instead of a login by e.g. /metrics
+	const CString& GetBearerToken() const { return m_sBearerToken; }
 	const CString& GetParamString() const;
 	const CString& GetContentType() const;
 	bool IsPost() const;
@@ -101,6 +103,7 @@ protected:
 	CString                  m_sURI;
 	CString                  m_sUser;
 	CString                  m_sPass;
+	CString                  m_sBearerToken;
 	CString                  m_sContentType;
 	CString                  m_sDocRoot;
 	map<CString, VCString>   m_msvsPOSTParams;
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "Handoff.h"
+#include "Client.h"
+#include "FileUtils.h"
+#include "IRCSock.h"
+#include "User.h"
+#include "znc.h"
+
+bool CHandoff::Save(unsigned long uPid, CString& sError) {
+	const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+	vector<Csock*> vpSocks;
+	MCString msState;
+	CString sUsers;
+
+	for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+		CUser* pUser = it->second;
+		CIRCSock* pIRCSock = pUser->GetIRCSock();
+		const CString sPrefix = pUser->GetUserName() + "/";
+		unsigned int uClients = 0;
+		bool bIRC = false;
+
+		if (pIRCSock && pIRCSock->IsAuthed() && CanHandOff(pIRCSock)
+				&& ExportSocket(pIRCSock, uPid, msState, sPrefix + "irc/")) {
+			pIRCSock->SaveState(msState, sPrefix + "irc/");
+			pUser->SaveState(msState, sPrefix);
+			vpSocks.push_back(pIRCSock);
+			bIRC = true;
+		}
+
+		// If the IRC connection is closed, the clients would still think
+		// they are in the channels the new process joins again.
+		if (bIRC || !pUser->IsIRCConnected()) {
+			vector<CClient*>& vClients = pUser->GetClients();
+
+			for (unsigned int a = 0; a < vClients.size(); a++) {
+				CClient* pClient = vClients[a];
+				const CString sClient = sPrefix + "client/" + CString(uClients) + "/";
+
+				if (CanHandOff(pClient) && ExportSocket(pClient, uPid, msState, sClient)) {
+					pClient->SaveState(msState, sClient);
+					vpSocks.push_back(pClient);
+					uClients++;
+				}
+			}
+		}
+
+		if (bIRC || uClients) {
+			msState[sPrefix + "clients"] = CString(uClients);
+			sUsers += (sUsers.empty() ? "" : " ") + pUser->GetUserName();
+		}
+	}
+
+	if (vpSocks.empty()) {
+		return true;
+	}
+
+	msState["users"] = sUsers;
+
+	const CString sFile = GetStateFile();
+	const CString sTmp = sFile + ".tmp";
+
+	// On Windows the new process already owns the duplicated sockets. If
+	// this fails, they stay unused there until the server times them out.
+	// The buffers in there are as private as the config, hence 0600.
+	if (msState.WriteToDisk(sTmp, 0600) != MCString::MCS_SUCCESS || !CFile::Move(sTmp, sFile, true)) {
+		CFile::Delete(sTmp);
+		sError = "Could not write [" + sFile + "]";
+		return false;
+	}
+
+	for (vector<Csock*>::const_iterator it = vpSocks.begin(); it != vpSocks.end(); ++it) {
+		DetachSocket(*it);
+	}
+
+	DEBUG("Handed off " << vpSocks.size() << " connections to [" << uPid << "]");
+
+	return true;
+}
+
+bool CHandoff::WaitForProcess(unsigned long uPid, unsigned int uTimeout) {
+	HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, uPid);
+
+	if (!hProcess) {
+		// It's already gone
+		return true;
+	}
+
+	DWORD dwRet = WaitForSingleObject(hProcess, uTimeout * 1000);
+	CloseHandle(hProcess);
+
+	return (dwRet == WAIT_OBJECT_0);
+}
+
+bool CHandoff::Load(CString& sError) {
+	const CString sFile = GetStateFile();
+	MCString msState;
+
+	if (!CFile::Exists(sFile)) {
+		sError = "The old process didn't hand off any connections";
+		return false;
+	}
+
+	MCString::status_t eStatus = msState.ReadFromDisk(sFile);
+
+	// Never take over the same sockets twice
+	CFile::Delete(sFile);
+
+	if (eStatus != MCString::MCS_SUCCESS) {
+		sError = "Could not read [" + sFile + "]";
+		return false;
+	}
+
+	// The buffered data is only replayed after all the state is back
+	vector<pair<Csock*, CString> > vSocks;
+	unsigned int uIRC = 0;
+	unsigned int uClients = 0;
+	VCString vsUsers;
+
+	GetValue(msState, "users").Split(" ", vsUsers, false);
+
+	for (VCString::const_iterator it = vsUsers.begin(); it != vsUsers.end(); ++it) {
+		CUser* pUser = CZNC::Get().FindUser(*it);
+		const CString sPrefix = *it + "/";
+
+		if (msState.find(sPrefix + "irc/sock") != msState.end()) {
+			cs_sock_t iSock = ImportSocket(msState, sPrefix + "irc/");
+
+			if (iSock != CS_INVALID_SOCK && (!pUser || pUser->GetIRCSock())) {
+				// This user was deleted from the config
+				closesocket(iSock);
+			} else if (iSock != CS_INVALID_SOCK) {
+				CIRCSock* pIRCSock = new CIRCSock(pUser);
+
+				AddSocket(pIRCSock, iSock, Csock::OUTBOUND, msState, sPrefix + "irc/", "IRC::" + pUser->GetUserName());
+				pIRCSock->LoadState(msState, sPrefix + "irc/");
+				pUser->LoadState(msState, sPrefix);
+				vSocks.push_back(make_pair((Csock*) pIRCSock, sPrefix + "irc/"));
+				uIRC++;
+			}
+		}
+
+		unsigned int uCount = GetValue(msState, sPrefix + "clients").ToUInt();
+
+		for (unsigned int a = 0; a < uCount; a++) {
+			const CString sClient = sPrefix + "client/" + CString(a) + "/";
+			cs_sock_t iSock = ImportSocket(msState, sClient);
+
+			if (iSock == CS_INVALID_SOCK) {
+				continue;
+			}
+
+			if (!pUser) {
+				closesocket(iSock);
+				continue;
+			}
+
+			CClient* pClient = new CClient();
+
+			AddSocket(pClient, iSock, Csock::INBOUND, msState, sClient, "USR::" + pUser->GetUserName());
+			pClient->LoadState(msState, sClient, *pUser);
+			vSocks.push_back(make_pair((Csock*) pClient, sClient));
+			uClients++;
+		}
+	}
+
+	for (vector<pair<Csock*, CString> >::const_iterator it = vSocks.begin(); it != vSocks.end(); ++it) {
+		Csock* pSock = it->first;
+		const CString& sWrite = GetValue(msState, it->second + "wbuf");
+		const CString& sRead = GetValue(msState, it->second + "rbuf");
+
+		if (!sWrite.empty()) {
+			pSock->Write(sWrite);
+		}
+
+		if (!sRead.empty()) {
+			pSock->PushBuff(sRead.data(), sRead.size());
+		}
+	}
+
+	DEBUG("Took over " << uIRC << " IRC connections and " << uClients << " clients");
+
+	return true;
+}
+
+CString CHandoff::GetStateFile() {
+	return CZNC::Get().GetZNCPath() + "/handoff.state";
+}
+
+const CString& CHandoff::GetValue(const MCString& msState, const CString& sKey) {
+	static const CString sEmpty;
+	MCString::const_iterator it = msState.find(sKey);
+
+	return (it != msState.end()) ? it->second : sEmpty;
+}
+
+bool CHandoff::CanHandOff(Csock* pSock) {
+	// The SSL session lives in this process, only the socket could move
+	return (!pSock->GetSSL() && pSock->IsConnected() && !pSock->IsClosed()
+			&& pSock->GetSock() != CS_INVALID_SOCK);
+}
+
+bool CHandoff::ExportSocket(Csock* pSock, unsigned long uPid, MCString& msState, const CString& sPrefix) {
+	WSAPROTOCOL_INFO Info;
+	CString sSock;
+
+	if (WSADuplicateSocket(pSock->GetSock(), uPid, &Info) != 0) {
+		DEBUG("WSADuplicateSocket() failed for [" << pSock->GetSockName() << "]: " << WSAGetLastError());
+		return false;
+	}
+
+	sSock.assign((const char*) &Info, sizeof(Info));
+	sSock.Base64Encode();
+
+	msState[sPrefix + "sock"] = sSock;
+	msState[sPrefix + "host"] = pSock->GetHostName();
+	msState[sPrefix + "port"] = CString(pSock->GetPort());
+	msState[sPrefix + "ipv6"] = CString(pSock->GetIPv6());
+	msState[sPrefix + "wbuf"] = pSock->GetInternalWriteBuffer();
+	msState[sPrefix + "rbuf"] = pSock->GetInternalReadBuffer();
+
+	return true;
+}
+
+void CHandoff::DetachSocket(Csock* pSock) {
+	// The new process has its own descriptor for the same socket
+	closesocket(pSock->GetSock());
+
+	// Deleting the socket now neither closes it nor sends a QUIT
+	pSock->SetSock(CS_INVALID_SOCK);
+}
+
+cs_sock_t CHandoff::ImportSocket(const MCString& msState, const CString& sPrefix) {
+	CString sSock = GetValue(msState, sPrefix + "sock");
+	WSAPROTOCOL_INFO Info;
+
+	sSock.Base64Decode();
+
+	if (sSock.size() != sizeof(Info)) {
+		return CS_INVALID_SOCK;
+	}
+
+	memcpy(&Info, sSock.data(), sizeof(Info));
+
+	cs_sock_t iSock = WSASocket(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &Info, 0, 0);
+
+	if (iSock == INVALID_SOCKET) {
+		DEBUG("WSASocket() failed for [" << sPrefix << "]: " << WSAGetLastError());
+		return CS_INVALID_SOCK;
+	}
+
+	// Csocket expects non-blocking sockets, WSASocket() doesn't copy that
+	u_long uOpts = 1;
+	ioctlsocket(iSock, FIONBIO, &uOpts);
+
+	return iSock;
+}
+
+void CHandoff::AddSocket(Csock* pSock, cs_sock_t iSock, int iType, const MCString& msState, const CString& sPrefix, const CString& sName) {
+	pSock->SetSock(iSock);
+	pSock->SetType(iType);
+	pSock->SetHostName(GetValue(msState, sPrefix + "host"));
+	pSock->SetPort(GetValue(msState, sPrefix + "port").ToUShort());
+	pSock->SetIPv6(GetValue(msState, sPrefix + "ipv6").ToBool());
+	// Otherwise the first read calls Connected() and we would log in again
+	pSock->SetIsConnected(true);
+
+	CZNC::Get().GetManager().AddSock(pSock, sName);
+}
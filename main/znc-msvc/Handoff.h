@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _HANDOFF_H
+#define _HANDOFF_H
+
+#include "zncconfig.h"
+#include "ZNCString.h"
+#include "Csocket.h"
+
+/**
+ * @class CHandoff
+ * @brief Hands the open IRC and client connections to a new ZNC process.
+ *
+ * "Restart Live" writes what the new process needs to know about each
+ * connection to a state file and passes the sockets themselves along
+ * with WSADuplicateSocket(). The new process doesn't inherit any handles.
+ * It gets started with --handoff, waits for the old one to go away and
+ * takes the connections over once it read its config. SSL connections
+ * can't be handed off, these are closed and reconnect just like after a
+ * normal restart.
+ */
+class ZNC_API CHandoff {
+public:
+	/** Writes the state file for the process uPid and detaches the
+	 *  handed off sockets, so that deleting CZNC doesn't close them.
+	 *  Nothing is detached if this fails.
+	 */
+	static bool Save(unsigned long uPid, CString& sError);
+	//! Waits up to uTimeout seconds until the old process uPid exited
+	static bool WaitForProcess(unsigned long uPid, unsigned int uTimeout);
+	/** Takes over the connections from the state file and deletes it.
+	 *  Call this after CZNC::ParseConfig(), the users have to exist.
+	 */
+	static bool Load(CString& sError);
+
+	static CString GetStateFile();
+	//! Empty if there is no such key
+	static const CString& GetValue(const MCString& msState, const CString& sKey);
+private:
+	static bool CanHandOff(Csock* pSock);
+	static bool ExportSocket(Csock* pSock, unsigned long uPid, MCString& msState, const CString& sPrefix);
+	static void DetachSocket(Csock* pSock);
+	static cs_sock_t ImportSocket(const MCString& msState, const CString& sPrefix);
+	static void AddSocket(Csock* pSock, cs_sock_t iSock, int iType, const MCString& msState, const CString& sPrefix, const CString& sName);
+};
+
+#endif // !_HANDOFF_H
@@ -10,6 +10,7 @@
 #include "IRCSock.h"
 #include "Chan.h"
 #include "Client.h"
+#include "Handoff.h"
 #include "User.h"
 #include "znc.h"
 #include "Server.h"
@@ -17,6 +18,28 @@
 // These are used in OnGeneralCTCP()
 const time_t CIRCSock::m_uCTCPFloodTime = 5;
 const unsigned int CIRCSock::m_uCTCPFloodCount = 5;
+// Servers want their PINGs answered, so we never stop reading for long
+const time_t CIRCSock::m_uMaxReadPause = 30;
+
+// Servers cut lines at 512 bytes, coalesced lines stay well below that
+#define IRC_MAX_COALESCED_LEN 450
+
+class CIRCFloodTimer : public CCron {
+public:
+	CIRCFloodTimer(CIRCSock* pSock) : CCron() {
+		m_pSock = pSock;
+		SetName("IRCFloodTimer");
+		Start(1);
+	}
+	virtual ~CIRCFloodTimer() {}
+
+protected:
+	virtual void RunJob() {
+		m_pSock->TrySend();
+	}
+
+	CIRCSock* m_pSock;
+};
 
 CIRCSock::CIRCSock(CUser* pUser) : CZNCSock() {
 	m_pUser = pUser;
@@ -31,6 +54,15 @@ CIRCSock::CIRCSock(CUser* pUser) : CZNCSock() {
 	m_uCapPaused = 0;
 	m_lastCTCP = 0;
 	m_uNumCTCP = 0;
+	m_fSendTokens = pUser->GetFloodBurst();
+	m_uLastRefill = CUtils::GetMillTime();
+	m_uMaxModes = 3;
+	m_uQueuedLines = 0;
+	m_uCoalescedLines = 0;
+	m_uQueueLatencySum = 0;
+	m_uMaxQueueLatency = 0;
+	m_tReadPaused = 0;
+	m_tNoPauseUntil = 0;
 	m_sPerms = "*!@%+";
 	m_sPermModes = "qaohv";
 	m_mueChanModes['b'] = ListArg;
@@ -48,6 +80,8 @@ CIRCSock::CIRCSock(CUser* pUser) : CZNCSock() {
 
 	// RFC says a line can have 512 chars max, but we don't care ;)
 	SetMaxBufferThreshold(1024);
+
+	AddCron(new CIRCFloodTimer(this));
 }
 
 CIRCSock::~CIRCSock() {
@@ -77,6 +111,10 @@ void CIRCSock::Quit(const CString& sQuitMsg) {
 		Close(CLT_NOW);
 		return;
 	}
+	// The QUIT skips the queue, lines which still wait for the flood
+	// protection would never be sent after it
+	TrySend(true);
+
 	if (!sQuitMsg.empty()) {
 		PutIRC("QUIT :" + sQuitMsg);
 	} else {
@@ -85,12 +123,105 @@ void CIRCSock::Quit(const CString& sQuitMsg) {
 	Close(CLT_AFTERWRITE);
 }
 
+void CIRCSock::SaveState(MCString& msState, const CString& sPrefix) const {
+	CString sChanModes, sUserModes, sCaps;
+	unsigned int uLines = 0;
+
+	// The mode followed by its EChanModeArgs, e.g. "b0k1l2"
+	for (map<unsigned char, EChanModeArgs>::const_iterator it = m_mueChanModes.begin(); it != m_mueChanModes.end(); ++it) {
+		sChanModes += CString(it->first) + CString((int) it->second);
+	}
+
+	for (set<unsigned char>::const_iterator it = m_scUserModes.begin(); it != m_scUserModes.end(); ++it) {
+		sUserModes += *it;
+	}
+
+	for (SCString::const_iterator it = m_ssAcceptedCaps.begin(); it != m_ssAcceptedCaps.end(); ++it) {
+		sCaps += (sCaps.empty() ? "" : " ") + *it;
+	}
+
+	msState[sPrefix + "nick"] = m_Nick.GetNickMask();
+	msState[sPrefix + "perms"] = m_sPerms;
+	msState[sPrefix + "permmodes"] = m_sPermModes;
+	msState[sPrefix + "chanmodes"] = sChanModes;
+	msState[sPrefix + "usermodes"] = sUserModes;
+	msState[sPrefix + "maxnicklen"] = CString(m_uMaxNickLen);
+	msState[sPrefix + "maxmodes"] = CString(m_uMaxModes);
+	msState[sPrefix + "namesx"] = CString(m_bNamesx);
+	msState[sPrefix + "uhnames"] = CString(m_bUHNames);
+	msState[sPrefix + "caps"] = sCaps;
+	msState[sPrefix + "sendtokens"] = CString(m_fSendTokens);
+
+	for (unsigned int a = 0; a < PRIO_COUNT; a++) {
+		for (deque<SQueuedLine>::const_iterator it = m_aqSendQueue[a].begin(); it != m_aqSendQueue[a].end(); ++it, uLines++) {
+			msState[sPrefix + "queue/" + CString(uLines)] = it->sLine;
+			msState[sPrefix + "queue/" + CString(uLines) + "/prio"] = CString(a);
+		}
+	}
+
+	msState[sPrefix + "queue"] = CString(uLines);
+}
+
+void CIRCSock::LoadState(const MCString& msState, const CString& sPrefix) {
+	const CString& sChanModes = CHandoff::GetValue(msState, sPrefix + "chanmodes");
+	const CString& sUserModes = CHandoff::GetValue(msState, sPrefix + "usermodes");
+	unsigned int uLines = CHandoff::GetValue(msState, sPrefix + "queue").ToUInt();
+	VCString vsCaps;
+
+	m_Nick.Parse(CHandoff::GetValue(msState, sPrefix + "nick"));
+	SetNick(m_Nick.GetNick());
+
+	m_sPerms = CHandoff::GetValue(msState, sPrefix + "perms");
+	m_sPermModes = CHandoff::GetValue(msState, sPrefix + "permmodes");
+
+	m_mueChanModes.clear();
+	for (unsigned int a = 0; a + 1 < sChanModes.size(); a += 2) {
+		m_mueChanModes[sChanModes[a]] = (EChanModeArgs) (sChanModes[a + 1] - '0');
+	}
+
+	m_scUserModes.clear();
+	for (unsigned int b = 0; b < sUserModes.size(); b++) {
+		m_scUserModes.insert(sUserModes[b]);
+	}
+
+	m_uMaxNickLen = CHandoff::GetValue(msState, sPrefix + "maxnicklen").ToUInt();
+	m_uMaxModes = CHandoff::GetValue(msState, sPrefix + "maxmodes").ToUInt();
+	m_bNamesx = CHandoff::GetValue(msState, sPrefix + "namesx").ToBool();
+	m_bUHNames = CHandoff::GetValue(msState, sPrefix + "uhnames").ToBool();
+	m_fSendTokens = CHandoff::GetValue(msState, sPrefix + "sendtokens").ToDouble();
+
+	CHandoff::GetValue(msState, sPrefix + "caps").Split(" ", vsCaps, false);
+	m_ssAcceptedCaps.clear();
+	m_ssAcceptedCaps.insert(vsCaps.begin(), vsCaps.end());
+
+	for (unsigned int c = 0; c < uLines; c++) {
+		unsigned int uPrio = CHandoff::GetValue(msState, sPrefix + "queue/" + CString(c) + "/prio").ToUInt();
+		SQueuedLine Line;
+
+		if (uPrio >= PRIO_COUNT) {
+			uPrio = PRIO_BULK;
+		}
+
+		Line.sLine = CHandoff::GetValue(msState, sPrefix + "queue/" + CString(c));
+		Line.uQueued = CUtils::GetMillTime();
+		m_aqSendQueue[uPrio].push_back(Line);
+		m_uQueuedLines++;
+	}
+
+	// We already got our 001, see ReadLine()
+	m_bAuthed = true;
+	SetTimeout(540, TMO_READ);
+}
+
 void CIRCSock::ReadLine(const CString& sData) {
 	CString sLine = sData;
 
 	sLine.TrimRight("\n\r");
 
 	DEBUG("(" << m_pUser->GetUserName() << ") IRC -> ZNC [" << sLine << "]");
+	CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_IRC_IN);
+	// This line is still handled, Csock stops before the next one
+	CheckBackpressure();
 
 	MODULECALL(OnRaw(sLine), m_pUser, NULL, return);
 
@@ -133,7 +264,7 @@ void CIRCSock::ReadLine(const CString& sData) {
 
 				m_pUser->SetIRCServer(sServer);
 				SetTimeout(540, TMO_READ);  // Now that we are connected, let nature take its course
-				PutIRC("WHO " + sNick);
+				PutIRC("WHO " + sNick, PRIO_BULK);
 
 				m_bAuthed = true;
 				m_pUser->PutStatus("Connected!");
@@ -325,7 +456,7 @@ void CIRCSock::ReadLine(const CString& sData) {
 							}
 
 							if (!sModes.empty()) {
-								PutIRC("MODE " + pChan->GetName() + " " + sModes);
+								PutIRC("MODE " + pChan->GetName() + " " + sModes, PRIO_BULK);
 							}
 						}
 					}
@@ -472,7 +603,7 @@ void CIRCSock::ReadLine(const CString& sData) {
 				if (pChan) {
 					pChan->Enable();
 					pChan->SetIsOn(true);
-					PutIRC("MODE " + sChan);
+					PutIRC("MODE " + sChan, PRIO_BULK);
 				}
 			} else {
 				pChan = m_pUser->FindChan(sChan);
@@ -912,10 +1043,277 @@ bool CIRCSock::OnChanMsg(CNick& Nick, const CString& sChan, CString& sMessage) {
 }
 
 void CIRCSock::PutIRC(const CString& sLine) {
+	PutIRC(sLine, GetSendPriority(sLine));
+}
+
+void CIRCSock::PutIRC(const CString& sLine, ESendPriority ePriority) {
+	// Flood protection is turned off
+	if (m_pUser->GetFloodRate() <= 0) {
+		SendLine(sLine);
+		return;
+	}
+
+	RefillSendTokens();
+
+	if (ePriority == PRIO_URGENT) {
+		// Waiting could get us disconnected (e.g. a late PONG), but
+		// these lines still count against the server's flood limit
+		if (m_fSendTokens >= 1) {
+			m_fSendTokens--;
+		}
+
+		SendLine(sLine);
+		return;
+	}
+
+	deque<SQueuedLine>& qQueue = m_aqSendQueue[ePriority];
+
+	// Only lines which have to wait anyway are merged
+	if (!qQueue.empty() && CoalesceLine(qQueue.back().sLine, sLine)) {
+		m_uCoalescedLines++;
+		return;
+	}
+
+	SQueuedLine Line;
+	Line.sLine = sLine;
+	Line.uQueued = CUtils::GetMillTime();
+	qQueue.push_back(Line);
+	m_uQueuedLines++;
+
+	TrySend();
+}
+
+void CIRCSock::TrySend(bool bFlush) {
+	bool bUnlimited = (bFlush || m_pUser->GetFloodRate() <= 0);
+	unsigned long long uNow = CUtils::GetMillTime();
+
+	RefillSendTokens();
+
+	for (unsigned int a = 0; a < PRIO_COUNT; a++) {
+		deque<SQueuedLine>& qQueue = m_aqSendQueue[a];
+
+		while (!qQueue.empty() && (bUnlimited || m_fSendTokens >= 1)) {
+			unsigned long long uLatency = uNow - qQueue.front().uQueued;
+
+			m_uQueueLatencySum += uLatency;
+			if (uLatency > m_uMaxQueueLatency) {
+				m_uMaxQueueLatency = uLatency;
+			}
+
+			if (!bUnlimited) {
+				m_fSendTokens--;
+			}
+
+			SendLine(qQueue.front().sLine);
+			qQueue.pop_front();
+		}
+	}
+}
+
+void CIRCSock::CheckBackpressure() {
+	size_t uHighWater = CZNC::Get().GetClientSendQHighWater();
+
+	if (m_tReadPaused || !m_bAuthed || time(NULL) < m_tNoPauseUntil) {
+		return;
+	}
+
+	if (m_pUser->ClientsBacklogged(uHighWater)) {
+		DEBUG("(" << m_pUser->GetUserName() << ") all clients are behind, not reading from IRC");
+		m_tReadPaused = time(NULL);
+		CZNC::Get().GetPerfStats().AddIRCReadPause();
+		PauseRead();
+	}
+}
+
+void CIRCSock::ReadPaused() {
+	if (!m_tReadPaused) {
+		// Not paused by CheckBackpressure()
+		return;
+	}
+
+	// Resume once one client is down to half of the high water mark
+	size_t uLowWater = CZNC::Get().GetClientSendQHighWater() / 2;
+	time_t tNow = time(NULL);
+
+	if (uLowWater && m_pUser->ClientsBacklogged(uLowWater) && tNow - m_tReadPaused < m_uMaxReadPause) {
+		return;
+	}
+
+	if (tNow - m_tReadPaused >= m_uMaxReadPause) {
+		// The clients didn't catch up, read for a while to answer PINGs
+		// and leave the rest to ClientSendQHardLimit
+		DEBUG("(" << m_pUser->GetUserName() << ") clients still behind, reading from IRC again");
+		m_tNoPauseUntil = tNow + m_uMaxReadPause / 2;
+	}
+
+	m_tReadPaused = 0;
+	UnPauseRead();
+}
+
+void CIRCSock::RefillSendTokens() {
+	unsigned long long uNow = CUtils::GetMillTime();
+	double fBurst = m_pUser->GetFloodBurst();
+
+	m_fSendTokens += (uNow - m_uLastRefill) * m_pUser->GetFloodRate() / 1000;
+	m_uLastRefill = uNow;
+
+	if (m_fSendTokens > fBurst) {
+		m_fSendTokens = fBurst;
+	}
+}
+
+void CIRCSock::SendLine(const CString& sLine) {
 	DEBUG("(" << m_pUser->GetUserName() << ") ZNC -> IRC [" << sLine << "]");
+	CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_IRC_OUT);
 	Write(sLine + "\r\n");
 }
 
+CIRCSock::ESendPriority CIRCSock::GetSendPriority(const CString& sLine) const {
+	if (!m_bAuthed) {
+		// Registration
+		return PRIO_URGENT;
+	}
+
+	const CString sCmd = sLine.Token(0);
+
+	if (sCmd.Equals("PONG") || sCmd.Equals("PING") || sCmd.Equals("QUIT")
+			|| sCmd.Equals("CAP") || sCmd.Equals("PASS") || sCmd.Equals("USER")) {
+		return PRIO_URGENT;
+	}
+
+	// Not PRIO_BULK for e.g. MODE, a client's ban and kick have to
+	// reach the server in the order they were sent.
+	return PRIO_INTERACTIVE;
+}
+
+bool CIRCSock::IsArgMode(unsigned char uMode) const {
+	if (IsPermMode(uMode)) {
+		return true;
+	}
+
+	map<unsigned char, EChanModeArgs>::const_iterator it = m_mueChanModes.find(uMode);
+
+	return (it != m_mueChanModes.end() && (it->second == ListArg || it->second == HasArg));
+}
+
+bool CIRCSock::CoalesceLine(CString& sLast, const CString& sLine) const {
+	const CString sCmd = sLine.Token(0);
+
+	if (!sCmd.Equals(sLast.Token(0)) || sLast.size() + sLine.size() > IRC_MAX_COALESCED_LEN) {
+		return false;
+	}
+
+	if (sCmd.Equals("JOIN")) {
+		// JOIN <#chan,#chan...> [key,key...]
+		CString sChans = sLast.Token(1);
+		CString sKeys = sLast.Token(2);
+		const CString sNewChans = sLine.Token(1);
+		const CString sNewKeys = sLine.Token(2);
+
+		if (sChans.empty() || sNewChans.empty() || sChans == "0" || sNewChans == "0"
+				|| !sLast.Token(3).empty() || !sLine.Token(3).empty()) {
+			return false;
+		}
+
+		if (!sNewKeys.empty()) {
+			// Keys are matched to channels by position, so every
+			// channel in front of the new ones needs a key
+			VCString vsChans, vsKeys;
+			sChans.Split(",", vsChans, false);
+			sKeys.Split(",", vsKeys, false);
+
+			if (vsChans.size() != vsKeys.size()) {
+				return false;
+			}
+		}
+
+		sLast = "JOIN " + sChans + "," + sNewChans;
+
+		if (!sKeys.empty()) {
+			sLast += " " + sKeys;
+			if (!sNewKeys.empty()) {
+				sLast += "," + sNewKeys;
+			}
+		}
+
+		return true;
+	}
+
+	if (sCmd.Equals("MODE")) {
+		// MODE <#chan> <+-modes> <one arg per mode>, e.g. autoop's +o
+		const CString sChan = sLast.Token(1);
+		const CString sModes = sLast.Token(2);
+		const CString sNewModes = sLine.Token(2);
+
+		if (sChan.empty() || !sChan.Equals(sLine.Token(1))
+				|| m_pUser->GetChanPrefixes().find(sChan[0]) == CString::npos) {
+			return false;
+		}
+
+		if (sModes.empty() || sNewModes.empty()
+				|| (sModes[0] != '+' && sModes[0] != '-')
+				|| (sNewModes[0] != '+' && sNewModes[0] != '-')) {
+			return false;
+		}
+
+		VCString vsArgs, vsNewArgs;
+		sLast.Token(3, true).Split(" ", vsArgs, false);
+		sLine.Token(3, true).Split(" ", vsNewArgs, false);
+
+		unsigned int uModes = 0;
+		unsigned int uNewModes = 0;
+		char cSign = '+';
+
+		for (CString::size_type a = 0; a < sModes.size(); a++) {
+			if (sModes[a] == '+' || sModes[a] == '-') {
+				cSign = sModes[a];
+			} else if (IsArgMode(sModes[a])) {
+				uModes++;
+			} else {
+				return false;
+			}
+		}
+
+		for (CString::size_type a = 0; a < sNewModes.size(); a++) {
+			if (sNewModes[a] == '+' || sNewModes[a] == '-') {
+				continue;
+			} else if (IsArgMode(sNewModes[a])) {
+				uNewModes++;
+			} else {
+				return false;
+			}
+		}
+
+		if (!uModes || !uNewModes || uModes != vsArgs.size() || uNewModes != vsNewArgs.size()
+				|| uModes + uNewModes > m_uMaxModes) {
+			return false;
+		}
+
+		CString sMerged = sModes + ((sNewModes[0] == cSign) ? CString(sNewModes.substr(1)) : sNewModes);
+
+		sLast = "MODE " + sChan + " " + sMerged + " " + sLast.Token(3, true) + " " + sLine.Token(3, true);
+		return true;
+	}
+
+	return false;
+}
+
+size_t CIRCSock::GetSendQueueSize() const {
+	size_t uSize = 0;
+
+	for (unsigned int a = 0; a < PRIO_COUNT; a++) {
+		uSize += m_aqSendQueue[a].size();
+	}
+
+	return uSize;
+}
+
+unsigned long long CIRCSock::GetAvgQueueLatency() const {
+	unsigned long long uSent = m_uQueuedLines - GetSendQueueSize();
+
+	return (uSent) ? m_uQueueLatencySum / uSent : 0;
+}
+
 void CIRCSock::SetNick(const CString& sNick) {
 	m_Nick.SetNick(sNick);
 	m_pUser->SetIRCNick(m_Nick);
@@ -1065,6 +1463,12 @@ void CIRCSock::ParseISupport(const CString& sLine) {
 			if (uMax) {
 				m_uMaxNickLen = uMax;
 			}
+		} else if (sName.Equals("MODES")) {
+			unsigned int uMax = sValue.ToUInt();
+
+			if (uMax) {
+				m_uMaxModes = uMax;
+			}
 		} else if (sName.Equals("CHANMODES")) {
 			if (!sValue.empty()) {
 				m_mueChanModes.clear();
@@ -12,6 +12,7 @@
 #include "zncconfig.h"
 #include "Socket.h"
 #include "Nick.h"
+#include <deque>
 
 // Forward Declarations
 class CChan;
@@ -32,6 +33,17 @@ public:
 		NoArg      = 3
 	} EChanModeArgs;
 
+	// Lines sent to IRC are queued by priority, lower values go out first
+	typedef enum {
+		// PONG, QUIT and everything before we are registered, never waits
+		PRIO_URGENT      = 0,
+		// Everything else, lines from clients keep their order
+		PRIO_INTERACTIVE = 1,
+		// Only used when asked for, e.g. ZNC's own WHO and MODE queries
+		PRIO_BULK        = 2,
+		PRIO_COUNT       = 3
+	} ESendPriority;
+
 	// Message Handlers
 	bool OnCTCPReply(CNick& Nick, CString& sMessage);
 	bool OnPrivCTCP(CNick& Nick, CString& sMessage);
@@ -51,10 +63,21 @@ public:
 	virtual void SockError(int iErrno);
 	virtual void Timeout();
 	virtual void ReachedMaxBuffer();
+	virtual void ReadPaused();
 
+	//! Sends with GetSendPriority(), which never returns PRIO_BULK
 	void PutIRC(const CString& sLine);
+	void PutIRC(const CString& sLine, ESendPriority ePriority);
+	/** Sends as many queued lines as the user's FloodRate and FloodBurst
+	 *  allow, or all of them if bFlush is set.
+	 */
+	void TrySend(bool bFlush = false);
+	ESendPriority GetSendPriority(const CString& sLine) const;
 	void ResetChans();
 	void Quit(const CString& sQuitMsg = "");
+	//! For CHandoff, what the server told us and what still waits to be sent
+	void SaveState(MCString& msState, const CString& sPrefix) const;
+	void LoadState(const MCString& msState, const CString& sPrefix);
 
 	/** You can call this from CModule::OnServerCapResult to suspend
 	 *  sending other CAP requests and CAP END for a while. Each
@@ -89,6 +112,15 @@ public:
 	// This is true if we are past raw 001
 	bool IsAuthed() const { return m_bAuthed; }
 	bool IsCapAccepted(const CString& sCap) { return 1 == m_ssAcceptedCaps.count(sCap); }
+	size_t GetSendQueueSize() const;
+	size_t GetSendQueueSize(ESendPriority ePriority) const { return m_aqSendQueue[ePriority].size(); }
+	unsigned long long GetQueuedLines() const { return m_uQueuedLines; }
+	unsigned long long GetCoalescedLines() const { return m_uCoalescedLines; }
+	//! Average time in ms which lines spent in the send queue
+	unsigned long long GetAvgQueueLatency() const;
+	unsigned long long GetMaxQueueLatency() const { return m_uMaxQueueLatency; }
+	//! True while we don't read from the server because all clients are behind
+	bool IsBackpressured() const { return m_tReadPaused != 0; }
 	// !Getters
 
 	// This handles NAMESX and UHNAMES in a raw 353 reply
@@ -100,6 +132,17 @@ private:
 	// This is called when we connect and the nick we want is already taken
 	void SendAltNick(const CString& sBadNick);
 	void SendNextCap();
+	void SendLine(const CString& sLine);
+	void RefillSendTokens();
+	bool CoalesceLine(CString& sLast, const CString& sLine) const;
+	bool IsArgMode(unsigned char uMode) const;
+	//! Stops reading from the server while every client is behind, see ClientSendQHighWater
+	void CheckBackpressure();
+
+	struct SQueuedLine {
+		CString            sLine;
+		unsigned long long uQueued;
+	};
 protected:
 	bool                                m_bAuthed;
 	bool                                m_bNamesx;
@@ -120,6 +163,17 @@ protected:
 	unsigned int                        m_uNumCTCP;
 	static const time_t                 m_uCTCPFloodTime;
 	static const unsigned int           m_uCTCPFloodCount;
+	static const time_t                 m_uMaxReadPause;
+	time_t                              m_tReadPaused;
+	time_t                              m_tNoPauseUntil;
+	deque<SQueuedLine>                  m_aqSendQueue[PRIO_COUNT];
+	double                              m_fSendTokens;
+	unsigned long long                  m_uLastRefill;
+	unsigned int                        m_uMaxModes;
+	unsigned long long                  m_uQueuedLines;
+	unsigned long long                  m_uCoalescedLines;
+	unsigned long long                  m_uQueueLatencySum;
+	unsigned long long                  m_uMaxQueueLatency;
 };
 
 #endif // !_IRCSOCK_H
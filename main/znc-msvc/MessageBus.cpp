@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "MessageBus.h"
+#include "Client.h"
+#include "User.h"
+#include "znc.h"
+
+/////////////////// CFanOutLine ///////////////////
+CFanOutLine::CFanOutLine(const CString& sLine) {
+	m_sData.reserve(sLine.size() + 2);
+	m_sData = sLine;
+	m_sData += "\r\n";
+	m_bNick = false;
+}
+
+CFanOutLine::CFanOutLine(const CString& sPre, const CString& sPost) {
+	m_sData = sPre;
+	m_sPost.reserve(sPost.size() + 2);
+	m_sPost = sPost;
+	m_sPost += "\r\n";
+	m_bNick = true;
+}
+
+CString CFanOutLine::GetLine() const {
+	if (m_bNick) {
+		return m_sData + m_sPost.substr(0, m_sPost.size() - 2);
+	}
+
+	return m_sData.substr(0, m_sData.size() - 2);
+}
+
+void CFanOutLine::SendTo(CClient* pClient) const {
+	if (!m_bNick) {
+		DEBUG("(" << pClient->GetUser()->GetUserName() << ") ZNC -> CLI [" << GetLine() << "]");
+		CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_CLIENT_OUT);
+		pClient->Write(m_sData.data(), m_sData.size());
+		return;
+	}
+
+	const CString sNick = pClient->GetNick();
+
+	// Clients of the same user normally share their nick, so the last line
+	// can be sent again. assign() and append() keep the buffer's capacity.
+	if (m_sBuf.empty() || sNick != m_sBufNick) {
+		m_sBuf.assign(m_sData);
+		m_sBuf.append(sNick);
+		m_sBuf.append(m_sPost);
+		m_sBufNick = sNick;
+	}
+
+	DEBUG("(" << pClient->GetUser()->GetUserName() << ") ZNC -> CLI [" << m_sBuf.substr(0, m_sBuf.size() - 2) << "]");
+	CZNC::Get().GetPerfStats().AddLine(CPerfStats::LINES_CLIENT_OUT);
+	pClient->Write(m_sBuf.data(), m_sBuf.size());
+}
+
+unsigned int CFanOutLine::SendTo(CUser* pUser, const CClient* pSkipClient) const {
+	const vector<CClient*>& vClients = pUser->GetClients();
+	unsigned int uSent = 0;
+
+	for (vector<CClient*>::const_iterator it = vClients.begin(); it != vClients.end(); ++it) {
+		if (*it != pSkipClient) {
+			SendTo(*it);
+			uSent++;
+		}
+	}
+
+	return uSent;
+}
+
+/////////////////// CMessageBus ///////////////////
+bool CMessageBus::Subscribe(const CString& sTopic, CUser* pUser) {
+	if (!pUser || !m_mTopics[sTopic].insert(pUser).second) {
+		return false;
+	}
+
+	m_mUserTopics[pUser].insert(sTopic);
+	return true;
+}
+
+bool CMessageBus::Unsubscribe(const CString& sTopic, CUser* pUser) {
+	map<CString, set<CUser*> >::iterator it = m_mTopics.find(sTopic);
+
+	if (it == m_mTopics.end() || !it->second.erase(pUser)) {
+		return false;
+	}
+
+	if (it->second.empty()) {
+		m_mTopics.erase(it);
+	}
+
+	map<CUser*, set<CString> >::iterator itUser = m_mUserTopics.find(pUser);
+	if (itUser != m_mUserTopics.end()) {
+		itUser->second.erase(sTopic);
+		if (itUser->second.empty()) {
+			m_mUserTopics.erase(itUser);
+		}
+	}
+
+	return true;
+}
+
+void CMessageBus::UnsubscribeAll(CUser* pUser) {
+	map<CUser*, set<CString> >::iterator itUser = m_mUserTopics.find(pUser);
+
+	if (itUser == m_mUserTopics.end()) {
+		return;
+	}
+
+	for (set<CString>::const_iterator it = itUser->second.begin(); it != itUser->second.end(); ++it) {
+		map<CString, set<CUser*> >::iterator itTopic = m_mTopics.find(*it);
+
+		if (itTopic != m_mTopics.end()) {
+			itTopic->second.erase(pUser);
+			if (itTopic->second.empty()) {
+				m_mTopics.erase(itTopic);
+			}
+		}
+	}
+
+	m_mUserTopics.erase(itUser);
+}
+
+void CMessageBus::DelTopic(const CString& sTopic) {
+	map<CString, set<CUser*> >::iterator itTopic = m_mTopics.find(sTopic);
+
+	if (itTopic == m_mTopics.end()) {
+		return;
+	}
+
+	for (set<CUser*>::const_iterator it = itTopic->second.begin(); it != itTopic->second.end(); ++it) {
+		map<CUser*, set<CString> >::iterator itUser = m_mUserTopics.find(*it);
+
+		if (itUser != m_mUserTopics.end()) {
+			itUser->second.erase(sTopic);
+			if (itUser->second.empty()) {
+				m_mUserTopics.erase(itUser);
+			}
+		}
+	}
+
+	m_mTopics.erase(itTopic);
+}
+
+unsigned int CMessageBus::Publish(const CString& sTopic, const CFanOutLine& Line,
+		const CUser* pSkipUser, const CClient* pSkipClient) const {
+	map<CString, set<CUser*> >::const_iterator itTopic = m_mTopics.find(sTopic);
+	unsigned int uSent = 0;
+
+	if (itTopic == m_mTopics.end()) {
+		return 0;
+	}
+
+	for (set<CUser*>::const_iterator it = itTopic->second.begin(); it != itTopic->second.end(); ++it) {
+		if (*it != pSkipUser) {
+			uSent += Line.SendTo(*it, pSkipClient);
+		}
+	}
+
+	return uSent;
+}
+
+bool CMessageBus::IsSubscribed(const CString& sTopic, const CUser* pUser) const {
+	map<CString, set<CUser*> >::const_iterator it = m_mTopics.find(sTopic);
+
+	return (it != m_mTopics.end() && it->second.find(const_cast<CUser*>(pUser)) != it->second.end());
+}
+
+const set<CUser*>& CMessageBus::GetSubscribers(const CString& sTopic) const {
+	static const set<CUser*> ssEmpty;
+	map<CString, set<CUser*> >::const_iterator it = m_mTopics.find(sTopic);
+
+	return (it != m_mTopics.end()) ? it->second : ssEmpty;
+}
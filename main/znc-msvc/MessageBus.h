@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _MESSAGEBUS_H
+#define _MESSAGEBUS_H
+
+#include "zncconfig.h"
+#include "ZNCString.h"
+#include <map>
+#include <set>
+
+class CClient;
+class CUser;
+
+/**
+ * @class CFanOutLine
+ * @brief A line for many clients, put together only once.
+ *
+ * The line (including the trailing "\r\n") is built in the constructor and
+ * the same bytes are handed to every client's socket. Lines which have to
+ * contain the nick of the receiving client are built from the part before
+ * and the part after the nick. They are only joined again when the nick
+ * differs from the one of the previous client.
+ */
+class ZNC_API CFanOutLine {
+public:
+	//! sLine is sent as it is.
+	CFanOutLine(const CString& sLine);
+	//! Every client gets sPre + its nick + sPost.
+	CFanOutLine(const CString& sPre, const CString& sPost);
+	~CFanOutLine() {}
+
+	void SendTo(CClient* pClient) const;
+	/** Sends the line to all of pUser's clients except pSkipClient.
+	 *  @return The number of clients the line was sent to.
+	 */
+	unsigned int SendTo(CUser* pUser, const CClient* pSkipClient = NULL) const;
+
+	bool HasNick() const { return m_bNick; }
+	//! The line without "\r\n", the nick is left out.
+	CString GetLine() const;
+
+private:
+	CString         m_sData;
+	CString         m_sPost;
+	bool            m_bNick;
+	mutable CString m_sBuf;
+	mutable CString m_sBufNick;
+};
+
+/**
+ * @class CMessageBus
+ * @brief Topics which users can subscribe to, e.g. one per partyline channel.
+ *
+ * Publish() sends a line to all clients of all subscribed users. The
+ * subscriptions of a user are dropped automatically when it is destroyed.
+ * Topic names are case sensitive, prefix them with your module's name.
+ */
+class ZNC_API CMessageBus {
+public:
+	CMessageBus() {}
+	~CMessageBus() {}
+
+	bool Subscribe(const CString& sTopic, CUser* pUser);
+	bool Unsubscribe(const CString& sTopic, CUser* pUser);
+	void UnsubscribeAll(CUser* pUser);
+	//! Removes a topic together with all its subscriptions.
+	void DelTopic(const CString& sTopic);
+
+	/** Sends Line to every client of every user subscribed to sTopic,
+	 *  apart from pSkipUser's clients and pSkipClient.
+	 *  @return The number of clients the line was sent to.
+	 */
+	unsigned int Publish(const CString& sTopic, const CFanOutLine& Line,
+			const CUser* pSkipUser = NULL, const CClient* pSkipClient = NULL) const;
+	unsigned int Publish(const CString& sTopic, const CString& sLine,
+			const CUser* pSkipUser = NULL, const CClient* pSkipClient = NULL) const {
+		return Publish(sTopic, CFanOutLine(sLine), pSkipUser, pSkipClient);
+	}
+
+	// Getters
+	bool IsSubscribed(const CString& sTopic, const CUser* pUser) const;
+	const set<CUser*>& GetSubscribers(const CString& sTopic) const;
+	size_t GetTopicCount() const { return m_mTopics.size(); }
+	// !Getters
+
+private:
+	map<CString, set<CUser*> > m_mTopics;
+	// Reverse index, so that UnsubscribeAll() doesn't have to look at every topic
+	map<CUser*, set<CString> > m_mUserTopics;
+};
+
+#endif // !_MESSAGEBUS_H
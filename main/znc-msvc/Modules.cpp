@@ -20,11 +20,17 @@
 # warning "your crap box doesnt define RTLD_LOCAL !?"
 #endif
 
+// Only every HOOK_SAMPLE_RATE-th call of each hook is timed
+#define HOOK_SAMPLE_RATE 16
+
 #define _MODUNLOADCHK(func, type)                                        \
+	static unsigned int uHookCall = 0;                               \
+	const bool bTimeHook = (uHookCall++ % HOOK_SAMPLE_RATE == 0);    \
 	for (unsigned int a = 0; a < size(); a++) {                      \
 		try {                                                    \
 			type* pMod = (type *) (*this)[a];                \
 			CClient* pOldClient = pMod->GetClient();         \
+			unsigned long long uStart = (bTimeHook ? CUtils::GetMicroTime() : 0); \
 			pMod->SetClient(m_pClient);                      \
 			if (m_pUser) {                                   \
 				CUser* pOldUser = pMod->GetUser();       \
@@ -35,6 +41,9 @@
 				pMod->func;                              \
 			}                                                \
 			pMod->SetClient(pOldClient);                     \
+			if (bTimeHook) {                                 \
+				pMod->AddHookTime(#func, CUtils::GetMicroTime() - uStart, HOOK_SAMPLE_RATE); \
+			}                                                \
 		} catch (CModule::EModException e) {                     \
 			if (e == CModule::UNLOAD) {                      \
 				UnloadModule((*this)[a]->GetModName());  \
@@ -47,11 +56,14 @@
 
 #define _MODHALTCHK(func, type)                                          \
 	bool bHaltCore = false;                                          \
+	static unsigned int uHookCall = 0;                               \
+	const bool bTimeHook = (uHookCall++ % HOOK_SAMPLE_RATE == 0);    \
 	for (unsigned int a = 0; a < size(); a++) {                      \
 		try {                                                    \
 			type* pMod = (type*) (*this)[a];                 \
 			CModule::EModRet e = CModule::CONTINUE;          \
 			CClient* pOldClient = pMod->GetClient();         \
+			unsigned long long uStart = (bTimeHook ? CUtils::GetMicroTime() : 0); \
 			pMod->SetClient(m_pClient);                      \
 			if (m_pUser) {                                   \
 				CUser* pOldUser = pMod->GetUser();       \
@@ -62,6 +74,9 @@
 				e = pMod->func;                          \
 			}                                                \
 			pMod->SetClient(pOldClient);                     \
+			if (bTimeHook) {                                 \
+				pMod->AddHookTime(#func, CUtils::GetMicroTime() - uStart, HOOK_SAMPLE_RATE); \
+			}                                                \
 			if (e == CModule::HALTMODS) {                    \
 				break;                                   \
 			} else if (e == CModule::HALTCORE) {             \
@@ -146,6 +161,13 @@ CModule::~CModule() {
 
 void CModule::SetUser(CUser* pUser) { m_pUser = pUser; }
 void CModule::SetClient(CClient* pClient) { m_pClient = pClient; }
+void CModule::SetArgs(const CString& s) {
+	m_sArgs = s;
+
+	if (m_pUser) {
+		m_pUser->SetConfigChanged();
+	}
+}
 
 const CString& CModule::GetSavePath() const {
 	if (!CFile::Exists(m_sSavePath)) {
@@ -614,6 +636,12 @@ void CModules::UnloadAll() {
 	}
 }
 
+void CModules::ResetHookStats() {
+	for (unsigned int a = 0; a < size(); a++) {
+		(*this)[a]->ResetHookStats();
+	}
+}
+
 bool CModules::OnBoot() {
 	for (unsigned int a = 0; a < size(); a++) {
 		try {
@@ -908,6 +936,10 @@ bool CModules::UnloadModule(const CString& sModule, CString& sRetMsg) {
 	ModHandle p = pModule->GetDLL();
 
 	if (p) {
+		if (pModule->GetUser()) {
+			pModule->GetUser()->SetConfigChanged();
+		}
+
 		delete pModule;
 
 		for (iterator it = begin(); it != end(); ++it) {
@@ -942,6 +974,96 @@ bool CModules::ReloadModule(const CString& sModule, const CString& sArgs, CUser*
 	return true;
 }
 
+// Module information by path. Listing the available modules would
+// otherwise dlopen() every single module file.
+struct CModInfoCacheEntry {
+	off_t    m_uSize;
+	time_t   m_iMTime;
+	bool     m_bVersionMismatch;
+	CModInfo m_Info;
+};
+
+static map<CString, CModInfoCacheEntry> g_mModInfoCache;
+static bool g_bModInfoCacheLoaded = false;
+static bool g_bModInfoCacheDirty = false;
+static unsigned int g_uModInfoCacheMisses = 0;
+
+static CString GetModInfoCacheFile() {
+	return CZNC::Get().GetZNCPath() + "/modules.cache";
+}
+
+static CString GetModInfoCacheHeader() {
+	return "ZNCModInfoCache " + CString(CModule::GetCoreVersion());
+}
+
+static void LoadModInfoCache() {
+	if (g_bModInfoCacheLoaded)
+		return;
+	g_bModInfoCacheLoaded = true;
+
+	CFile File(GetModInfoCacheFile());
+	CString sLine;
+
+	if (!File.Open(O_RDONLY))
+		return;
+
+	// A cache written by another version of ZNC is useless, the
+	// version check in ZNCModInfo() might give a different answer
+	if (!File.ReadLine(sLine) || sLine.TrimRight_n("\r\n") != GetModInfoCacheHeader())
+		return;
+
+	while (File.ReadLine(sLine)) {
+		sLine.TrimRight("\r\n");
+
+		VCString vsFields;
+		if (sLine.Split("\t", vsFields) != 6)
+			continue;
+
+		CModInfoCacheEntry& Entry = g_mModInfoCache[vsFields[0].Escape_n(CString::EURL, CString::EASCII)];
+		Entry.m_uSize = (off_t) vsFields[1].ToULongLong();
+		Entry.m_iMTime = (time_t) vsFields[2].ToLongLong();
+		Entry.m_Info.SetGlobal(vsFields[3].ToBool());
+		Entry.m_bVersionMismatch = vsFields[4].ToBool();
+		Entry.m_Info.SetDescription(vsFields[5].Escape_n(CString::EURL, CString::EASCII));
+	}
+}
+
+static void SaveModInfoCache() {
+	if (!g_bModInfoCacheDirty)
+		return;
+	g_bModInfoCacheDirty = false;
+
+	CString sFile = GetModInfoCacheFile();
+	CFile File(sFile + "~");
+
+	if (!File.Open(O_WRONLY | O_CREAT | O_TRUNC, 0600)) {
+		DEBUG("Could not write module cache [" << sFile << "]");
+		return;
+	}
+
+	CString sData = GetModInfoCacheHeader() + "\n";
+	map<CString, CModInfoCacheEntry>::const_iterator it;
+
+	for (it = g_mModInfoCache.begin(); it != g_mModInfoCache.end(); ++it) {
+		const CModInfoCacheEntry& Entry = it->second;
+
+		sData += it->first.Escape_n(CString::EURL) + "\t"
+			+ CString((unsigned long long) Entry.m_uSize) + "\t"
+			+ CString((long long) Entry.m_iMTime) + "\t"
+			+ CString(Entry.m_Info.IsGlobal()) + "\t"
+			+ CString(Entry.m_bVersionMismatch) + "\t"
+			+ Entry.m_Info.GetDescription().Escape_n(CString::EURL) + "\n";
+	}
+
+	File.Write(sData);
+	File.Close();
+
+	if (File.HadError() || !File.Move(sFile, true)) {
+		DEBUG("Could not write module cache [" << sFile << "]");
+		CFile::Delete(sFile + "~");
+	}
+}
+
 bool CModules::GetModInfo(CModInfo& ModInfo, const CString& sModule, CString& sRetMsg) {
 	CString sModPath, sTmp;
 
@@ -957,12 +1079,51 @@ bool CModules::GetModInfo(CModInfo& ModInfo, const CString& sModule, CString& sR
 }
 
 bool CModules::GetModPathInfo(CModInfo& ModInfo, const CString& sModule, const CString& sModPath, CString& sRetMsg) {
+	bool bRet = ReadModInfo(ModInfo, sModule, sModPath, sRetMsg);
+
+	SaveModInfoCache();
+
+	return bRet;
+}
+
+bool CModules::ReadModInfo(CModInfo& ModInfo, const CString& sModule, const CString& sModPath, CString& sRetMsg) {
+	LoadModInfoCache();
+
+	off_t uSize = CFile::GetSize(sModPath);
+	time_t iMTime = CFile::GetMTime(sModPath);
 	bool bVersionMismatch;
 
-	ModHandle p = OpenModule(sModule, sModPath, bVersionMismatch, ModInfo, sRetMsg);
+	map<CString, CModInfoCacheEntry>::const_iterator it = g_mModInfoCache.find(sModPath);
 
-	if (!p)
-		return false;
+	if (it != g_mModInfoCache.end() && it->second.m_uSize == uSize && it->second.m_iMTime == iMTime) {
+		ModInfo = it->second.m_Info;
+		bVersionMismatch = it->second.m_bVersionMismatch;
+	} else {
+		ModHandle p = OpenModule(sModule, sModPath, bVersionMismatch, ModInfo, sRetMsg);
+
+		if (!p) {
+			if (g_mModInfoCache.erase(sModPath))
+				g_bModInfoCacheDirty = true;
+			return false;
+		}
+
+		dlclose(p);
+
+		g_uModInfoCacheMisses++;
+
+		CModInfoCacheEntry& Entry = g_mModInfoCache[sModPath];
+		Entry.m_uSize = uSize;
+		Entry.m_iMTime = iMTime;
+		Entry.m_bVersionMismatch = bVersionMismatch;
+		Entry.m_Info = CModInfo();
+		Entry.m_Info.SetGlobal(ModInfo.IsGlobal());
+		Entry.m_Info.SetDescription(ModInfo.GetDescription());
+		g_bModInfoCacheDirty = true;
+
+		// The loaders point into the module which was just closed
+		ModInfo.SetLoader(NULL);
+		ModInfo.SetGlobalLoader(NULL);
+	}
 
 	ModInfo.SetName(sModule);
 	ModInfo.SetPath(sModPath);
@@ -971,8 +1132,6 @@ bool CModules::GetModPathInfo(CModInfo& ModInfo, const CString& sModule, const C
 		ModInfo.SetDescription("--- Version mismatch, recompile this module. ---");
 	}
 
-	dlclose(p);
-
 	return true;
 }
 
@@ -981,6 +1140,10 @@ void CModules::GetAvailableMods(set<CModInfo>& ssMods, bool bGlobal) {
 
 	unsigned int a = 0;
 	CDir Dir;
+	set<CString> ssSeen;
+	unsigned long long uStart = CUtils::GetMillTime();
+
+	unsigned int uMisses = g_uModInfoCacheMisses;
 
 	ModDirList dirs = GetModDirs();
 
@@ -996,7 +1159,8 @@ void CModules::GetAvailableMods(set<CModInfo>& ssMods, bool bGlobal) {
 			sName.RightChomp(strlen(MODULE_FILE_EXT));
 
 			CString sIgnoreRetMsg;
-			if (GetModPathInfo(ModInfo, sName, sPath, sIgnoreRetMsg)) {
+			ssSeen.insert(sPath);
+			if (ReadModInfo(ModInfo, sName, sPath, sIgnoreRetMsg)) {
 				if (ModInfo.IsGlobal() == bGlobal) {
 					ssMods.insert(ModInfo);
 				}
@@ -1004,6 +1168,22 @@ void CModules::GetAvailableMods(set<CModInfo>& ssMods, bool bGlobal) {
 		}
 	}
 
+	// Forget about modules which were deleted
+	for (map<CString, CModInfoCacheEntry>::iterator it = g_mModInfoCache.begin(); it != g_mModInfoCache.end();) {
+		if (ssSeen.find(it->first) == ssSeen.end()) {
+			g_mModInfoCache.erase(it++);
+			g_bModInfoCacheDirty = true;
+		} else {
+			++it;
+		}
+	}
+
+	DEBUG("GetAvailableMods(): " << ssSeen.size() << " modules, "
+			<< (g_uModInfoCacheMisses - uMisses) << " had to be opened, took "
+			<< (CUtils::GetMillTime() - uStart) << "ms");
+
+	SaveModInfoCache();
+
 	GLOBALMODULECALL(OnGetAvailableMods(ssMods, bGlobal), NULL, NULL, NOTHING);
 }
 
@@ -11,6 +11,7 @@
 
 #include "zncconfig.h"
 #include "WebModules.h"
+#include "PerfStats.h"
 #include "main.h"
 #include <set>
 #include <queue>
@@ -180,6 +181,7 @@ public:
 	typedef CGlobalModule* (*GlobalModLoader)(ModHandle p, const CString& sModName, const CString& sModPath);
 
 	CModInfo() {
+		m_bGlobal = false;
 		m_fGlobalLoader = NULL;
 		m_fLoader = NULL;
 	}
@@ -852,7 +854,8 @@ public:
 	void SetGlobal(bool b) { m_bGlobal = b; }
 	void SetDescription(const CString& s) { m_sDescription = s; }
 	void SetModPath(const CString& s) { m_sModPath = s; }
-	void SetArgs(const CString& s) { m_sArgs = s; }
+	//! The arguments are part of the user's config
+	void SetArgs(const CString& s);
 	// !Setters
 
 	// Getters
@@ -872,8 +875,16 @@ public:
 	 */
 	CClient* GetClient() { return m_pClient; }
 	CSockManager* GetManager() { return m_pManager; }
+	/** Calls and time of this module's hooks, keyed by the hook call's text.
+	 *  Only some calls are timed, so these are estimates.
+	 */
+	const map<const char*, CHookStats>& GetHookStats() const { return m_mHookStats; }
 	// !Getters
 
+	//! Called by CModules after a timed hook call which stands for uCalls calls
+	void AddHookTime(const char* szHook, unsigned long long uTime, unsigned int uCalls) { m_mHookStats[szHook].Add(uTime, uCalls); }
+	void ResetHookStats() { m_mHookStats.clear(); }
+
 protected:
 	bool               m_bGlobal;
 	CString            m_sDescription;
@@ -892,6 +903,7 @@ private:
 	MCString           m_mssRegistry; //!< way to save name/value pairs. Note there is no encryption involved in this
 	VWebSubPages       m_vSubPages;
 	map<CString, CModCommand> m_mCommands;
+	map<const char*, CHookStats> m_mHookStats;
 };
 
 class ZNC_API CModules : public vector<CModule*> {
@@ -905,6 +917,7 @@ public:
 	CClient* GetClient() { return m_pClient; }
 
 	void UnloadAll();
+	void ResetHookStats();
 
 	bool OnBoot();
 	bool OnPreRehash();
@@ -976,6 +989,11 @@ public:
 	bool UnloadModule(const CString& sModule, CString& sRetMsg);
 	bool ReloadModule(const CString& sModule, const CString& sArgs, CUser* pUser, CString& sRetMsg);
 
+	/** Get a module's description and type. This information is cached
+	 *  (in memory and in <ZNC path>/modules.cache) by the module's path,
+	 *  size and modification time, so the module only has to be opened
+	 *  if it changed. The returned CModInfo has no loader functions set.
+	 */
 	static bool GetModInfo(CModInfo& ModInfo, const CString& sModule, CString &sRetMsg);
 	static bool GetModPathInfo(CModInfo& ModInfo, const CString& sModule, const CString& sModPath, CString &sRetMsg);
 	static void GetAvailableMods(set<CModInfo>& ssMods, bool bGlobal = false);
@@ -990,6 +1008,7 @@ public:
 	static ModDirList GetModDirs();
 
 private:
+	static bool ReadModInfo(CModInfo& ModInfo, const CString& sModule, const CString& sModPath, CString &sRetMsg);
 	static ModHandle OpenModule(const CString& sModule, const CString& sModPath,
 			bool &bVersionMismatch, CModInfo& Info, CString& sRetMsg);
 
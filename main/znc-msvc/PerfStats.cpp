@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "PerfStats.h"
+#include "Modules.h"
+#include "User.h"
+#include "znc.h"
+
+static const unsigned long long g_auLoopBucketLimits[CPerfStats::LOOP_BUCKETS] = {
+	100, 1000, 5000, 10000, 50000, 100000, 500000, 0
+};
+
+static void AddModuleStats(const CModules& Modules, map<CString, CHookStats>& mRet, bool bByHook) {
+	for (CModules::const_iterator it = Modules.begin(); it != Modules.end(); ++it) {
+		const map<const char*, CHookStats>& mHooks = (*it)->GetHookStats();
+
+		for (map<const char*, CHookStats>::const_iterator it2 = mHooks.begin(); it2 != mHooks.end(); ++it2) {
+			if (bByHook) {
+				// The hooks are known by the call, e.g. "OnRaw(sLine)"
+				CString sHook = CString(it2->first).Token(0, false, "(");
+				mRet[(*it)->GetModName() + "/" + sHook].Add(it2->second);
+			} else {
+				mRet[(*it)->GetModName()].Add(it2->second);
+			}
+		}
+	}
+}
+
+CPerfStats::CPerfStats() {
+	m_tSince = time(NULL);
+	m_uLastTimerLag = 0;
+	m_uDroppedLines = 0;
+	m_uPausedClients = 0;
+	m_uStalledClients = 0;
+	m_uIRCReadPauses = 0;
+
+	for (unsigned int a = 0; a < LOOP_BUCKETS; a++) {
+		m_auLoopBuckets[a] = 0;
+	}
+
+	for (unsigned int b = 0; b < LINE_COUNTERS; b++) {
+		m_auLines[b] = 0;
+	}
+}
+
+void CPerfStats::AddLoop(unsigned long long uBusy) {
+	unsigned int uBucket = 0;
+
+	while (uBucket < LOOP_BUCKETS - 1 && uBusy >= g_auLoopBucketLimits[uBucket]) {
+		uBucket++;
+	}
+
+	m_auLoopBuckets[uBucket]++;
+	m_Loops.Add(uBusy);
+}
+
+void CPerfStats::AddTimerLag(unsigned long long uLag) {
+	m_uLastTimerLag = uLag;
+	m_TimerLag.Add(uLag);
+}
+
+void CPerfStats::Reset() {
+	*this = CPerfStats();
+
+	CZNC::Get().GetModules().ResetHookStats();
+
+	const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+	for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+		it->second->GetModules().ResetHookStats();
+	}
+}
+
+void CPerfStats::GetModuleStats(map<CString, CHookStats>& mRet, bool bByHook) {
+	mRet.clear();
+
+	AddModuleStats(CZNC::Get().GetModules(), mRet, bByHook);
+
+	const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+	for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+		AddModuleStats(it->second->GetModules(), mRet, bByHook);
+	}
+}
+
+unsigned long long CPerfStats::GetLoopBucketLimit(unsigned int uBucket) {
+	return (uBucket < LOOP_BUCKETS) ? g_auLoopBucketLimits[uBucket] : 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _PERFSTATS_H
+#define _PERFSTATS_H
+
+#include "zncconfig.h"
+#include "ZNCString.h"
+#include <map>
+
+//! Number of calls of a module hook and the time spent in them
+class ZNC_API CHookStats {
+public:
+	CHookStats() : m_uCalls(0), m_uTime(0), m_uMaxTime(0) {}
+
+	//! uCalls > 1 if this one call was timed on behalf of uCalls calls
+	void Add(unsigned long long uTime, unsigned int uCalls = 1) {
+		m_uCalls += uCalls;
+		m_uTime += uTime * uCalls;
+		if (uTime > m_uMaxTime) {
+			m_uMaxTime = uTime;
+		}
+	}
+
+	void Add(const CHookStats& Other) {
+		m_uCalls += Other.m_uCalls;
+		m_uTime += Other.m_uTime;
+		if (Other.m_uMaxTime > m_uMaxTime) {
+			m_uMaxTime = Other.m_uMaxTime;
+		}
+	}
+
+	// Getters
+	unsigned long long GetCalls() const { return m_uCalls; }
+	//! In microseconds, like all times here
+	unsigned long long GetTime() const { return m_uTime; }
+	unsigned long long GetMaxTime() const { return m_uMaxTime; }
+	// !Getters
+
+private:
+	unsigned long long m_uCalls;
+	unsigned long long m_uTime;
+	unsigned long long m_uMaxTime;
+};
+
+/**
+ * @class CPerfStats
+ * @brief Where ZNC spends its time and memory, see the "Perf" status command.
+ *
+ * CZNC feeds this with the time each event loop iteration took (without
+ * waiting for sockets) and with how late a once-per-second timer fires.
+ * The module hook timings are kept by each CModule, GetModuleStats() adds
+ * them up over all users. The memory limits count what they had to do here.
+ */
+class ZNC_API CPerfStats {
+public:
+	enum { LOOP_BUCKETS = 8 };
+	enum ELineCounter {
+		LINES_IRC_IN,
+		LINES_IRC_OUT,
+		LINES_CLIENT_IN,
+		LINES_CLIENT_OUT,
+		LINE_COUNTERS
+	};
+
+	CPerfStats();
+	~CPerfStats() {}
+
+	void AddLoop(unsigned long long uBusy);
+	void AddTimerLag(unsigned long long uLag);
+	void AddLine(ELineCounter eCounter) { m_auLines[eCounter]++; }
+	void AddDroppedLines(unsigned int u) { m_uDroppedLines += u; }
+	void AddPausedClient() { m_uPausedClients++; }
+	void AddStalledClient() { m_uStalledClients++; }
+	void AddIRCReadPause() { m_uIRCReadPauses++; }
+	//! Also resets the hook timings of all modules
+	void Reset();
+
+	/** Adds up the hook timings of all loaded modules by module name.
+	 *  With bByHook the keys are "module/OnHook" instead.
+	 */
+	static void GetModuleStats(std::map<CString, CHookStats>& mRet, bool bByHook);
+	//! Upper bound of a loop histogram bucket in microseconds, 0 for the last one
+	static unsigned long long GetLoopBucketLimit(unsigned int uBucket);
+
+	// Getters
+	time_t GetSince() const { return m_tSince; }
+	const CHookStats& GetLoops() const { return m_Loops; }
+	unsigned long long GetLoopBucket(unsigned int uBucket) const { return m_auLoopBuckets[uBucket]; }
+	const CHookStats& GetTimerLag() const { return m_TimerLag; }
+	unsigned long long GetLastTimerLag() const { return m_uLastTimerLag; }
+	unsigned long long GetLines(ELineCounter eCounter) const { return m_auLines[eCounter]; }
+	//! Buffer lines dropped because of UserBufferLimit
+	unsigned long long GetDroppedLines() const { return m_uDroppedLines; }
+	//! Clients which we stopped reading from because of ClientSendQSoftLimit
+	unsigned long long GetPausedClients() const { return m_uPausedClients; }
+	//! Clients disconnected because of ClientSendQHardLimit
+	unsigned long long GetStalledClients() const { return m_uStalledClients; }
+	//! How often we stopped reading from IRC because of ClientSendQHighWater
+	unsigned long long GetIRCReadPauses() const { return m_uIRCReadPauses; }
+	// !Getters
+
+private:
+	time_t             m_tSince;
+	CHookStats         m_Loops;
+	unsigned long long m_auLoopBuckets[LOOP_BUCKETS];
+	CHookStats         m_TimerLag;
+	unsigned long long m_uLastTimerLag;
+	unsigned long long m_auLines[LINE_COUNTERS];
+	unsigned long long m_uDroppedLines;
+	unsigned long long m_uPausedClients;
+	unsigned long long m_uStalledClients;
+	unsigned long long m_uIRCReadPauses;
+};
+
+#endif // !_PERFSTATS_H
@@ -11,25 +11,80 @@
 #include "Modules.h"
 #include "User.h"
 #include "znc.h"
+#include "FileUtils.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
 
 unsigned int CSockManager::GetAnonConnectionCount(const CString &sIP) const {
-	const_iterator it;
-	unsigned int ret = 0;
-
-	for (it = begin(); it != end(); ++it) {
-		Csock *pSock = *it;
-		// Logged in CClients have "USR::<username>" as their sockname
-		if (pSock->GetType() == Csock::INBOUND && pSock->GetRemoteIP() == sIP
-				&& pSock->GetSockName().Left(5) != "USR::") {
-			ret++;
-		}
-	}
+	map<CString, pair<unsigned int, unsigned int> >::const_iterator it = m_mIPConns.find(sIP);
+	unsigned int ret = (it != m_mIPConns.end()) ? it->second.first : 0;
 
 	DEBUG("There are [" << ret << "] clients from [" << sIP << "]");
 
 	return ret;
 }
 
+unsigned int CSockManager::GetConnectionCount(const CString &sIP) const {
+	map<CString, pair<unsigned int, unsigned int> >::const_iterator it = m_mIPConns.find(sIP);
+
+	return (it != m_mIPConns.end()) ? it->second.first + it->second.second : 0;
+}
+
+int CSockManager::Select(std::map<int, short>& miiReadyFds, struct timeval* tvtimeout) {
+	unsigned long long uStart = CUtils::GetMicroTime();
+	int iRet = TSocketManager<CZNCSock>::Select(miiReadyFds, tvtimeout);
+
+	m_uWaitTime += CUtils::GetMicroTime() - uStart;
+	return iRet;
+}
+
+void CSockManager::AddSockIndex(Csock* pSock) {
+	TSocketManager<CZNCSock>::AddSockIndex(pSock);
+
+	if (pSock->GetType() != Csock::INBOUND) {
+		return;
+	}
+
+	// Logged in CClients have "USR::<username>" as their sockname
+	bool bAnon = (pSock->GetSockName().Left(5) != "USR::");
+	const CString sIP = pSock->GetRemoteIP();
+	pair<unsigned int, unsigned int>& Conns = m_mIPConns[sIP];
+
+	if (bAnon) {
+		Conns.first++;
+	} else {
+		Conns.second++;
+	}
+
+	m_mInboundSocks[pSock] = make_pair(sIP, bAnon);
+}
+
+void CSockManager::DelSockIndex(Csock* pSock) {
+	TSocketManager<CZNCSock>::DelSockIndex(pSock);
+
+	map<Csock*, pair<CString, bool> >::iterator it = m_mInboundSocks.find(pSock);
+	if (it == m_mInboundSocks.end()) {
+		return;
+	}
+
+	map<CString, pair<unsigned int, unsigned int> >::iterator itIP = m_mIPConns.find(it->second.first);
+	if (itIP != m_mIPConns.end()) {
+		if (it->second.second) {
+			itIP->second.first--;
+		} else {
+			itIP->second.second--;
+		}
+
+		if (itIP->second.first == 0 && itIP->second.second == 0) {
+			m_mIPConns.erase(itIP);
+		}
+	}
+
+	m_mInboundSocks.erase(it);
+}
+
 int CZNCSock::ConvertAddress( const struct sockaddr_storage * pAddr, socklen_t iAddrLen, CS_STRING & sIP, u_short * piPort ) {
 	int iRet = Csock::ConvertAddress(pAddr, iAddrLen, sIP, piPort);
 	if (pAddr->ss_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&reinterpret_cast<const struct sockaddr_in6 *>(pAddr)->sin6_addr)) {
@@ -41,6 +96,7 @@ int CZNCSock::ConvertAddress( const struct sockaddr_storage * pAddr, socklen_t i
 /////////////////// CSocket ///////////////////
 CSocket::CSocket(CModule* pModule) : CZNCSock() {
 	m_pModule = pModule;
+	m_iPipe[0] = m_iPipe[1] = -1;
 	if (m_pModule) m_pModule->AddSocket(this);
 	EnableReadLine();
 	SetMaxBufferThreshold(10240);
@@ -48,6 +104,7 @@ CSocket::CSocket(CModule* pModule) : CZNCSock() {
 
 CSocket::CSocket(CModule* pModule, const CString& sHostname, unsigned short uPort, int iTimeout) : CZNCSock(sHostname, uPort, iTimeout) {
 	m_pModule = pModule;
+	m_iPipe[0] = m_iPipe[1] = -1;
 	if (m_pModule) m_pModule->AddSocket(this);
 	EnableReadLine();
 	SetMaxBufferThreshold(10240);
@@ -56,6 +113,13 @@ CSocket::CSocket(CModule* pModule, const CString& sHostname, unsigned short uPor
 CSocket::~CSocket() {
 	CUser *pUser = NULL;
 
+#ifdef __linux__
+	if (m_iPipe[0] != -1) {
+		close(m_iPipe[0]);
+		close(m_iPipe[1]);
+	}
+#endif
+
 	// CWebSock could cause us to have a NULL pointer here
 	if (m_pModule) {
 		pUser = m_pModule->GetUser();
@@ -71,6 +135,90 @@ CSocket::~CSocket() {
 	}
 }
 
+bool CSocket::CanZeroCopy() {
+	return IsConnected() && !GetSSL() && GetRateBytes() == 0 && GetWriteBuffer().empty();
+}
+
+cs_ssize_t CSocket::SendFile(CFile& File, off_t uOffset, size_t uLen) {
+#ifdef __linux__
+	if (!CanZeroCopy() || File.GetFD() == -1) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	off_t iOffset = uOffset;
+	ssize_t iSent = sendfile(GetWSock(), File.GetFD(), &iOffset, uLen);
+
+	if (iSent > 0) {
+		AddBytesWritten(iSent);
+		if (TMO_WRITE & GetTimeoutType())
+			ResetTimer();
+	}
+
+	return iSent;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+cs_ssize_t CSocket::SpliceTo(CSocket& Peer, size_t uLen) {
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+	if (!CanZeroCopy() || !Peer.CanZeroCopy()) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	if (m_iPipe[0] == -1) {
+		if (pipe(m_iPipe) != 0) {
+			m_iPipe[0] = m_iPipe[1] = -1;
+			return -1;
+		}
+		fcntl(m_iPipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(m_iPipe[1], F_SETFL, O_NONBLOCK);
+	}
+
+	ssize_t iRead = splice(GetRSock(), NULL, m_iPipe[1], NULL, uLen, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+	if (iRead <= 0)
+		return iRead;
+
+	AddBytesRead(iRead);
+	if (TMO_READ & GetTimeoutType())
+		ResetTimer();
+
+	size_t uLeft = iRead;
+	while (uLeft > 0) {
+		ssize_t iWritten = splice(m_iPipe[0], NULL, Peer.GetWSock(), NULL, uLeft, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+		if (iWritten <= 0)
+			break;
+
+		uLeft -= iWritten;
+		Peer.AddBytesWritten(iWritten);
+		if (TMO_WRITE & Peer.GetTimeoutType())
+			Peer.ResetTimer();
+	}
+
+	// The peer is full, the pipe has to be empty for the next call
+	while (uLeft > 0) {
+		char szBuf[4096];
+		ssize_t iLen = read(m_iPipe[0], szBuf, (uLeft < sizeof(szBuf)) ? uLeft : sizeof(szBuf));
+
+		if (iLen <= 0)
+			break;
+
+		uLeft -= iLen;
+		Peer.Write(szBuf, iLen);
+	}
+
+	return iRead;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 void CSocket::ReachedMaxBuffer() {
 	DEBUG(GetSockName() << " == ReachedMaxBuffer()");
 	if (m_pModule) m_pModule->PutModule("Some socket reached its max buffer limit and was closed!");
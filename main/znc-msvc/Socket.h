@@ -13,6 +13,7 @@
 #include "Csocket.h"
 
 class CModule;
+class CFile;
 
 class ZNC_API CZNCSock : public Csock {
 public:
@@ -31,7 +32,7 @@ enum EAddrType {
 
 class ZNC_API CSockManager : public TSocketManager<CZNCSock> {
 public:
-	CSockManager() {}
+	CSockManager() : m_uWaitTime(0) {}
 	virtual ~CSockManager() {}
 
 	bool ListenHost(u_short iPort, const CString& sSockName, const CString& sBindHost, bool bSSL = false, int iMaxConns = SOMAXCONN, CZNCSock *pcSock = NULL, u_int iTimeout = 0, EAddrType eAddr = ADDR_ALL) {
@@ -106,8 +107,20 @@ public:
 	}
 
 	unsigned int GetAnonConnectionCount(const CString &sIP) const;
+	//! Counts all incoming connections from sIP, logged in or not
+	unsigned int GetConnectionCount(const CString &sIP) const;
+	//! Microseconds spent waiting for sockets in select()/poll() so far
+	unsigned long long GetWaitTime() const { return m_uWaitTime; }
 private:
+	unsigned long long m_uWaitTime;
+	// Incoming connections by IP, first is the number of anonymous ones
+	map<CString, pair<unsigned int, unsigned int> > m_mIPConns;
+	// The IP every incoming sock was counted for and whether it counted as anonymous
+	map<Csock*, pair<CString, bool> > m_mInboundSocks;
 protected:
+	virtual void AddSockIndex(Csock* pSock);
+	virtual void DelSockIndex(Csock* pSock);
+	virtual int Select(std::map<int, short>& miiReadyFds, struct timeval* tvtimeout);
 };
 
 /**
@@ -151,12 +164,34 @@ public:
 	//! Ease of use Listen, assigned to the manager and is subsequently tracked
 	bool Listen(unsigned short uPort, bool bSSL, unsigned int uTimeout = 0);
 
+	/** Zero-copy transfers only work on connected plain text sockets
+	 *  without a rate limit and with an empty write buffer. If this
+	 *  returns false (or SendFile()/SpliceTo() fail with ENOSYS or EINVAL),
+	 *  use Read() and Write() instead.
+	 */
+	bool CanZeroCopy();
+	/** Sends up to uLen bytes of File, starting at uOffset, without copying
+	 *  them through user space. File's position is not changed.
+	 *  @return the number of bytes sent, 0 at the end of the file or -1
+	 *          with errno set (EAGAIN if the socket is full).
+	 */
+	cs_ssize_t SendFile(CFile& File, off_t uOffset, size_t uLen);
+	/** Moves up to uLen bytes which are waiting on this socket to Peer,
+	 *  without copying them through user space. Anything Peer can't take
+	 *  right now ends up in its write buffer, so the usual write buffer
+	 *  based throttling still works.
+	 *  @return the number of bytes read, 0 on EOF or -1 with errno set
+	 *          (EAGAIN if nothing is waiting).
+	 */
+	cs_ssize_t SpliceTo(CSocket& Peer, size_t uLen);
+
 	// Getters
 	CModule* GetModule() const;
 	// !Getters
 private:
 protected:
 	CModule*  m_pModule; //!< pointer to the module that this sock instance belongs to
+	int       m_iPipe[2]; //!< used by SpliceTo(), created on first use
 };
 
 #endif /* SOCKET_H */
@@ -0,0 +1,842 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "StreamParser.h"
+
+// a single tag, comment or JSON token must not get any larger than this
+#define MAX_TOKEN_SIZE	1024 * 1024
+// objects and arrays nested deeper than this are rejected
+#define MAX_JSON_DEPTH	512
+
+static inline bool IsSpace(char c) {
+	return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+static void AppendUTF8(CString& sOut, unsigned long uChar) {
+	if (uChar < 0x80) {
+		sOut += (char) uChar;
+	} else if (uChar < 0x800) {
+		sOut += (char) (0xC0 | (uChar >> 6));
+		sOut += (char) (0x80 | (uChar & 0x3F));
+	} else if (uChar < 0x10000) {
+		sOut += (char) (0xE0 | (uChar >> 12));
+		sOut += (char) (0x80 | ((uChar >> 6) & 0x3F));
+		sOut += (char) (0x80 | (uChar & 0x3F));
+	} else {
+		sOut += (char) (0xF0 | (uChar >> 18));
+		sOut += (char) (0x80 | ((uChar >> 12) & 0x3F));
+		sOut += (char) (0x80 | ((uChar >> 6) & 0x3F));
+		sOut += (char) (0x80 | (uChar & 0x3F));
+	}
+}
+
+/////////////////// CStrSpan ///////////////////
+bool CStrSpan::Equals(const char* psz, bool bCaseSensitive) const {
+	size_t uLen = strlen(psz);
+
+	if (uLen != m_uLen) {
+		return false;
+	}
+
+	if (bCaseSensitive) {
+		return (memcmp(m_pData, psz, uLen) == 0);
+	}
+
+	return (strncasecmp(m_pData, psz, uLen) == 0);
+}
+/////////////////// !CStrSpan ///////////////////
+
+/////////////////// CXMLStreamParser ///////////////////
+CXMLStreamParser::CXMLStreamParser() {
+	Reset();
+}
+
+CXMLStreamParser::~CXMLStreamParser() {}
+
+void CXMLStreamParser::Reset() {
+	m_eState = XS_TEXT;
+	m_sMarkup.clear();
+	m_uMarkupLen = 0;
+	m_cQuote = m_cPrev1 = m_cPrev2 = 0;
+	m_uDeclDepth = 0;
+	m_sOpen.clear();
+	m_vuOpen.clear();
+	m_vAttributes.clear();
+	m_bSeenRoot = false;
+	m_bRootClosed = false;
+	m_uOffset = 0;
+	m_sError.clear();
+}
+
+void CXMLStreamParser::SetError(const CString& sError) {
+	// the first error is the interesting one
+	if (m_sError.empty()) {
+		m_sError = sError;
+	}
+}
+
+bool CXMLStreamParser::Feed(const char* pData, size_t uLen) {
+	static const char szCData[] = "![CDATA[";
+
+	if (HasError()) {
+		return false;
+	}
+
+	const char* p = pData;
+	const char* pEnd = pData + uLen;
+	// start of the markup's contents, if the markup began in this piece
+	const char* pMarkup = pData;
+
+	while (p < pEnd) {
+		if (m_eState == XS_TEXT) {
+			const char* pLT = (const char*) memchr(p, '<', pEnd - p);
+			const char* pTextEnd = (pLT ? pLT : pEnd);
+
+			// whitespace and junk outside of the root element are ignored
+			if (pTextEnd > p && !m_vuOpen.empty()) {
+				OnText(CStrSpan(p, pTextEnd - p));
+
+				if (HasError()) {
+					m_uOffset += p - pData;
+					return false;
+				}
+			}
+
+			if (!pLT) {
+				p = pEnd;
+				break;
+			}
+
+			p = pLT + 1;
+			pMarkup = p;
+			m_eState = XS_MARKUP;
+			m_uMarkupLen = 0;
+			m_cQuote = m_cPrev1 = m_cPrev2 = 0;
+			m_uDeclDepth = 0;
+			continue;
+		}
+
+		char c = *p++;
+		bool bDone = false;
+
+		switch (m_eState) {
+		case XS_MARKUP:
+			if (c == '?') {
+				m_eState = XS_PI;
+			} else if (c == '!') {
+				m_eState = XS_BANG;
+			} else if (c == '>') {
+				bDone = true;
+			} else {
+				m_eState = XS_TAG;
+			}
+			break;
+		case XS_BANG:
+			// still deciding between <!-- -->, <![CDATA[ ]]> and <!DOCTYPE>
+			if (m_uMarkupLen == 1 && (c == '-' || c == '[')) {
+				break;
+			} else if (m_uMarkupLen == 2 && m_cPrev1 == '-') {
+				if (c == '-') {
+					m_eState = XS_COMMENT;
+					break;
+				}
+			} else if (m_uMarkupLen >= 2 && m_uMarkupLen < 8 && c == szCData[m_uMarkupLen]) {
+				if (m_uMarkupLen == 7) {
+					m_eState = XS_CDATA;
+				}
+				break;
+			}
+
+			m_eState = XS_DECL;
+			// fall through
+		case XS_DECL:
+			if (c == '[') {
+				m_uDeclDepth++;
+			} else if (c == ']' && m_uDeclDepth > 0) {
+				m_uDeclDepth--;
+			} else if (c == '>' && m_uDeclDepth == 0) {
+				bDone = true;
+			}
+			break;
+		case XS_TAG:
+			if (m_cQuote) {
+				if (c == m_cQuote) m_cQuote = 0;
+			} else if (c == '"' || c == '\'') {
+				m_cQuote = c;
+			} else if (c == '>') {
+				bDone = true;
+			}
+			break;
+		case XS_COMMENT:
+			bDone = (c == '>' && m_cPrev1 == '-' && m_cPrev2 == '-' && m_uMarkupLen >= 5);
+			break;
+		case XS_CDATA:
+			bDone = (c == '>' && m_cPrev1 == ']' && m_cPrev2 == ']' && m_uMarkupLen >= 10);
+			break;
+		case XS_PI:
+			bDone = (c == '>' && m_cPrev1 == '?' && m_uMarkupLen >= 2);
+			break;
+		case XS_TEXT:
+			break;
+		}
+
+		if (!bDone) {
+			m_cPrev2 = m_cPrev1;
+			m_cPrev1 = c;
+			m_uMarkupLen++;
+			continue;
+		}
+
+		bool bOK;
+
+		if (m_sMarkup.empty()) {
+			bOK = ProcessMarkup(pMarkup, p - 1 - pMarkup);
+		} else {
+			m_sMarkup.append(pMarkup, p - 1 - pMarkup);
+			bOK = ProcessMarkup(m_sMarkup.data(), m_sMarkup.size());
+			m_sMarkup.clear();
+		}
+
+		m_eState = XS_TEXT;
+
+		if (!bOK) {
+			m_uOffset += p - pData;
+			return false;
+		}
+	}
+
+	if (m_eState != XS_TEXT) {
+		// keep the unfinished markup for the next call
+		m_sMarkup.append(pMarkup, pEnd - pMarkup);
+
+		if (m_sMarkup.size() > MAX_TOKEN_SIZE) {
+			SetError("Markup too long");
+			return false;
+		}
+	}
+
+	m_uOffset += uLen;
+
+	return true;
+}
+
+bool CXMLStreamParser::Finish() {
+	if (HasError()) {
+		return false;
+	}
+
+	if (m_eState != XS_TEXT) {
+		SetError("Unterminated markup at the end of the document");
+	} else if (!m_vuOpen.empty()) {
+		SetError("Found unclosed tags");
+	}
+
+	return !HasError();
+}
+
+bool CXMLStreamParser::ProcessMarkup(const char* pData, size_t uLen) {
+	switch (m_eState) {
+	case XS_MARKUP:
+	case XS_TAG:
+		return ProcessTag(pData, uLen);
+	case XS_CDATA:
+		if (m_vuOpen.empty()) {
+			SetError("CDATA outside of the root element");
+			return false;
+		}
+
+		// strip the leading ![CDATA[ and the trailing ]]
+		OnCData(CStrSpan(pData + 8, uLen - 10));
+		break;
+	default:
+		// comments, processing instructions and DTDs are skipped
+		break;
+	}
+
+	return !HasError();
+}
+
+bool CXMLStreamParser::ProcessTag(const char* pData, size_t uLen) {
+	size_t uEnd = uLen;
+
+	while (uEnd > 0 && IsSpace(pData[uEnd - 1])) {
+		uEnd--;
+	}
+
+	if (uEnd == 0) {
+		SetError("Empty tag");
+		return false;
+	}
+
+	if (pData[0] == '/') {
+		CStrSpan sName(pData + 1, uEnd - 1);
+
+		if (m_vuOpen.empty() || m_sOpen.size() - m_vuOpen.back() != sName.size()
+				|| memcmp(m_sOpen.data() + m_vuOpen.back(), sName.data(), sName.size()) != 0) {
+			SetError("Ending tag for '" + sName.ToString() + "', which is not open");
+			return false;
+		}
+
+		OnEndElement(sName);
+
+		m_sOpen.erase(m_vuOpen.back());
+		m_vuOpen.pop_back();
+		m_bRootClosed = m_vuOpen.empty();
+
+		return !HasError();
+	}
+
+	// look out for <img /> style tags
+	bool bSelfClosing = (pData[uEnd - 1] == '/');
+
+	if (bSelfClosing) {
+		uEnd--;
+	}
+
+	size_t u = 0;
+
+	while (u < uEnd && !IsSpace(pData[u])) {
+		u++;
+	}
+
+	if (u == 0) {
+		SetError("Empty tag");
+		return false;
+	}
+
+	if (m_bRootClosed) {
+		SetError("Multiple root tags?");
+		return false;
+	}
+
+	CStrSpan sName(pData, u);
+
+	m_vAttributes.clear();
+
+	while (true) {
+		while (u < uEnd && IsSpace(pData[u])) u++;
+
+		if (u >= uEnd) {
+			break;
+		}
+
+		size_t uNameStart = u;
+
+		while (u < uEnd && pData[u] != '=' && !IsSpace(pData[u])) u++;
+
+		CStrSpan sAttr(pData + uNameStart, u - uNameStart);
+
+		while (u < uEnd && IsSpace(pData[u])) u++;
+
+		if (u >= uEnd || pData[u] != '=') {
+			// an attribute without a value, like the bar in <foo bar>
+			m_vAttributes.push_back(std::make_pair(sAttr, CStrSpan(pData + u, 0)));
+			continue;
+		}
+
+		u++;
+
+		while (u < uEnd && IsSpace(pData[u])) u++;
+
+		const char* pClose = NULL;
+
+		if (u < uEnd && (pData[u] == '"' || pData[u] == '\'')) {
+			pClose = (const char*) memchr(pData + u + 1, pData[u], uEnd - u - 1);
+		}
+
+		if (!pClose) {
+			SetError("Couldn't parse the attributes of <" + sName.ToString() + ">");
+			return false;
+		}
+
+		m_vAttributes.push_back(std::make_pair(sAttr, CStrSpan(pData + u + 1, pClose - pData - u - 1)));
+		u = pClose - pData + 1;
+	}
+
+	m_bSeenRoot = true;
+	m_vuOpen.push_back(m_sOpen.size());
+	m_sOpen.append(sName.data(), sName.size());
+
+	OnStartElement(sName, m_vAttributes);
+
+	if (bSelfClosing && !HasError()) {
+		OnEndElement(sName);
+
+		m_sOpen.erase(m_vuOpen.back());
+		m_vuOpen.pop_back();
+		m_bRootClosed = m_vuOpen.empty();
+	}
+
+	return !HasError();
+}
+
+CStrSpan CXMLStreamParser::GetAttribute(const VAttributes& vAttributes, const char* pszName) {
+	for (VAttributes::const_iterator it = vAttributes.begin(); it != vAttributes.end(); ++it) {
+		if (it->first.Equals(pszName)) {
+			return it->second;
+		}
+	}
+
+	return CStrSpan();
+}
+
+CString CXMLStreamParser::DecodeEntities(const char* pData, size_t uLen) {
+	CString sRet;
+	size_t u = 0;
+
+	sRet.reserve(uLen);
+
+	while (u < uLen) {
+		const char* pAmp = (const char*) memchr(pData + u, '&', uLen - u);
+
+		if (!pAmp) {
+			sRet.append(pData + u, uLen - u);
+			break;
+		}
+
+		sRet.append(pData + u, pAmp - pData - u);
+		u = pAmp - pData;
+
+		// the longest entity we know is &#x10FFFF;
+		const char* pSemi = (const char*) memchr(pAmp, ';', (uLen - u < 11 ? uLen - u : 11));
+		bool bOK = (pSemi != NULL);
+
+		if (bOK) {
+			CStrSpan sEnt(pAmp + 1, pSemi - pAmp - 1);
+
+			if (sEnt.Equals("lt")) {
+				sRet += '<';
+			} else if (sEnt.Equals("gt")) {
+				sRet += '>';
+			} else if (sEnt.Equals("amp")) {
+				sRet += '&';
+			} else if (sEnt.Equals("quot")) {
+				sRet += '"';
+			} else if (sEnt.Equals("apos")) {
+				sRet += '\'';
+			} else if (sEnt.size() > 1 && sEnt.data()[0] == '#') {
+				CString sNum = sEnt.ToString();
+				bool bHex = (sNum[1] == 'x' || sNum[1] == 'X');
+				const char* pStart = sNum.c_str() + (bHex ? 2 : 1);
+				char* pNumEnd = NULL;
+				unsigned long uChar = strtoul(pStart, &pNumEnd, (bHex ? 16 : 10));
+
+				bOK = (pNumEnd != pStart && *pNumEnd == '\0' && uChar > 0 && uChar <= 0x10FFFF);
+
+				if (bOK) {
+					AppendUTF8(sRet, uChar);
+				}
+			} else {
+				bOK = false;
+			}
+		}
+
+		if (bOK) {
+			u = pSemi - pData + 1;
+		} else {
+			// not an entity we understand, leave it alone
+			sRet += '&';
+			u++;
+		}
+	}
+
+	return sRet;
+}
+/////////////////// !CXMLStreamParser ///////////////////
+
+/////////////////// CJSONStreamParser ///////////////////
+CJSONStreamParser::CJSONStreamParser() {
+	Reset();
+}
+
+CJSONStreamParser::~CJSONStreamParser() {}
+
+void CJSONStreamParser::Reset() {
+	m_eExpect = JE_VALUE;
+	m_eToken = JT_NONE;
+	m_bEscape = false;
+	m_sToken.clear();
+	m_sStack.clear();
+	m_uOffset = 0;
+	m_sError.clear();
+}
+
+void CJSONStreamParser::SetError(const CString& sError) {
+	if (m_sError.empty()) {
+		m_sError = sError;
+	}
+}
+
+bool CJSONStreamParser::BeginValue() {
+	if (m_eExpect != JE_VALUE && m_eExpect != JE_VALUE_OR_END) {
+		SetError(m_eExpect == JE_DONE ? "Garbage after the end of the document" : "Unexpected value");
+		return false;
+	}
+
+	return true;
+}
+
+void CJSONStreamParser::EndValue() {
+	m_eExpect = (m_sStack.empty() ? JE_DONE : JE_COMMA_OR_END);
+}
+
+bool CJSONStreamParser::CloseContainer(char cType) {
+	bool bOK = (!m_sStack.empty() && m_sStack[m_sStack.size() - 1] == cType);
+
+	if (bOK) {
+		bOK = (m_eExpect == JE_COMMA_OR_END || m_eExpect == (cType == '{' ? JE_KEY_OR_END : JE_VALUE_OR_END));
+	}
+
+	if (!bOK) {
+		SetError(CString("Unexpected ") + (cType == '{' ? "}" : "]"));
+		return false;
+	}
+
+	m_sStack.erase(m_sStack.size() - 1);
+
+	if (cType == '{') {
+		OnObjectEnd();
+	} else {
+		OnArrayEnd();
+	}
+
+	EndValue();
+
+	return !HasError();
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? as in RFC 4627. strtod()
+// would also take hex numbers, inf, nan and leading whitespace.
+static bool IsJSONNumber(const CStrSpan& sNum) {
+	const char* p = sNum.data();
+	const char* pEnd = p + sNum.size();
+
+	if (p != pEnd && *p == '-') {
+		p++;
+	}
+
+	if (p == pEnd || !isdigit((unsigned char) *p)) {
+		return false;
+	}
+
+	if (*p == '0') {
+		p++;
+	} else {
+		while (p != pEnd && isdigit((unsigned char) *p)) p++;
+	}
+
+	if (p != pEnd && *p == '.') {
+		if (++p == pEnd || !isdigit((unsigned char) *p)) {
+			return false;
+		}
+
+		while (p != pEnd && isdigit((unsigned char) *p)) p++;
+	}
+
+	if (p != pEnd && (*p == 'e' || *p == 'E')) {
+		p++;
+
+		if (p != pEnd && (*p == '+' || *p == '-')) {
+			p++;
+		}
+
+		if (p == pEnd || !isdigit((unsigned char) *p)) {
+			return false;
+		}
+
+		while (p != pEnd && isdigit((unsigned char) *p)) p++;
+	}
+
+	return (p == pEnd);
+}
+
+bool CJSONStreamParser::EmitToken(const char* pData, size_t uLen) {
+	CStrSpan sToken(pData, uLen);
+	EToken eToken = m_eToken;
+
+	m_eToken = JT_NONE;
+
+	if (eToken == JT_STRING) {
+		if (m_eExpect == JE_KEY || m_eExpect == JE_KEY_OR_END) {
+			OnKey(sToken);
+			m_eExpect = JE_COLON;
+			return !HasError();
+		}
+
+		OnString(sToken);
+	} else if (eToken == JT_NUMBER) {
+		if (!IsJSONNumber(sToken)) {
+			SetError("Invalid number: " + sToken.ToString());
+			return false;
+		}
+
+		OnNumber(sToken);
+	} else if (sToken.Equals("true")) {
+		OnBool(true);
+	} else if (sToken.Equals("false")) {
+		OnBool(false);
+	} else if (sToken.Equals("null")) {
+		OnNull();
+	} else {
+		SetError("Unknown literal: " + sToken.ToString());
+		return false;
+	}
+
+	EndValue();
+
+	return !HasError();
+}
+
+bool CJSONStreamParser::Feed(const char* pData, size_t uLen) {
+	if (HasError()) {
+		return false;
+	}
+
+	const char* p = pData;
+	const char* pEnd = pData + uLen;
+	// start of the current token, if it began in this piece
+	const char* pToken = pData;
+
+	while (p < pEnd) {
+		if (m_eToken == JT_STRING) {
+			while (p < pEnd) {
+				char c = *p;
+
+				if (m_bEscape) {
+					m_bEscape = false;
+				} else if (c == '\\') {
+					m_bEscape = true;
+				} else if (c == '"') {
+					break;
+				} else if ((unsigned char) c < 0x20) {
+					SetError("Control character in string");
+					break;
+				}
+
+				p++;
+			}
+
+			if (HasError()) {
+				break;
+			}
+
+			if (p == pEnd) {
+				break;
+			}
+		} else if (m_eToken != JT_NONE) {
+			while (p < pEnd && (isalnum((unsigned char) *p) || *p == '-' || *p == '+' || *p == '.')) {
+				p++;
+			}
+
+			if (p == pEnd) {
+				break;
+			}
+		}
+
+		if (m_eToken != JT_NONE) {
+			bool bString = (m_eToken == JT_STRING);
+			bool bOK;
+
+			if (m_sToken.empty()) {
+				bOK = EmitToken(pToken, p - pToken);
+			} else {
+				m_sToken.append(pToken, p - pToken);
+				bOK = EmitToken(m_sToken.data(), m_sToken.size());
+				m_sToken.clear();
+			}
+
+			if (!bOK) {
+				break;
+			}
+
+			// skip the closing quote, but not whatever ended a number
+			if (bString) {
+				p++;
+			}
+
+			continue;
+		}
+
+		char c = *p;
+
+		switch (c) {
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			break;
+		case '{':
+		case '[':
+			if (!BeginValue()) {
+				break;
+			}
+
+			if (m_sStack.size() >= MAX_JSON_DEPTH) {
+				SetError("Nested too deeply");
+				break;
+			}
+
+			m_sStack += c;
+
+			if (c == '{') {
+				m_eExpect = JE_KEY_OR_END;
+				OnObjectStart();
+			} else {
+				m_eExpect = JE_VALUE_OR_END;
+				OnArrayStart();
+			}
+			break;
+		case '}':
+			CloseContainer('{');
+			break;
+		case ']':
+			CloseContainer('[');
+			break;
+		case ':':
+			if (m_eExpect != JE_COLON) {
+				SetError("Unexpected :");
+				break;
+			}
+
+			m_eExpect = JE_VALUE;
+			break;
+		case ',':
+			if (m_eExpect != JE_COMMA_OR_END) {
+				SetError("Unexpected ,");
+				break;
+			}
+
+			m_eExpect = (m_sStack[m_sStack.size() - 1] == '{' ? JE_KEY : JE_VALUE);
+			break;
+		case '"':
+			if (m_eExpect != JE_KEY && m_eExpect != JE_KEY_OR_END && !BeginValue()) {
+				break;
+			}
+
+			m_eToken = JT_STRING;
+			m_bEscape = false;
+			pToken = p + 1;
+			break;
+		default:
+			if (!isalnum((unsigned char) c) && c != '-') {
+				SetError("Unexpected character");
+				break;
+			}
+
+			if (!BeginValue()) {
+				break;
+			}
+
+			m_eToken = ((c == '-' || isdigit((unsigned char) c)) ? JT_NUMBER : JT_LITERAL);
+			pToken = p;
+			// the token loop above picks it up
+			continue;
+		}
+
+		if (HasError()) {
+			break;
+		}
+
+		p++;
+	}
+
+	if (HasError()) {
+		m_uOffset += p - pData;
+		return false;
+	}
+
+	if (m_eToken != JT_NONE) {
+		// keep the unfinished token for the next call
+		m_sToken.append(pToken, pEnd - pToken);
+
+		if (m_sToken.size() > MAX_TOKEN_SIZE) {
+			SetError("Token too long");
+			return false;
+		}
+	}
+
+	m_uOffset += uLen;
+
+	return true;
+}
+
+bool CJSONStreamParser::Finish() {
+	if (HasError()) {
+		return false;
+	}
+
+	if (m_eToken == JT_STRING) {
+		SetError("Unterminated string at the end of the document");
+	} else if (m_eToken != JT_NONE) {
+		// a number or literal at the very end of the document
+		CString sToken = m_sToken;
+
+		m_sToken.clear();
+		EmitToken(sToken.data(), sToken.size());
+	}
+
+	if (!HasError() && m_eExpect != JE_DONE) {
+		SetError("Unexpected end of the document");
+	}
+
+	return !HasError();
+}
+
+CString CJSONStreamParser::Unescape(const char* pData, size_t uLen) {
+	CString sRet;
+	size_t u = 0;
+
+	sRet.reserve(uLen);
+
+	while (u < uLen) {
+		const char* pBackslash = (const char*) memchr(pData + u, '\\', uLen - u);
+
+		if (!pBackslash || pBackslash + 1 >= pData + uLen) {
+			sRet.append(pData + u, uLen - u);
+			break;
+		}
+
+		sRet.append(pData + u, pBackslash - pData - u);
+		u = pBackslash - pData + 2;
+
+		switch (pBackslash[1]) {
+		case 'b': sRet += '\b'; break;
+		case 'f': sRet += '\f'; break;
+		case 'n': sRet += '\n'; break;
+		case 'r': sRet += '\r'; break;
+		case 't': sRet += '\t'; break;
+		case 'u':
+			if (u + 4 <= uLen) {
+				unsigned long uChar = strtoul(CString(pData + u, 4).c_str(), NULL, 16);
+
+				u += 4;
+
+				// combine UTF-16 surrogate pairs
+				if (uChar >= 0xD800 && uChar < 0xDC00 && u + 6 <= uLen && pData[u] == '\\' && pData[u + 1] == 'u') {
+					unsigned long uLow = strtoul(CString(pData + u + 2, 4).c_str(), NULL, 16);
+
+					if (uLow >= 0xDC00 && uLow < 0xE000) {
+						uChar = 0x10000 + ((uChar - 0xD800) << 10) + (uLow - 0xDC00);
+						u += 6;
+					}
+				}
+
+				AppendUTF8(sRet, uChar);
+			}
+			break;
+		default:
+			// \" \\ \/ and anything invalid
+			sRet += pBackslash[1];
+			break;
+		}
+	}
+
+	return sRet;
+}
+/////////////////// !CJSONStreamParser ///////////////////
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#ifndef _STREAMPARSER_H
+#define _STREAMPARSER_H
+
+#include "zncconfig.h"
+#include "ZNCString.h"
+#include <vector>
+
+/**
+ * @class CStrSpan
+ * @brief A non-owning view of a piece of a buffer.
+ *
+ * Spans handed out by the stream parsers point into the data passed to
+ * Feed() (or into a small internal buffer when a token was split between
+ * two Feed() calls) and are only valid until the hook that received them
+ * returns. Use ToString() to keep a copy.
+ */
+class ZNC_API CStrSpan {
+public:
+	CStrSpan() : m_pData(NULL), m_uLen(0) {}
+	CStrSpan(const char* pData, size_t uLen) : m_pData(pData), m_uLen(uLen) {}
+
+	const char* data() const { return m_pData; }
+	size_t size() const { return m_uLen; }
+	bool empty() const { return m_uLen == 0; }
+
+	bool Equals(const char* psz, bool bCaseSensitive = true) const;
+	CString ToString() const { return CString(m_pData, m_uLen); }
+
+private:
+	const char* m_pData;
+	size_t      m_uLen;
+};
+
+/**
+ * @class CXMLStreamParser
+ * @brief Incremental, callback driven (SAX style) XML parser.
+ *
+ * Data can be fed in arbitrary pieces, e.g. straight from
+ * CHTTPRequest::OnBodyData(). Nothing but the names of the currently open
+ * elements is kept around, so memory use does not depend on the size of
+ * the document.
+ *
+ * Text and attribute values are passed as they appear in the document,
+ * use DecodeEntities() on the parts you are interested in. OnText() may be
+ * called several times for one piece of text.
+ *
+ * DTDs are skipped, namespaces are not resolved.
+ */
+class ZNC_API CXMLStreamParser {
+public:
+	typedef std::vector<std::pair<CStrSpan, CStrSpan> > VAttributes;
+
+	CXMLStreamParser();
+	virtual ~CXMLStreamParser();
+
+	/** Parses the next piece of the document.
+	 *  @return false if the document is broken, see GetError().
+	 */
+	bool Feed(const char* pData, size_t uLen);
+	bool Feed(const CString& sData) { return Feed(sData.data(), sData.size()); }
+	/** Tells the parser that the document is complete.
+	 *  @return false if the document was broken or truncated.
+	 */
+	bool Finish();
+	//! Forgets all state so that a new document can be parsed.
+	void Reset();
+
+	// Getters
+	bool HasError() const { return !m_sError.empty(); }
+	const CString& GetError() const { return m_sError; }
+	//! Number of bytes consumed so far.
+	unsigned long long GetOffset() const { return m_uOffset; }
+	//! Number of open elements, including the one a hook is called for.
+	unsigned int GetDepth() const { return (unsigned int) m_vuOpen.size(); }
+	bool SeenRoot() const { return m_bSeenRoot; }
+	// !Getters
+
+	static CString DecodeEntities(const char* pData, size_t uLen);
+	static CString DecodeEntities(const CStrSpan& s) { return DecodeEntities(s.data(), s.size()); }
+	static CStrSpan GetAttribute(const VAttributes& vAttributes, const char* pszName);
+
+protected:
+	// Hooks
+	virtual void OnStartElement(const CStrSpan& sName, const VAttributes& vAttributes) {}
+	virtual void OnEndElement(const CStrSpan& sName) {}
+	virtual void OnText(const CStrSpan& sText) {}
+	//! The contents of a CDATA section, which must not be entity decoded.
+	virtual void OnCData(const CStrSpan& sData) {}
+	// !Hooks
+
+	//! Hooks may call this to stop parsing, Feed() will then return false.
+	void SetError(const CString& sError);
+
+private:
+	enum EState {
+		XS_TEXT,
+		XS_MARKUP,
+		XS_BANG,
+		XS_TAG,
+		XS_COMMENT,
+		XS_CDATA,
+		XS_PI,
+		XS_DECL
+	};
+
+	bool ProcessMarkup(const char* pData, size_t uLen);
+	bool ProcessTag(const char* pData, size_t uLen);
+
+	EState             m_eState;
+	CString            m_sMarkup;
+	size_t             m_uMarkupLen;
+	char               m_cQuote;
+	char               m_cPrev1;
+	char               m_cPrev2;
+	unsigned int       m_uDeclDepth;
+	CString            m_sOpen;
+	std::vector<size_t> m_vuOpen;
+	VAttributes        m_vAttributes;
+	bool               m_bSeenRoot;
+	bool               m_bRootClosed;
+	unsigned long long m_uOffset;
+	CString            m_sError;
+};
+
+/**
+ * @class CJSONStreamParser
+ * @brief Incremental, callback driven JSON parser.
+ *
+ * Works like CXMLStreamParser: feed it pieces of the document and it calls
+ * the hooks as soon as a value is complete. Strings and keys are passed
+ * still escaped, Unescape() them if needed.
+ */
+class ZNC_API CJSONStreamParser {
+public:
+	CJSONStreamParser();
+	virtual ~CJSONStreamParser();
+
+	bool Feed(const char* pData, size_t uLen);
+	bool Feed(const CString& sData) { return Feed(sData.data(), sData.size()); }
+	bool Finish();
+	void Reset();
+
+	// Getters
+	bool HasError() const { return !m_sError.empty(); }
+	const CString& GetError() const { return m_sError; }
+	unsigned long long GetOffset() const { return m_uOffset; }
+	//! Number of open objects and arrays.
+	unsigned int GetDepth() const { return (unsigned int) m_sStack.size(); }
+	// !Getters
+
+	//! Resolves backslash escapes, \\u sequences are converted to UTF-8.
+	static CString Unescape(const char* pData, size_t uLen);
+	static CString Unescape(const CStrSpan& s) { return Unescape(s.data(), s.size()); }
+
+protected:
+	// Hooks
+	virtual void OnObjectStart() {}
+	virtual void OnObjectEnd() {}
+	virtual void OnArrayStart() {}
+	virtual void OnArrayEnd() {}
+	virtual void OnKey(const CStrSpan& sKey) {}
+	virtual void OnString(const CStrSpan& sValue) {}
+	//! Numbers are passed as text, so no precision gets lost.
+	virtual void OnNumber(const CStrSpan& sValue) {}
+	virtual void OnBool(bool bValue) {}
+	virtual void OnNull() {}
+	// !Hooks
+
+	void SetError(const CString& sError);
+
+private:
+	enum EExpect {
+		JE_VALUE,
+		JE_VALUE_OR_END,
+		JE_KEY,
+		JE_KEY_OR_END,
+		JE_COLON,
+		JE_COMMA_OR_END,
+		JE_DONE
+	};
+
+	enum EToken {
+		JT_NONE,
+		JT_STRING,
+		JT_NUMBER,
+		JT_LITERAL
+	};
+
+	bool BeginValue();
+	void EndValue();
+	bool EmitToken(const char* pData, size_t uLen);
+	bool CloseContainer(char cType);
+
+	EExpect            m_eExpect;
+	EToken             m_eToken;
+	bool               m_bEscape;
+	CString            m_sToken;
+	CString            m_sStack;
+	unsigned long long m_uOffset;
+	CString            m_sError;
+};
+
+#endif // !_STREAMPARSER_H
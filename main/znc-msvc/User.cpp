@@ -11,6 +11,7 @@
 #include "Chan.h"
 #include "Config.h"
 #include "FileUtils.h"
+#include "Handoff.h"
 #include "IRCSock.h"
 #include "Server.h"
 #include "znc.h"
@@ -79,8 +80,12 @@ CUser::CUser(const CString& sUserName)
 	m_uBufferCount = 50;
 	m_uMaxJoinTries = 10;
 	m_uMaxJoins = 5;
+	m_fFloodRate = 0;
+	m_uFloodBurst = 4;
 	m_bKeepBuffer = false;
 	m_bBeingDeleted = false;
+	m_bTemporary = false;
+	m_bConfigChanged = true;
 	m_sTimestampFormat = "[%H:%M:%S]";
 	m_bAppendTimestamp = false;
 	m_bPrependTimestamp = true;
@@ -101,6 +106,7 @@ CUser::~CUser() {
 	}
 
 	CZNC::Get().GetManager().DelCronByAddr(m_pUserTimer);
+	CZNC::Get().GetMessageBus().UnsubscribeAll(this);
 }
 
 template<class T>
@@ -128,6 +134,7 @@ bool CUser::ParseConfig(CConfig* pConfig, CString& sError) {
 	TOption<unsigned int> UIntOptions[] = {
 		{ "jointries", &CUser::SetJoinTries },
 		{ "maxjoins", &CUser::SetMaxJoins },
+		{ "floodburst", &CUser::SetFloodBurst },
 	};
 	size_t numUIntOptions = sizeof(UIntOptions) / sizeof(UIntOptions[0]);
 	TOption<bool> BoolOptions[] = {
@@ -224,6 +231,9 @@ bool CUser::ParseConfig(CConfig* pConfig, CString& sError) {
 	if (pConfig->FindStringEntry("timezoneoffset", sValue)) {
 		SetTimezoneOffset(sValue.ToDouble());
 	}
+	if (pConfig->FindStringEntry("floodrate", sValue)) {
+		SetFloodRate(sValue.ToDouble());
+	}
 	if (pConfig->FindStringEntry("timestamp", sValue)) {
 		if (!sValue.Trim_n().Equals("true")) {
 			if (sValue.Trim_n().Equals("append")) {
@@ -249,6 +259,7 @@ bool CUser::ParseConfig(CConfig* pConfig, CString& sError) {
 	// Pass = <hash name>#<salted hash>#<salt>#
 	// 'Salted hash' means hash of 'password' + 'salt'
 	// Possible hashes are md5 and sha256
+	// Pass = pbkdf2#<iterations>$<hash>#<salt>#
 	if (sValue.Right(1) == "-") {
 		sValue.RightChomp();
 		sValue.Trim();
@@ -256,10 +267,12 @@ bool CUser::ParseConfig(CConfig* pConfig, CString& sError) {
 	} else {
 		CString sMethod = sValue.Token(0, false, "#");
 		CString sPass = sValue.Token(1, true, "#");
-		if (sMethod == "md5" || sMethod == "sha256") {
+		if (sMethod == "md5" || sMethod == "sha256" || sMethod == "pbkdf2") {
 			CUser::eHashType type = CUser::HASH_MD5;
 			if (sMethod == "sha256")
 				type = CUser::HASH_SHA256;
+			else if (sMethod == "pbkdf2")
+				type = CUser::HASH_PBKDF2;
 
 			CString sSalt = sPass.Token(1, false, "#");
 			sPass = sPass.Token(0, false, "#");
@@ -380,6 +393,7 @@ void CUser::DelServers()
 	}
 
 	m_vServers.clear();
+	m_bConfigChanged = true;
 }
 
 void CUser::SetIRCSocket(CIRCSock* pIRCSock) {
@@ -554,6 +568,64 @@ void CUser::UserDisconnected(CClient* pClient) {
 	}
 }
 
+void CUser::SaveState(MCString& msState, const CString& sPrefix) const {
+	CServer* pServer = GetCurrentServer();
+
+	msState[sPrefix + "server"] = (pServer) ? pServer->GetName() : "";
+	msState[sPrefix + "ircserver"] = m_sIRCServer;
+	msState[sPrefix + "ircaway"] = CString(m_bIRCAway);
+	msState[sPrefix + "chanprefixes"] = m_sChanPrefixes;
+
+	m_RawBuffer.SaveState(msState, sPrefix + "raw");
+	m_MotdBuffer.SaveState(msState, sPrefix + "motd");
+	m_QueryBuffer.SaveState(msState, sPrefix + "query");
+
+	msState[sPrefix + "chans"] = CString(m_vChans.size());
+	for (unsigned int a = 0; a < m_vChans.size(); a++) {
+		m_vChans[a]->SaveState(msState, sPrefix + "chan/" + CString(a) + "/");
+	}
+}
+
+void CUser::LoadState(const MCString& msState, const CString& sPrefix) {
+	CServer* pServer = FindServer(CHandoff::GetValue(msState, sPrefix + "server"));
+	unsigned int uChans = CHandoff::GetValue(msState, sPrefix + "chans").ToUInt();
+
+	// So that a later reconnect goes on with the next server
+	if (pServer) {
+		SetNextServer(pServer);
+		GetNextServer();
+	}
+
+	SetIRCServer(CHandoff::GetValue(msState, sPrefix + "ircserver"));
+	SetIRCAway(CHandoff::GetValue(msState, sPrefix + "ircaway").ToBool());
+	SetChanPrefixes(CHandoff::GetValue(msState, sPrefix + "chanprefixes"));
+
+	m_RawBuffer.LoadState(msState, sPrefix + "raw");
+	m_MotdBuffer.LoadState(msState, sPrefix + "motd");
+	m_QueryBuffer.LoadState(msState, sPrefix + "query");
+
+	for (unsigned int a = 0; a < uChans; a++) {
+		const CString sChan = sPrefix + "chan/" + CString(a) + "/";
+		const CString& sName = CHandoff::GetValue(msState, sChan + "name");
+		CChan* pChan = FindChan(sName);
+
+		if (sName.empty()) {
+			continue;
+		}
+
+		// Channels which were joined without being in the config
+		if (!pChan) {
+			pChan = new CChan(sName, this, false);
+
+			if (!AddChan(pChan)) {
+				continue;
+			}
+		}
+
+		pChan->LoadState(msState, sChan);
+	}
+}
+
 bool CUser::Clone(const CUser& User, CString& sErrorRet, bool bCloneChans) {
 	unsigned int a = 0;
 	sErrorRet.clear();
@@ -569,6 +641,9 @@ bool CUser::Clone(const CUser& User, CString& sErrorRet, bool bCloneChans) {
 				<< "]; New username [" << User.GetUserName() << "]");
 	}
 
+	// Not everything below goes through the setters
+	m_bConfigChanged = true;
+
 	if (!User.GetPass().empty()) {
 		SetPass(User.GetPass(), User.GetPassHashType(), User.GetPassSalt());
 	}
@@ -586,6 +661,8 @@ bool CUser::Clone(const CUser& User, CString& sErrorRet, bool bCloneChans) {
 	SetBufferCount(User.GetBufferCount(), true);
 	SetJoinTries(User.JoinTries());
 	SetMaxJoins(User.MaxJoins());
+	SetFloodRate(User.GetFloodRate());
+	SetFloodBurst(User.GetFloodBurst());
 
 	// Allowed Hosts
 	m_ssAllowedHosts.clear();
@@ -727,6 +804,7 @@ bool CUser::AddAllowedHost(const CString& sHostMask) {
 	}
 
 	m_ssAllowedHosts.insert(sHostMask);
+	m_bConfigChanged = true;
 	return true;
 }
 
@@ -805,6 +883,7 @@ bool CUser::AddChan(CChan* pChan) {
 	}
 
 	m_vChans.push_back(pChan);
+	m_bConfigChanged = true;
 	return true;
 }
 
@@ -815,6 +894,7 @@ bool CUser::AddChan(const CString& sName, bool bInConfig) {
 
 	CChan* pChan = new CChan(sName, this, bInConfig);
 	m_vChans.push_back(pChan);
+	m_bConfigChanged = true;
 	return true;
 }
 
@@ -823,6 +903,7 @@ bool CUser::DelChan(const CString& sName) {
 		if (sName.Equals((*a)->GetName())) {
 			delete *a;
 			m_vChans.erase(a);
+			m_bConfigChanged = true;
 			return true;
 		}
 	}
@@ -830,7 +911,7 @@ bool CUser::DelChan(const CString& sName) {
 	return false;
 }
 
-bool CUser::PrintLine(CFile& File, CString sName, CString sValue) const {
+bool CUser::PrintLine(CString& sConfig, CString sName, CString sValue) const {
 	sName.Trim();
 	sValue.Trim();
 
@@ -842,67 +923,90 @@ bool CUser::PrintLine(CFile& File, CString sName, CString sValue) const {
 
 	// FirstLine() so that no one can inject new lines to the config if he
 	// manages to add "\n" to e.g. sValue.
-	CString sLine = "\t" + sName.FirstLine() + " = " + sValue.FirstLine() + "\n";
+	sConfig += "\t" + sName.FirstLine() + " = " + sValue.FirstLine() + "\n";
+	return true;
+}
+
+bool CUser::PrintLine(CFile& File, CString sName, CString sValue) const {
+	CString sLine;
+
+	if (!PrintLine(sLine, sName, sValue)) {
+		return false;
+	}
+
 	return (File.Write(sLine) > 0);
 }
 
 bool CUser::WriteConfig(CFile& File) {
-	File.Write("<User " + GetUserName().FirstLine() + ">\n");
+	CString sConfig;
+	bool bRet = WriteConfig(sConfig);
+
+	File.Write(sConfig);
+
+	return bRet;
+}
+
+bool CUser::WriteConfig(CString& sConfig) {
+	sConfig += "<User " + GetUserName().FirstLine() + ">\n";
 
 	if (m_eHashType != HASH_NONE) {
 		CString sHash = "md5";
 		if (m_eHashType == HASH_SHA256)
 			sHash = "sha256";
+		else if (m_eHashType == HASH_PBKDF2)
+			sHash = "pbkdf2";
 		if (m_sPassSalt.empty()) {
-			PrintLine(File, "Pass", sHash + "#" + GetPass());
+			PrintLine(sConfig, "Pass", sHash + "#" + GetPass());
 		} else {
-			PrintLine(File, "Pass", sHash + "#" + GetPass() + "#" + m_sPassSalt + "#");
+			PrintLine(sConfig, "Pass", sHash + "#" + GetPass() + "#" + m_sPassSalt + "#");
 		}
 	} else {
-		PrintLine(File, "Pass", "plain#" + GetPass());
-	}
-	PrintLine(File, "Nick", GetNick());
-	PrintLine(File, "AltNick", GetAltNick());
-	PrintLine(File, "Ident", GetIdent());
-	PrintLine(File, "RealName", GetRealName());
-	PrintLine(File, "BindHost", GetBindHost());
-	PrintLine(File, "DCCBindHost", GetDCCBindHost());
-	PrintLine(File, "QuitMsg", GetQuitMsg());
+		PrintLine(sConfig, "Pass", "plain#" + GetPass());
+	}
+	PrintLine(sConfig, "Nick", GetNick());
+	PrintLine(sConfig, "AltNick", GetAltNick());
+	PrintLine(sConfig, "Ident", GetIdent());
+	PrintLine(sConfig, "RealName", GetRealName());
+	PrintLine(sConfig, "BindHost", GetBindHost());
+	PrintLine(sConfig, "DCCBindHost", GetDCCBindHost());
+	PrintLine(sConfig, "QuitMsg", GetQuitMsg());
 	if (CZNC::Get().GetStatusPrefix() != GetStatusPrefix())
-		PrintLine(File, "StatusPrefix", GetStatusPrefix());
-	PrintLine(File, "Skin", GetSkinName());
-	PrintLine(File, "ChanModes", GetDefaultChanModes());
-	PrintLine(File, "Buffer", CString(GetBufferCount()));
-	PrintLine(File, "KeepBuffer", CString(KeepBuffer()));
-	PrintLine(File, "MultiClients", CString(MultiClients()));
-	PrintLine(File, "DenyLoadMod", CString(DenyLoadMod()));
-	PrintLine(File, "Admin", CString(IsAdmin()));
-	PrintLine(File, "DenySetBindHost", CString(DenySetBindHost()));
-	PrintLine(File, "TimestampFormat", GetTimestampFormat());
-	PrintLine(File, "AppendTimestamp", CString(GetTimestampAppend()));
-	PrintLine(File, "PrependTimestamp", CString(GetTimestampPrepend()));
-	PrintLine(File, "TimezoneOffset", CString(m_fTimezoneOffset));
-	PrintLine(File, "JoinTries", CString(m_uMaxJoinTries));
-	PrintLine(File, "MaxJoins", CString(m_uMaxJoins));
-	PrintLine(File, "IRCConnectEnabled", CString(GetIRCConnectEnabled()));
-	File.Write("\n");
+		PrintLine(sConfig, "StatusPrefix", GetStatusPrefix());
+	PrintLine(sConfig, "Skin", GetSkinName());
+	PrintLine(sConfig, "ChanModes", GetDefaultChanModes());
+	PrintLine(sConfig, "Buffer", CString(GetBufferCount()));
+	PrintLine(sConfig, "KeepBuffer", CString(KeepBuffer()));
+	PrintLine(sConfig, "MultiClients", CString(MultiClients()));
+	PrintLine(sConfig, "DenyLoadMod", CString(DenyLoadMod()));
+	PrintLine(sConfig, "Admin", CString(IsAdmin()));
+	PrintLine(sConfig, "DenySetBindHost", CString(DenySetBindHost()));
+	PrintLine(sConfig, "TimestampFormat", GetTimestampFormat());
+	PrintLine(sConfig, "AppendTimestamp", CString(GetTimestampAppend()));
+	PrintLine(sConfig, "PrependTimestamp", CString(GetTimestampPrepend()));
+	PrintLine(sConfig, "TimezoneOffset", CString(m_fTimezoneOffset));
+	PrintLine(sConfig, "JoinTries", CString(m_uMaxJoinTries));
+	PrintLine(sConfig, "MaxJoins", CString(m_uMaxJoins));
+	PrintLine(sConfig, "FloodRate", CString(m_fFloodRate));
+	PrintLine(sConfig, "FloodBurst", CString(m_uFloodBurst));
+	PrintLine(sConfig, "IRCConnectEnabled", CString(GetIRCConnectEnabled()));
+	sConfig += "\n";
 
 	// Allow Hosts
 	if (!m_ssAllowedHosts.empty()) {
 		for (set<CString>::iterator it = m_ssAllowedHosts.begin(); it != m_ssAllowedHosts.end(); ++it) {
-			PrintLine(File, "Allow", *it);
+			PrintLine(sConfig, "Allow", *it);
 		}
 
-		File.Write("\n");
+		sConfig += "\n";
 	}
 
 	// CTCP Replies
 	if (!m_mssCTCPReplies.empty()) {
 		for (MCString::const_iterator itb = m_mssCTCPReplies.begin(); itb != m_mssCTCPReplies.end(); ++itb) {
-			PrintLine(File, "CTCPReply", itb->first.AsUpper() + " " + itb->second);
+			PrintLine(sConfig, "CTCPReply", itb->first.AsUpper() + " " + itb->second);
 		}
 
-		File.Write("\n");
+		sConfig += "\n";
 	}
 
 	// Modules
@@ -916,29 +1020,29 @@ bool CUser::WriteConfig(CFile& File) {
 				sArgs = " " + sArgs;
 			}
 
-			PrintLine(File, "LoadModule", Mods[a]->GetModName() + sArgs);
+			PrintLine(sConfig, "LoadModule", Mods[a]->GetModName() + sArgs);
 		}
 
-		File.Write("\n");
+		sConfig += "\n";
 	}
 
 	// Servers
 	for (unsigned int b = 0; b < m_vServers.size(); b++) {
-		PrintLine(File, "Server", m_vServers[b]->GetString());
+		PrintLine(sConfig, "Server", m_vServers[b]->GetString());
 	}
 
 	// Chans
 	for (unsigned int c = 0; c < m_vChans.size(); c++) {
 		CChan* pChan = m_vChans[c];
 		if (pChan->InConfig()) {
-			File.Write("\n");
-			if (!pChan->WriteConfig(File)) {
+			sConfig += "\n";
+			if (!pChan->WriteConfig(sConfig)) {
 				return false;
 			}
 		}
 	}
 
-	File.Write("</User>\n");
+	sConfig += "</User>\n";
 
 	return true;
 }
@@ -1087,6 +1191,7 @@ bool CUser::DelServer(const CString& sName, unsigned short uPort, const CString&
 		}
 
 		delete pServer;
+		m_bConfigChanged = true;
 
 		return true;
 	}
@@ -1154,6 +1259,7 @@ bool CUser::AddServer(const CString& sName, unsigned short uPort, const CString&
 
 	CServer* pServer = new CServer(sName, uPort, sPass, bSSL);
 	m_vServers.push_back(pServer);
+	m_bConfigChanged = true;
 
 	CheckIRCConnect();
 
@@ -1198,18 +1304,28 @@ bool CUser::SetNextServer(const CServer* pServer) {
 }
 
 bool CUser::CheckPass(const CString& sPass) const {
-	switch (m_eHashType)
+	return CheckPassHash(sPass, m_eHashType, m_sPass, m_sPassSalt);
+}
+
+bool CUser::CheckPassHash(const CString& sPass, eHashType eHash, const CString& sHash, const CString& sSalt) {
+	switch (eHash)
 	{
 	case HASH_MD5:
-		return m_sPass.Equals(CUtils::SaltedMD5Hash(sPass, m_sPassSalt));
+		return sHash.Equals(CUtils::SaltedMD5Hash(sPass, sSalt));
 	case HASH_SHA256:
-		return m_sPass.Equals(CUtils::SaltedSHA256Hash(sPass, m_sPassSalt));
+		return sHash.Equals(CUtils::SaltedSHA256Hash(sPass, sSalt));
+	case HASH_PBKDF2:
+		return sHash.Equals(PBKDF2Hash(sPass, sSalt, sHash.Token(0, false, "$").ToUInt()));
 	case HASH_NONE:
 	default:
-		return (sPass == m_sPass);
+		return (sPass == sHash);
 	}
 }
 
+CString CUser::PBKDF2Hash(const CString& sPass, const CString& sSalt, unsigned int uIterations) {
+	return CString(uIterations) + "$" + CUtils::SaltedPBKDF2Hash(sPass, sSalt, uIterations);
+}
+
 /*CClient* CUser::GetClient() {
 	// Todo: optimize this by saving a pointer to the sock
 	CSockManager& Manager = CZNC::Get().GetManager();
@@ -1259,6 +1375,12 @@ bool CUser::PutIRC(const CString& sLine) {
 }
 
 bool CUser::PutUser(const CString& sLine, CClient* pClient, CClient* pSkipClient) {
+	if (!pClient) {
+		// Put the line together once instead of once per client
+		CFanOutLine(sLine).SendTo(this, pSkipClient);
+		return true;
+	}
+
 	for (unsigned int a = 0; a < m_vClients.size(); a++) {
 		if ((!pClient || pClient == m_vClients[a]) && pSkipClient != m_vClients[a]) {
 			m_vClients[a]->PutClient(sLine);
@@ -1273,6 +1395,10 @@ bool CUser::PutUser(const CString& sLine, CClient* pClient, CClient* pSkipClient
 }
 
 bool CUser::PutStatus(const CString& sLine, CClient* pClient, CClient* pSkipClient) {
+	if (!pClient) {
+		return PutModule("status", sLine, NULL, pSkipClient);
+	}
+
 	for (unsigned int a = 0; a < m_vClients.size(); a++) {
 		if ((!pClient || pClient == m_vClients[a]) && pSkipClient != m_vClients[a]) {
 			m_vClients[a]->PutStatus(sLine);
@@ -1287,6 +1413,10 @@ bool CUser::PutStatus(const CString& sLine, CClient* pClient, CClient* pSkipClie
 }
 
 bool CUser::PutStatusNotice(const CString& sLine, CClient* pClient, CClient* pSkipClient) {
+	if (!pClient) {
+		return PutModNotice("status", sLine, NULL, pSkipClient);
+	}
+
 	for (unsigned int a = 0; a < m_vClients.size(); a++) {
 		if ((!pClient || pClient == m_vClients[a]) && pSkipClient != m_vClients[a]) {
 			m_vClients[a]->PutStatusNotice(sLine);
@@ -1301,6 +1431,13 @@ bool CUser::PutStatusNotice(const CString& sLine, CClient* pClient, CClient* pSk
 }
 
 bool CUser::PutModule(const CString& sModule, const CString& sLine, CClient* pClient, CClient* pSkipClient) {
+	if (!pClient) {
+		// Only the nick differs between clients and usually not even that
+		CFanOutLine(":" + GetStatusPrefix() + ((sModule.empty()) ? "status" : sModule) + "!znc@znc.in PRIVMSG ",
+				" :" + sLine).SendTo(this, pSkipClient);
+		return true;
+	}
+
 	for (unsigned int a = 0; a < m_vClients.size(); a++) {
 		if ((!pClient || pClient == m_vClients[a]) && pSkipClient != m_vClients[a]) {
 			m_vClients[a]->PutModule(sModule, sLine);
@@ -1315,6 +1452,12 @@ bool CUser::PutModule(const CString& sModule, const CString& sLine, CClient* pCl
 }
 
 bool CUser::PutModNotice(const CString& sModule, const CString& sLine, CClient* pClient, CClient* pSkipClient) {
+	if (!pClient) {
+		CFanOutLine(":" + GetStatusPrefix() + ((sModule.empty()) ? "status" : sModule) + "!znc@znc.in NOTICE ",
+				" :" + sLine).SendTo(this, pSkipClient);
+		return true;
+	}
+
 	for (unsigned int a = 0; a < m_vClients.size(); a++) {
 		if ((!pClient || pClient == m_vClients[a]) && pSkipClient != m_vClients[a]) {
 			m_vClients[a]->PutModNotice(sModule, sLine);
@@ -1356,30 +1499,32 @@ bool CUser::IsChan(const CString& sChan) const {
 	return GetChanPrefixes().find(sChan[0]) != CString::npos;
 }
 
-void CUser::SetNick(const CString& s) { m_sNick = s; }
-void CUser::SetAltNick(const CString& s) { m_sAltNick = s; }
-void CUser::SetIdent(const CString& s) { m_sIdent = s; }
-void CUser::SetRealName(const CString& s) { m_sRealName = s; }
-void CUser::SetBindHost(const CString& s) { m_sBindHost = s; }
-void CUser::SetDCCBindHost(const CString& s) { m_sDCCBindHost = s; }
+void CUser::SetNick(const CString& s) { m_sNick = s; m_bConfigChanged = true; }
+void CUser::SetAltNick(const CString& s) { m_sAltNick = s; m_bConfigChanged = true; }
+void CUser::SetIdent(const CString& s) { m_sIdent = s; m_bConfigChanged = true; }
+void CUser::SetRealName(const CString& s) { m_sRealName = s; m_bConfigChanged = true; }
+void CUser::SetBindHost(const CString& s) { m_sBindHost = s; m_bConfigChanged = true; }
+void CUser::SetDCCBindHost(const CString& s) { m_sDCCBindHost = s; m_bConfigChanged = true; }
 void CUser::SetPass(const CString& s, eHashType eHash, const CString& sSalt) {
 	m_sPass = s;
 	m_eHashType = eHash;
 	m_sPassSalt = sSalt;
+	m_bConfigChanged = true;
 }
-void CUser::SetMultiClients(bool b) { m_bMultiClients = b; }
-void CUser::SetDenyLoadMod(bool b) { m_bDenyLoadMod = b; }
-void CUser::SetAdmin(bool b) { m_bAdmin = b; }
-void CUser::SetDenySetBindHost(bool b) { m_bDenySetBindHost = b; }
-void CUser::SetDefaultChanModes(const CString& s) { m_sDefaultChanModes = s; }
+void CUser::SetMultiClients(bool b) { m_bMultiClients = b; m_bConfigChanged = true; }
+void CUser::SetDenyLoadMod(bool b) { m_bDenyLoadMod = b; m_bConfigChanged = true; }
+void CUser::SetAdmin(bool b) { m_bAdmin = b; m_bConfigChanged = true; }
+void CUser::SetDenySetBindHost(bool b) { m_bDenySetBindHost = b; m_bConfigChanged = true; }
+void CUser::SetDefaultChanModes(const CString& s) { m_sDefaultChanModes = s; m_bConfigChanged = true; }
 void CUser::SetIRCServer(const CString& s) { m_sIRCServer = s; }
-void CUser::SetQuitMsg(const CString& s) { m_sQuitMsg = s; }
-void CUser::SetKeepBuffer(bool b) { m_bKeepBuffer = b; }
+void CUser::SetQuitMsg(const CString& s) { m_sQuitMsg = s; m_bConfigChanged = true; }
+void CUser::SetKeepBuffer(bool b) { m_bKeepBuffer = b; m_bConfigChanged = true; }
 
 bool CUser::SetBufferCount(size_t u, bool bForce) {
 	if (!bForce && u > CZNC::Get().GetMaxBufferSize())
 		return false;
 	m_uBufferCount = u;
+	m_bConfigChanged = true;
 	return true;
 }
 
@@ -1407,16 +1552,19 @@ bool CUser::AddCTCPReply(const CString& sCTCP, const CString& sReply) {
 		return false;
 	}
 	m_mssCTCPReplies[sCTCP.AsUpper()] = sReply;
+	m_bConfigChanged = true;
 	return true;
 }
 
 bool CUser::DelCTCPReply(const CString& sCTCP) {
+	m_bConfigChanged = true;
 	return m_mssCTCPReplies.erase(sCTCP) > 0;
 }
 
 bool CUser::SetStatusPrefix(const CString& s) {
 	if ((!s.empty()) && (s.length() < 6) && (s.find(' ') == CString::npos)) {
 		m_sStatusPrefix = (s.empty()) ? "*" : s;
+		m_bConfigChanged = true;
 		return true;
 	}
 
@@ -1444,6 +1592,71 @@ bool CUser::MultiClients() const { return m_bMultiClients; }
 const CString& CUser::GetStatusPrefix() const { return m_sStatusPrefix; }
 const CString& CUser::GetDefaultChanModes() const { return m_sDefaultChanModes; }
 const vector<CChan*>& CUser::GetChans() const { return m_vChans; }
+
+size_t CUser::GetBufferBytes() const {
+	size_t uBytes = m_RawBuffer.GetBytes() + m_MotdBuffer.GetBytes() + m_QueryBuffer.GetBytes();
+
+	for (vector<CChan*>::const_iterator it = m_vChans.begin(); it != m_vChans.end(); ++it) {
+		uBytes += (*it)->GetBufferBytes();
+	}
+
+	return uBytes;
+}
+
+bool CUser::ClientsBacklogged(size_t uBytes) const {
+	if (!uBytes || m_vClients.empty()) {
+		return false;
+	}
+
+	for (vector<CClient*>::const_iterator it = m_vClients.begin(); it != m_vClients.end(); ++it) {
+		if ((*it)->GetInternalWriteBuffer().size() <= uBytes) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+unsigned int CUser::TrimBuffers(size_t uMax) {
+	size_t uBytes = GetBufferBytes();
+	unsigned int uDropped = 0;
+
+	while (uBytes > uMax) {
+		CChan* pBiggest = NULL;
+		size_t uBiggest = m_QueryBuffer.GetBytes();
+
+		for (vector<CChan*>::const_iterator it = m_vChans.begin(); it != m_vChans.end(); ++it) {
+			if ((*it)->GetBufferBytes() > uBiggest) {
+				pBiggest = *it;
+				uBiggest = pBiggest->GetBufferBytes();
+			}
+		}
+
+		if (uBiggest == 0) {
+			// Only the raw and motd buffers are left, those are needed
+			break;
+		}
+
+		// Drop an eighth at once, trimming line by line would be slow
+		if (pBiggest) {
+			unsigned int uLines = (unsigned int) pBiggest->GetBuffer().size();
+			unsigned int uDrop = (uLines / 8 > 0) ? uLines / 8 : 1;
+
+			pBiggest->TrimBuffer(uLines - uDrop);
+			uBytes -= uBiggest - pBiggest->GetBufferBytes();
+			uDropped += uDrop;
+		} else {
+			unsigned int uLines = m_QueryBuffer.Size();
+			unsigned int uDrop = (uLines / 8 > 0) ? uLines / 8 : 1;
+
+			m_QueryBuffer.Trim(uLines - uDrop);
+			uBytes -= uBiggest - m_QueryBuffer.GetBytes();
+			uDropped += uDrop;
+		}
+	}
+
+	return uDropped;
+}
 const vector<CServer*>& CUser::GetServers() const { return m_vServers; }
 const CNick& CUser::GetIRCNick() const { return m_IRCNick; }
 const CString& CUser::GetIRCServer() const { return m_sIRCServer; }
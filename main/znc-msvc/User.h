@@ -38,6 +38,7 @@ public:
 		HASH_NONE,
 		HASH_MD5,
 		HASH_SHA256,
+		HASH_PBKDF2,
 
 		HASH_DEFAULT = HASH_SHA256
 	};
@@ -47,9 +48,17 @@ public:
 	static CString SaltedHash(const CString& sPass, const CString& sSalt) {
 		return CUtils::SaltedSHA256Hash(sPass, sSalt);
 	}
+	/** Hashes sPass for HASH_PBKDF2. The number of iterations is part of
+	 *  the result, so it can be changed without breaking old hashes.
+	 */
+	static CString PBKDF2Hash(const CString& sPass, const CString& sSalt, unsigned int uIterations);
+	//! Compares sPass to a hash as stored by SetPass(). Thread safe.
+	static bool CheckPassHash(const CString& sPass, eHashType eHash, const CString& sHash, const CString& sSalt);
 
 	bool PrintLine(CFile& File, CString sName, CString sValue) const;
+	bool PrintLine(CString& sConfig, CString sName, CString sValue) const;
 	bool WriteConfig(CFile& File);
+	bool WriteConfig(CString& sConfig);
 	CChan* FindChan(const CString& sName) const;
 	bool AddChan(CChan* pChan);
 	bool AddChan(const CString& sName, bool bInConfig);
@@ -95,6 +104,16 @@ public:
 	void AddQueryBuffer(const CString& sPre, const CString& sPost, bool bIncNick = true) { m_QueryBuffer.AddLine(sPre, sPost, bIncNick); }
 	void UpdateQueryBuffer(const CString& sPre, const CString& sPost, bool bIncNick = true) { m_QueryBuffer.UpdateLine(sPre, sPost, bIncNick); }
 	void ClearQueryBuffer() { m_QueryBuffer.Clear(); }
+
+	//! Bytes used by all buffers of this user, including the channels' ones
+	size_t GetBufferBytes() const;
+	/** Drops the oldest lines of the biggest channel and query buffers until
+	 *  all buffers together use at most uMax bytes.
+	 *  @return The number of lines dropped.
+	 */
+	unsigned int TrimBuffers(size_t uMax);
+	//! True if there are clients and each has more than uBytes waiting to be sent to it
+	bool ClientsBacklogged(size_t uBytes) const;
 	// !Buffers
 
 	bool PutIRC(const CString& sLine);
@@ -107,6 +126,9 @@ public:
 	bool IsUserAttached() const { return !m_vClients.empty(); }
 	void UserConnected(CClient* pClient);
 	void UserDisconnected(CClient* pClient);
+	//! For CHandoff, the buffers, the channels and what the IRC server told us
+	void SaveState(MCString& msState, const CString& sPrefix) const;
+	void LoadState(const MCString& msState, const CString& sPrefix);
 
 	CString GetLocalIP();
 	CString GetLocalDCCIP();
@@ -154,14 +176,22 @@ public:
 	void SetKeepBuffer(bool b);
 	void SetChanPrefixes(const CString& s) { m_sChanPrefixes = s; }
 	void SetBeingDeleted(bool b) { m_bBeingDeleted = b; }
-	void SetTimestampFormat(const CString& s) { m_sTimestampFormat = s; }
-	void SetTimestampAppend(bool b) { m_bAppendTimestamp = b; }
-	void SetTimestampPrepend(bool b) { m_bPrependTimestamp = b; }
-	void SetTimezoneOffset(float b) { m_fTimezoneOffset = b; }
-	void SetJoinTries(unsigned int i) { m_uMaxJoinTries = i; }
-	void SetMaxJoins(unsigned int i) { m_uMaxJoins = i; }
-	void SetSkinName(const CString& s) { m_sSkinName = s; }
-	void SetIRCConnectEnabled(bool b) { m_bIRCConnectEnabled = b; }
+	//! Temporary users are never written to the config
+	void SetTemporary(bool b) { m_bTemporary = b; }
+	void SetTimestampFormat(const CString& s) { m_sTimestampFormat = s; m_bConfigChanged = true; }
+	void SetTimestampAppend(bool b) { m_bAppendTimestamp = b; m_bConfigChanged = true; }
+	void SetTimestampPrepend(bool b) { m_bPrependTimestamp = b; m_bConfigChanged = true; }
+	void SetTimezoneOffset(float b) { m_fTimezoneOffset = b; m_bConfigChanged = true; }
+	void SetJoinTries(unsigned int i) { m_uMaxJoinTries = i; m_bConfigChanged = true; }
+	void SetMaxJoins(unsigned int i) { m_uMaxJoins = i; m_bConfigChanged = true; }
+	void SetFloodRate(double f) { m_fFloodRate = f; m_bConfigChanged = true; }
+	void SetFloodBurst(unsigned int i) { m_uFloodBurst = (i) ? i : 1; m_bConfigChanged = true; }
+	void SetSkinName(const CString& s) { m_sSkinName = s; m_bConfigChanged = true; }
+	void SetIRCConnectEnabled(bool b) { m_bIRCConnectEnabled = b; m_bConfigChanged = true; }
+	/** Everything that ends up in WriteConfig() sets this. CZNC::WriteConfig()
+	 *  only serializes users which have it set and resets it.
+	 */
+	void SetConfigChanged(bool b = true) { m_bConfigChanged = b; }
 	void SetIRCAway(bool b) { m_bIRCAway = b; }
 	// !Setters
 
@@ -206,12 +236,17 @@ public:
 	size_t GetBufferCount() const;
 	bool KeepBuffer() const;
 	bool IsBeingDeleted() const { return m_bBeingDeleted; }
+	bool IsTemporary() const { return m_bTemporary; }
+	bool IsConfigChanged() const { return m_bConfigChanged; }
 	bool HasServers() const { return !m_vServers.empty(); }
 	float GetTimezoneOffset() const { return m_fTimezoneOffset; }
 	unsigned long long BytesRead() const { return m_uBytesRead; }
 	unsigned long long BytesWritten() const { return m_uBytesWritten; }
 	unsigned int JoinTries() const { return m_uMaxJoinTries; }
 	unsigned int MaxJoins() const { return m_uMaxJoins; }
+	//! Lines per second which may be sent to IRC, <= 0 turns off flood protection
+	double GetFloodRate() const { return m_fFloodRate; }
+	unsigned int GetFloodBurst() const { return m_uFloodBurst; }
 	bool IsIRCAway() const { return m_bIRCAway; }
 	CString GetSkinName() const;
 	// !Getters
@@ -255,6 +290,8 @@ protected:
 	bool                  m_bDenySetBindHost;
 	bool                  m_bKeepBuffer;
 	bool                  m_bBeingDeleted;
+	bool                  m_bTemporary;
+	bool                  m_bConfigChanged;
 	bool                  m_bAppendTimestamp;
 	bool                  m_bPrependTimestamp;
 	bool                  m_bIRCConnectEnabled;
@@ -272,6 +309,8 @@ protected:
 	unsigned long long    m_uBytesWritten;
 	unsigned int          m_uMaxJoinTries;
 	unsigned int          m_uMaxJoins;
+	double                m_fFloodRate;
+	unsigned int          m_uFloodBurst;
 	CString               m_sSkinName;
 
 	CModules*             m_pModules;
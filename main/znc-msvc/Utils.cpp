@@ -16,6 +16,7 @@
 #include <errno.h>
 #ifdef HAVE_LIBSSL
 #include <openssl/ssl.h>
+#include <openssl/evp.h>
 #endif /* HAVE_LIBSSL */
 #include <sstream>
 #include <sys/stat.h>
@@ -179,6 +180,67 @@ CString CUtils::SaltedSHA256Hash(const CString& sPass, const CString& sSalt) {
 	return CString(sPass + sSalt).SHA256();
 }
 
+#ifndef HAVE_LIBSSL
+// Slow, but only used if OpenSSL isn't available
+static CString RawSHA256(const CString& sData) {
+	CString sHex = sData.SHA256();
+	CString sRet;
+
+	for (size_t a = 0; a + 1 < sHex.size(); a += 2) {
+		sRet += (char) strtoul(sHex.substr(a, 2).c_str(), NULL, 16);
+	}
+
+	return sRet;
+}
+
+static CString HMACSHA256(const CString& sKey, const CString& sData) {
+	CString sInner = (sKey.size() > 64) ? RawSHA256(sKey) : sKey;
+	sInner.append(64 - sInner.size(), '\0');
+	CString sOuter = sInner;
+
+	for (size_t a = 0; a < 64; a++) {
+		sInner[a] ^= 0x36;
+		sOuter[a] ^= 0x5c;
+	}
+
+	return RawSHA256(sOuter + RawSHA256(sInner + sData));
+}
+#endif
+
+CString CUtils::SaltedPBKDF2Hash(const CString& sPass, const CString& sSalt, unsigned int uIterations) {
+	static const char szHex[] = "0123456789abcdef";
+	unsigned char digest[32];
+
+	if (uIterations == 0)
+		uIterations = 1;
+
+#ifdef HAVE_LIBSSL
+	PKCS5_PBKDF2_HMAC(sPass.data(), (int) sPass.size(),
+			(const unsigned char*) sSalt.data(), (int) sSalt.size(),
+			(int) uIterations, EVP_sha256(), sizeof(digest), digest);
+#else
+	// One block is enough, SHA256 gives exactly the 32 bytes we need
+	CString sU = HMACSHA256(sPass, sSalt + CString("\0\0\0\1", 4));
+	CString sT = sU;
+
+	for (unsigned int i = 1; i < uIterations; i++) {
+		sU = HMACSHA256(sPass, sU);
+		for (size_t a = 0; a < sT.size(); a++)
+			sT[a] ^= sU[a];
+	}
+
+	memcpy(digest, sT.data(), sizeof(digest));
+#endif
+
+	CString sRet;
+	for (size_t a = 0; a < sizeof(digest); a++) {
+		sRet += szHex[digest[a] >> 4];
+		sRet += szHex[digest[a] & 0xf];
+	}
+
+	return sRet;
+}
+
 CString CUtils::GetPass(const CString& sPrompt) {
 	PrintPrompt(sPrompt);
 #ifdef HAVE_GETPASSPHRASE
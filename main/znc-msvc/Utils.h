@@ -59,6 +59,8 @@ public:
 	static CString GetSalt();
 	static CString SaltedMD5Hash(const CString& sPass, const CString& sSalt);
 	static CString SaltedSHA256Hash(const CString& sPass, const CString& sSalt);
+	//! PBKDF2-HMAC-SHA256 with uIterations rounds, as a hex string. Thread safe.
+	static CString SaltedPBKDF2Hash(const CString& sPass, const CString& sSalt, unsigned int uIterations);
 	static CString GetPass(const CString& sPrompt);
 	static bool GetInput(const CString& sPrompt, CString& sRet, const CString& sDefault = "", const CString& sHint = "");
 	static bool GetBoolInput(const CString& sPrompt, bool bDefault);
@@ -73,6 +75,11 @@ public:
 		iTime += ((unsigned long long) tv.tv_usec / 1000);
 		return iTime;
 	}
+	static unsigned long long GetMicroTime() {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+	}
 #ifdef HAVE_LIBSSL
 	static void GenerateCert(FILE *pOut, const CString& sHost = "");
 #endif /* HAVE_LIBSSL */
@@ -89,7 +96,9 @@ class CException {
 public:
 	typedef enum {
 		EX_Shutdown,
-		EX_Restart
+		EX_Restart,
+		//! Restart and hand the open connections to the new process, see CHandoff
+		EX_RestartLive
 	} EType;
 
 	CException(EType e) {
@@ -536,7 +536,227 @@ void CWebSock::OnPageRequest(const CString& sURI) {
 	}
 }
 
+// Prometheus wants seconds, we count microseconds
+static CString MetricSeconds(unsigned long long uMicro) {
+	char szBuf[32];
+	snprintf(szBuf, sizeof(szBuf), "%llu.%06llu", uMicro / 1000000, uMicro % 1000000);
+	return szBuf;
+}
+
+static CString MetricLabel(const CString& sValue) {
+	CString sRet;
+	sRet.reserve(sValue.size() + 2);
+
+	for (CString::const_iterator it = sValue.begin(); it != sValue.end(); ++it) {
+		if (*it == '\\' || *it == '"') {
+			sRet += '\\';
+			sRet += *it;
+		} else if (*it == '\n') {
+			sRet += "\\n";
+		} else {
+			sRet += *it;
+		}
+	}
+
+	return sRet;
+}
+
+// Looks at every byte of sSecret, so the time taken doesn't tell how much
+// of sGiven was right. Only the length of sGiven can be found out this way.
+static bool SecretEquals(const CString& sGiven, const CString& sSecret) {
+	unsigned char uDiff = (sGiven.size() != sSecret.size());
+
+	for (size_t a = 0; a < sSecret.size(); a++) {
+		uDiff |= sSecret[a] ^ ((a < sGiven.size()) ? sGiven[a] : 0);
+	}
+
+	return (uDiff == 0);
+}
+
+static void MetricHeader(CString& sOut, const CString& sName, const CString& sType, const CString& sHelp) {
+	sOut += "# HELP " + sName + " " + sHelp + "\n";
+	sOut += "# TYPE " + sName + " " + sType + "\n";
+}
+
+CWebSock::EPageReqResult CWebSock::PrintMetrics() {
+	const CString& sToken = CZNC::Get().GetMetricsToken();
+
+	if (sToken.empty()) {
+		return PAGE_NOTFOUND;
+	}
+
+	// Only as a header, a ?token= parameter would end up in proxy and access logs
+	if (!SecretEquals(GetBearerToken(), sToken)) {
+		AddHeader("WWW-Authenticate", "Bearer");
+		PrintErrorPage(401, "Unauthorized", "A valid MetricsToken is needed");
+		return PAGE_DONE;
+	}
+
+	const CPerfStats& Stats = CZNC::Get().GetPerfStats();
+	const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+	CZNC::TrafficStatsPair Users, ZNC, Total;
+	CZNC::TrafficStatsMap mTraffic = CZNC::Get().GetTrafficStats(Users, ZNC, Total);
+	unsigned int uUserLabels = CZNC::Get().GetMetricsUserLabels();
+	size_t uAttached = 0, uClients = 0, uIRC = 0, uBuffers = 0;
+
+	for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+		uAttached += it->second->IsUserAttached() ? 1 : 0;
+		uIRC += it->second->IsIRCConnected() ? 1 : 0;
+		uClients += it->second->GetClients().size();
+		uBuffers += it->second->GetBufferBytes();
+	}
+
+	// The length isn't known up front, the body ends when we close the connection.
+	// Every metric family is handed to Write() once it is done. Whatever the
+	// scraper doesn't take right away still waits in the send buffer, so with
+	// a slow scraper most of the page ends up in memory anyway.
+	PrintHeader(0, "text/plain; version=0.0.4");
+	CString sOut;
+
+	MetricHeader(sOut, "znc_start_time_seconds", "gauge", "When ZNC was started");
+	sOut += "znc_start_time_seconds " + CString((unsigned long long) CZNC::Get().TimeStarted()) + "\n";
+	MetricHeader(sOut, "znc_users", "gauge", "Configured users");
+	sOut += "znc_users " + CString(msUsers.size()) + "\n";
+	MetricHeader(sOut, "znc_attached_users", "gauge", "Users with at least one client");
+	sOut += "znc_attached_users " + CString(uAttached) + "\n";
+	MetricHeader(sOut, "znc_clients", "gauge", "Connected IRC clients");
+	sOut += "znc_clients " + CString(uClients) + "\n";
+	MetricHeader(sOut, "znc_irc_connections", "gauge", "Users connected to an IRC server");
+	sOut += "znc_irc_connections " + CString(uIRC) + "\n";
+	MetricHeader(sOut, "znc_sockets", "gauge", "All sockets, including listeners and web clients");
+	sOut += "znc_sockets " + CString(CZNC::Get().GetManager().size()) + "\n";
+	MetricHeader(sOut, "znc_buffer_bytes", "gauge", "Bytes used by channel, query, raw and MOTD buffers");
+	sOut += "znc_buffer_bytes " + CString(uBuffers) + "\n";
+	Write(sOut);
+	sOut.clear();
+
+	const CSockManager& Manager = CZNC::Get().GetManager();
+	unsigned long long uSendQ = 0, uRecvQ = 0;
+
+	for (CSockManager::const_iterator it = Manager.begin(); it != Manager.end(); ++it) {
+		uSendQ += (*it)->GetInternalWriteBuffer().size();
+		uRecvQ += (*it)->GetInternalReadBuffer().size();
+	}
+
+	MetricHeader(sOut, "znc_socket_queue_bytes", "gauge", "Bytes waiting in socket queues");
+	sOut += "znc_socket_queue_bytes{queue=\"send\"} " + CString(uSendQ) + "\n";
+	sOut += "znc_socket_queue_bytes{queue=\"recv\"} " + CString(uRecvQ) + "\n";
+	MetricHeader(sOut, "znc_memory_limit_actions_total", "counter", "What the memory limits had to do");
+	sOut += "znc_memory_limit_actions_total{action=\"drop_buffer_line\"} " + CString(Stats.GetDroppedLines()) + "\n";
+	sOut += "znc_memory_limit_actions_total{action=\"pause_client\"} " + CString(Stats.GetPausedClients()) + "\n";
+	sOut += "znc_memory_limit_actions_total{action=\"disconnect_client\"} " + CString(Stats.GetStalledClients()) + "\n";
+	sOut += "znc_memory_limit_actions_total{action=\"pause_irc_read\"} " + CString(Stats.GetIRCReadPauses()) + "\n";
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_traffic_bytes_total", "counter", "Bytes transferred, by direction");
+	sOut += "znc_traffic_bytes_total{direction=\"in\"} " + CString(Total.first) + "\n";
+	sOut += "znc_traffic_bytes_total{direction=\"out\"} " + CString(Total.second) + "\n";
+	MetricHeader(sOut, "znc_lines_total", "counter", "IRC lines, by peer and direction");
+	sOut += "znc_lines_total{peer=\"irc\",direction=\"in\"} " + CString(Stats.GetLines(CPerfStats::LINES_IRC_IN)) + "\n";
+	sOut += "znc_lines_total{peer=\"irc\",direction=\"out\"} " + CString(Stats.GetLines(CPerfStats::LINES_IRC_OUT)) + "\n";
+	sOut += "znc_lines_total{peer=\"client\",direction=\"in\"} " + CString(Stats.GetLines(CPerfStats::LINES_CLIENT_IN)) + "\n";
+	sOut += "znc_lines_total{peer=\"client\",direction=\"out\"} " + CString(Stats.GetLines(CPerfStats::LINES_CLIENT_OUT)) + "\n";
+	Write(sOut);
+	sOut.clear();
+
+	const CHookStats& Loops = Stats.GetLoops();
+	unsigned long long uCount = 0;
+
+	MetricHeader(sOut, "znc_loop_busy_seconds", "histogram", "Time each event loop iteration spent working");
+	for (unsigned int a = 0; a < CPerfStats::LOOP_BUCKETS; a++) {
+		unsigned long long uLimit = CPerfStats::GetLoopBucketLimit(a);
+
+		uCount += Stats.GetLoopBucket(a);
+		sOut += "znc_loop_busy_seconds_bucket{le=\"" + (uLimit ? MetricSeconds(uLimit) : CString("+Inf")) + "\"} " + CString(uCount) + "\n";
+	}
+	sOut += "znc_loop_busy_seconds_sum " + MetricSeconds(Loops.GetTime()) + "\n";
+	sOut += "znc_loop_busy_seconds_count " + CString(Loops.GetCalls()) + "\n";
+	MetricHeader(sOut, "znc_timer_lag_seconds", "gauge", "How late the last timer ran");
+	sOut += "znc_timer_lag_seconds " + MetricSeconds(Stats.GetLastTimerLag()) + "\n";
+	MetricHeader(sOut, "znc_timer_lag_max_seconds", "gauge", "How late a timer ran at most");
+	sOut += "znc_timer_lag_max_seconds " + MetricSeconds(Stats.GetTimerLag().GetMaxTime()) + "\n";
+	Write(sOut);
+	sOut.clear();
+
+	map<CString, CHookStats> mHooks;
+	CPerfStats::GetModuleStats(mHooks, true);
+
+	MetricHeader(sOut, "znc_module_hook_calls_total", "counter", "Calls of module hooks");
+	for (map<CString, CHookStats>::const_iterator it = mHooks.begin(); it != mHooks.end(); ++it) {
+		sOut += "znc_module_hook_calls_total{module=\"" + MetricLabel(it->first.Token(0, false, "/"))
+			+ "\",hook=\"" + MetricLabel(it->first.Token(1, true, "/")) + "\"} " + CString(it->second.GetCalls()) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_module_hook_seconds_total", "counter", "Time spent in module hooks");
+	for (map<CString, CHookStats>::const_iterator it = mHooks.begin(); it != mHooks.end(); ++it) {
+		sOut += "znc_module_hook_seconds_total{module=\"" + MetricLabel(it->first.Token(0, false, "/"))
+			+ "\",hook=\"" + MetricLabel(it->first.Token(1, true, "/")) + "\"} " + MetricSeconds(it->second.GetTime()) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	if (uUserLabels == 0) {
+		return PAGE_DONE;
+	}
+
+	// One series per user gets expensive for Prometheus on big instances,
+	// so only the first users get one and the rest is counted
+	vector<CUser*> vpUsers;
+
+	for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end() && vpUsers.size() < uUserLabels; ++it) {
+		vpUsers.push_back(it->second);
+	}
+
+	// Samples of one family have to be next to each other
+	MetricHeader(sOut, "znc_user_traffic_bytes_total", "counter", "Bytes transferred, by user and direction");
+	for (unsigned int b = 0; b < vpUsers.size(); b++) {
+		const CString& sUser = vpUsers[b]->GetUserName();
+		const CString sLabel = "{user=\"" + MetricLabel(sUser) + "\",direction=";
+
+		sOut += "znc_user_traffic_bytes_total" + sLabel + "\"in\"} " + CString(mTraffic[sUser].first) + "\n";
+		sOut += "znc_user_traffic_bytes_total" + sLabel + "\"out\"} " + CString(mTraffic[sUser].second) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_user_clients", "gauge", "Connected clients, by user");
+	for (unsigned int c = 0; c < vpUsers.size(); c++) {
+		sOut += "znc_user_clients{user=\"" + MetricLabel(vpUsers[c]->GetUserName()) + "\"} " + CString(vpUsers[c]->GetClients().size()) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_user_irc_connected", "gauge", "Whether the user is connected to IRC");
+	for (unsigned int d = 0; d < vpUsers.size(); d++) {
+		sOut += "znc_user_irc_connected{user=\"" + MetricLabel(vpUsers[d]->GetUserName()) + "\"} " + CString(vpUsers[d]->IsIRCConnected() ? 1 : 0) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_user_buffer_bytes", "gauge", "Bytes used by the user's buffers");
+	for (unsigned int e = 0; e < vpUsers.size(); e++) {
+		sOut += "znc_user_buffer_bytes{user=\"" + MetricLabel(vpUsers[e]->GetUserName()) + "\"} " + CString(vpUsers[e]->GetBufferBytes()) + "\n";
+	}
+	Write(sOut);
+	sOut.clear();
+
+	MetricHeader(sOut, "znc_metrics_unlabeled_users", "gauge", "Users left out of the per user series by MetricsUserLabels");
+	sOut += "znc_metrics_unlabeled_users " + CString(msUsers.size() - vpUsers.size()) + "\n";
+	Write(sOut);
+
+	return PAGE_DONE;
+}
+
 CWebSock::EPageReqResult CWebSock::OnPageRequestInternal(const CString& sURI, CString& sPageRet) {
+	// Scrapers don't keep cookies, so this must be handled before a
+	// session is created for them
+	if (sURI == "/metrics") {
+		return PrintMetrics();
+	}
+
 	// Check that their session really belongs to their IP address. IP-based
 	// authentication is bad, but here it's just an extra layer that makes
 	// stealing cookies harder to pull off.
@@ -146,6 +146,7 @@ protected:
 
 private:
 	EPageReqResult OnPageRequestInternal(const CString& sURI, CString& sPageRet);
+	EPageReqResult PrintMetrics();
 
 	bool                    m_bPathsSet;
 	CTemplate               m_Template;
@@ -65,6 +65,51 @@ unsigned char* CString::strnchr(const unsigned char* src, unsigned char c, unsig
 	return NULL;
 }
 
+// tolower()/toupper() for every byte, looked up instead of called for each
+// character. The tables follow the C library, so the results don't change.
+class CCaseTables {
+public:
+	CCaseTables() {
+		for (unsigned int a = 0; a < 256; a++) {
+			m_auLower[a] = (unsigned char) tolower(a);
+			m_auUpper[a] = (unsigned char) toupper(a);
+		}
+	}
+
+	unsigned char m_auLower[256];
+	unsigned char m_auUpper[256];
+};
+
+static const CCaseTables& CaseTables() {
+	static const CCaseTables Tables;
+	return Tables;
+}
+
+static void MapChars(char* p, size_t uLen, const unsigned char* auTable) {
+	unsigned char* q = (unsigned char*) p;
+
+	for (size_t a = 0; a < uLen; a++) {
+		q[a] = auTable[q[a]];
+	}
+}
+
+// Same result as strncasecmp(), without calling tolower() twice per character
+static int CaseCompare(const char* s1, const char* s2, size_t uLen) {
+	const unsigned char* auLower = CaseTables().m_auLower;
+	const unsigned char* p1 = (const unsigned char*) s1;
+	const unsigned char* p2 = (const unsigned char*) s2;
+
+	for (size_t a = 0; a < uLen; a++) {
+		int iDiff = auLower[p1[a]] - auLower[p2[a]];
+
+		if (iDiff || !p1[a]) {
+			return iDiff;
+		}
+	}
+
+	return 0;
+}
+
 int CString::CaseCmp(const CString& s, size_t uLen) const {
 	if (uLen != CString::npos) {
 		return strncasecmp(c_str(), s.c_str(), uLen);
@@ -83,7 +128,7 @@ bool CString::Equals(const CString& s, bool bCaseSensitive, size_t uLen) const {
 	if (bCaseSensitive) {
 		return (StrCmp(s, uLen) == 0);
 	} else {
-		return (CaseCmp(s, uLen) == 0);
+		return (CaseCompare(c_str(), s.c_str(), uLen) == 0);
 	}
 }
 
@@ -130,18 +175,16 @@ bool CString::WildCmp(const CString& sWild) const {
 }
 
 CString& CString::MakeUpper() {
-	for (unsigned int a = 0; a < length(); a++) {
-		char& c = (*this)[a];
-		c = toupper(c);
+	if (!empty()) {
+		MapChars(&(*this)[0], length(), CaseTables().m_auUpper);
 	}
 
 	return *this;
 }
 
 CString& CString::MakeLower() {
-	for (unsigned int a = 0; a < length(); a++) {
-		char& c = (*this)[a];
-		c = tolower(c);
+	if (!empty()) {
+		MapChars(&(*this)[0], length(), CaseTables().m_auLower);
 	}
 
 	return *this;
@@ -150,23 +193,13 @@ CString& CString::MakeLower() {
 CString CString::AsUpper() const {
 	CString sRet = *this;
 
-	for (unsigned int a = 0; a < length(); a++) {
-		char& c = sRet[a];
-		c = toupper(c);
-	}
-
-	return sRet;
+	return sRet.MakeUpper();
 }
 
 CString CString::AsLower() const {
 	CString sRet = *this;
 
-	for (unsigned int a = 0; a < length(); a++) {
-		char& c = sRet[a];
-		c = tolower(c);
-	}
-
-	return sRet;
+	return sRet.MakeLower();
 }
 
 CString::EEscape CString::ToEscape(const CString& sEsc) {
@@ -183,7 +216,54 @@ CString::EEscape CString::ToEscape(const CString& sEsc) {
 	return EASCII;
 }
 
+// Which bytes Escape_n() changes when it escapes plain text
+class CEscapeTables {
+public:
+	CEscapeTables() {
+		for (unsigned int a = 0; a < 256; a++) {
+			unsigned char ch = (unsigned char) a;
+
+			m_abHTML[a] = (ch == '<' || ch == '>' || ch == '"' || ch == '&');
+			m_abURL[a] = !(isalnum(ch) || ch == '_' || ch == '.' || ch == '-');
+			m_abSQL[a] = (ch == '\0' || ch == '\n' || ch == '\t' || ch == '\r' || ch == '\b'
+					|| ch == '"' || ch == '\'' || ch == '\\');
+		}
+	}
+
+	bool m_abHTML[256];
+	bool m_abURL[256];
+	bool m_abSQL[256];
+};
+
 CString CString::Escape_n(EEscape eFrom, EEscape eTo) const {
+	if (eFrom == EASCII) {
+		// Most strings don't contain anything to escape, look for that
+		// before building a copy byte by byte
+		static const CEscapeTables Tables;
+		const bool* abEscape = NULL;
+
+		switch (eTo) {
+			case EHTML: abEscape = Tables.m_abHTML; break;
+			case EURL:  abEscape = Tables.m_abURL;  break;
+			case ESQL:  abEscape = Tables.m_abSQL;  break;
+			case EASCII: return *this;
+		}
+
+		if (abEscape) {
+			const unsigned char* p = (const unsigned char*) data();
+			size_t uLen = length();
+			size_t a = 0;
+
+			while (a < uLen && !abEscape[p[a]]) {
+				a++;
+			}
+
+			if (a == uLen) {
+				return *this;
+			}
+		}
+	}
+
 	CString sRet;
 	const char szHex[] = "0123456789ABCDEF";
 	const unsigned char *pStart = (const unsigned char*) data();
@@ -425,6 +505,50 @@ CString CString::Token(unsigned int uPos, bool bRest, const CString& sSep, bool
 	size_t start_pos = 0;
 	size_t end_pos;
 
+	if (sep_len == 1 && sep_str[0] != '\0') {
+		// The usual case, a single character separator. Same as below, but
+		// memchr() skips over the text between separators.
+		const char c = sep_str[0];
+		const char* q;
+
+		if (!bAllowEmpty) {
+			while (start_pos < str_len && str[start_pos] == c) {
+				start_pos++;
+			}
+		}
+
+		while (uPos != 0 && start_pos < str_len) {
+			if (str[start_pos] != c) {
+				q = (const char*) memchr(str + start_pos, c, str_len - start_pos);
+				start_pos = (q) ? q - str : str_len;
+				continue;
+			}
+
+			start_pos++;
+			if (!bAllowEmpty) {
+				while (start_pos < str_len && str[start_pos] == c) {
+					start_pos++;
+				}
+			}
+
+			uPos--;
+		}
+
+		if (start_pos >= str_len)
+			return "";
+
+		if (bRest) {
+			return substr(start_pos);
+		}
+
+		q = (const char*) memchr(str + start_pos, c, str_len - start_pos);
+		if (q) {
+			return substr(start_pos, (q - str) - start_pos);
+		}
+
+		return substr(start_pos);
+	}
+
 	if (!bAllowEmpty) {
 		while (strncmp(&str[start_pos], sep_str, sep_len) == 0) {
 			start_pos += sep_len;
@@ -570,6 +694,48 @@ size_t CString::Split(const CString& sDelim, VCString& vsRet, bool bAllowEmpty,
 	size_t uRightLen = sRight.length();
 	const char* p = c_str();
 
+	if (uDelimLen == 1 && (!uLeftLen || !uRightLen) && !isalpha((unsigned char) sDelim[0])
+			&& sDelim[0] != '\0') {
+		// No quotes and a delimiter without an upper/lower case variant,
+		// so memchr() can find it. Like below, the string ends at a '\0'.
+		const char c = sDelim[0];
+		const char* pEnd = (const char*) memchr(p, '\0', length());
+		const char* q;
+
+		if (!pEnd) {
+			pEnd = p + length();
+		}
+
+		if (!bAllowEmpty) {
+			while (p < pEnd && *p == c) {
+				p++;
+			}
+		}
+
+		while (p < pEnd && (q = (const char*) memchr(p, c, pEnd - p)) != NULL) {
+			vsRet.push_back(CString(p, q - p));
+			if (bTrimWhiteSpace) {
+				vsRet.back().Trim();
+			}
+
+			p = q + 1;
+			if (!bAllowEmpty) {
+				while (p < pEnd && *p == c) {
+					p++;
+				}
+			}
+		}
+
+		if (p < pEnd) {
+			vsRet.push_back(CString(p, pEnd - p));
+			if (bTrimWhiteSpace) {
+				vsRet.back().Trim();
+			}
+		}
+
+		return vsRet.size();
+	}
+
 	if (!bAllowEmpty) {
 		while (strncasecmp(p, sDelim.c_str(), uDelimLen) == 0) {
 			p += uDelimLen;
@@ -664,13 +830,17 @@ CString CString::RandomString(size_t uLength) {
 }
 
 bool CString::Base64Encode(size_t uWrap) {
-	CString sCopy(*this);
-	return sCopy.Base64Encode(*this, uWrap);
+	CString sRet;
+	bool bRet = Base64Encode(sRet, uWrap);
+	swap(sRet);
+	return bRet;
 }
 
 size_t CString::Base64Decode() {
-	CString sCopy(*this);
-	return sCopy.Base64Decode(*this);
+	CString sRet;
+	size_t uRet = Base64Decode(sRet);
+	swap(sRet);
+	return uRet;
 }
 
 CString CString::Base64Encode_n(size_t uWrap) const {
@@ -685,12 +855,30 @@ CString CString::Base64Decode_n() const {
 	return sRet;
 }
 
+// Every 12 bit value mapped to its two base64 characters, so three input
+// bytes only need two table lookups
+static const char* Base64PairTable() {
+	static const char b64table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	static char szPairs[4096 * 2];
+	static bool bInit = false;
+
+	if (!bInit) {
+		for (unsigned int a = 0; a < 4096; a++) {
+			szPairs[a * 2] = b64table[a >> 6];
+			szPairs[a * 2 + 1] = b64table[a & 0x3f];
+		}
+		bInit = true;
+	}
+
+	return szPairs;
+}
+
 bool CString::Base64Encode(CString& sRet, size_t uWrap) const {
 	const char b64table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-	sRet.clear();
+	const char* szPairs = Base64PairTable();
 	size_t len = size();
-	const unsigned char* input = (const unsigned char*) c_str();
-	unsigned char *output, *p;
+	const unsigned char* input = (const unsigned char*) data();
+	char *output, *p;
 	size_t        i = 0, mod = len % 3, toalloc;
 	toalloc = (len / 3) * 4 + (3 - mod) % 3 + 1 + 8;
 
@@ -702,17 +890,23 @@ bool CString::Base64Encode(CString& sRet, size_t uWrap) const {
 	}
 
 	if (toalloc < len) {
+		sRet.clear();
 		return 0;
 	}
 
-	p = output = new unsigned char [toalloc];
+	// Write straight into sRet and cut it down to size at the end
+	sRet.resize(toalloc);
+	p = output = &sRet[0];
 
 	while (i < len - mod) {
-		*p++ = b64table[input[i++] >> 2];
-		*p++ = b64table[((input[i - 1] << 4) | (input[i] >> 4)) & 0x3f];
-		*p++ = b64table[((input[i] << 2) | (input[i + 1] >> 6)) & 0x3f];
-		*p++ = b64table[input[i + 1] & 0x3f];
-		i += 2;
+		unsigned int uGroup = (input[i] << 16) | (input[i + 1] << 8) | input[i + 2];
+		const char* pPair = szPairs + (uGroup >> 12) * 2;
+		*p++ = pPair[0];
+		*p++ = pPair[1];
+		pPair = szPairs + (uGroup & 0xfff) * 2;
+		*p++ = pPair[0];
+		*p++ = pPair[1];
+		i += 3;
 
 		if (uWrap && !(i % 57)) {
 			*p++ = '\n';
@@ -724,12 +918,14 @@ bool CString::Base64Encode(CString& sRet, size_t uWrap) const {
 			*p++ = '\n';
 		}
 	} else {
-		*p++ = b64table[input[i++] >> 2];
-		*p++ = b64table[((input[i - 1] << 4) | (input[i] >> 4)) & 0x3f];
+		unsigned char uNext = (mod == 2) ? input[i + 1] : 0;
+
+		*p++ = b64table[input[i] >> 2];
+		*p++ = b64table[((input[i] << 4) | (uNext >> 4)) & 0x3f];
 		if (mod == 1) {
 			*p++ = '=';
 		} else {
-			*p++ = b64table[(input[i] << 2) & 0x3f];
+			*p++ = b64table[(uNext << 2) & 0x3f];
 		}
 
 		*p++ = '=';
@@ -739,23 +935,33 @@ bool CString::Base64Encode(CString& sRet, size_t uWrap) const {
 		}
 	}
 
-	*p = 0;
-	sRet = (char*) output;
-	delete[] output;
+	sRet.resize(p - output);
 	return true;
 }
 
 size_t CString::Base64Decode(CString& sRet) const {
-	CString sTmp(*this);
-	// remove new lines
-	sTmp.Replace("\r", "");
-	sTmp.Replace("\n", "");
+	CString sTmp;
+	const CString* pIn = this;
+
+	// remove new lines, but don't copy the string if there are none
+	if (find_first_of("\r\n") != npos) {
+		sTmp = *this;
+		sTmp.Replace("\r", "");
+		sTmp.Replace("\n", "");
+		pIn = &sTmp;
+	} else if (&sRet == this) {
+		sTmp = *this;
+		pIn = &sTmp;
+	}
 
-	const char* in = sTmp.c_str();
-	char c, c1, *p;
+	const char* in = pIn->c_str();
+	char c, c1, *p, *out;
 	size_t i;
-	size_t uLen = sTmp.size();
-	char* out = new char[uLen + 1];
+	size_t uLen = pIn->size();
+
+	// The result is never longer than the input, decode straight into sRet
+	sRet.resize(uLen + 1);
+	out = &sRet[0];
 
 	for (i = 0, p = out; i < uLen; i++) {
 		c = (char)base64_table[(unsigned char)in[i++]];
@@ -778,11 +984,8 @@ size_t CString::Base64Decode(CString& sRet) const {
 		}
 	}
 
-	*p = '\0';
 	size_t uRet = p - out;
-	sRet.clear();
-	sRet.append(out, uRet);
-	delete[] out;
+	sRet.resize(uRet);
 
 	return uRet;
 }
@@ -867,14 +1070,20 @@ void CString::Decrypt(const CString& sPass, const CString& sIvec) {
 }
 
 void CString::Crypt(const CString& sPass, bool bEncrypt, const CString& sIvec) {
-	unsigned char szIvec[8] = {0,0,0,0,0,0,0,0};
 	BF_KEY bKey;
 
+	BF_set_key(&bKey, (int) sPass.length(), (unsigned char*) sPass.data());
+	Crypt(&bKey, bEncrypt, sIvec);
+	memset(&bKey, 0, sizeof(bKey));
+}
+
+void CString::Crypt(const BF_KEY* pKey, bool bEncrypt, const CString& sIvec) {
+	unsigned char szIvec[8] = {0,0,0,0,0,0,0,0};
+
 	if (sIvec.length() >= 8) {
 		memcpy(szIvec, sIvec.data(), 8);
 	}
 
-	BF_set_key(&bKey, (int) sPass.length(), (unsigned char*) sPass.data());
 	unsigned int uPad = (length() % 8);
 
 	if (uPad) {
@@ -882,13 +1091,13 @@ void CString::Crypt(const CString& sPass, bool bEncrypt, const CString& sIvec) {
 		append(uPad, '\0');
 	}
 
-	size_t uLen = length();
-	unsigned char* szBuff = (unsigned char*) malloc(uLen);
-	BF_cbc_encrypt((const unsigned char*) data(), szBuff, (long) uLen, &bKey, szIvec, ((bEncrypt) ? BF_ENCRYPT : BF_DECRYPT));
+	if (empty()) {
+		return;
+	}
 
-	clear();
-	append((const char*) szBuff, uLen);
-	free(szBuff);
+	// BF_cbc_encrypt() works in place
+	unsigned char* szBuff = (unsigned char*) &(*this)[0];
+	BF_cbc_encrypt(szBuff, szBuff, (long) length(), pKey, szIvec, ((bEncrypt) ? BF_ENCRYPT : BF_DECRYPT));
 }
 #endif	// HAVE_LIBSSL
 
@@ -31,6 +31,11 @@ using std::pair;
 class CString;
 class MCString;
 
+#ifdef HAVE_LIBSSL
+// BF_KEY from <openssl/blowfish.h>
+struct bf_key_st;
+#endif
+
 typedef set<CString> SCString;
 typedef vector<CString>                 VCString;
 typedef vector<pair<CString, CString> > VPair;
@@ -344,6 +349,11 @@ public:
 	void Encrypt(const CString& sPass, const CString& sIvec = "");
 	void Decrypt(const CString& sPass, const CString& sIvec = "");
 	void Crypt(const CString& sPass, bool bEncrypt, const CString& sIvec = "");
+	/** Same as above, but with a key schedule from BF_set_key(). Keep it
+	 *  around if you use the same password a lot, setting up the key costs
+	 *  much more than encrypting a short string.
+	 */
+	void Crypt(const struct bf_key_st* pKey, bool bEncrypt, const CString& sIvec = "");
 #endif
 
 	/** Pretty-print a percent value.
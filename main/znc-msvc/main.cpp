@@ -10,6 +10,7 @@
 #include <getopt.h>
 #include <sys/wait.h>
 #include <conio.h>
+#include <process.h>
 
 static const struct option g_LongOpts[] = {
 	{ "help",        no_argument,       0, 'h' },
@@ -19,9 +20,59 @@ static const struct option g_LongOpts[] = {
 	{ "makepass",    no_argument,       0, 's' },
 	{ "makepem",     no_argument,       0, 'p' },
 	{ "datadir",     required_argument, 0, 'd' },
+	{ "handoff",     required_argument, 0, 'H' },
 	{ 0, 0, 0, 0 }
 };
 
+// Quotes an argument the way the C runtime splits the command line again
+static CString QuoteArg(const CString& sArg) {
+	CString sRet = "\"";
+	size_t uSlashes = 0;
+
+	for (size_t a = 0; a < sArg.size(); a++) {
+		if (sArg[a] == '\\') {
+			uSlashes++;
+		} else {
+			if (sArg[a] == '"') {
+				sRet.append(uSlashes + 1, '\\');
+			}
+			uSlashes = 0;
+		}
+
+		sRet += sArg[a];
+	}
+
+	// Backslashes in front of the closing quote have to be doubled
+	sRet.append(uSlashes, '\\');
+
+	return sRet + "\"";
+}
+
+// Starts a copy of this program without letting it inherit any handles,
+// the sockets it takes over are duplicated by CHandoff.
+static bool SpawnSelf(char* const* args, PROCESS_INFORMATION& ProcInfo) {
+	char szPath[MAX_PATH] = {0};
+	STARTUPINFO StartupInfo;
+	CString sCmdLine;
+
+	if (GetModuleFileName(NULL, szPath, MAX_PATH - 1) == 0) {
+		return false;
+	}
+
+	for (char* const* p = args; *p; p++) {
+		sCmdLine += (sCmdLine.empty() ? "" : " ") + QuoteArg(*p);
+	}
+
+	memset(&StartupInfo, 0, sizeof(StartupInfo));
+	StartupInfo.cb = sizeof(StartupInfo);
+
+	// CreateProcess() may modify the command line
+	vector<char> vCmdLine(sCmdLine.begin(), sCmdLine.end());
+	vCmdLine.push_back('\0');
+
+	return (CreateProcess(szPath, &vCmdLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &StartupInfo, &ProcInfo) != 0);
+}
+
 static void GenerateHelp(const char *appname) {
 	CUtils::PrintMessage("USAGE: " + CString(appname) + " [options]");
 	CUtils::PrintMessage("Options are:");
@@ -34,6 +85,7 @@ static void GenerateHelp(const char *appname) {
 	CUtils::PrintMessage("\t-p, --makepem      Generates a pemfile for use with SSL");
 #endif /* HAVE_LIBSSL */
 	CUtils::PrintMessage("\t-d, --datadir      Set a different ZNC repository (default is ~/.znc)");
+	CUtils::PrintMessage("\t    --handoff PID  Take over the connections of ZNC process PID (used by Restart Live)");
 }
 
 // removed: die() rehash() isRoot()
@@ -97,6 +149,7 @@ int main(int argc, char** argv) {
 	bool bMakePass = false;
 	bool bAllowRoot = false;
 	bool bMakePem = false;
+	unsigned long uHandoffPid = 0;
 
 	while ((iArg = getopt_long(argc, argv, "hvcspd:D", g_LongOpts, &iOptIndex)) != -1) {
 		switch (iArg) {
@@ -126,6 +179,9 @@ int main(int argc, char** argv) {
 		case 'D':
 			CDebug::SetDebug(true);
 			break;
+		case 'H':
+			uHandoffPid = CString(optarg).ToULong();
+			break;
 		case '?':
 		default:
 			GenerateHelp(argv[0]);
@@ -181,6 +237,13 @@ int main(int argc, char** argv) {
 		/* Fall through to normal bootup */
 	}
 
+	// The old process still holds the listeners and the config lock
+	if (uHandoffPid && !CHandoff::WaitForProcess(uHandoffPid, 60)) {
+		CUtils::PrintError("The old ZNC process [" + CString(uHandoffPid) + "] didn't exit.");
+		delete pZNC;
+		return 1;
+	}
+
 	CString sDummyError;
 	if (!pZNC->ParseConfig(sConfig, sDummyError)) {
 		if(argc < 2)
@@ -203,6 +266,13 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
+	if (uHandoffPid) {
+		CString sError;
+
+		CUtils::PrintAction("Taking over the connections of the old process");
+		CUtils::PrintStatus(CHandoff::Load(sError), sError);
+	}
+
 	// removed: checks for isRoot, bForeground, forking and signal handlers
 
 	int iRet = 0;
@@ -220,6 +290,7 @@ int main(int argc, char** argv) {
 				iRet = 0;
 				CUtils::PrintMessage("************** Shutting down ZNC... **************");
 				break;
+			case CException::EX_RestartLive:
 			case CException::EX_Restart: {
 				// strdup() because GCC is stupid
 				char *args[] = {
@@ -245,6 +316,38 @@ int main(int argc, char** argv) {
 				// The above code adds 3 entries to args tops
 				// which means the array should be big enough
 
+				if (e.GetType() == CException::EX_RestartLive) {
+					// WSADuplicateSocket() needs the new process' id,
+					// so it has to be started before the handoff
+					args[pos++] = strdup("--handoff");
+					args[pos++] = strdup(CString((unsigned long) GetCurrentProcessId()).c_str());
+
+					PROCESS_INFORMATION ProcInfo;
+
+					if (SpawnSelf(args, ProcInfo)) {
+						CString sError;
+
+						CUtils::PrintMessage("************** Restarting ZNC live... **************");
+						if (!CHandoff::Save(ProcInfo.dwProcessId, sError)) {
+							CUtils::PrintError(sError);
+						}
+
+						CloseHandle(ProcInfo.hThread);
+						CloseHandle(ProcInfo.hProcess);
+						delete pZNC;
+
+						// The new process waits for this one to exit
+						return 0;
+					}
+
+					CUtils::PrintError("Unable to restart ZNC live [" + CString((unsigned long) GetLastError()) + "], restarting normally");
+					pos -= 2;
+					free(args[pos]);
+					free(args[pos + 1]);
+					args[pos] = NULL;
+					args[pos + 1] = NULL;
+				}
+
 				CUtils::PrintMessage("************** Restarting ZNC... **************");
 				delete pZNC; /* stuff screws up real bad if we don't close all sockets etc. */
 				pZNC = NULL;
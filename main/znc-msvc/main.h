@@ -98,12 +98,18 @@
 #include "Buffer.h"
 #include "Chan.h"
 #include "Client.h"
+#include "AuthQueue.h"
 #include "Csocket.h"
 #include "FileUtils.h"
+#include "Handoff.h"
 #include "HTTPSock.h"
+#include "HTTPClient.h"
+#include "StreamParser.h"
 #include "IRCSock.h"
+#include "MessageBus.h"
 #include "Modules.h"
 #include "Nick.h"
+#include "PerfStats.h"
 #include "Server.h"
 #include "Template.h"
 #include "User.h"
@@ -28,9 +28,19 @@ static array_size_helper<N> array_size(T (&)[N]) {
 
 #define ARRAY_SIZE(array) sizeof(array_size((array)))
 
+// Upper limit for the number of commands in one Begin/Commit block
+#define ADMIN_MAX_BATCH 20000
+
 class CAdminMod : public CModule {
 	using CModule::PutModule;
 
+	// While a batch is applied, replies are collected here instead of being sent
+	bool     m_bCapture;
+	VCString m_vsCaptured;
+	// Commands queued since Begin
+	bool     m_bBatch;
+	VCString m_vsBatch;
+
 	void PrintHelp(const CString&) {
 		HandleHelpCommand();
 
@@ -59,6 +69,8 @@ class CAdminMod : public CModule {
 			{"Password",         str},
 			{"JoinTries",        integer},
 			{"MaxJoins",         integer},
+			{"FloodRate",        doublenum},
+			{"FloodBurst",       integer},
 			{"TimezoneOffset",   doublenum},
 			{"Admin",            boolean},
 			{"AppendTimestamp",  boolean},
@@ -158,6 +170,10 @@ class CAdminMod : public CModule {
 			PutModule("MaxJoins = " + CString(pUser->MaxJoins()));
 		else if (sVar == "jointries")
 			PutModule("JoinTries = " + CString(pUser->JoinTries()));
+		else if (sVar == "floodrate")
+			PutModule("FloodRate = " + CString(pUser->GetFloodRate()));
+		else if (sVar == "floodburst")
+			PutModule("FloodBurst = " + CString(pUser->GetFloodBurst()));
 		else if (sVar == "timezoneoffset")
 			PutModule("TimezoneOffset = " + CString(pUser->GetTimezoneOffset()));
 		else if (sVar == "appendtimestamp")
@@ -276,6 +292,16 @@ class CAdminMod : public CModule {
 			pUser->SetJoinTries(i);
 			PutModule("JoinTries = " + CString(pUser->JoinTries()));
 		}
+		else if (sVar == "floodrate") {
+			double d = sValue.ToDouble();
+			pUser->SetFloodRate(d);
+			PutModule("FloodRate = " + CString(pUser->GetFloodRate()));
+		}
+		else if (sVar == "floodburst") {
+			unsigned int i = sValue.ToUInt();
+			pUser->SetFloodBurst(i);
+			PutModule("FloodBurst = " + CString(pUser->GetFloodBurst()));
+		}
 		else if (sVar == "timezoneoffset") {
 			double d = sValue.ToDouble();
 			pUser->SetTimezoneOffset(d);
@@ -567,6 +593,50 @@ class CAdminMod : public CModule {
 		return;
 	}
 
+	void AddChan(const CString& sLine) {
+		CString sUsername = sLine.Token(1);
+		CString sChan = sLine.Token(2);
+
+		if (sChan.empty()) {
+			PutModule("Usage: addchan <username> <channel>");
+			return;
+		}
+
+		CUser* pUser = GetUser(sUsername);
+		if (!pUser)
+			return;
+
+		if (pUser->FindChan(sChan)) {
+			PutModule("Error: User [" + pUser->GetUserName() + "] already has channel [" + sChan + "]");
+			return;
+		}
+
+		pUser->AddChan(sChan, true);
+		PutModule("Channel [" + sChan + "] added to user [" + pUser->GetUserName() + "]");
+	}
+
+	void DelChan(const CString& sLine) {
+		CString sUsername = sLine.Token(1);
+		CString sChan = sLine.Token(2);
+
+		if (sChan.empty()) {
+			PutModule("Usage: delchan <username> <channel>");
+			return;
+		}
+
+		CUser* pUser = GetUser(sUsername);
+		if (!pUser)
+			return;
+
+		if (!pUser->DelChan(sChan)) {
+			PutModule("Error: Channel not found: " + sChan);
+			return;
+		}
+
+		pUser->PutIRC("PART " + sChan);
+		PutModule("Channel [" + sChan + "] deleted from user [" + pUser->GetUserName() + "]");
+	}
+
 	void AddServer(const CString& sLine) {
 		CString sUsername = sLine.Token(1);
 		CString sServer = sLine.Token(2, true);
@@ -815,8 +885,235 @@ class CAdminMod : public CModule {
 
 	}
 
+	void Begin(const CString&) {
+		if (m_bBatch) {
+			PutModule("Error: A batch is already open, use Commit or Abort first");
+			return;
+		}
+
+		m_bBatch = true;
+		m_vsBatch.clear();
+		PutModule("BATCH BEGIN");
+	}
+
+	void Commit(const CString&) {
+		if (!m_bBatch) {
+			PutModule("Error: No batch is open, use Begin first");
+		}
+	}
+
+	void Abort(const CString&) {
+		if (!m_bBatch) {
+			PutModule("Error: No batch is open, use Begin first");
+		}
+	}
+
+	/** Checks what can be checked about a queued command before anything
+	 *  is applied: whether it may be used in a batch at all, its
+	 *  arguments and the users it refers to. ssUsers holds the names of
+	 *  all users as they will exist once the previous commands ran.
+	 *  @return An empty string if the command looks fine, else the reason.
+	 */
+	CString ValidateBatchCommand(const CString& sLine, set<CString>& ssUsers) {
+		const CString sCmd = sLine.Token(0).AsLower();
+		CString sUsername;
+		unsigned int uArgs = 0;
+		bool bNeedsAdmin = false;
+
+		if (sCmd == "set") {
+			uArgs = 3;
+			sUsername = sLine.Token(2);
+		} else if (sCmd == "setchan") {
+			uArgs = 4;
+			sUsername = sLine.Token(2);
+		} else if (sCmd == "addchan" || sCmd == "delchan" || sCmd == "addserver"
+				|| sCmd == "loadmodule" || sCmd == "unloadmodule"
+				|| sCmd == "addctcp" || sCmd == "delctcp") {
+			uArgs = 2;
+			sUsername = sLine.Token(1);
+		} else if (sCmd == "reconnect" || sCmd == "disconnect") {
+			uArgs = 1;
+			sUsername = sLine.Token(1);
+		} else if (sCmd == "adduser") {
+			uArgs = 2;
+			bNeedsAdmin = true;
+		} else if (sCmd == "deluser") {
+			uArgs = 1;
+			bNeedsAdmin = true;
+		} else if (sCmd == "cloneuser") {
+			uArgs = 2;
+			bNeedsAdmin = true;
+			sUsername = sLine.Token(1);
+		} else {
+			return "Command can't be used in a batch";
+		}
+
+		if (sLine.Token(uArgs).empty()) {
+			return "Not enough arguments";
+		}
+
+		if (bNeedsAdmin && !m_pUser->IsAdmin()) {
+			return "You need to have admin rights for this";
+		}
+
+		if (sCmd == "adduser" || sCmd == "cloneuser") {
+			const CString sNewUser = sLine.Token(sCmd == "adduser" ? 1 : 2);
+
+			if (sCmd == "cloneuser" && ssUsers.find(sUsername) == ssUsers.end()) {
+				return "User not found: " + sUsername;
+			}
+			if (ssUsers.find(sNewUser) != ssUsers.end()) {
+				return "User " + sNewUser + " already exists";
+			}
+
+			ssUsers.insert(sNewUser);
+			return "";
+		}
+
+		if (sCmd == "deluser") {
+			sUsername = sLine.Token(1, true);
+
+			if (sUsername.Equals(m_pUser->GetUserName())) {
+				return "You can't delete yourself";
+			}
+			if (!ssUsers.erase(sUsername)) {
+				return "User not found: " + sUsername;
+			}
+
+			return "";
+		}
+
+		if (sUsername.Equals("$me")) {
+			sUsername = m_pUser->GetUserName();
+		}
+
+		if (ssUsers.find(sUsername) == ssUsers.end()) {
+			return "User not found: " + sUsername;
+		}
+		if (!sUsername.Equals(m_pUser->GetUserName()) && !m_pUser->IsAdmin()) {
+			return "You need to have admin rights to modify other users";
+		}
+
+		return "";
+	}
+
+	static bool IsErrorReply(const CString& sLine) {
+		static const char* aszErrors[] = {
+			"Error", "Usage", "Access denied", "User not found", "Unable",
+			"Setting failed", "Loading modules has been denied", "Could not",
+			"That would be a bad idea"
+		};
+
+		for (unsigned int i = 0; i != ARRAY_SIZE(aszErrors); ++i) {
+			if (sLine.Equals(aszErrors[i], false, CString(aszErrors[i]).size()))
+				return true;
+		}
+
+		return false;
+	}
+
+	/** Validates all queued commands and, if all of them are fine, runs
+	 *  them and writes the config once. One line per command is sent back:
+	 *  "<index> OK" or "<index> ERR <reason>", followed by a summary.
+	 */
+	void CommitBatch() {
+		VCString vsBatch;
+		vsBatch.swap(m_vsBatch);
+		m_bBatch = false;
+
+		set<CString> ssUsers;
+		const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+		for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+			ssUsers.insert(it->first);
+		}
+
+		unsigned int uInvalid = 0;
+		for (unsigned int i = 0; i < vsBatch.size(); i++) {
+			CString sReason = ValidateBatchCommand(vsBatch[i], ssUsers);
+
+			if (!sReason.empty()) {
+				PutModule(CString(i + 1) + " ERR " + sReason);
+				uInvalid++;
+			}
+		}
+
+		if (uInvalid) {
+			PutModule("BATCH ABORTED " + CString(uInvalid) + " of " + CString(vsBatch.size()) + " commands invalid, nothing was changed");
+			return;
+		}
+
+		unsigned int uFailed = 0;
+
+		for (unsigned int i = 0; i < vsBatch.size(); i++) {
+			const CString& sLine = vsBatch[i];
+
+			m_bCapture = true;
+			m_vsCaptured.clear();
+			HandleCommand(sLine);
+			m_bCapture = false;
+
+			CString sError;
+			for (VCString::const_iterator it = m_vsCaptured.begin(); it != m_vsCaptured.end(); ++it) {
+				if (IsErrorReply(*it)) {
+					sError = *it;
+					break;
+				}
+			}
+
+			if (!sError.empty()) {
+				PutModule(CString(i + 1) + " ERR " + sError);
+				uFailed++;
+				continue;
+			}
+
+			PutModule(CString(i + 1) + " OK");
+		}
+
+		if (uFailed < vsBatch.size() && !CZNC::Get().WriteConfig()) {
+			PutModule("Error: Writing the config failed");
+		}
+
+		PutModule("BATCH DONE " + CString(vsBatch.size() - uFailed) + " ok, " + CString(uFailed) + " failed");
+	}
+
 public:
+	virtual bool PutModule(const CString& sLine) {
+		if (m_bCapture) {
+			m_vsCaptured.push_back(sLine);
+			return true;
+		}
+
+		return CModule::PutModule(sLine);
+	}
+
+	virtual void OnModCommand(const CString& sLine) {
+		if (!m_bBatch) {
+			HandleCommand(sLine);
+			return;
+		}
+
+		const CString sCmd = sLine.Token(0);
+
+		if (sCmd.Equals("Commit")) {
+			CommitBatch();
+		} else if (sCmd.Equals("Abort")) {
+			m_bBatch = false;
+			m_vsBatch.clear();
+			PutModule("BATCH ABORTED");
+		} else if (sCmd.Equals("Begin")) {
+			Begin(sLine);
+		} else if (m_vsBatch.size() >= ADMIN_MAX_BATCH) {
+			PutModule("Error: Too many commands in this batch, the limit is " + CString(ADMIN_MAX_BATCH));
+		} else if (!sLine.Trim_n().empty()) {
+			// Queued silently, Commit reports on every command
+			m_vsBatch.push_back(sLine);
+		}
+	}
+
 	MODCONSTRUCTOR(CAdminMod) {
+		m_bCapture = false;
+		m_bBatch = false;
+
 		AddCommand("Help",         static_cast<CModCommand::ModCmdFunc>(&CAdminMod::PrintHelp),
 			"",                              "Generates this output");
 		AddCommand("Get",          static_cast<CModCommand::ModCmdFunc>(&CAdminMod::Get),
@@ -835,6 +1132,10 @@ public:
 			"username",                      "Deletes a user");
 		AddCommand("CloneUser",    static_cast<CModCommand::ModCmdFunc>(&CAdminMod::CloneUser),
 			"oldusername newusername",       "Clones a user");
+		AddCommand("AddChan",      static_cast<CModCommand::ModCmdFunc>(&CAdminMod::AddChan),
+			"username chan",                 "Adds a channel for the given user");
+		AddCommand("DelChan",      static_cast<CModCommand::ModCmdFunc>(&CAdminMod::DelChan),
+			"username chan",                 "Deletes a channel of the given user");
 		AddCommand("AddServer",    static_cast<CModCommand::ModCmdFunc>(&CAdminMod::AddServer),
 			"[username] server",             "Adds a new IRC server for the given or current user");
 		AddCommand("Reconnect",    static_cast<CModCommand::ModCmdFunc>(&CAdminMod::ReconnectUser),
@@ -853,6 +1154,12 @@ public:
 			"username ctcp [reply]",         "Configure a new CTCP reply");
 		AddCommand("DelCTCP",      static_cast<CModCommand::ModCmdFunc>(&CAdminMod::DelCTCP),
 			"username ctcp",                 "Remove a CTCP reply");
+		AddCommand("Begin",        static_cast<CModCommand::ModCmdFunc>(&CAdminMod::Begin),
+			"",                              "Starts a batch, the following commands are only queued");
+		AddCommand("Commit",       static_cast<CModCommand::ModCmdFunc>(&CAdminMod::Commit),
+			"",                              "Checks and runs the queued commands, then saves the config once");
+		AddCommand("Abort",        static_cast<CModCommand::ModCmdFunc>(&CAdminMod::Abort),
+			"",                              "Throws away the queued commands");
 	}
 
 	virtual ~CAdminMod() {}
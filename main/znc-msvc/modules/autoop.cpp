@@ -8,6 +8,7 @@
 
 #include "stdafx.hpp"
 #include "Chan.h"
+#include "IRCSock.h"
 #include "User.h"
 
 class CAutoOpMod;
@@ -165,7 +166,7 @@ public:
 				// and the nick who joined is a valid user
 				if (it->second->HostMatches(Nick.GetHostMask()) && it->second->ChannelMatches(Channel.GetName())) {
 					if (it->second->GetUserKey().Equals("__NOKEY__")) {
-						PutIRC("MODE " + Channel.GetName() + " +o " + Nick.GetNick());
+						PutMode(Channel.GetName() + " +o " + Nick.GetNick());
 					} else {
 						// then insert this nick into the queue, the timer does the rest
 						CString sNick = Nick.GetNick().AsLower();
@@ -450,11 +451,20 @@ public:
 				const CNick* pNick = Chan.FindNick(Nick.GetNick());
 
 				if (pNick && !pNick->HasPerm(CChan::Op)) {
-					PutIRC("MODE " + Chan.GetName() + " +o " + Nick.GetNick());
+					PutMode(Chan.GetName() + " +o " + Nick.GetNick());
 				}
 			}
 		}
 	}
+
+	// Behind what the user sends, consecutive +o get merged there
+	void PutMode(const CString& sArgs) {
+		CIRCSock* pIRCSock = m_pUser->GetIRCSock();
+
+		if (pIRCSock) {
+			pIRCSock->PutIRC("MODE " + sArgs, CIRCSock::PRIO_BULK);
+		}
+	}
 private:
 	map<CString, CAutoOpUser*> m_msUsers;
 	MCString                   m_msQueue;
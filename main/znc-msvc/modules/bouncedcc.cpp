@@ -29,6 +29,7 @@ public:
 	static unsigned short DCCRequest(const CString& sNick, unsigned long uLongIP, unsigned short uPort, const CString& sFileName, bool bIsChat, CBounceDCCMod* pMod, const CString& sRemoteIP);
 
 	void ReadLine(const CString& sData);
+	virtual cs_ssize_t Read(char* data, size_t len);
 	virtual void ReadData(const char* data, size_t len);
 	virtual void ReadPaused();
 	virtual void Timeout();
@@ -71,6 +72,7 @@ protected:
 	unsigned short               m_uRemotePort;
 	bool                         m_bIsChat;
 	bool                         m_bIsRemote;
+	bool                         m_bZeroCopy;
 
 	static const unsigned int    m_uiMaxDCCBuffer;
 	static const unsigned int    m_uiMinDCCBuffer;
@@ -274,6 +276,7 @@ CDCCBounce::CDCCBounce(CBounceDCCMod* pMod, unsigned long uLongIP, unsigned shor
 	m_sLocalIP = pMod->GetLocalDCCIP();
 	m_pPeer = NULL;
 	m_bIsRemote = false;
+	m_bZeroCopy = true;
 
 	if (bIsChat) {
 		EnableReadLine();
@@ -293,6 +296,7 @@ CDCCBounce::CDCCBounce(CBounceDCCMod* pMod, const CString& sHostname, unsigned s
 	m_sFileName = sFileName;
 	m_sRemoteIP = sRemoteIP;
 	m_bIsRemote = false;
+	m_bZeroCopy = true;
 
 	SetMaxBufferThreshold(10240);
 	if (bIsChat) {
@@ -326,6 +330,28 @@ void CDCCBounce::ReachedMaxBuffer() {
 	Close();
 }
 
+cs_ssize_t CDCCBounce::Read(char* data, size_t len) {
+	// File transfers are passed on inside the kernel if possible. If
+	// either side has data buffered, this round goes through ReadData().
+	if (m_bZeroCopy && !m_bIsChat && m_pPeer && CanZeroCopy() && m_pPeer->CanZeroCopy()) {
+		cs_ssize_t iLen = SpliceTo(*m_pPeer, 64 * 1024);
+
+		if (iLen > 0)
+			return READ_EAGAIN;
+		if (iLen == 0)
+			return READ_EOF;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return READ_EAGAIN;
+		if (errno != ENOSYS && errno != EINVAL)
+			return READ_ERR;
+
+		DEBUG(GetSockName() << " == splice() not possible, using buffered relaying");
+		m_bZeroCopy = false;
+	}
+
+	return CSocket::Read(data, len);
+}
+
 void CDCCBounce::ReadData(const char* data, size_t len) {
 	if (m_pPeer) {
 		m_pPeer->Write(data, len);
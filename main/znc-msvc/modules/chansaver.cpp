@@ -37,7 +37,7 @@ public:
 
 	virtual EModRet OnRaw(CString& sLine) {
 		if (m_bWriteConf) {
-			CZNC::Get().WriteConfig();
+			CZNC::Get().QueueConfigWrite();
 			m_bWriteConf = false;
 		}
 
@@ -52,20 +52,20 @@ public:
 			return;
 
 		Channel.SetKey(sArg);
-		m_bWriteConf = true;
+		CZNC::Get().QueueConfigWrite();
 	}
 
 	virtual void OnJoin(const CNick& Nick, CChan& Channel) {
 		if (Nick.GetNick() == m_pUser->GetIRCNick().GetNick()) {
 			Channel.SetInConfig(true);
-			CZNC::Get().WriteConfig();
+			CZNC::Get().QueueConfigWrite();
 		}
 	}
 
 	virtual void OnPart(const CNick& Nick, CChan& Channel, const CString& sMessage) {
 		if (Nick.GetNick() == m_pUser->GetIRCNick().GetNick()) {
 			Channel.SetInConfig(false);
-			CZNC::Get().WriteConfig();
+			CZNC::Get().QueueConfigWrite();
 		}
 	}
 
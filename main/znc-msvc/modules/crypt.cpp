@@ -25,13 +25,18 @@
 #include "stdafx.hpp"
 #include "Chan.h"
 #include "User.h"
+#include <openssl/blowfish.h>
 
 #define REQUIRESSL	1
 
 class CCryptMod : public CModule {
 public:
 	MODCONSTRUCTOR(CCryptMod) {}
-	virtual ~CCryptMod() {}
+	virtual ~CCryptMod() {
+		while (!m_mKeys.empty()) {
+			ForgetKey(m_mKeys.begin()->first);
+		}
+	}
 
 	virtual EModRet OnUserMsg(CString& sTarget, CString& sMessage) {
 		sTarget.TrimLeft("\244");
@@ -52,7 +57,7 @@ public:
 			}
 
 			CString sMsg = MakeIvec() + sMessage;
-			sMsg.Encrypt(it->second);
+			sMsg.Crypt(GetKey(it->first, it->second), true);
 			sMsg.Base64Encode();
 			sMsg = "+OK *" + sMsg;
 
@@ -80,7 +85,7 @@ public:
 			if (it != EndNV()) {
 				sMessage.LeftChomp(5);
 				sMessage.Base64Decode();
-				sMessage.Decrypt(it->second);
+				sMessage.Crypt(GetKey(it->first, it->second), false);
 				sMessage.LeftChomp(8);
 				sMessage = sMessage.c_str();
 				Nick.SetNick("\244" + Nick.GetNick());
@@ -96,6 +101,8 @@ public:
 			CString sTarget = sCommand.Token(1);
 
 			if (!sTarget.empty()) {
+				ForgetKey(sTarget.AsLower());
+
 				if (DelNV(sTarget.AsLower())) {
 					PutModule("Target [" + sTarget + "] deleted");
 				} else {
@@ -112,6 +119,7 @@ public:
 			sKey.TrimPrefix("cbc:");
 
 			if (!sKey.empty()) {
+				ForgetKey(sTarget.AsLower());
 				SetNV(sTarget.AsLower(), sKey);
 				PutModule("Set encryption key for [" + sTarget + "] to [" + sKey + "]");
 			} else {
@@ -140,6 +148,33 @@ public:
 		}
 	}
 
+	// Setting up a blowfish key is a lot more work than encrypting a line,
+	// so the key schedule is kept for every target
+	const BF_KEY* GetKey(const CString& sTarget, const CString& sKey) {
+		map<CString, pair<CString, BF_KEY> >::iterator it = m_mKeys.find(sTarget);
+
+		if (it != m_mKeys.end() && it->second.first == sKey) {
+			return &it->second.second;
+		}
+
+		ForgetKey(sTarget);
+
+		pair<CString, BF_KEY>& Key = m_mKeys[sTarget];
+		Key.first = sKey;
+		BF_set_key(&Key.second, (int) sKey.length(), (const unsigned char*) sKey.data());
+
+		return &Key.second;
+	}
+
+	void ForgetKey(const CString& sTarget) {
+		map<CString, pair<CString, BF_KEY> >::iterator it = m_mKeys.find(sTarget);
+
+		if (it != m_mKeys.end()) {
+			memset(&it->second.second, 0, sizeof(BF_KEY));
+			m_mKeys.erase(it);
+		}
+	}
+
 	CString MakeIvec() {
 		CString sRet;
 		time_t t;
@@ -150,6 +185,10 @@ public:
 
 		return sRet;
 	}
+
+private:
+	// target -> (key, key schedule)
+	map<CString, pair<CString, BF_KEY> > m_mKeys;
 };
 
 template<> void TModInfo<CCryptMod>(CModInfo& Info) {
@@ -8,6 +8,7 @@
 
 #include "stdafx.hpp"
 #include "Chan.h"
+#include "IRCSock.h"
 #include "User.h"
 
 class CAutoVoiceUser {
@@ -148,7 +149,12 @@ public:
 			for (map<CString, CAutoVoiceUser*>::iterator it = m_msUsers.begin(); it != m_msUsers.end(); ++it) {
 				// and the nick who joined is a valid user
 				if (it->second->HostMatches(Nick.GetHostMask()) && it->second->ChannelMatches(Channel.GetName())) {
-					PutIRC("MODE " + Channel.GetName() + " +v " + Nick.GetNick());
+					CIRCSock* pIRCSock = m_pUser->GetIRCSock();
+
+					// Behind what the user sends, consecutive +v get merged there
+					if (pIRCSock) {
+						pIRCSock->PutIRC("MODE " + Channel.GetName() + " +v " + Nick.GetNick(), CIRCSock::PRIO_BULK);
+					}
 					break;
 				}
 			}
@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "Chan.h"
+#include "FileUtils.h"
+#include "IRCSock.h"
+#include "Template.h"
+#include "User.h"
+#include "znc.h"
+#include <algorithm>
+
+// Microbenchmarks for CString, CBuffer, CChan, MCString and CTemplate.
+//
+// Every benchmark is first calibrated until one sample takes a noticeable
+// amount of time and then sampled BENCH_SAMPLES times, the median is
+// reported. Results are also written to a tab separated file in the
+// module's data directory, one line per benchmark:
+//   <name> <iterations per sample> <median ns/op> <min ns/op> <max ns/op>
+// ZNC doesn't handle any sockets while a benchmark runs, so only one
+// benchmark is run per second and a sample takes at most BENCH_MAX_MS.
+
+#define BENCH_SAMPLES 5
+#define BENCH_MAX_MS 200
+
+static const char* const g_szPrivMsg = ":SomeNick!~someident@host-12-34-56-78.dsl.example.net PRIVMSG #znc :yeah, that should be fixed in the next release";
+
+class CBenchMod;
+typedef void (CBenchMod::*BenchFunc)(unsigned int uIters);
+
+class CBenchTimer : public CTimer {
+public:
+	CBenchTimer(CBenchMod* pModule, unsigned int uCycles)
+			: CTimer((CModule*) pModule, 1, uCycles, "BenchRun", "Runs the next benchmark") {
+		m_pParent = pModule;
+	}
+
+	virtual ~CBenchTimer() {}
+
+protected:
+	virtual void RunJob();
+
+	CBenchMod* m_pParent;
+};
+
+struct SBenchmark {
+	const char* szName;
+	BenchFunc   pFunc;
+	bool        bNeedsIRC;
+};
+
+struct SBenchResult {
+	CString            sName;
+	unsigned int       uIters;
+	double             fMedian;
+	double             fMin;
+	double             fMax;
+};
+
+class CBenchMod : public CModule {
+public:
+	MODCONSTRUCTOR(CBenchMod) {
+		m_uSink = 0;
+		m_uMs = 0;
+
+		AddHelpCommand();
+		AddCommand("List", static_cast<CModCommand::ModCmdFunc>(&CBenchMod::ListCommand),
+			"", "List all benchmarks");
+		AddCommand("Run",  static_cast<CModCommand::ModCmdFunc>(&CBenchMod::RunCommand),
+			"[wildcard] [ms per sample]", "Run benchmarks, one per second, each blocks ZNC for a moment");
+	}
+
+	virtual ~CBenchMod() {}
+
+	virtual bool OnLoad(const CString& sArgs, CString& sMessage) {
+		if (!m_pUser->IsAdmin()) {
+			sMessage = "You must be admin to use this module";
+			return false;
+		}
+
+		return true;
+	}
+
+	void ListCommand(const CString& sLine) {
+		CTable Table;
+		Table.AddColumn("Name");
+		Table.AddColumn("Needs IRC");
+
+		for (const SBenchmark* p = GetBenchmarks(); p->szName; p++) {
+			Table.AddRow();
+			Table.SetCell("Name", p->szName);
+			Table.SetCell("Needs IRC", p->bNeedsIRC ? "yes" : "no");
+		}
+
+		PutModule(Table);
+	}
+
+	void RunCommand(const CString& sLine) {
+		CString sWild = sLine.Token(1);
+		unsigned int uMs = sLine.Token(2).ToUInt();
+
+		if (FindTimer("BenchRun")) {
+			PutModule("A run is already in progress");
+			return;
+		}
+
+		if (sWild.empty()) {
+			sWild = "*";
+		}
+
+		if (uMs == 0) {
+			uMs = 50;
+		} else if (uMs > BENCH_MAX_MS) {
+			uMs = BENCH_MAX_MS;
+		}
+
+		m_vpPending.clear();
+		m_vResults.clear();
+		m_uMs = uMs;
+
+		for (const SBenchmark* p = GetBenchmarks(); p->szName; p++) {
+			if (CString(p->szName).WildCmp(sWild)) {
+				m_vpPending.push_back(p);
+			}
+		}
+
+		if (m_vpPending.empty()) {
+			PutModule("No benchmarks matched");
+			return;
+		}
+
+		PutModule("Running " + CString(m_vpPending.size()) + " benchmarks with " + CString(m_uMs) + " ms per sample...");
+		AddTimer(new CBenchTimer(this, m_vpPending.size()));
+	}
+
+	void RunNext() {
+		if (m_vpPending.empty()) {
+			return;
+		}
+
+		const SBenchmark* p = m_vpPending.front();
+		m_vpPending.erase(m_vpPending.begin());
+
+		if (p->bNeedsIRC && !m_pUser->GetIRCSock()) {
+			PutModule("Skipping [" + CString(p->szName) + "], it needs a connection to IRC");
+		} else {
+			m_vResults.push_back(Run(p, m_uMs));
+		}
+
+		if (m_vpPending.empty()) {
+			Report(m_vResults);
+		}
+	}
+
+private:
+	void Report(const vector<SBenchResult>& vResults) {
+		if (vResults.empty()) {
+			PutModule("No benchmarks were run");
+			return;
+		}
+
+		CTable Table;
+		Table.AddColumn("Name");
+		Table.AddColumn("Iterations");
+		Table.AddColumn("ns/op");
+		Table.AddColumn("Min");
+		Table.AddColumn("Max");
+
+		time_t tNow = time(NULL);
+		char szTime[64];
+		strftime(szTime, sizeof(szTime), "%Y-%m-%d %H:%M:%S", gmtime(&tNow));
+
+		CString sOut = "# " + CZNC::GetTag(false) + " " + CString(szTime) + " UTC\n";
+
+		for (vector<SBenchResult>::const_iterator it = vResults.begin(); it != vResults.end(); ++it) {
+			Table.AddRow();
+			Table.SetCell("Name", it->sName);
+			Table.SetCell("Iterations", CString(it->uIters));
+			Table.SetCell("ns/op", CString(it->fMedian, 1));
+			Table.SetCell("Min", CString(it->fMin, 1));
+			Table.SetCell("Max", CString(it->fMax, 1));
+
+			sOut += it->sName + "\t" + CString(it->uIters) + "\t" + CString(it->fMedian, 1)
+				+ "\t" + CString(it->fMin, 1) + "\t" + CString(it->fMax, 1) + "\n";
+		}
+
+		PutModule(Table);
+
+		CString sFile = GetSavePath() + "/results-" + CString((unsigned long long) tNow) + ".tsv";
+		CFile File(sFile);
+
+		if (File.Open(O_WRONLY | O_CREAT | O_TRUNC, 0600) && File.Write(sOut) == (int) sOut.size()) {
+			PutModule("Results written to [" + sFile + "]");
+		} else {
+			PutModule("Could not write [" + sFile + "]");
+		}
+	}
+
+	SBenchResult Run(const SBenchmark* pBench, unsigned int uMs) {
+		unsigned long long uTarget = (unsigned long long) uMs * 1000;
+		unsigned long long uTime;
+		unsigned int uIters = 1;
+		vector<double> vfSamples;
+		SBenchResult Result;
+
+		// Find an iteration count which takes about uMs
+		for (;;) {
+			uTime = Measure(pBench, uIters);
+
+			if (uTime >= uTarget / 4 || uIters >= (1u << 30)) {
+				break;
+			}
+
+			uIters *= 2;
+		}
+
+		if (uTime > 0 && uTime < uTarget) {
+			double fScaled = (double) uIters * uTarget / uTime;
+			uIters = (fScaled > (1u << 30)) ? (1u << 30) : (unsigned int) fScaled;
+		}
+
+		for (unsigned int a = 0; a < BENCH_SAMPLES; a++) {
+			vfSamples.push_back(Measure(pBench, uIters) * 1000.0 / uIters);
+		}
+
+		sort(vfSamples.begin(), vfSamples.end());
+
+		Result.sName = pBench->szName;
+		Result.uIters = uIters;
+		Result.fMedian = vfSamples[BENCH_SAMPLES / 2];
+		Result.fMin = vfSamples.front();
+		Result.fMax = vfSamples.back();
+
+		return Result;
+	}
+
+	unsigned long long Measure(const SBenchmark* pBench, unsigned int uIters) {
+		unsigned long long uStart = CUtils::GetMicroTime();
+		(this->*pBench->pFunc)(uIters);
+		return CUtils::GetMicroTime() - uStart;
+	}
+
+	// CString
+	void BenchToken(unsigned int uIters) {
+		const CString sLine = g_szPrivMsg;
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += sLine.Token(0).size() + sLine.Token(1).size() + sLine.Token(2).size();
+			m_uSink += sLine.Token(3, true).size();
+		}
+	}
+
+	void BenchSplit(unsigned int uIters) {
+		const CString sLine = g_szPrivMsg;
+		VCString vsRet;
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += sLine.Split(" ", vsRet, false);
+		}
+	}
+
+	void BenchSplitNames(unsigned int uIters) {
+		const CString& sNames = GetNames();
+		VCString vsRet;
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += sNames.Split(" ", vsRet, false);
+		}
+	}
+
+	void BenchCaseFold(unsigned int uIters) {
+		const CString sNick = "SomeLongerNick|away";
+		const CString sOther = "somelongernick|AWAY";
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += sNick.AsLower().size();
+			m_uSink += sNick.Equals(sOther);
+		}
+	}
+
+	void BenchEscape(unsigned int uIters) {
+		const CString sPlain = "just some text without anything special in it";
+		const CString sHTML = "<b>\"quoted\" & escaped</b>";
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += sPlain.Escape_n(CString::EHTML).size();
+			m_uSink += sHTML.Escape_n(CString::EHTML).size();
+		}
+	}
+
+	void BenchWildCmp(unsigned int uIters) {
+		static const char* const aszRules[] = {
+			"*!*@*.example.org", "*!~bad@*", "evil*!*@*", "*!*@192.168.*", "*!*@*.dsl.example.com",
+			"spam?bot!*@*", "*!*spam*@*", "*!*@host-*.cable.example.net", "troll!*@*", "*!*@*.onion",
+			"*!webchat@*", "*!*@gateway/web/*", "flood*!*@*", "*!*@10.*", "*!?bot*@*",
+			"*!*@unaffiliated/*", "bot[0-9]!*@*", "*!*@*.example.edu", "*!*@*.tor-exit.*", "*|away!*@*",
+		};
+		const CString sMask = "SomeNick!~someident@host-12-34-56-78.dsl.example.net";
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			for (unsigned int b = 0; b < sizeof(aszRules) / sizeof(aszRules[0]); b++) {
+				m_uSink += CString::WildCmp(aszRules[b], sMask);
+			}
+		}
+	}
+
+	// CBuffer
+	void BenchBufferAdd(unsigned int uIters, unsigned int uLines) {
+		CBuffer Buffer(uLines);
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += Buffer.AddLine(":nick!ident@host PRIVMSG #chan :", "line number " + CString(a));
+		}
+	}
+
+	void BenchBufferAdd100(unsigned int uIters) { BenchBufferAdd(uIters, 100); }
+	void BenchBufferAdd10000(unsigned int uIters) { BenchBufferAdd(uIters, 10000); }
+
+	void BenchBufferUpdate(unsigned int uIters, unsigned int uLines) {
+		CBuffer Buffer(uLines);
+
+		// UpdateLine() has to search the buffer, fill it first
+		for (unsigned int a = 0; a < uLines; a++) {
+			Buffer.AddLine(":irc.example.net " + CString(a) + " ", "value");
+		}
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += Buffer.UpdateLine(":irc.example.net " + CString(a % uLines) + " ", "new value");
+		}
+	}
+
+	void BenchBufferUpdate100(unsigned int uIters) { BenchBufferUpdate(uIters, 100); }
+	void BenchBufferUpdate1000(unsigned int uIters) { BenchBufferUpdate(uIters, 1000); }
+
+	// CChan, these need the IRC sock for the nick prefixes
+	void BenchChanNames(unsigned int uIters) {
+		CChan Chan("#bench", m_pUser, false);
+		const CString& sNames = GetNames();
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			m_uSink += Chan.AddNicks(sNames);
+			Chan.ClearNicks();
+		}
+	}
+
+	void BenchChanNick(unsigned int uIters) {
+		CChan Chan("#bench", m_pUser, false);
+		Chan.AddNicks(GetNames());
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			CString sNick = "user" + CString(a % 500);
+			m_uSink += Chan.ChangeNick(sNick, sNick + "_");
+			m_uSink += Chan.ChangeNick(sNick + "_", sNick);
+		}
+	}
+
+	void BenchChanQuit(unsigned int uIters) {
+		CChan Chan("#bench", m_pUser, false);
+		Chan.AddNicks(GetNames());
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			CString sNick = "user" + CString(a % 500);
+			m_uSink += Chan.RemNick(sNick);
+			m_uSink += Chan.AddNick(sNick + "!~ident@host.example.net");
+		}
+	}
+
+	// MCString
+	void BenchMCString(unsigned int uIters) {
+		const CString sFile = GetSavePath() + "/bench.registry";
+		MCString msValues, msRead;
+
+		for (unsigned int a = 0; a < 100; a++) {
+			msValues["key" + CString(a)] = "some value with spaces and = signs " + CString(a);
+		}
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			msValues.WriteToDisk(sFile);
+			msRead.ReadFromDisk(sFile);
+			m_uSink += msRead.size();
+		}
+
+		CFile::Delete(sFile);
+	}
+
+	// CTemplate
+	void BenchTemplate(unsigned int uIters) {
+		const CString sFile = GetSavePath() + "/bench.tmpl";
+		CFile File(sFile);
+
+		if (!File.Open(O_WRONLY | O_CREAT | O_TRUNC, 0600)) {
+			return;
+		}
+
+		File.Write("<html><title><? VAR Title ?></title><table>\n"
+			"<? LOOP Rows ?><tr class=\"<? IF __EVEN__ ?>even<? ELSE ?>odd<? ENDIF ?>\">"
+			"<td><? VAR Name ?></td><td><? VAR Value ESC=HTML ?></td></tr>\n<? ENDLOOP ?>"
+			"</table></html>\n");
+		File.Close();
+
+		for (unsigned int a = 0; a < uIters; a++) {
+			CTemplate Tmpl;
+			CString sOut;
+
+			Tmpl["Title"] = "Benchmark";
+
+			for (unsigned int b = 0; b < 50; b++) {
+				CTemplate& Row = Tmpl.AddRow("Rows");
+				Row["Name"] = "row" + CString(b);
+				Row["Value"] = "<value & " + CString(b) + ">";
+			}
+
+			Tmpl.SetFile(sFile);
+			Tmpl.PrintString(sOut);
+			m_uSink += sOut.size();
+		}
+
+		CFile::Delete(sFile);
+	}
+
+	// A 353 reply's nick list, 500 nicks with some prefixes and UHNAMES
+	const CString& GetNames() {
+		if (m_sNames.empty()) {
+			for (unsigned int a = 0; a < 500; a++) {
+				if (!m_sNames.empty()) {
+					m_sNames += " ";
+				}
+
+				if (a % 50 == 0) {
+					m_sNames += "@";
+				} else if (a % 20 == 0) {
+					m_sNames += "+";
+				}
+
+				m_sNames += "user" + CString(a) + "!~ident" + CString(a) + "@host" + CString(a) + ".example.net";
+			}
+		}
+
+		return m_sNames;
+	}
+
+	static const SBenchmark* GetBenchmarks() {
+		static const SBenchmark aBenchmarks[] = {
+			{ "string/token",         &CBenchMod::BenchToken,           false },
+			{ "string/split",         &CBenchMod::BenchSplit,           false },
+			{ "string/split_names",   &CBenchMod::BenchSplitNames,      false },
+			{ "string/casefold",      &CBenchMod::BenchCaseFold,        false },
+			{ "string/escape",        &CBenchMod::BenchEscape,          false },
+			{ "string/wildcmp20",     &CBenchMod::BenchWildCmp,         false },
+			{ "buffer/add_100",       &CBenchMod::BenchBufferAdd100,    false },
+			{ "buffer/add_10000",     &CBenchMod::BenchBufferAdd10000,  false },
+			{ "buffer/update_100",    &CBenchMod::BenchBufferUpdate100, false },
+			{ "buffer/update_1000",   &CBenchMod::BenchBufferUpdate1000, false },
+			{ "chan/names_500",       &CBenchMod::BenchChanNames,       true },
+			{ "chan/nick_500",        &CBenchMod::BenchChanNick,        true },
+			{ "chan/quit_500",        &CBenchMod::BenchChanQuit,        true },
+			{ "mcstring/disk_100",    &CBenchMod::BenchMCString,        false },
+			{ "template/loop_50",     &CBenchMod::BenchTemplate,        false },
+			{ NULL,                   NULL,                             false }
+		};
+
+		return aBenchmarks;
+	}
+
+	CString                    m_sNames;
+	unsigned long long         m_uSink;
+	vector<const SBenchmark*>  m_vpPending;
+	vector<SBenchResult>       m_vResults;
+	unsigned int               m_uMs;
+};
+
+void CBenchTimer::RunJob() {
+	m_pParent->RunNext();
+}
+
+MODULEDEFS(CBenchMod, "Microbenchmarks for ZNC's core data structures")
@@ -61,6 +61,7 @@ protected:
 	unsigned long   m_uBytesSoFar;
 	bool            m_bSend;
 	bool            m_bNoDelFile;
+	bool            m_bZeroCopy;
 	CFile*          m_pFile;
 	CDCCMod*        m_pModule;
 };
@@ -255,6 +256,7 @@ CDCCSock::CDCCSock(CDCCMod* pMod, const CString& sRemoteNick, const CString& sLo
 	m_sLocalFile = sLocalFile;
 	m_bSend = true;
 	m_bNoDelFile = false;
+	m_bZeroCopy = true;
 	SetMaxBufferThreshold(0);
 }
 
@@ -270,6 +272,7 @@ CDCCSock::CDCCSock(CDCCMod* pMod, const CString& sRemoteNick, const CString& sRe
 	m_sLocalFile = sLocalFile;
 	m_bSend = false;
 	m_bNoDelFile = false;
+	m_bZeroCopy = false;
 	SetMaxBufferThreshold(0);
 }
 
@@ -370,6 +373,36 @@ void CDCCSock::SendPacket() {
 		return;
 	}
 
+	if (m_bZeroCopy) {
+		if (!GetInternalWriteBuffer().empty()) {
+			return;
+		}
+
+		// Let the kernel move the file into the socket. The receiver's
+		// acknowledgements drive this just like the buffered path, so
+		// there is nothing to do if the socket is full right now.
+		cs_ssize_t iLen = SendFile(*m_pFile, m_uBytesSoFar, 16 * 1024);
+
+		if (iLen >= 0) {
+			m_uBytesSoFar += iLen;
+			return;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		}
+
+		DEBUG("SendPacket(): sendfile() not possible [" << strerror(errno) << "], using buffered sends ["
+				<< m_sRemoteNick << "][" << m_sFileName << "]");
+		m_bZeroCopy = false;
+
+		if (!m_pFile->Seek(m_uBytesSoFar)) {
+			m_pModule->PutModule(((m_bSend) ? "DCC -> [" : "DCC <- [") + m_sRemoteNick + "][" + m_sFileName + "] - Error reading from file.");
+			Close();
+			return;
+		}
+	}
+
 	if (GetInternalWriteBuffer().size() > 1024 * 1024) {
 		// There is still enough data to be written, don't add more
 		// stuff to that buffer.
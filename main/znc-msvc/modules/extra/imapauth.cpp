@@ -9,53 +9,84 @@
 #include "stdafx.hpp"
 #include "Modules.h"
 #include "znc.h"
+#include <deque>
 
 using std::map;
 
 class CIMAPAuthMod;
 
+// IMAP doesn't allow a second LOGIN once one succeeded, so a connection
+// can only be reused after a failed attempt. Successful ones LOGOUT and
+// a fresh connection is opened for the next check.
 class CIMAPSock : public CSocket {
 public:
-	CIMAPSock(CIMAPAuthMod* pModule, CSmartPtr<CAuthBase> Auth)
-		: CSocket((CModule*) pModule), m_spAuth(Auth) {
+	CIMAPSock(CIMAPAuthMod* pModule)
+		: CSocket((CModule*) pModule) {
 			m_pIMAPMod = pModule;
-			m_bSentReply = false;
-			m_bSentLogin = false;
+			m_bReady = false;
+			m_bReused = false;
+			m_uTag = 0;
 			EnableReadLine();
 	}
 
-	virtual ~CIMAPSock() {
-		if (!m_bSentReply) {
-			m_spAuth->RefuseLogin("IMAP server is down, please try again later");
-		}
-	}
+	virtual ~CIMAPSock();
 
 	virtual void ReadLine(const CString& sLine);
+	virtual void Timeout();
+
+	void StartCheck(const CString& sKey, const CString& sUsername, const CString& sPassword);
+	bool IsIdle() const { return m_bReady && m_sKey.empty(); }
+	bool IsReady() const { return m_bReady; }
+	//! Called when the module goes away before this socket does.
+	void Detach() { m_pIMAPMod = NULL; m_sKey.clear(); }
+
+	static CString Quote(const CString& s);
 private:
 protected:
 	CIMAPAuthMod*        m_pIMAPMod;
-	bool                 m_bSentLogin;
-	bool                 m_bSentReply;
-	CSmartPtr<CAuthBase> m_spAuth;
+	bool                 m_bReady;
+	bool                 m_bReused;
+	unsigned int         m_uTag;
+	CString              m_sKey;
 };
 
 
 class CIMAPAuthMod : public CGlobalModule {
 public:
 	GLOBALMODCONSTRUCTOR(CIMAPAuthMod) {
-		m_Cache.SetTTL(60000);
 		m_sServer = "localhost";
 		m_uPort = 143;
 		m_bSSL = false;
+		m_uMaxConns = 4;
+		m_uCacheTTL = 60;
+		m_Cache.SetTTL(m_uCacheTTL * 1000);
+		// Cache keys are salted so they can't be looked up in a rainbow table
+		m_sCacheSalt = CUtils::GetSalt();
 	}
 
-	virtual ~CIMAPAuthMod() {}
+	virtual ~CIMAPAuthMod() {
+		// Our sockets are deleted along with us, they mustn't call back
+		for (set<CIMAPSock*>::iterator it = m_ssSocks.begin(); it != m_ssSocks.end(); ++it) {
+			(*it)->Detach();
+		}
+
+		for (map<CString, CCheck>::iterator it = m_mChecks.begin(); it != m_mChecks.end(); ++it) {
+			for (size_t a = 0; a < it->second.m_vAuths.size(); a++) {
+				it->second.m_vAuths[a]->RefuseLogin("IMAP server is down, please try again later");
+			}
+		}
+	}
 
 	virtual bool OnBoot() {
 		return true;
 	}
 
 	virtual bool OnLoad(const CString& sArgs, CString& sMessage) {
+		if (!GetNV("MaxConns").empty())
+			SetMaxConns(GetNV("MaxConns").ToUInt());
+		if (!GetNV("CacheTTL").empty())
+			SetCacheTTL(GetNV("CacheTTL").ToUInt());
+
 		if (sArgs.Trim_n().empty()) {
 			return true; // use defaults
 		}
@@ -86,69 +117,274 @@ public:
 			return HALT;
 		}
 
-		if (pUser && m_Cache.HasItem(CString(Auth->GetUsername() + ":" + Auth->GetPassword()).MD5())) {
+		// These can't be sent inside a quoted string and would end the LOGIN command
+		const CString sBadChars("\r\n\0", 3);
+
+		if (Auth->GetUsername().find_first_of(sBadChars) != CString::npos || Auth->GetPassword().find_first_of(sBadChars) != CString::npos) {
+			Auth->RefuseLogin("Invalid Password");
+			return HALT;
+		}
+
+		CString sKey = CacheKey(Auth->GetUsername(), Auth->GetPassword());
+
+		if (m_Cache.HasItem(sKey)) {
 			DEBUG("+++ Found in cache");
 			Auth->AcceptLogin(*pUser);
 			return HALT;
 		}
 
-		CIMAPSock* pSock = new CIMAPSock(this, Auth);
-		pSock->Connect(m_sServer, m_uPort, m_bSSL, 20);
+		map<CString, CCheck>::iterator it = m_mChecks.find(sKey);
+
+		if (it != m_mChecks.end()) {
+			// Someone is already checking the same credentials, e.g. a client reconnecting twice
+			DEBUG("+++ Joining pending IMAP lookup");
+			it->second.m_vAuths.push_back(Auth);
+			return HALT;
+		}
+
+		CCheck& Check = m_mChecks[sKey];
+		Check.m_sUsername = Auth->GetUsername();
+		Check.m_sPassword = Auth->GetPassword();
+		Check.m_vAuths.push_back(Auth);
+
+		m_dQueue.push_back(sKey);
+		Dispatch();
 
 		return HALT;
 	}
 
 	virtual void OnModCommand(const CString& sLine) {
+		CString sCommand = sLine.Token(0);
+
+		if (!m_pUser->IsAdmin()) {
+			PutModule("Access denied");
+		} else if (sCommand.Equals("show")) {
+			PutModule("Server: " + m_sServer + " " + CString(m_bSSL ? "+" : "") + CString(m_uPort));
+			PutModule("MaxConns: " + CString(m_uMaxConns) + ", CacheTTL: " + CString(m_uCacheTTL) + " secs");
+			PutModule("Connections: " + CString(m_ssSocks.size()) + ", queued checks: " + CString(m_dQueue.size())
+					+ ", pending checks: " + CString(m_mChecks.size()));
+		} else if (sCommand.Equals("maxconns") && !sLine.Token(1).empty()) {
+			SetMaxConns(sLine.Token(1).ToUInt());
+			SetNV("MaxConns", CString(m_uMaxConns));
+			PutModule("Using at most [" + CString(m_uMaxConns) + "] IMAP connections");
+		} else if (sCommand.Equals("cachettl") && !sLine.Token(1).empty()) {
+			SetCacheTTL(sLine.Token(1).ToUInt());
+			SetNV("CacheTTL", CString(m_uCacheTTL));
+			PutModule("Successful logins are cached for [" + CString(m_uCacheTTL) + "] secs");
+		} else if (sCommand.Equals("clearcache")) {
+			m_Cache.Clear();
+			PutModule("Cache cleared");
+		} else {
+			PutModule("Commands: show, maxconns <num>, cachettl <secs>, clearcache");
+		}
 	}
 
-	void CacheLogin(const CString& sLogin) {
-		m_Cache.AddItem(sLogin);
+	//! Hands the next queued check to pSock or leaves it idle.
+	void SockReady(CIMAPSock* pSock) {
+		while (!m_dQueue.empty()) {
+			CString sKey = m_dQueue.front();
+			m_dQueue.pop_front();
+
+			map<CString, CCheck>::iterator it = m_mChecks.find(sKey);
+			if (it != m_mChecks.end()) {
+				pSock->StartCheck(sKey, it->second.m_sUsername, it->second.m_sPassword);
+				return;
+			}
+		}
+	}
+
+	void CheckDone(const CString& sKey, bool bSuccess, const CString& sReason = "Invalid Password") {
+		map<CString, CCheck>::iterator it = m_mChecks.find(sKey);
+		if (it == m_mChecks.end())
+			return;
+
+		CCheck Check = it->second;
+		m_mChecks.erase(it);
+
+		if (bSuccess) {
+			m_Cache.Cleanup();
+			m_Cache.AddItem(sKey);
+			DEBUG("+++ Successful IMAP lookup");
+		} else {
+			DEBUG("--- FAILED IMAP lookup");
+		}
+
+		for (size_t a = 0; a < Check.m_vAuths.size(); a++) {
+			CUser* pUser = CZNC::Get().FindUser(Check.m_vAuths[a]->GetUsername());
+
+			if (bSuccess && pUser) {
+				Check.m_vAuths[a]->AcceptLogin(*pUser);
+			} else {
+				Check.m_vAuths[a]->RefuseLogin(sReason);
+			}
+		}
+	}
+
+	void SockGone(CIMAPSock* pSock, const CString& sKey, bool bRetry, bool bWasReady) {
+		m_ssSocks.erase(pSock);
+
+		if (!bWasReady && !m_dQueue.empty()) {
+			// Every new connection is opened for a queued check, so don't
+			// retry forever if the server can't be reached
+			CString sQueued = m_dQueue.front();
+			m_dQueue.pop_front();
+			CheckDone(sQueued, false, "IMAP server is down, please try again later");
+		}
+
+		if (!sKey.empty()) {
+			if (bRetry && m_mChecks.find(sKey) != m_mChecks.end()) {
+				// The server probably dropped an idle connection just as we used it
+				m_dQueue.push_front(sKey);
+			} else {
+				CheckDone(sKey, false, "IMAP server is down, please try again later");
+			}
+		}
+
+		Dispatch();
 	}
 
 	// Getters
 	const CString& GetUserFormat() const { return m_sUserFormat; }
 	// !Getters
 private:
+	struct CCheck {
+		CString                            m_sUsername;
+		CString                            m_sPassword;
+		std::vector<CSmartPtr<CAuthBase> > m_vAuths;
+	};
+
+	CString CacheKey(const CString& sUsername, const CString& sPassword) const {
+		// Hashed so passes don't sit in memory in plain text
+		return CString(m_sCacheSalt + sUsername + ":" + sPassword).SHA256();
+	}
+
+	void SetMaxConns(unsigned int u) { m_uMaxConns = (u > 0 ? u : 1); }
+
+	void SetCacheTTL(unsigned int uSecs) {
+		m_uCacheTTL = uSecs;
+		m_Cache.SetTTL(m_uCacheTTL * 1000);
+	}
+
+	void Dispatch() {
+		// Idle connections first, no need for a new handshake
+		for (set<CIMAPSock*>::iterator it = m_ssSocks.begin(); it != m_ssSocks.end() && !m_dQueue.empty(); ++it) {
+			if ((*it)->IsIdle()) {
+				SockReady(*it);
+			}
+		}
+
+		// Connections which are still being set up will take a check each
+		size_t uConnecting = 0;
+		for (set<CIMAPSock*>::iterator it = m_ssSocks.begin(); it != m_ssSocks.end(); ++it) {
+			if (!(*it)->IsReady())
+				uConnecting++;
+		}
+
+		while (m_dQueue.size() > uConnecting && m_ssSocks.size() < m_uMaxConns) {
+			CIMAPSock* pSock = new CIMAPSock(this);
+			m_ssSocks.insert(pSock);
+			pSock->Connect(m_sServer, m_uPort, m_bSSL, 20);
+			uConnecting++;
+		}
+	}
+
 	// Settings
 	CString         m_sServer;
 	unsigned short  m_uPort;
 	bool            m_bSSL;
 	CString         m_sUserFormat;
+	unsigned int    m_uMaxConns;
+	unsigned int    m_uCacheTTL;
 	// !Settings
 
-	TCacheMap<CString> m_Cache;
+	TCacheMap<CString>     m_Cache;
+	CString                m_sCacheSalt;
+	map<CString, CCheck>   m_mChecks;
+	std::deque<CString>    m_dQueue;
+	set<CIMAPSock*>        m_ssSocks;
 };
 
-void CIMAPSock::ReadLine(const CString& sLine) {
-	if (!m_bSentLogin) {
-		CString sUsername = m_spAuth->GetUsername();
-		m_bSentLogin = true;
+CIMAPSock::~CIMAPSock() {
+	if (m_pIMAPMod) {
+		m_pIMAPMod->SockGone(this, m_sKey, m_bReused, m_bReady);
+	}
+}
 
-		const CString& sFormat = m_pIMAPMod->GetUserFormat();
+CString CIMAPSock::Quote(const CString& s) {
+	CString sRet = "\"";
 
-		if (!sFormat.empty()) {
-			if (sFormat.find('%') != CString::npos) {
-				sUsername = sFormat.Replace_n("%", sUsername);
-			} else {
-				sUsername += sFormat;
-			}
-		}
+	for (size_t a = 0; a < s.size(); a++) {
+		if (s[a] == '"' || s[a] == '\\')
+			sRet += '\\';
+		sRet += s[a];
+	}
 
-		Write("AUTH LOGIN " + sUsername + " " + m_spAuth->GetPassword() + "\r\n");
-	} else {
-		CUser* pUser = CZNC::Get().FindUser(m_spAuth->GetUsername());
+	return sRet + "\"";
+}
 
-		if (pUser && sLine.Equals("AUTH OK", false, 7)) {
-			m_spAuth->AcceptLogin(*pUser);
-			m_pIMAPMod->CacheLogin(CString(m_spAuth->GetUsername() + ":" + m_spAuth->GetPassword()).MD5()); // Use MD5 so passes don't sit in memory in plain text
-			DEBUG("+++ Successful IMAP lookup");
+void CIMAPSock::StartCheck(const CString& sKey, const CString& sUsername, const CString& sPassword) {
+	CString sLogin = sUsername;
+	const CString& sFormat = m_pIMAPMod->GetUserFormat();
+
+	if (!sFormat.empty()) {
+		if (sFormat.find('%') != CString::npos) {
+			sLogin = sFormat.Replace_n("%", sLogin);
 		} else {
-			m_spAuth->RefuseLogin("Invalid Password");
-			DEBUG("--- FAILED IMAP lookup");
+			sLogin += sFormat;
+		}
+	}
+
+	m_sKey = sKey;
+	SetTimeout(20);
+	Write("A" + CString(++m_uTag) + " LOGIN " + Quote(sLogin) + " " + Quote(sPassword) + "\r\n");
+}
+
+void CIMAPSock::Timeout() {
+	// Idle connections just go away, a running check fails in our destructor
+	m_bReused = false;
+	Close();
+}
+
+void CIMAPSock::ReadLine(const CString& sLine) {
+	if (!m_pIMAPMod)
+		return;
+
+	if (!m_bReady) {
+		if (!sLine.Equals("* OK", false, 4)) {
+			// e.g. "* PREAUTH" or "* BYE", nothing we could LOGIN on
+			Close();
+			return;
 		}
 
-		m_bSentReply = true;
-		Close();
+		m_bReady = true;
+		m_pIMAPMod->SockReady(this);
+		return;
+	}
+
+	CString sTag = "A" + CString(m_uTag);
+
+	if (m_sKey.empty() || !sLine.Token(0).Equals(sTag)) {
+		// Untagged responses like CAPABILITY updates
+		return;
+	}
+
+	CString sKey = m_sKey;
+	m_sKey.clear();
+
+	if (sLine.Token(1).Equals("OK")) {
+		// We are logged in now and can't check anyone else on this connection
+		CIMAPAuthMod* pModule = m_pIMAPMod;
+		Detach();
+		Write("A" + CString(++m_uTag) + " LOGOUT\r\n");
+		Close(CLT_AFTERWRITE);
+
+		pModule->CheckDone(sKey, true);
+		pModule->SockGone(this, "", false, true);
+	} else {
+		m_bReused = true;
+		m_pIMAPMod->CheckDone(sKey, false);
+		SetTimeout(50);
+		m_pIMAPMod->SockReady(this);
 	}
 }
 
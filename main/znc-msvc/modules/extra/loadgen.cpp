@@ -0,0 +1,752 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include "stdafx.hpp"
+#include "Listener.h"
+#include "User.h"
+#include "znc.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Load generator: a fake ircd and a swarm of IRC clients, both running over
+// loopback inside this ZNC process.
+//
+// "Start" creates temporary users (loadgen1, loadgen2, ...) which connect to
+// the fake ircd and join #load. The fake ircd sends the scenario's traffic
+// to each of them once per second, the synthetic clients log in through one
+// of ZNC's listeners, get their buffers played back, talk into the channel
+// and now and then detach and attach again. Every PRIVMSG carries the time
+// it was sent ("LG <usec>"), which gives the latency through ZNC in both
+// directions. At the end a report with throughput, latency percentiles,
+// RSS and CPU time is printed and the users are deleted again. The fake
+// ircd and clients run in this process, so RSS and CPU time include them.
+// The users are temporary, they never end up in znc.conf.
+
+#define LOADGEN_PORT        16667
+#define LOADGEN_MAX_SAMPLES 1000000
+#define LOADGEN_CHANNEL     "#load"
+
+class CLoadGenMod;
+
+// CPU time (user + system) in microseconds and the resident set size in bytes
+static void GetProcessUsage(unsigned long long& uCPU, unsigned long long& uRSS) {
+	uCPU = 0;
+	uRSS = 0;
+
+#ifdef _WIN32
+	FILETIME ftCreation, ftExit, ftKernel, ftUser;
+	PROCESS_MEMORY_COUNTERS Counters;
+
+	if (GetProcessTimes(GetCurrentProcess(), &ftCreation, &ftExit, &ftKernel, &ftUser)) {
+		uCPU  = ((unsigned long long) ftKernel.dwHighDateTime << 32 | ftKernel.dwLowDateTime) / 10;
+		uCPU += ((unsigned long long) ftUser.dwHighDateTime << 32 | ftUser.dwLowDateTime) / 10;
+	}
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters))) {
+		uRSS = Counters.WorkingSetSize;
+	}
+#else
+	struct rusage Usage;
+
+	if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+		uCPU  = (unsigned long long) Usage.ru_utime.tv_sec * 1000000 + Usage.ru_utime.tv_usec;
+		uCPU += (unsigned long long) Usage.ru_stime.tv_sec * 1000000 + Usage.ru_stime.tv_usec;
+	}
+
+	// /proc has the current RSS, ru_maxrss only the peak
+	CFile File("/proc/self/statm");
+	CString sLine;
+
+	if (File.Open(O_RDONLY) && File.ReadLine(sLine)) {
+		uRSS = sLine.Token(1).ToULongLong() * sysconf(_SC_PAGESIZE);
+	}
+#endif
+}
+
+// Returns "LG <usec>" to put into a line, ParseStamp() gets the time back out of it
+static CString Stamp() {
+	return "LG " + CString(CUtils::GetMicroTime());
+}
+
+static bool ParseStamp(const CString& sLine, unsigned long long& uStamp) {
+	CString::size_type uPos = sLine.find(" :LG ");
+
+	if (uPos == CString::npos) {
+		return false;
+	}
+
+	uStamp = CString(sLine.substr(uPos + 5)).Token(0).ToULongLong();
+	return (uStamp != 0);
+}
+
+class CLoadIRCdConn : public CSocket {
+public:
+	CLoadIRCdConn(CLoadGenMod* pMod);
+	virtual ~CLoadIRCdConn();
+
+	virtual void ReadLine(const CString& sLine);
+
+	void Tick(unsigned int uTick);
+	void Forget() { m_pMod = NULL; }
+
+private:
+	void SendNames();
+	void Send(const CString& sLine);
+
+	CLoadGenMod* m_pMod;
+	CString      m_sNick;
+	bool         m_bRegistered;
+	bool         m_bJoined;
+};
+
+class CLoadIRCd : public CSocket {
+public:
+	CLoadIRCd(CLoadGenMod* pMod);
+	virtual ~CLoadIRCd() {}
+
+	virtual Csock* GetSockObj(const CString& sHost, unsigned short uPort);
+	virtual bool ConnectionFrom(const CString& sHost, unsigned short uPort) { return true; }
+
+private:
+	CLoadGenMod* m_pMod;
+};
+
+class CLoadClient : public CSocket {
+public:
+	CLoadClient(CLoadGenMod* pMod, const CString& sUser);
+	virtual ~CLoadClient();
+
+	virtual void Connected();
+	virtual void ReadLine(const CString& sLine);
+
+	void Tick();
+	void Forget() { m_pMod = NULL; }
+
+	// Getters
+	const CString& GetUser() const { return m_sUser; }
+	bool IsReady() const { return m_bReady; }
+	// !Getters
+
+private:
+	CLoadGenMod*       m_pMod;
+	CString            m_sUser;
+	bool               m_bReady;
+	unsigned long long m_uAttached;
+};
+
+class CLoadTimer : public CTimer {
+public:
+	CLoadTimer(CModule* pModule)
+		: CTimer(pModule, 1, 0, "loadgen", "Drives the load generator") {}
+	virtual ~CLoadTimer() {}
+
+protected:
+	virtual void RunJob();
+};
+
+class CLoadGenMod : public CModule {
+public:
+	enum EScenario {
+		SCENARIO_CHATTER,
+		SCENARIO_NAMES,
+		SCENARIO_NETSPLIT,
+		SCENARIO_NICKFLOOD,
+		SCENARIO_MIXED
+	};
+
+	MODCONSTRUCTOR(CLoadGenMod) {
+		m_bRunning = false;
+		m_bThrottleSaved = false;
+		m_uSavedThrottle = 0;
+		m_pListener = NULL;
+		m_pIRCd = NULL;
+
+		AddHelpCommand();
+		AddCommand("Start", static_cast<CModCommand::ModCmdFunc>(&CLoadGenMod::StartCommand),
+			"<chatter|names|netsplit|nickflood|mixed> [users] [seconds] [lines/s] [nicks] [churn %]",
+			"Start a load test on port " + CString(LOADGEN_PORT) + ", CPU and RSS include the generator itself");
+		AddCommand("Stop",  static_cast<CModCommand::ModCmdFunc>(&CLoadGenMod::StopCommand),
+			"", "Stop the running load test and report");
+		AddCommand("Stats", static_cast<CModCommand::ModCmdFunc>(&CLoadGenMod::StatsCommand),
+			"", "Report on the running load test");
+	}
+
+	virtual ~CLoadGenMod() {
+		Stop(false);
+	}
+
+	virtual bool OnLoad(const CString& sArgs, CString& sMessage) {
+		if (!m_pUser->IsAdmin()) {
+			sMessage = "You must be admin to use this module";
+			return false;
+		}
+
+		// Stays around, Stop() can be called from inside the timer
+		AddTimer(new CLoadTimer(this));
+
+		return true;
+	}
+
+	void StartCommand(const CString& sLine) {
+		CString sScenario = sLine.Token(1);
+
+		if (m_bRunning) {
+			PutModule("A load test is already running, stop it first");
+			return;
+		}
+
+		if (sScenario.Equals("chatter")) {
+			m_eScenario = SCENARIO_CHATTER;
+		} else if (sScenario.Equals("names")) {
+			m_eScenario = SCENARIO_NAMES;
+		} else if (sScenario.Equals("netsplit")) {
+			m_eScenario = SCENARIO_NETSPLIT;
+		} else if (sScenario.Equals("nickflood")) {
+			m_eScenario = SCENARIO_NICKFLOOD;
+		} else if (sScenario.Equals("mixed")) {
+			m_eScenario = SCENARIO_MIXED;
+		} else {
+			PutModule("Usage: Start <chatter|names|netsplit|nickflood|mixed> [users] [seconds] [lines/s] [nicks] [churn %]");
+			return;
+		}
+
+		m_sScenario = sScenario.AsLower();
+		m_uUsers    = GetArg(sLine, 2, 10, 1, 5000);
+		m_uSeconds  = GetArg(sLine, 3, 60, 1, 86400);
+		m_uRate     = GetArg(sLine, 4, 20, 1, 100000);
+		m_uNicks    = GetArg(sLine, 5, 200, 1, 100000);
+		m_uChurn    = GetArg(sLine, 6, 5, 0, 100);
+
+		if (!Start()) {
+			Stop(false);
+		}
+	}
+
+	void StopCommand(const CString& sLine) {
+		if (!m_bRunning) {
+			PutModule("No load test is running");
+			return;
+		}
+
+		Report();
+		Stop(true);
+	}
+
+	void StatsCommand(const CString& sLine) {
+		if (!m_bRunning) {
+			PutModule("No load test is running");
+			return;
+		}
+
+		Report();
+	}
+
+	// Called once per second by CLoadTimer
+	void Tick() {
+		if (!m_bRunning) {
+			return;
+		}
+
+		m_uTick++;
+
+		if (m_uTick > m_uSeconds) {
+			Report();
+			Stop(true);
+			return;
+		}
+
+		// Stay below the limit of anonymous connections per IP
+		unsigned int uWave = CZNC::Get().GetAnonIPLimit() / 2;
+		if (uWave == 0) {
+			uWave = 1;
+		}
+
+		while (uWave-- && !m_dsPending.empty()) {
+			ConnectClient(m_dsPending.front());
+			m_dsPending.pop_front();
+		}
+
+		for (set<CLoadIRCdConn*>::const_iterator it = m_ssConns.begin(); it != m_ssConns.end(); ++it) {
+			(*it)->Tick(m_uTick);
+		}
+
+		vector<CLoadClient*> vReattach;
+		for (set<CLoadClient*>::const_iterator it = m_ssClients.begin(); it != m_ssClients.end(); ++it) {
+			if (!(*it)->IsReady()) {
+				continue;
+			}
+
+			if ((unsigned int) (rand() % 100) < m_uChurn) {
+				vReattach.push_back(*it);
+			} else {
+				(*it)->Tick();
+			}
+		}
+
+		for (vector<CLoadClient*>::const_iterator it = vReattach.begin(); it != vReattach.end(); ++it) {
+			m_dsPending.push_back((*it)->GetUser());
+			(*it)->Forget();
+			m_ssClients.erase(*it);
+			(*it)->Close();
+			m_uReattaches++;
+		}
+	}
+
+	void AddConn(CLoadIRCdConn* pConn) { m_ssConns.insert(pConn); }
+	void DelConn(CLoadIRCdConn* pConn) { m_ssConns.erase(pConn); }
+	void DelClient(CLoadClient* pClient) {
+		if (m_ssClients.erase(pClient) && m_bRunning) {
+			// Lost the connection, try again
+			m_dsPending.push_back(pClient->GetUser());
+		}
+	}
+
+	void AddLinesToZNC(unsigned int u) { m_uLinesToZNC += u; }
+	void AddLineToClient() { m_uLinesToClients++; }
+	void AddLineFromClient() { m_uLinesFromClients++; }
+	void AddLogin() { m_uLogins++; }
+	void AddDownLatency(unsigned long long uStamp) { AddSample(m_vuDown, uStamp); }
+	void AddUpLatency(unsigned long long uStamp) { AddSample(m_vuUp, uStamp); }
+
+	// Getters
+	EScenario GetScenario() const { return m_eScenario; }
+	unsigned int GetRate() const { return m_uRate; }
+	unsigned int GetNicks() const { return m_uNicks; }
+	const CString& GetPass() const { return m_sPass; }
+	// !Getters
+
+private:
+	static unsigned int GetArg(const CString& sLine, unsigned int uPos, unsigned int uDefault, unsigned int uMin, unsigned int uMax) {
+		CString sArg = sLine.Token(uPos);
+
+		if (sArg.empty()) {
+			return uDefault;
+		}
+
+		unsigned int u = sArg.ToUInt();
+		return (u < uMin) ? uMin : (u > uMax) ? uMax : u;
+	}
+
+	bool Start() {
+		const vector<CListener*>& vpListeners = CZNC::Get().GetListeners();
+
+		m_pListener = NULL;
+		for (vector<CListener*>::const_iterator it = vpListeners.begin(); it != vpListeners.end(); ++it) {
+			if (!(*it)->IsSSL() && (*it)->GetAcceptType() != CListener::ACCEPT_HTTP) {
+				m_pListener = *it;
+				break;
+			}
+		}
+
+		if (!m_pListener) {
+			PutModule("Need a listener without SSL which accepts IRC connections");
+			return false;
+		}
+
+		for (unsigned int a = 1; a <= m_uUsers; a++) {
+			if (CZNC::Get().FindUser("loadgen" + CString(a))) {
+				PutModule("User [loadgen" + CString(a) + "] already exists, not starting");
+				return false;
+			}
+		}
+
+		m_bRunning = true;
+		m_uTick = 0;
+		m_uLinesToZNC = 0;
+		m_uLinesToClients = 0;
+		m_uLinesFromClients = 0;
+		m_uLogins = 0;
+		m_uReattaches = 0;
+		m_vuDown.clear();
+		m_vuUp.clear();
+		m_sPass = CUtils::GetSalt();
+
+		m_pIRCd = new CLoadIRCd(this);
+		// The users connect to 127.0.0.1, nobody else has to reach this
+		if (!GetManager()->ListenHost(LOADGEN_PORT, "MOD::L::" + GetModName(), "127.0.0.1", false, SOMAXCONN, m_pIRCd, 0, ADDR_IPV4ONLY)) {
+			// ListenHost() already deleted the socket
+			m_pIRCd = NULL;
+			PutModule("Could not listen on port " + CString(LOADGEN_PORT));
+			return false;
+		}
+
+		// All users connect to the same server, don't throttle that
+		m_bThrottleSaved = true;
+		m_uSavedThrottle = CZNC::Get().GetServerThrottle();
+		CZNC::Get().SetServerThrottle(0);
+
+		// Hashed like CAuthQueue would, a login would otherwise upgrade
+		// the hash and write the config.
+		CString sSalt = CUtils::GetSalt();
+		unsigned int uIterations = CZNC::Get().GetPassHashIterations();
+		CUser::eHashType eHash = uIterations ? CUser::HASH_PBKDF2 : CUser::HASH_DEFAULT;
+		CString sHash = uIterations ? CUser::PBKDF2Hash(m_sPass, sSalt, uIterations) : CUser::SaltedHash(m_sPass, sSalt);
+
+		for (unsigned int a = 1; a <= m_uUsers; a++) {
+			CUser* pUser = new CUser("loadgen" + CString(a));
+			CString sErr;
+
+			pUser->SetPass(sHash, eHash, sSalt);
+			pUser->SetTemporary(true);
+			pUser->AddServer("127.0.0.1", LOADGEN_PORT);
+			pUser->AddChan(LOADGEN_CHANNEL, true);
+
+			if (!CZNC::Get().AddUser(pUser, sErr)) {
+				delete pUser;
+				PutModule("Could not add user: " + sErr);
+				return false;
+			}
+
+			m_vsUsers.push_back(pUser->GetUserName());
+			CZNC::Get().ConnectUser(pUser);
+
+			m_dsPending.push_back(pUser->GetUserName());
+		}
+
+		GetProcessUsage(m_uStartCPU, m_uStartRSS);
+		m_uStartTime = CUtils::GetMicroTime();
+
+		PutModule("Started scenario [" + m_sScenario + "] with " + CString(m_uUsers) + " users for "
+				+ CString(m_uSeconds) + " seconds");
+		return true;
+	}
+
+	void Stop(bool bVerbose) {
+		m_bRunning = false;
+		m_dsPending.clear();
+
+		for (set<CLoadClient*>::const_iterator it = m_ssClients.begin(); it != m_ssClients.end(); ++it) {
+			(*it)->Forget();
+			(*it)->Close();
+		}
+
+		for (set<CLoadIRCdConn*>::const_iterator it = m_ssConns.begin(); it != m_ssConns.end(); ++it) {
+			(*it)->Forget();
+			(*it)->Close();
+		}
+
+		m_ssClients.clear();
+		m_ssConns.clear();
+
+		for (vector<CString>::const_iterator it = m_vsUsers.begin(); it != m_vsUsers.end(); ++it) {
+			CZNC::Get().DeleteUser(*it);
+		}
+
+		if (m_bThrottleSaved) {
+			CZNC::Get().SetServerThrottle(m_uSavedThrottle);
+			m_bThrottleSaved = false;
+		}
+
+		m_vsUsers.clear();
+
+		if (m_pIRCd) {
+			RemSocket(m_pIRCd);
+			m_pIRCd = NULL;
+		}
+
+		if (bVerbose) {
+			PutModule("Load test stopped, temporary users deleted");
+		}
+	}
+
+	void ConnectClient(const CString& sUser) {
+		CLoadClient* pClient = new CLoadClient(this, sUser);
+		CString sHost = m_pListener->GetBindHost();
+
+		if (sHost.empty()) {
+			sHost = (m_pListener->GetAddrType() == ADDR_IPV6ONLY) ? "::1" : "127.0.0.1";
+		}
+
+		m_ssClients.insert(pClient);
+		pClient->Connect(sHost, m_pListener->GetPort());
+	}
+
+	void AddSample(vector<unsigned int>& vuSamples, unsigned long long uStamp) {
+		unsigned long long uNow = CUtils::GetMicroTime();
+
+		if (vuSamples.size() < LOADGEN_MAX_SAMPLES && uNow >= uStamp && uNow - uStamp <= 0xffffffffULL) {
+			vuSamples.push_back((unsigned int) (uNow - uStamp));
+		}
+	}
+
+	static CString Percentile(const vector<unsigned int>& vuSorted, unsigned int uPercent) {
+		if (vuSorted.empty()) {
+			return "-";
+		}
+
+		size_t uIdx = (vuSorted.size() - 1) * uPercent / 100;
+		return CString(vuSorted[uIdx] / 1000.0, 2) + " ms";
+	}
+
+	void Report() {
+		unsigned long long uCPU, uRSS;
+		GetProcessUsage(uCPU, uRSS);
+
+		double fSecs = (CUtils::GetMicroTime() - m_uStartTime) / 1000000.0;
+		if (fSecs <= 0) {
+			fSecs = 1;
+		}
+
+		vector<unsigned int> vuDown(m_vuDown), vuUp(m_vuUp);
+		sort(vuDown.begin(), vuDown.end());
+		sort(vuUp.begin(), vuUp.end());
+
+		CTable Table;
+		Table.AddColumn("Metric");
+		Table.AddColumn("Value");
+
+		AddRow(Table, "Scenario", m_sScenario + ", " + CString(m_uUsers) + " users, "
+				+ CString(m_ssConns.size()) + " connected to IRC, " + CString(m_ssClients.size()) + " clients");
+		AddRow(Table, "Running for", CString(fSecs, 1) + " s");
+		AddRow(Table, "Lines ircd -> ZNC", CString(m_uLinesToZNC) + " (" + CString(m_uLinesToZNC / fSecs, 1) + "/s)");
+		AddRow(Table, "Lines ZNC -> clients", CString(m_uLinesToClients) + " (" + CString(m_uLinesToClients / fSecs, 1) + "/s)");
+		AddRow(Table, "Lines clients -> ircd", CString(m_uLinesFromClients) + " (" + CString(m_uLinesFromClients / fSecs, 1) + "/s)");
+		AddRow(Table, "Logins / reattaches", CString(m_uLogins) + " / " + CString(m_uReattaches));
+		AddRow(Table, "Latency down p50/p90/p99/max", Percentile(vuDown, 50) + " / " + Percentile(vuDown, 90)
+				+ " / " + Percentile(vuDown, 99) + " / " + Percentile(vuDown, 100));
+		AddRow(Table, "Latency up p50/p90/p99/max", Percentile(vuUp, 50) + " / " + Percentile(vuUp, 90)
+				+ " / " + Percentile(vuUp, 99) + " / " + Percentile(vuUp, 100));
+		// The generator's share is in here too, see the comment at the top
+		AddRow(Table, "RSS (ZNC + generator)", CString(uRSS / 1024) + " KiB (" + CString(((long long) uRSS - (long long) m_uStartRSS) / 1024) + " KiB since start)");
+		AddRow(Table, "CPU (ZNC + generator)", CString((uCPU - m_uStartCPU) / 1000000.0, 2) + " s ("
+				+ CString((uCPU - m_uStartCPU) / 10000.0 / fSecs, 1) + "%)");
+
+		PutModule(Table);
+	}
+
+	static void AddRow(CTable& Table, const CString& sMetric, const CString& sValue) {
+		Table.AddRow();
+		Table.SetCell("Metric", sMetric);
+		Table.SetCell("Value", sValue);
+	}
+
+	bool                 m_bRunning;
+	bool                 m_bThrottleSaved;
+	EScenario            m_eScenario;
+	CString              m_sScenario;
+	unsigned int         m_uUsers;
+	unsigned int         m_uSeconds;
+	unsigned int         m_uRate;
+	unsigned int         m_uNicks;
+	unsigned int         m_uChurn;
+	unsigned int         m_uSavedThrottle;
+	CString              m_sPass;
+	CListener*           m_pListener;
+	CLoadIRCd*           m_pIRCd;
+	vector<CString>      m_vsUsers;
+	deque<CString>       m_dsPending;
+	set<CLoadIRCdConn*>  m_ssConns;
+	set<CLoadClient*>    m_ssClients;
+
+	unsigned int         m_uTick;
+	unsigned long long   m_uStartTime;
+	unsigned long long   m_uStartCPU;
+	unsigned long long   m_uStartRSS;
+	unsigned long long   m_uLinesToZNC;
+	unsigned long long   m_uLinesToClients;
+	unsigned long long   m_uLinesFromClients;
+	unsigned long long   m_uLogins;
+	unsigned long long   m_uReattaches;
+	vector<unsigned int> m_vuDown;  //!< ircd -> client latencies in usec
+	vector<unsigned int> m_vuUp;    //!< client -> ircd latencies in usec
+};
+
+/////////////////// CLoadIRCdConn ///////////////////
+CLoadIRCdConn::CLoadIRCdConn(CLoadGenMod* pMod) : CSocket(pMod) {
+	m_pMod = pMod;
+	m_bRegistered = false;
+	m_bJoined = false;
+	m_pMod->AddConn(this);
+}
+
+CLoadIRCdConn::~CLoadIRCdConn() {
+	if (m_pMod) {
+		m_pMod->DelConn(this);
+	}
+}
+
+void CLoadIRCdConn::Send(const CString& sLine) {
+	Write(sLine + "\r\n");
+
+	if (m_pMod) {
+		m_pMod->AddLinesToZNC(1);
+	}
+}
+
+void CLoadIRCdConn::ReadLine(const CString& sData) {
+	CString sLine = sData.TrimRight_n("\r\n");
+	CString sCmd = sLine.Token(0);
+	unsigned long long uStamp;
+
+	if (!m_pMod) {
+		return;
+	}
+
+	if (sCmd.Equals("NICK")) {
+		m_sNick = sLine.Token(1).TrimPrefix_n(":");
+	} else if (sCmd.Equals("USER") && !m_bRegistered) {
+		m_bRegistered = true;
+		Send(":loadgen.irc 001 " + m_sNick + " :Welcome to the load generator " + m_sNick);
+		Send(":loadgen.irc 005 " + m_sNick + " CHANTYPES=# PREFIX=(ov)@+ NETWORK=loadgen :are supported by this server");
+		Send(":loadgen.irc 376 " + m_sNick + " :End of /MOTD command.");
+	} else if (sCmd.Equals("PING")) {
+		Send(":loadgen.irc PONG loadgen.irc " + sLine.Token(1));
+	} else if (sCmd.Equals("JOIN") && !m_bJoined) {
+		m_bJoined = true;
+		Send(":" + m_sNick + "!" + m_sNick + "@loadgen JOIN " LOADGEN_CHANNEL);
+		SendNames();
+	} else if (sCmd.Equals("PRIVMSG")) {
+		m_pMod->AddLineFromClient();
+
+		if (ParseStamp(sLine, uStamp)) {
+			m_pMod->AddUpLatency(uStamp);
+		}
+	}
+}
+
+void CLoadIRCdConn::SendNames() {
+	CString sPre = ":loadgen.irc 353 " + m_sNick + " = " LOADGEN_CHANNEL " :";
+	CString sNames = "@" + m_sNick;
+
+	for (unsigned int a = 0; a < m_pMod->GetNicks(); a++) {
+		if (sNames.size() > 400) {
+			Send(sPre + sNames);
+			sNames.clear();
+		} else {
+			sNames += " ";
+		}
+
+		sNames += ((a % 10 == 0) ? "+lg" : "lg") + CString(a);
+	}
+
+	Send(sPre + sNames);
+	Send(":loadgen.irc 366 " + m_sNick + " " LOADGEN_CHANNEL " :End of /NAMES list.");
+}
+
+void CLoadIRCdConn::Tick(unsigned int uTick) {
+	if (!m_bJoined || !m_pMod) {
+		return;
+	}
+
+	CLoadGenMod::EScenario eScenario = m_pMod->GetScenario();
+	unsigned int uRate = m_pMod->GetRate();
+	unsigned int uNicks = m_pMod->GetNicks();
+	bool bMixed = (eScenario == CLoadGenMod::SCENARIO_MIXED);
+
+	if (bMixed) {
+		uRate = (uRate >= 4) ? uRate / 4 : 1;
+	}
+
+	// There always is some chatter, it's what the latency is measured with
+	for (unsigned int a = 0; a < uRate; a++) {
+		CString sNick = "lg" + CString(rand() % uNicks);
+		Send(":" + sNick + "!" + sNick + "@loadgen PRIVMSG " LOADGEN_CHANNEL " :" + Stamp() + " the quick brown fox jumps over the lazy dog");
+	}
+
+	if (eScenario == CLoadGenMod::SCENARIO_NAMES || bMixed) {
+		SendNames();
+	}
+
+	if (eScenario == CLoadGenMod::SCENARIO_NETSPLIT || bMixed) {
+		// Half of the channel splits off and comes back a second later
+		for (unsigned int a = 0; a < uNicks / 2; a++) {
+			CString sNick = "lg" + CString(a);
+
+			if (uTick % 2) {
+				Send(":" + sNick + "!" + sNick + "@loadgen QUIT :*.net *.split");
+			} else {
+				Send(":" + sNick + "!" + sNick + "@loadgen JOIN " LOADGEN_CHANNEL);
+			}
+		}
+	}
+
+	if (eScenario == CLoadGenMod::SCENARIO_NICKFLOOD || bMixed) {
+		for (unsigned int a = 0; a < uRate; a++) {
+			CString sNick = "lg" + CString(uNicks / 2 + rand() % (uNicks - uNicks / 2));
+
+			Send(":" + sNick + "!" + sNick + "@loadgen NICK " + sNick + "_");
+			Send(":" + sNick + "_!" + sNick + "@loadgen NICK " + sNick);
+		}
+	}
+}
+
+/////////////////// CLoadIRCd ///////////////////
+CLoadIRCd::CLoadIRCd(CLoadGenMod* pMod) : CSocket(pMod) {
+	m_pMod = pMod;
+	SetSockName("MOD::L::loadgen");
+}
+
+Csock* CLoadIRCd::GetSockObj(const CString& sHost, unsigned short uPort) {
+	return new CLoadIRCdConn(m_pMod);
+}
+
+/////////////////// CLoadClient ///////////////////
+CLoadClient::CLoadClient(CLoadGenMod* pMod, const CString& sUser) : CSocket(pMod) {
+	m_pMod = pMod;
+	m_sUser = sUser;
+	m_bReady = false;
+	m_uAttached = 0;
+}
+
+CLoadClient::~CLoadClient() {
+	if (m_pMod) {
+		m_pMod->DelClient(this);
+	}
+}
+
+void CLoadClient::Connected() {
+	if (!m_pMod) {
+		return;
+	}
+
+	Write("PASS " + m_sUser + ":" + m_pMod->GetPass() + "\r\n");
+	Write("NICK " + m_sUser + "\r\n");
+	Write("USER " + m_sUser + " 0 * :ZNC load generator\r\n");
+}
+
+void CLoadClient::ReadLine(const CString& sData) {
+	CString sLine = sData.TrimRight_n("\r\n");
+	unsigned long long uStamp;
+
+	if (!m_pMod) {
+		return;
+	}
+
+	m_pMod->AddLineToClient();
+
+	if (sLine.Token(0).Equals("PING")) {
+		Write("PONG " + sLine.Token(1) + "\r\n");
+	} else if (!m_bReady && sLine.Token(1) == "001") {
+		m_bReady = true;
+		m_uAttached = CUtils::GetMicroTime();
+		m_pMod->AddLogin();
+	} else if (m_bReady && ParseStamp(sLine, uStamp)) {
+		// Buffer playback isn't live traffic, only count what was
+		// sent while we were attached
+		if (uStamp >= m_uAttached) {
+			m_pMod->AddDownLatency(uStamp);
+		}
+	}
+}
+
+void CLoadClient::Tick() {
+	Write("PRIVMSG " LOADGEN_CHANNEL " :" + Stamp() + " hello from " + m_sUser + "\r\n");
+}
+
+/////////////////// CLoadTimer ///////////////////
+void CLoadTimer::RunJob() {
+	static_cast<CLoadGenMod*>(m_pModule)->Tick();
+}
+
+MODULEDEFS(CLoadGenMod, "Load generator with a fake ircd and synthetic clients")
@@ -116,27 +116,34 @@ const char *prime1080="FBE1022E23D213E8ACFA9AE8B9DFADA3EA6B7AC7A7B7E95AB5EB2DF85
 
 int base64dec(char c)
 {
+    static int B64DEC[256];
+    static int inited = 0;
     int i;
 
-    for (i = 0; i < 64; i++)
-        if (B64[i] == c) return i;
+    if (!inited) {
+        for (i = 0; i < 256; i++) B64DEC[i] = 0;
+        for (i = 0; i < 64; i++) B64DEC[(unsigned char)B64[i]] = i;
+        inited = 1;
+    }
 
-    return 0;
+    return B64DEC[(unsigned char)c];
 }
 
-char *encrypts(char *key,char *str) {
+/*
+   encrypts() and decrypts() take a key schedule from BF_set_key(), setting
+   it up costs a lot more than a line of text, so CFishMod keeps them around.
+*/
+char *encrypts(const BF_KEY *bfkey,char *str) {
   char *result;
   unsigned int length;
   unsigned int left,right;
   char *s,*d;
   unsigned char *p;
-  BF_KEY bfkey;
   int i;
 
-  if(key==NULL||str==NULL) return NULL;
+  if(bfkey==NULL||str==NULL) return NULL;
 
   length=strlen(str);
-  BF_set_key(&bfkey, strlen(key), (const unsigned char *)key);
 
   s=(char *)malloc(length+9);
 
@@ -149,7 +156,7 @@ char *encrypts(char *key,char *str) {
   d=result;
 
   while(*p) {
-    BF_ecb_encrypt((const unsigned char *)p, (unsigned char *)p, &bfkey, BF_ENCRYPT);
+    BF_ecb_encrypt((const unsigned char *)p, (unsigned char *)p, bfkey, BF_ENCRYPT);
     left = ((*p++) << 24);
     left += ((*p++) << 16);
     left += ((*p++) << 8);
@@ -175,19 +182,17 @@ char *encrypts(char *key,char *str) {
   return result;
 }
 
-char *decrypts(char *key, char *str) {
+char *decrypts(const BF_KEY *bfkey, char *str) {
   char *result;
   unsigned int length;
   unsigned int left,right;
   int i;
   char *d;
   unsigned char *c;
-  BF_KEY bfkey;
 
-  if(key==NULL||str==NULL) return NULL;
+  if(bfkey==NULL||str==NULL) return NULL;
 
   length=strlen(str);
-  BF_set_key(&bfkey,strlen(key),(const unsigned char *)key);
 
   result=(char *)malloc((length/12*8)+1);
   c=(unsigned char *)result;
@@ -201,7 +206,7 @@ char *decrypts(char *key, char *str) {
     left=htonl(left);
     memcpy(c,&left,4);
     memcpy(c+4,&right,4);
-    BF_ecb_encrypt(c,c,&bfkey,BF_DECRYPT);
+    BF_ecb_encrypt(c,c,bfkey,BF_DECRYPT);
     c+=8;
   }
   *c='\0';
@@ -221,6 +226,35 @@ class CFishMod : public CModule {
 public:
 	MODCONSTRUCTOR(CFishMod) {}
 	virtual ~CFishMod() {
+		while (!m_mKeys.empty()) {
+			ForgetKey(m_mKeys.begin()->first);
+		}
+	}
+
+	// Key schedules by target, together with the key they were set up from
+	const BF_KEY* GetKey(const CString& sTarget, const CString& sKey) {
+		map<CString, pair<CString, BF_KEY> >::iterator it = m_mKeys.find(sTarget);
+
+		if (it != m_mKeys.end() && it->second.first == sKey) {
+			return &it->second.second;
+		}
+
+		ForgetKey(sTarget);
+
+		pair<CString, BF_KEY>& Key = m_mKeys[sTarget];
+		Key.first = sKey;
+		BF_set_key(&Key.second, (int) sKey.length(), (const unsigned char *)sKey.data());
+
+		return &Key.second;
+	}
+
+	void ForgetKey(const CString& sTarget) {
+		map<CString, pair<CString, BF_KEY> >::iterator it = m_mKeys.find(sTarget);
+
+		if (it != m_mKeys.end()) {
+			memset(&it->second.second, 0, sizeof(BF_KEY));
+			m_mKeys.erase(it);
+		}
 	}
 
         virtual EModRet OnPrivNotice(CNick& Nick, CString& sMessage) {
@@ -273,7 +307,7 @@ public:
 			if ((pChan) && (pChan->KeepBuffer())) {
 				pChan->AddBuffer(":" + m_pUser->GetIRCNick().GetNickMask() + " PRIVMSG " + sTarget + " :" + sMessage);
 			}
-			char * cMsg = encrypts((char *)it->second.c_str(), (char *)sMessage.c_str());
+			char * cMsg = encrypts(GetKey(it->first, it->second), (char *)sMessage.c_str());
 
 			CString sMsg = "+OK " + CString(cMsg);
 			PutIRC("PRIVMSG " + sTarget + " :" + sMsg);
@@ -294,7 +328,7 @@ public:
 			if ((pChan) && (pChan->KeepBuffer())) {
 				pChan->AddBuffer(":" + m_pUser->GetIRCNick().GetNickMask() + " PRIVMSG " + sTarget + " :\001ACTION " + sMessage + "\001");
 			}
-			char * cMsg = encrypts((char *)it->second.c_str(), (char *)sMessage.c_str());
+			char * cMsg = encrypts(GetKey(it->first, it->second), (char *)sMessage.c_str());
 
 			CString sMsg = "+OK " + CString(cMsg);
 			PutIRC("PRIVMSG " + sTarget + " :\001ACTION " + sMsg + "\001");
@@ -315,7 +349,7 @@ public:
 			if ((pChan) && (pChan->KeepBuffer())) {
 				pChan->AddBuffer(":" + m_pUser->GetIRCNick().GetNickMask() + " NOTICE " + sTarget + " :" + sMessage);
 			}
-			char * cMsg = encrypts((char *)it->second.c_str(), (char *)sMessage.c_str());
+			char * cMsg = encrypts(GetKey(it->first, it->second), (char *)sMessage.c_str());
 
 			CString sMsg = "+OK " + CString(cMsg);
 			PutIRC("NOTICE " + sTarget + " :" + sMsg);
@@ -333,7 +367,7 @@ public:
 		if (!sTopic.empty()) {
 			MCString::iterator it = FindNV(sChannel.AsLower());
 			if (it != EndNV()) {
-				char * cTopic = encrypts((char *)it->second.c_str(), (char *)sTopic.c_str());
+				char * cTopic = encrypts(GetKey(it->first, it->second), (char *)sTopic.c_str());
 				sTopic = "+OK " + CString(cTopic);
 				free(cTopic);
 			}
@@ -406,7 +440,7 @@ public:
 					mark_broken_block = 1;
 				}
 
-				char *cMsg = decrypts((char *)it->second.c_str(), (char *)sMessage.c_str());
+				char *cMsg = decrypts(GetKey(it->first, it->second), (char *)sMessage.c_str());
 				sMessage = CString(cMsg);
 
 				if (mark_broken_block) {
@@ -425,6 +459,8 @@ public:
 			CString sTarget = sCommand.Token(1);
 
 			if (!sTarget.empty()) {
+				ForgetKey(sTarget.AsLower());
+
 				if (DelNV(sTarget.AsLower())) {
 					PutModule("Target [" + sTarget + "] deleted");
 				} else {
@@ -639,6 +675,8 @@ private:
 	}
 
 	map<CString, pair<time_t, CString> >	m_msKeyExchange;
+	// target -> (key, key schedule)
+	map<CString, pair<CString, BF_KEY> >	m_mKeys;
 
 };
 
@@ -17,17 +17,27 @@
 
 class CPartylineChannel {
 public:
-	CPartylineChannel(const CString& sName) { m_sName = sName.AsLower(); }
-	~CPartylineChannel() {}
+	CPartylineChannel(const CString& sName) {
+		m_sName = sName.AsLower();
+		m_sBusTopic = "partyline/" + m_sName;
+	}
+	~CPartylineChannel() { CZNC::Get().GetMessageBus().DelTopic(m_sBusTopic); }
 
 	const CString& GetTopic() const { return m_sTopic; }
 	const CString& GetName() const { return m_sName; }
+	const CString& GetBusTopic() const { return m_sBusTopic; }
 	const set<CString>& GetNicks() const { return m_ssNicks; }
 
 	void SetTopic(const CString& s) { m_sTopic = s; }
 
-	void AddNick(const CString& s) { m_ssNicks.insert(s); }
-	void DelNick(const CString& s) { m_ssNicks.erase(s); }
+	void AddNick(const CString& s) {
+		m_ssNicks.insert(s);
+		CZNC::Get().GetMessageBus().Subscribe(m_sBusTopic, CZNC::Get().FindUser(s));
+	}
+	void DelNick(const CString& s) {
+		m_ssNicks.erase(s);
+		CZNC::Get().GetMessageBus().Unsubscribe(m_sBusTopic, CZNC::Get().FindUser(s));
+	}
 
 	void AddFixedNick(const CString& s) { m_ssFixedNicks.insert(s); }
 	void DelFixedNick(const CString& s) { m_ssFixedNicks.erase(s); }
@@ -38,6 +48,7 @@ public:
 protected:
 	CString      m_sTopic;
 	CString      m_sName;
+	CString      m_sBusTopic;
 	set<CString> m_ssNicks;
 	set<CString> m_ssFixedNicks;
 };
@@ -121,7 +132,7 @@ public:
 			if (sAction == "topic") {
 				pChannel = FindChannel(sKey);
 				if (pChannel && !(it->second).empty()) {
-					PutChan(pChannel->GetNicks(), ":irc.znc.in TOPIC " + pChannel->GetName() + " :" + it->second);
+					PutChan(pChannel, ":irc.znc.in TOPIC " + pChannel->GetName() + " :" + it->second);
 					pChannel->SetTopic(it->second);
 				}
 			}
@@ -198,7 +209,6 @@ public:
 				continue;
 
 			CString sHost = m_pUser->GetBindHost();
-			const set<CString>& ssNicks = pChannel->GetNicks();
 
 			if (sHost.empty()) {
 				sHost = m_pUser->GetIRCNick().GetHost();
@@ -206,7 +216,7 @@ public:
 			if (sHost.empty()) {
 				sHost = "znc.in";
 			}
-			PutChan(ssNicks, ":?" + sNick + "!" + m_pUser->GetIdent() + "@" + sHost + " JOIN " + *a, false);
+			PutChan(pChannel, ":?" + sNick + "!" + m_pUser->GetIdent() + "@" + sHost + " JOIN " + *a, false);
 			pChannel->AddNick(sNick);
 		}
 
@@ -224,7 +234,7 @@ public:
 				}
 
 				SendNickList(m_pUser, ssNicks, (*it)->GetName());
-				PutChan(ssNicks, ":*" + GetModName() + "!znc@znc.in MODE " + (*it)->GetName() + " +" + CString(m_pUser->IsAdmin() ? "o" : "v") + " ?" + m_pUser->GetUserName(), true);
+				PutChan(*it, ":*" + GetModName() + "!znc@znc.in MODE " + (*it)->GetName() + " +" + CString(m_pUser->IsAdmin() ? "o" : "v") + " ?" + m_pUser->GetUserName(), true);
 			}
 		}
 	}
@@ -235,7 +245,7 @@ public:
 				const set<CString>& ssNicks = (*it)->GetNicks();
 
 				if (ssNicks.find(m_pUser->GetUserName()) != ssNicks.end()) {
-					PutChan(ssNicks, ":*" + GetModName() + "!znc@znc.in MODE " + (*it)->GetName() + " -ov ?" + m_pUser->GetUserName() + " ?" + m_pUser->GetUserName(), true);
+					PutChan(*it, ":*" + GetModName() + "!znc@znc.in MODE " + (*it)->GetName() + " -ov ?" + m_pUser->GetUserName() + " ?" + m_pUser->GetUserName(), true);
 				}
 			}
 		}
@@ -255,10 +265,9 @@ public:
 			CPartylineChannel* pChannel = FindChannel(sChannel);
 
 			if (pChannel && pChannel->IsInChannel(m_pUser->GetUserName())) {
-				const set<CString>& ssNicks = pChannel->GetNicks();
 				if (!sTopic.empty()) {
 					if (m_pUser->IsAdmin()) {
-						PutChan(ssNicks, ":" + m_pUser->GetIRCNick().GetNickMask() + " TOPIC " + sChannel + " :" + sTopic);
+						PutChan(pChannel, ":" + m_pUser->GetIRCNick().GetNickMask() + " TOPIC " + sChannel + " :" + sTopic);
 						pChannel->SetTopic(sTopic);
 						SaveTopic(pChannel);
 					} else {
@@ -329,13 +338,13 @@ public:
 			if (bNickAsTarget) {
 				pUser->PutUser(":" + pUser->GetIRCNick().GetNickMask() + sCmd
 						+ pChannel->GetName() + " " + pUser->GetIRCNick().GetNick() + sMsg);
-				PutChan(ssNicks, ":?" + pUser->GetUserName() + "!" + pUser->GetIdent() + "@" + sHost
+				PutChan(pChannel, ":?" + pUser->GetUserName() + "!" + pUser->GetIdent() + "@" + sHost
 						+ sCmd + pChannel->GetName() + " ?" + pUser->GetUserName() + sMsg,
 						false, true, pUser);
 			} else {
 				pUser->PutUser(":" + pUser->GetIRCNick().GetNickMask() + sCmd
 						+ pChannel->GetName() + sMsg);
-				PutChan(ssNicks, ":?" + pUser->GetUserName() + "!" + pUser->GetIdent() + "@" + sHost
+				PutChan(pChannel, ":?" + pUser->GetUserName() + "!" + pUser->GetIdent() + "@" + sHost
 						+ sCmd + pChannel->GetName() + sMsg, false, true, pUser);
 			}
 
@@ -385,7 +394,7 @@ public:
 			}
 
 			pUser->PutUser(":" + pUser->GetIRCNick().GetNickMask() + " JOIN " + pChannel->GetName());
-			PutChan(ssNicks, ":?" + sNick + "!" + pUser->GetIdent() + "@" + sHost + " JOIN " + pChannel->GetName(), false, true, pUser);
+			PutChan(pChannel, ":?" + sNick + "!" + pUser->GetIdent() + "@" + sHost + " JOIN " + pChannel->GetName(), false, true, pUser);
 
 			if (!pChannel->GetTopic().empty()) {
 				pUser->PutUser(":" + GetIRCServer(pUser) + " 332 " + pUser->GetIRCNick().GetNickMask() + " " + pChannel->GetName() + " :" + pChannel->GetTopic());
@@ -393,7 +402,7 @@ public:
 			SendNickList(pUser, ssNicks, pChannel->GetName());
 
 			if (pUser->IsAdmin()) {
-				PutChan(ssNicks, ":*" + GetModName() + "!znc@znc.in MODE " + pChannel->GetName() + " +o ?" + pUser->GetUserName(), false, true, pUser);
+				PutChan(pChannel, ":*" + GetModName() + "!znc@znc.in MODE " + pChannel->GetName() + " +o ?" + pUser->GetUserName(), false, true, pUser);
 			}
 		}
 	}
@@ -621,32 +630,22 @@ public:
 		CPartylineChannel* pChannel = FindChannel(sChan);
 
 		if (pChannel != NULL) {
-			PutChan(pChannel->GetNicks(), sLine, bIncludeCurUser, bIncludeClient, pUser, pClient);
+			PutChan(pChannel, sLine, bIncludeCurUser, bIncludeClient, pUser, pClient);
 			return true;
 		}
 
 		return false;
 	}
 
-	void PutChan(const set<CString>& ssNicks, const CString& sLine, bool bIncludeCurUser = true, bool bIncludeClient = true, CUser* pUser = NULL, CClient* pClient = NULL) {
-		const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
-
+	void PutChan(const CPartylineChannel* pChannel, const CString& sLine, bool bIncludeCurUser = true, bool bIncludeClient = true, CUser* pUser = NULL, CClient* pClient = NULL) {
 		if (!pUser)
 			pUser = m_pUser;
 		if (!pClient)
 			pClient = m_pClient;
 
-		for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
-			if (ssNicks.find(it->first) != ssNicks.end()) {
-				if (it->second == pUser) {
-					if (bIncludeCurUser) {
-						it->second->PutUser(sLine, NULL, (bIncludeClient ? NULL : pClient));
-					}
-				} else {
-					it->second->PutUser(sLine);
-				}
-			}
-		}
+		// pClient belongs to pUser, so it only needs skipping if pUser gets the line at all
+		CZNC::Get().GetMessageBus().Publish(pChannel->GetBusTopic(), sLine,
+				(bIncludeCurUser ? NULL : pUser), (bIncludeClient ? NULL : pClient));
 	}
 
 	void PutUserIRCNick(CUser *pUser, const CString& sPre, const CString& sPost) {
@@ -656,11 +655,7 @@ public:
 			return;
 		}
 
-		const vector<CClient*>& vClients = pUser->GetClients();
-		vector<CClient*>::const_iterator it;
-		for (it = vClients.begin(); it != vClients.end(); ++it) {
-			(*it)->PutClient(sPre + (*it)->GetNick() + sPost);
-		}
+		CFanOutLine(sPre, sPost).SendTo(pUser);
 	}
 
 	void SendNickList(CUser* pUser, const set<CString>& ssNicks, const CString& sChan) {
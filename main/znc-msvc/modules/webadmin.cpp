@@ -18,6 +18,7 @@
 #include "Listener.h"
 #include <sstream>
 #include <utility>
+#include <algorithm>
 
 using std::stringstream;
 using std::make_pair;
@@ -52,6 +53,58 @@ inline bool FOR_EACH_MODULE_CanContinue(FOR_EACH_MODULE_Type& state, CModules::i
 	if (FOR_EACH_MODULE_Type FOR_EACH_MODULE_Var = pUser) {} else\
 	for (CModules::iterator I = CZNC::Get().GetModules().begin(); FOR_EACH_MODULE_CanContinue(FOR_EACH_MODULE_Var, I); ++I)
 
+// One line of the user list, with the value it is sorted by already
+// looked up so that sorting doesn't call into the users over and over.
+struct CUserListEntry {
+	CUser*       pUser;
+	CString      sKey;
+	unsigned int uKey;
+};
+
+struct CUserListSort {
+	bool bNumeric;
+	bool bDesc;
+
+	CUserListSort(bool bNum, bool bD) : bNumeric(bNum), bDesc(bD) {}
+
+	bool operator()(const CUserListEntry& a, const CUserListEntry& b) const {
+		if (bNumeric) {
+			return bDesc ? (a.uKey > b.uKey) : (a.uKey < b.uKey);
+		}
+		return bDesc ? (a.sKey.StrCmp(b.sKey) > 0) : (a.sKey.StrCmp(b.sKey) < 0);
+	}
+};
+
+// The template can only sort by strings, these sort the perf page's tables by numbers
+static bool SortHooksByTime(const pair<CString, CHookStats>& a, const pair<CString, CHookStats>& b) {
+	return a.second.GetTime() > b.second.GetTime();
+}
+
+static bool SortSocksBySendq(Csock* a, Csock* b) {
+	return a->GetInternalWriteBuffer().size() > b->GetInternalWriteBuffer().size();
+}
+
+static CString JSONString(const CString& s) {
+	CString sRet = "\"";
+
+	for (size_t a = 0; a < s.size(); a++) {
+		unsigned char c = s[a];
+
+		if (c == '"' || c == '\\') {
+			sRet += '\\';
+			sRet += c;
+		} else if (c < 0x20) {
+			char szBuf[8];
+			snprintf(szBuf, sizeof(szBuf), "\\u%04x", c);
+			sRet += szBuf;
+		} else {
+			sRet += c;
+		}
+	}
+
+	return sRet + "\"";
+}
+
 class CWebAdminMod : public CGlobalModule {
 public:
 	GLOBALMODCONSTRUCTOR(CWebAdminMod) {
@@ -60,6 +113,7 @@ public:
 		AddSubPage(new CWebSubPage("settings", "Global Settings", CWebSubPage::F_ADMIN));
 		AddSubPage(new CWebSubPage("edituser", "Your Settings", vParams));
 		AddSubPage(new CWebSubPage("traffic", "Traffic Info", CWebSubPage::F_ADMIN));
+		AddSubPage(new CWebSubPage("perf", "Performance", CWebSubPage::F_ADMIN));
 		AddSubPage(new CWebSubPage("listusers", "List Users", CWebSubPage::F_ADMIN));
 		AddSubPage(new CWebSubPage("adduser", "Add User", CWebSubPage::F_ADMIN));
 	}
@@ -255,6 +309,16 @@ public:
 		pNewUser->SetTimezoneOffset(WebSock.GetParam("timezoneoffset").ToDouble());
 		pNewUser->SetJoinTries(WebSock.GetParam("jointries").ToUInt());
 		pNewUser->SetMaxJoins(WebSock.GetParam("maxjoins").ToUInt());
+
+		// Keep the defaults for new users if these were left empty
+		sArg = WebSock.GetParam("floodrate");
+		if (!sArg.empty()) {
+			pNewUser->SetFloodRate(sArg.ToDouble());
+		}
+		sArg = WebSock.GetParam("floodburst");
+		if (!sArg.empty()) {
+			pNewUser->SetFloodBurst(sArg.ToUInt());
+		}
 		pNewUser->SetIRCConnectEnabled(WebSock.GetParam("doconnect").ToBool());
 
 		if (spSession->IsAdmin()) {
@@ -477,6 +541,8 @@ public:
 			return ListUsersPage(WebSock, Tmpl);
 		} else if (sPageName == "traffic" && spSession->IsAdmin()) {
 			return TrafficPage(WebSock, Tmpl);
+		} else if (sPageName == "perf" && spSession->IsAdmin()) {
+			return PerfPage(WebSock, Tmpl);
 		} else if (sPageName == "index") {
 			return true;
 		}
@@ -640,6 +706,8 @@ public:
 				Tmpl["TimezoneOffset"] = CString(pUser->GetTimezoneOffset());
 				Tmpl["JoinTries"] = CString(pUser->JoinTries());
 				Tmpl["MaxJoins"] = CString(pUser->MaxJoins());
+				Tmpl["FloodRate"] = CString(pUser->GetFloodRate());
+				Tmpl["FloodBurst"] = CString(pUser->GetFloodBurst());
 				Tmpl["IRCConnectEnabled"] = CString(pUser->GetIRCConnectEnabled());
 
 				const set<CString>& ssAllowedHosts = pUser->GetAllowedHosts();
@@ -870,18 +938,127 @@ public:
 		return false;
 	}
 
+	/** Picks the users matching the "filter" parameter, sorted by "sort"
+	 *  (username, clients, server or nick, "desc" reverses it). Only the
+	 *  page selected by "page" and "perpage" is returned, uTotal is set to
+	 *  the number of matching users.
+	 */
+	vector<CUser*> GetUserListPage(CWebSock& WebSock, size_t& uTotal, unsigned int& uPage, unsigned int& uPerPage) {
+		const map<CString,CUser*>& msUsers = CZNC::Get().GetUserMap();
+		CString sFilter = WebSock.GetParam("filter", false).Trim_n().AsLower();
+		CString sSort = WebSock.GetParam("sort", false).AsLower();
+		bool bDesc = WebSock.GetParam("desc", false).ToBool();
+
+		uPerPage = WebSock.GetParam("perpage", false).ToUInt();
+		if (uPerPage == 0) {
+			uPerPage = 50;
+		} else if (uPerPage > 500) {
+			uPerPage = 500;
+		}
+
+		uPage = WebSock.GetParam("page", false).ToUInt();
+		if (uPage == 0) {
+			uPage = 1;
+		}
+
+		vector<CUser*> vpRet;
+
+		// The user map is sorted by name already, so without a filter
+		// and another sort order just jump to the right page.
+		if (sFilter.empty() && (sSort.empty() || sSort == "username") && !bDesc) {
+			uTotal = msUsers.size();
+
+			size_t uSkip = (size_t) (uPage - 1) * uPerPage;
+			if (uSkip >= uTotal) {
+				return vpRet;
+			}
+
+			map<CString,CUser*>::const_iterator it = msUsers.begin();
+			std::advance(it, uSkip);
+
+			for (; it != msUsers.end() && vpRet.size() < uPerPage; ++it) {
+				vpRet.push_back(it->second);
+			}
+
+			return vpRet;
+		}
+
+		vector<CUserListEntry> vEntries;
+		bool bNumeric = (sSort == "clients");
+
+		for (map<CString,CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+			CUser* pUser = it->second;
+
+			if (!sFilter.empty() && it->first.AsLower().find(sFilter) == CString::npos
+					&& pUser->GetIRCNick().GetNick().AsLower().find(sFilter) == CString::npos) {
+				continue;
+			}
+
+			CUserListEntry Entry;
+			Entry.pUser = pUser;
+			Entry.uKey = 0;
+
+			if (sSort == "clients") {
+				Entry.uKey = (unsigned int) pUser->GetClients().size();
+			} else if (sSort == "server") {
+				CServer* pServer = pUser->GetCurrentServer();
+				Entry.sKey = pServer ? pServer->GetName() : "";
+			} else if (sSort == "nick") {
+				Entry.sKey = pUser->GetIRCNick().GetNick().AsLower();
+			} else {
+				Entry.sKey = it->first;
+			}
+
+			vEntries.push_back(Entry);
+		}
+
+		// Stable, so users with the same key stay sorted by name
+		std::stable_sort(vEntries.begin(), vEntries.end(), CUserListSort(bNumeric, bDesc));
+
+		uTotal = vEntries.size();
+
+		for (size_t a = (size_t) (uPage - 1) * uPerPage; a < vEntries.size() && vpRet.size() < uPerPage; a++) {
+			vpRet.push_back(vEntries[a].pUser);
+		}
+
+		return vpRet;
+	}
+
 	bool ListUsersPage(CWebSock& WebSock, CTemplate& Tmpl) {
 		CSmartPtr<CWebSession> spSession = WebSock.GetSession();
-		const map<CString,CUser*>& msUsers = CZNC::Get().GetUserMap();
+		size_t uTotal;
+		unsigned int uPage, uPerPage;
+		vector<CUser*> vpUsers = GetUserListPage(WebSock, uTotal, uPage, uPerPage);
+
+		if (WebSock.GetParam("format", false).Equals("json")) {
+			return ListUsersJSON(WebSock, vpUsers, uTotal, uPage, uPerPage);
+		}
+
 		Tmpl["Title"] = "List Users";
 		Tmpl["Action"] = "listusers";
+		Tmpl["TotalUsers"] = CString(CZNC::Get().GetUserMap().size());
+		Tmpl["Matching"] = CString(uTotal);
+		Tmpl["Filter"] = WebSock.GetParam("filter", false).Trim_n();
+		Tmpl["Sort"] = WebSock.GetParam("sort", false).AsLower();
+		Tmpl["Desc"] = CString(WebSock.GetParam("desc", false).ToBool());
+		Tmpl["PerPage"] = CString(uPerPage);
+		Tmpl["Page"] = CString(uPage);
+
+		unsigned int uPages = (unsigned int) ((uTotal + uPerPage - 1) / uPerPage);
+		Tmpl["Pages"] = CString(uPages > 0 ? uPages : 1);
+
+		if (uPage > 1) {
+			Tmpl["PrevPage"] = CString(uPage - 1);
+		}
 
-		unsigned int a = 0;
+		if (uPage < uPages) {
+			Tmpl["NextPage"] = CString(uPage + 1);
+		}
 
-		for (map<CString,CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it, a++) {
-			CServer* pServer = it->second->GetCurrentServer();
+		for (vector<CUser*>::const_iterator it = vpUsers.begin(); it != vpUsers.end(); ++it) {
+			CServer* pServer = (*it)->GetCurrentServer();
 			CTemplate& l = Tmpl.AddRow("UserLoop");
-			CUser& User = *it->second;
+			CUser& User = **it;
 
 			l["Username"] = User.GetUserName();
 			l["Clients"] = CString(User.GetClients().size());
@@ -899,6 +1076,35 @@ public:
 		return true;
 	}
 
+	bool ListUsersJSON(CWebSock& WebSock, const vector<CUser*>& vpUsers, size_t uTotal, unsigned int uPage, unsigned int uPerPage) {
+		CString sJSON = "{\"total\":" + CString(uTotal) + ",\"page\":" + CString(uPage)
+			+ ",\"perpage\":" + CString(uPerPage) + ",\"users\":[";
+
+		for (vector<CUser*>::const_iterator it = vpUsers.begin(); it != vpUsers.end(); ++it) {
+			CUser& User = **it;
+			CServer* pServer = User.GetCurrentServer();
+
+			if (it != vpUsers.begin()) {
+				sJSON += ",";
+			}
+
+			sJSON += "{\"username\":" + JSONString(User.GetUserName())
+				+ ",\"clients\":" + CString(User.GetClients().size())
+				+ ",\"server\":" + (pServer ? JSONString(pServer->GetName()) : CString("null"))
+				+ ",\"nick\":" + JSONString(User.GetIRCNick().GetNick())
+				+ ",\"admin\":" + CString(User.IsAdmin()) + "}";
+		}
+
+		sJSON += "]}";
+
+		// The caller sees the header was sent and closes the connection
+		WebSock.AddHeader("Cache-Control", "no-cache");
+		WebSock.PrintHeader(sJSON.length(), "application/json");
+		WebSock.Write(sJSON);
+
+		return true;
+	}
+
 	bool TrafficPage(CWebSock& WebSock, CTemplate& Tmpl) {
 		CSmartPtr<CWebSession> spSession = WebSock.GetSession();
 		Tmpl["Uptime"] = CZNC::Get().GetUptime();
@@ -951,6 +1157,124 @@ public:
 		return true;
 	}
 
+	bool PerfPage(CWebSock& WebSock, CTemplate& Tmpl) {
+		CPerfStats& Stats = CZNC::Get().GetPerfStats();
+
+		if (WebSock.GetParam("reset").ToBool()) {
+			Stats.Reset();
+		}
+
+		const CHookStats& Loops = Stats.GetLoops();
+		const CHookStats& Lag = Stats.GetTimerLag();
+		map<CString, CHookStats> mHooks;
+		CPerfStats::GetModuleStats(mHooks, true);
+
+		if (WebSock.GetParam("format", false).Equals("json")) {
+			return PerfJSON(WebSock, Stats, mHooks);
+		}
+
+		Tmpl["Title"] = "Performance";
+		Tmpl["Since"] = CString::ToTimeStr(time(NULL) - Stats.GetSince());
+		Tmpl["Loops"] = CString(Loops.GetCalls());
+		Tmpl["LoopAvg"] = CString(Loops.GetCalls() ? Loops.GetTime() / Loops.GetCalls() : 0);
+		Tmpl["LoopMax"] = CString(Loops.GetMaxTime());
+		Tmpl["LagLast"] = CString(Stats.GetLastTimerLag());
+		Tmpl["LagAvg"] = CString(Lag.GetCalls() ? Lag.GetTime() / Lag.GetCalls() : 0);
+		Tmpl["LagMax"] = CString(Lag.GetMaxTime());
+
+		for (unsigned int a = 0; a < CPerfStats::LOOP_BUCKETS; a++) {
+			CTemplate& l = Tmpl.AddRow("BucketLoop");
+			unsigned long long uLimit = CPerfStats::GetLoopBucketLimit(a);
+
+			l["Limit"] = uLimit ? "< " + CString(uLimit) : ">= " + CString(CPerfStats::GetLoopBucketLimit(a - 1));
+			l["Loops"] = CString(Stats.GetLoopBucket(a));
+		}
+
+		vector<pair<CString, CHookStats> > vHooks(mHooks.begin(), mHooks.end());
+		sort(vHooks.begin(), vHooks.end(), SortHooksByTime);
+
+		for (vector<pair<CString, CHookStats> >::const_iterator it = vHooks.begin(); it != vHooks.end(); ++it) {
+			CTemplate& l = Tmpl.AddRow("HookLoop");
+
+			l["Name"] = it->first;
+			l["Calls"] = CString(it->second.GetCalls());
+			l["Total"] = CString(it->second.GetTime());
+			l["Avg"] = CString(it->second.GetCalls() ? it->second.GetTime() / it->second.GetCalls() : 0);
+			l["Max"] = CString(it->second.GetMaxTime());
+		}
+
+		const CSockManager& Manager = CZNC::Get().GetManager();
+		vector<Csock*> vSocks(Manager.begin(), Manager.end());
+		sort(vSocks.begin(), vSocks.end(), SortSocksBySendq);
+
+		for (vector<Csock*>::const_iterator it = vSocks.begin(); it != vSocks.end(); ++it) {
+			Csock* pSock = *it;
+
+			// Idle sockets are not interesting and there can be thousands
+			if (pSock->GetInternalWriteBuffer().empty() && pSock->GetInternalReadBuffer().empty()) {
+				continue;
+			}
+
+			CTemplate& l = Tmpl.AddRow("SockLoop");
+			l["Name"] = pSock->GetSockName();
+			l["SendQ"] = CString(pSock->GetInternalWriteBuffer().size());
+			l["RecvQ"] = CString(pSock->GetInternalReadBuffer().size());
+		}
+
+		const map<CString, CUser*>& msUsers = CZNC::Get().GetUserMap();
+		for (map<CString, CUser*>::const_iterator it = msUsers.begin(); it != msUsers.end(); ++it) {
+			CTemplate& l = Tmpl.AddRow("BufferLoop");
+			l["Username"] = it->first;
+			l["Chans"] = CString(it->second->GetChans().size());
+			l["Size"] = CString::ToByteStr(it->second->GetBufferBytes());
+		}
+
+		return true;
+	}
+
+	bool PerfJSON(CWebSock& WebSock, const CPerfStats& Stats, const map<CString, CHookStats>& mHooks) {
+		const CHookStats& Loops = Stats.GetLoops();
+		const CHookStats& Lag = Stats.GetTimerLag();
+
+		CString sJSON = "{\"since\":" + CString((unsigned long long) Stats.GetSince())
+			+ ",\"loops\":" + CString(Loops.GetCalls())
+			+ ",\"loop_us\":" + CString(Loops.GetTime())
+			+ ",\"loop_max_us\":" + CString(Loops.GetMaxTime())
+			+ ",\"timer_lag_us\":" + CString(Stats.GetLastTimerLag())
+			+ ",\"timer_lag_max_us\":" + CString(Lag.GetMaxTime())
+			+ ",\"loop_buckets\":[";
+
+		for (unsigned int a = 0; a < CPerfStats::LOOP_BUCKETS; a++) {
+			if (a > 0) {
+				sJSON += ",";
+			}
+
+			sJSON += "{\"le_us\":" + CString(CPerfStats::GetLoopBucketLimit(a))
+				+ ",\"loops\":" + CString(Stats.GetLoopBucket(a)) + "}";
+		}
+
+		sJSON += "],\"hooks\":[";
+
+		for (map<CString, CHookStats>::const_iterator it = mHooks.begin(); it != mHooks.end(); ++it) {
+			if (it != mHooks.begin()) {
+				sJSON += ",";
+			}
+
+			sJSON += "{\"name\":" + JSONString(it->first)
+				+ ",\"calls\":" + CString(it->second.GetCalls())
+				+ ",\"us\":" + CString(it->second.GetTime())
+				+ ",\"max_us\":" + CString(it->second.GetMaxTime()) + "}";
+		}
+
+		sJSON += "]}";
+
+		WebSock.AddHeader("Cache-Control", "no-cache");
+		WebSock.PrintHeader(sJSON.length(), "application/json");
+		WebSock.Write(sJSON);
+
+		return true;
+	}
+
 	bool SettingsPage(CWebSock& WebSock, CTemplate& Tmpl) {
 		if (!WebSock.GetParam("submitted").ToUInt()) {
 			CString sBindHosts, sMotd;
@@ -961,6 +1285,12 @@ public:
 			Tmpl["ConnectDelay"] = CString(CZNC::Get().GetConnectDelay());
 			Tmpl["ServerThrottle"] = CString(CZNC::Get().GetServerThrottle());
 			Tmpl["AnonIPLimit"] = CString(CZNC::Get().GetAnonIPLimit());
+			Tmpl["MetricsToken"] = CZNC::Get().GetMetricsToken();
+			Tmpl["MetricsUserLabels"] = CString(CZNC::Get().GetMetricsUserLabels());
+			Tmpl["UserBufferLimit"] = CString(CZNC::Get().GetUserBufferLimit());
+			Tmpl["ClientSendQSoftLimit"] = CString(CZNC::Get().GetClientSendQSoftLimit());
+			Tmpl["ClientSendQHardLimit"] = CString(CZNC::Get().GetClientSendQHardLimit());
+			Tmpl["ClientSendQHighWater"] = CString(CZNC::Get().GetClientSendQHighWater());
 			Tmpl["ProtectWebSessions"] = CString(CZNC::Get().GetProtectWebSessions());
 
 			const VCString& vsBindHosts = CZNC::Get().GetBindHosts();
@@ -1053,6 +1383,12 @@ public:
 		sArg = WebSock.GetParam("connectdelay"); CZNC::Get().SetConnectDelay(sArg.ToUInt());
 		sArg = WebSock.GetParam("serverthrottle"); CZNC::Get().SetServerThrottle(sArg.ToUInt());
 		sArg = WebSock.GetParam("anoniplimit"); CZNC::Get().SetAnonIPLimit(sArg.ToUInt());
+		sArg = WebSock.GetParam("metricstoken"); CZNC::Get().SetMetricsToken(sArg.Trim_n());
+		sArg = WebSock.GetParam("metricsuserlabels"); CZNC::Get().SetMetricsUserLabels(sArg.ToUInt());
+		sArg = WebSock.GetParam("userbufferlimit"); CZNC::Get().SetUserBufferLimit(sArg.ToULong());
+		sArg = WebSock.GetParam("clientsendqsoftlimit"); CZNC::Get().SetClientSendQSoftLimit(sArg.ToULong());
+		sArg = WebSock.GetParam("clientsendqhardlimit"); CZNC::Get().SetClientSendQHardLimit(sArg.ToULong());
+		sArg = WebSock.GetParam("clientsendqhighwater"); CZNC::Get().SetClientSendQHighWater(sArg.ToULong());
 		sArg = WebSock.GetParam("protectwebsessions"); CZNC::Get().SetProtectWebSessions(sArg.ToBool());
 
 		VCString vsArgs;
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2004-2011  See the AUTHORS file for details.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+// Checks that CZNC::WriteConfig() only serializes users which changed.
+// Link this against the core objects (everything but main.cpp).
+
+#include "stdafx.hpp"
+#include "znc.h"
+#include "User.h"
+#include "Chan.h"
+#include "FileUtils.h"
+
+class CTestZNC : public CZNC {
+public:
+	void SetConfigFile(const CString& sFile) { m_sConfigFile = sFile; }
+};
+
+static CString ReadFile(const CString& sFile) {
+	CFile File(sFile);
+	CString sRet;
+
+	if (File.Open()) {
+		File.ReadFile(sRet);
+	}
+
+	return sRet;
+}
+
+static CString UserBlock(const CString& sConfig, const CString& sUser) {
+	CString::size_type uStart = sConfig.find("<User " + sUser + ">");
+	if (uStart == CString::npos) {
+		return "";
+	}
+
+	return sConfig.substr(uStart, sConfig.find("</User>", uStart) - uStart);
+}
+
+#define CHECK(x) do { if (!(x)) { fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #x); return 1; } } while (0)
+
+int main() {
+	CString sFile = "ConfigWriteTest.conf";
+	CString sErr;
+	CTestZNC* pZNC = static_cast<CTestZNC*>(&CZNC::Get());
+	pZNC->SetConfigFile(sFile);
+
+	CUser* pAlice = new CUser("alice");
+	pAlice->SetPass("a", CUser::HASH_NONE);
+	pAlice->AddChan("#alice", true);
+	CUser* pBob = new CUser("bob");
+	pBob->SetPass("b", CUser::HASH_NONE);
+	pBob->AddChan("#bob", true);
+
+	CHECK(pZNC->AddUser(pAlice, sErr));
+	CHECK(pZNC->AddUser(pBob, sErr));
+	CHECK(pZNC->WriteConfig());
+	CHECK(!pAlice->IsConfigChanged());
+	CHECK(!pBob->IsConfigChanged());
+	CString sFirst = ReadFile(sFile);
+
+	pAlice->SetNick("alice2");
+	CHECK(pAlice->IsConfigChanged());
+	CHECK(!pBob->IsConfigChanged());
+
+	// This bypasses the setters, so it only shows up if bob is serialized again
+	const_cast<CString&>(pBob->GetRealName()) = "not written";
+
+	CHECK(pZNC->WriteConfig());
+	CString sSecond = ReadFile(sFile);
+	CHECK(UserBlock(sFirst, "bob") == UserBlock(sSecond, "bob"));
+	CHECK(UserBlock(sSecond, "alice").find("alice2") != CString::npos);
+
+	// Channel settings belong to the user's config, too
+	pBob->FindChan("#bob")->SetKey("secret");
+	CHECK(pBob->IsConfigChanged());
+	CHECK(!pAlice->IsConfigChanged());
+
+	CHECK(pZNC->WriteConfig());
+	CString sThird = ReadFile(sFile);
+	CHECK(UserBlock(sSecond, "alice") == UserBlock(sThird, "alice"));
+	CHECK(UserBlock(sThird, "bob").find("secret") != CString::npos);
+
+	CFile::Delete(sFile);
+	printf("ok\n");
+	return 0;
+}
@@ -163,7 +163,7 @@ DWORD CZNCWindowsService::Loop()
 			ReportEvent(hEventLog, EVENTLOG_WARNING_TYPE, RUNTIME_CATEGORY, MSG_RUNTIME_SHUTDOWN, NULL, 0, 0, NULL, NULL);
 			dwRet = 0;
 		}
-		else if(e.GetType() == CException::EX_Restart)
+		else if(e.GetType() == CException::EX_Restart || e.GetType() == CException::EX_RestartLive)
 		{
 			// we can't restart from within this service without causing possible nasty endless restart
 			// loops, having only one reliable restart per day and/or causing lots of error-type event log entries.
@@ -20,6 +20,9 @@
 #include "ares.h"
 #endif
 
+// QueueConfigWrite() writes the config after this many seconds
+#define CONFIG_WRITE_DELAY 3
+
 static inline CString FormatBindError() {
 	CString sError;
 
@@ -33,6 +36,68 @@ static inline CString FormatBindError() {
 	return "Unable to bind [" + sError + "]";
 }
 
+static CString GetListenerDescription(const CListener* pListener) {
+	CString sRet = "[" + CString(pListener->IsSSL() ? "+" : "") + CString(pListener->GetPort()) + "]";
+
+	if (!pListener->GetBindHost().empty())
+		sRet += " on host [" + pListener->GetBindHost() + "]";
+
+	switch (pListener->GetAddrType()) {
+		case ADDR_IPV4ONLY:
+			sRet += " using ipv4";
+			break;
+		case ADDR_IPV6ONLY:
+			sRet += " using ipv6";
+			break;
+		default:
+			break;
+	}
+
+	return sRet;
+}
+
+// Measures how late timers run, which is how long the event loop was busy
+// with something else
+class CPerfTimer : public CCron {
+public:
+	CPerfTimer() : CCron() {
+		SetName("Perf stats");
+		Start(1);
+		m_uLastRun = 0;
+	}
+	virtual ~CPerfTimer() {}
+
+protected:
+	virtual void RunJob() {
+		unsigned long long uNow = CUtils::GetMicroTime();
+
+		// GetNextRun() only has whole seconds, measure from the last run instead
+		if (m_uLastRun) {
+			unsigned long long uDue = m_uLastRun + 1000000;
+
+			CZNC::Get().GetPerfStats().AddTimerLag((uNow > uDue) ? uNow - uDue : 0);
+		}
+
+		m_uLastRun = uNow;
+	}
+
+	unsigned long long m_uLastRun;
+};
+
+class CMemoryLimitTimer : public CCron {
+public:
+	CMemoryLimitTimer() : CCron() {
+		SetName("Memory limits");
+		Start(1);
+	}
+	virtual ~CMemoryLimitTimer() {}
+
+protected:
+	virtual void RunJob() {
+		CZNC::Get().EnforceMemoryLimits();
+	}
+};
+
 CZNC::CZNC() {
 	m_pModules = new CGlobalModules();
 	m_uiConnectDelay = 5;
@@ -46,9 +111,23 @@ CZNC::CZNC() {
 	m_sConnectThrottle.SetTTL(30000);
 	m_pLockFile = NULL;
 	m_bProtectWebSessions = true;
+	m_uPassHashIterations = 10000;
+	m_uMetricsUserLabels = 100;
+	m_uUserBufferLimit = 0;
+	m_uClientSendQSoftLimit = 0;
+	m_uClientSendQHardLimit = 0;
+	m_uClientSendQHighWater = 1024 * 1024;
+	m_pAuthQueue = new CAuthQueue();
+	m_bConfigWritePending = false;
+	m_Manager.AddCron(new CPerfTimer());
+	m_Manager.AddCron(new CMemoryLimitTimer());
 }
 
 CZNC::~CZNC() {
+	if (m_bConfigWritePending) {
+		WriteConfig();
+	}
+
 	m_pModules->UnloadAll();
 
 	for (map<CString,CUser*>::iterator a = m_msUsers.begin(); a != m_msUsers.end(); ++a) {
@@ -63,6 +142,10 @@ CZNC::~CZNC() {
 		a->second->SetBeingDeleted(true);
 	}
 
+	// Stops the worker threads and refuses logins which are still being checked
+	delete m_pAuthQueue;
+	m_pAuthQueue = NULL;
+
 	m_pConnectUserTimer = NULL;
 	// This deletes m_pConnectUserTimer
 	m_Manager.Cleanup();
@@ -195,10 +278,15 @@ bool CZNC::HandleUserDeletion()
 #ifdef _WIN32
 void CZNC::Loop(bool* bLoop) {
 	while (*bLoop) {
+		unsigned long long uStart = CUtils::GetMicroTime();
+		unsigned long long uWait = m_Manager.GetWaitTime();
+
 		LoopDoMaintenance();
 
 		// have to use Loop instead of DynamicSelectLoop because the latter waits for too long
 		m_Manager.Loop();
+
+		m_PerfStats.AddLoop(CUtils::GetMicroTime() - uStart - (m_Manager.GetWaitTime() - uWait));
 	}
 	Broadcast("ZNC has been requested to shut down!");
 	if(!CZNC::Get().WriteConfig())
@@ -209,11 +297,17 @@ void CZNC::Loop(bool* bLoop) {
 #else
 void CZNC::Loop() {
 	while (true) {
+		unsigned long long uStart = CUtils::GetMicroTime();
+		unsigned long long uWait = m_Manager.GetWaitTime();
+
 		LoopDoMaintenance();
 
 		// Csocket wants micro seconds
 		// 500 msec to 600 sec
 		m_Manager.DynamicSelectLoop(500 * 1000, 600 * 1000 * 1000);
+
+		// Only count the time spent working, not waiting for sockets
+		m_PerfStats.AddLoop(CUtils::GetMicroTime() - uStart - (m_Manager.GetWaitTime() - uWait));
 	}
 }
 #endif
@@ -228,6 +322,10 @@ void CZNC::LoopDoMaintenance()
 
 			if (RehashConfig(sError)) {
 				Broadcast("Rehashing succeeded", true);
+
+				for (VCString::const_iterator it = m_vsRehashChanges.begin(); it != m_vsRehashChanges.end(); ++it) {
+					Broadcast(*it, true);
+				}
 			} else {
 				Broadcast("Rehashing failed: " + sError, true);
 				Broadcast("ZNC is in some possibly inconsistent state!", true);
@@ -504,6 +602,15 @@ bool CZNC::WriteConfig() {
 	pFile->Write("MaxBufferSize= " + CString(m_uiMaxBufferSize) + "\n");
 	pFile->Write("SSLCertFile  = " + CString(m_sSSLCertFile) + "\n");
 	pFile->Write("ProtectWebSessions = " + CString(m_bProtectWebSessions) + "\n");
+	pFile->Write("PassHashIterations = " + CString(m_uPassHashIterations) + "\n");
+	if (!m_sMetricsToken.empty()) {
+		pFile->Write("MetricsToken = " + m_sMetricsToken + "\n");
+	}
+	pFile->Write("MetricsUserLabels = " + CString(m_uMetricsUserLabels) + "\n");
+	pFile->Write("UserBufferLimit = " + CString(m_uUserBufferLimit) + "\n");
+	pFile->Write("ClientSendQSoftLimit = " + CString(m_uClientSendQSoftLimit) + "\n");
+	pFile->Write("ClientSendQHardLimit = " + CString(m_uClientSendQHardLimit) + "\n");
+	pFile->Write("ClientSendQHighWater = " + CString(m_uClientSendQHighWater) + "\n");
 
 	for (size_t l = 0; l < m_vpListeners.size(); l++) {
 		CListener* pListener = m_vpListeners[l];
@@ -579,19 +686,51 @@ bool CZNC::WriteConfig() {
 		pFile->Write("LoadModule   = " + sName.FirstLine() + sArgs + "\n");
 	}
 
+	// Every user's part of the config depends on the global StatusPrefix
+	if (m_sUserConfigsPrefix != m_sStatusPrefix) {
+		m_msUserConfigs.clear();
+		m_sUserConfigsPrefix = m_sStatusPrefix;
+	}
+
+	// Forget users which are gone
+	for (map<CString,CString>::iterator it = m_msUserConfigs.begin(); it != m_msUserConfigs.end();) {
+		if (m_msUsers.find(it->first) == m_msUsers.end()) {
+			m_msUserConfigs.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
 	for (map<CString,CUser*>::iterator it = m_msUsers.begin(); it != m_msUsers.end(); ++it) {
-		CString sErr;
+		CUser* pUser = it->second;
 
-		if (!it->second->IsValid(sErr)) {
-			DEBUG("** Error writing config for user [" << it->first << "] [" << sErr << "]");
+		if (pUser->IsTemporary()) {
 			continue;
 		}
 
-		pFile->Write("\n");
+		map<CString,CString>::iterator itCached = m_msUserConfigs.find(it->first);
 
-		if (!it->second->WriteConfig(*pFile)) {
-			DEBUG("** Error writing config for user [" << it->first << "]");
+		// Only users which changed since the last write are serialized again
+		if (itCached == m_msUserConfigs.end() || pUser->IsConfigChanged()) {
+			CString sUserConfig, sErr;
+
+			if (!pUser->IsValid(sErr)) {
+				DEBUG("** Error writing config for user [" << it->first << "] [" << sErr << "]");
+				m_msUserConfigs.erase(it->first);
+				continue;
+			}
+
+			if (!pUser->WriteConfig(sUserConfig)) {
+				DEBUG("** Error writing config for user [" << it->first << "]");
+			}
+
+			m_msUserConfigs[it->first] = sUserConfig;
+			itCached = m_msUserConfigs.find(it->first);
+			pUser->SetConfigChanged(false);
 		}
+
+		pFile->Write("\n");
+		pFile->Write(itCached->second);
 	}
 
 	// If Sync() fails... well, let's hope nothing important breaks..
@@ -632,6 +771,8 @@ bool CZNC::WriteConfig() {
 	delete m_pLockFile;
 	m_pLockFile = pFile;
 
+	m_bConfigWritePending = false;
+
 	return true;
 }
 
@@ -1062,6 +1203,7 @@ bool CZNC::RehashConfig(CString& sError)
 bool CZNC::DoRehash(CString& sError)
 {
 	sError.clear();
+	m_vsRehashChanges.clear();
 
 	CUtils::PrintAction("Opening Config [" + m_sConfigFile + "]");
 
@@ -1111,12 +1253,6 @@ bool CZNC::DoRehash(CString& sError)
 	m_vsBindHosts.clear();
 	m_vsMotd.clear();
 
-	// Delete all listeners
-	while (!m_vpListeners.empty()) {
-		delete m_vpListeners[0];
-		m_vpListeners.erase(m_vpListeners.begin());
-	}
-
 	MCString msModules;          // Modules are queued for later loading
 
 	VCString vsList;
@@ -1158,6 +1294,7 @@ bool CZNC::DoRehash(CString& sError)
 				sError = sModRet;
 				return false;
 			}
+			m_vsRehashChanges.push_back("Loaded global module [" + sModName + "]");
 		} else if (pOldMod->GetArgs() != sArgs) {
 			CUtils::PrintAction("Reloading Global Module [" + sModName + "]");
 
@@ -1168,6 +1305,7 @@ bool CZNC::DoRehash(CString& sError)
 				sError = sModRet;
 				return false;
 			}
+			m_vsRehashChanges.push_back("Reloaded global module [" + sModName + "]");
 		} else
 			CUtils::PrintMessage("Module [" + sModName + "] already loaded.");
 
@@ -1232,6 +1370,22 @@ bool CZNC::DoRehash(CString& sError)
 		m_uiMaxBufferSize = sVal.ToUInt();
 	if (config.FindStringEntry("protectwebsessions", sVal))
   		m_bProtectWebSessions = sVal.ToBool();
+	if (config.FindStringEntry("passhashiterations", sVal))
+		m_uPassHashIterations = sVal.ToUInt();
+	// Without this, a rehash could not turn the endpoint off again
+	m_sMetricsToken.clear();
+	if (config.FindStringEntry("metricstoken", sVal))
+		m_sMetricsToken = sVal;
+	if (config.FindStringEntry("metricsuserlabels", sVal))
+		m_uMetricsUserLabels = sVal.ToUInt();
+	if (config.FindStringEntry("userbufferlimit", sVal))
+		m_uUserBufferLimit = sVal.ToULong();
+	if (config.FindStringEntry("clientsendqsoftlimit", sVal))
+		m_uClientSendQSoftLimit = sVal.ToULong();
+	if (config.FindStringEntry("clientsendqhardlimit", sVal))
+		m_uClientSendQHardLimit = sVal.ToULong();
+	if (config.FindStringEntry("clientsendqhighwater", sVal))
+		m_uClientSendQHighWater = sVal.ToULong();
 
 	// This has to be after SSLCertFile is handled since it uses that value
 	const char *szListenerEntries[] = {
@@ -1239,17 +1393,30 @@ bool CZNC::DoRehash(CString& sError)
 		"listener", "listener6", "listener4"
 	};
 	const size_t numListenerEntries = sizeof(szListenerEntries) / sizeof(szListenerEntries[0]);
+	// Listeners which are still configured, existing ones aren't bound again
+	set<CListener*> ssKeepListeners;
 
 	for (size_t i = 0; i < numListenerEntries; i++) {
 		config.FindStringVector(szListenerEntries[i], vsList);
 		vit = vsList.begin();
 
 		for (; vit != vsList.end(); ++vit) {
-			if (!AddListener(szListenerEntries[i] + CString(" ") + *vit, sError))
+			if (!AddListener(szListenerEntries[i] + CString(" ") + *vit, sError, &ssKeepListeners))
 				return false;
 		}
 	}
 
+	for (size_t i = 0; i < m_vpListeners.size(); ) {
+		CListener* pListener = m_vpListeners[i];
+
+		if (ssKeepListeners.find(pListener) == ssKeepListeners.end()) {
+			m_vsRehashChanges.push_back("Removed listener on port " + GetListenerDescription(pListener));
+			DelListener(pListener);
+		} else {
+			i++;
+		}
+	}
+
 	CConfig::SubConfig subConf;
 	CConfig::SubConfig::const_iterator subIt;
 	config.FindSubConfig("user", subConf);
@@ -1266,6 +1433,30 @@ bool CZNC::DoRehash(CString& sError)
 		if (it != m_msDelUsers.end()) {
 			pRealUser = it->second;
 			m_msDelUsers.erase(it);
+
+			// If the running user serializes to exactly what is in the
+			// file, there is nothing to apply and the user, its channels
+			// and its modules are left alone.
+			CString sLive, sErr;
+			CConfig LiveConfig;
+			CConfig::SubConfig subLive;
+
+			pRealUser->WriteConfig(sLive);
+
+			if (LiveConfig.Parse(sLive, sErr) && LiveConfig.FindSubConfig("user", subLive)
+					&& subLive.size() == 1 && subLive.begin()->second.m_pSubConfig
+					&& *subLive.begin()->second.m_pSubConfig == *pSubConf) {
+				if (!AddUser(pRealUser, sErr)) {
+					sError = "Invalid user [" + sUserName + "] " + sErr;
+					CUtils::PrintError(sError);
+					return false;
+				}
+
+				// What we just serialized is what WriteConfig() would write
+				m_msUserConfigs[sUserName] = sLive;
+				pRealUser->SetConfigChanged(false);
+				continue;
+			}
 		}
 
 		CUser* pUser = new CUser(sUserName);
@@ -1299,12 +1490,16 @@ bool CZNC::DoRehash(CString& sError)
 					|| !AddUser(pRealUser, sErr)) {
 				sError = "Invalid user [" + pUser->GetUserName() + "] " + sErr;
 				DEBUG("CUser::Clone() failed in rehash");
+			} else {
+				m_vsRehashChanges.push_back("Modified user [" + sUserName + "]");
 			}
 			pUser->SetBeingDeleted(true);
 			delete pUser;
 			pUser = NULL;
 		} else if (!AddUser(pUser, sErr)) {
 			sError = "Invalid user [" + pUser->GetUserName() + "] " + sErr;
+		} else {
+			m_vsRehashChanges.push_back("Added user [" + sUserName + "]");
 		}
 
 		if (!sError.empty()) {
@@ -1340,9 +1535,10 @@ bool CZNC::DoRehash(CString& sError)
 	}
 
 	for (set<CString>::iterator it = ssUnload.begin(); it != ssUnload.end(); ++it) {
-		if (GetModules().UnloadModule(*it))
+		if (GetModules().UnloadModule(*it)) {
 			CUtils::PrintMessage("Unloaded Global Module [" + *it + "]");
-		else
+			m_vsRehashChanges.push_back("Unloaded global module [" + *it + "]");
+		} else
 			CUtils::PrintMessage("Could not unload [" + *it + "]");
 	}
 
@@ -1358,6 +1554,11 @@ bool CZNC::DoRehash(CString& sError)
 		return false;
 	}
 
+	// Users which are still in m_msDelUsers get deleted by RehashConfig()
+	for (map<CString,CUser*>::iterator it = m_msDelUsers.begin(); it != m_msDelUsers.end(); ++it) {
+		m_vsRehashChanges.push_back("Removed user [" + it->first + "]");
+	}
+
 	// Make sure that users that want to connect do so and also make sure a
 	// new ConnectDelay setting is applied.
 	DisableConnectUser();
@@ -1423,6 +1624,13 @@ bool CZNC::RemBindHost(const CString& sHost) {
 
 void CZNC::Broadcast(const CString& sMessage, bool bAdminOnly,
 		CUser* pSkipUser, CClient *pSkipClient) {
+	// Most users share a status prefix and modules rarely change the
+	// message, so usually the line is only put together once.
+	CFanOutLine Line("");
+	CString sLinePrefix;
+	CString sLineMsg;
+	bool bHaveLine = false;
+
 	for (map<CString,CUser*>::iterator a = m_msUsers.begin(); a != m_msUsers.end(); ++a) {
 		if (bAdminOnly && !a->second->IsAdmin())
 			continue;
@@ -1431,7 +1639,17 @@ void CZNC::Broadcast(const CString& sMessage, bool bAdminOnly,
 			CString sMsg = sMessage;
 
 			MODULECALL(OnBroadcast(sMsg), a->second, NULL, continue);
-			a->second->PutStatusNotice("*** " + sMsg, NULL, pSkipClient);
+
+			const CString& sPrefix = a->second->GetStatusPrefix();
+
+			if (!bHaveLine || sPrefix != sLinePrefix || sMsg != sLineMsg) {
+				Line = CFanOutLine(":" + sPrefix + "status!znc@znc.in NOTICE ", " :*** " + sMsg);
+				sLinePrefix = sPrefix;
+				sLineMsg = sMsg;
+				bHaveLine = true;
+			}
+
+			Line.SendTo(a->second, pSkipClient);
 		}
 	}
 }
@@ -1510,7 +1728,7 @@ CListener* CZNC::FindListener(u_short uPort, const CString& sBindHost, EAddrType
 	return NULL;
 }
 
-bool CZNC::AddListener(const CString& sLine, CString& sError) {
+bool CZNC::AddListener(const CString& sLine, CString& sError, set<CListener*>* pssKeep) {
 	CString sName = sLine.Token(0);
 	CString sValue = sLine.Token(1, true);
 
@@ -1568,7 +1786,30 @@ bool CZNC::AddListener(const CString& sLine, CString& sError) {
 	}
 
 	unsigned short uPort = sPort.ToUShort();
-	CUtils::PrintAction("Binding to port [" + CString((bSSL) ? "+" : "") + CString(uPort) + "]" + sHostComment + sIPV6Comment);
+	CString sDescription = "[" + CString((bSSL) ? "+" : "") + CString(uPort) + "]" + sHostComment + sIPV6Comment;
+
+	if (pssKeep) {
+		CListener* pOld = FindListener(uPort, sBindHost, eAddr);
+
+		if (pOld && pssKeep->find(pOld) == pssKeep->end()) {
+			if (pOld->IsSSL() == bSSL) {
+				// Already listening, don't drop the socket
+				if (pOld->GetAcceptType() != eAccept) {
+					pOld->SetAcceptType(eAccept);
+					m_vsRehashChanges.push_back("Changed listener on port " + sDescription);
+				}
+				pssKeep->insert(pOld);
+				CUtils::PrintMessage("Keeping listener on port " + sDescription);
+				return true;
+			}
+
+			// The port has to be free before it can be bound with new settings
+			m_vsRehashChanges.push_back("Removed listener on port " + GetListenerDescription(pOld));
+			DelListener(pOld);
+		}
+	}
+
+	CUtils::PrintAction("Binding to port " + sDescription);
 
 #ifndef HAVE_IPV6
 	if (ADDR_IPV6ONLY == eAddr) {
@@ -1610,8 +1851,33 @@ bool CZNC::AddListener(const CString& sLine, CString& sError) {
 	}
 
 	CListener* pListener = new CListener(uPort, sBindHost, bSSL, eAddr, eAccept);
+	bool bListening = pListener->Listen();
 
-	if (!pListener->Listen()) {
+	if (!bListening && pssKeep) {
+		// An old listener which is no longer configured, e.g. for a
+		// different bind host, might still be using this port.
+		bool bFreed = false;
+
+		for (size_t i = 0; i < m_vpListeners.size(); ) {
+			CListener* pOld = m_vpListeners[i];
+
+			if (pOld->GetPort() == uPort && pssKeep->find(pOld) == pssKeep->end()) {
+				m_vsRehashChanges.push_back("Removed listener on port " + GetListenerDescription(pOld));
+				DelListener(pOld);
+				bFreed = true;
+			} else {
+				i++;
+			}
+		}
+
+		if (bFreed) {
+			delete pListener;
+			pListener = new CListener(uPort, sBindHost, bSSL, eAddr, eAccept);
+			bListening = pListener->Listen();
+		}
+	}
+
+	if (!bListening) {
 		sError = FormatBindError();
 		CUtils::PrintStatus(false, sError);
 		delete pListener;
@@ -1621,6 +1887,11 @@ bool CZNC::AddListener(const CString& sLine, CString& sError) {
 	m_vpListeners.push_back(pListener);
 	CUtils::PrintStatus(true);
 
+	if (pssKeep) {
+		pssKeep->insert(pListener);
+		m_vsRehashChanges.push_back("Added listener on port " + sDescription);
+	}
+
 	return true;
 }
 
@@ -1706,13 +1977,50 @@ CZNC::TrafficStatsMap CZNC::GetTrafficStats(TrafficStatsPair &Users,
 	return ret;
 }
 
+void CZNC::EnforceMemoryLimits() {
+	if (!m_uUserBufferLimit && !m_uClientSendQSoftLimit && !m_uClientSendQHardLimit) {
+		return;
+	}
+
+	for (map<CString, CUser*>::const_iterator it = m_msUsers.begin(); it != m_msUsers.end(); ++it) {
+		CUser* pUser = it->second;
+
+		if (m_uUserBufferLimit) {
+			unsigned int uDropped = pUser->TrimBuffers(m_uUserBufferLimit);
+
+			if (uDropped) {
+				DEBUG("(" << pUser->GetUserName() << ") dropped [" << uDropped << "] buffer lines");
+				m_PerfStats.AddDroppedLines(uDropped);
+			}
+		}
+
+		// Closed clients stay in this list until the socket is gone
+		const vector<CClient*>& vClients = pUser->GetClients();
+		for (vector<CClient*>::const_iterator it2 = vClients.begin(); it2 != vClients.end(); ++it2) {
+			if (!(*it2)->IsClosed()) {
+				(*it2)->CheckSendQ(m_uClientSendQSoftLimit, m_uClientSendQHardLimit);
+			}
+		}
+	}
+}
+
 void CZNC::AuthUser(CSmartPtr<CAuthBase> AuthClass) {
 	// TODO unless the auth module calls it, CUser::IsHostAllowed() is not honoured
 	GLOBALMODULECALL(OnLoginAttempt(AuthClass), NULL, NULL, return);
 
 	CUser* pUser = FindUser(AuthClass->GetUsername());
 
-	if (!pUser || !pUser->CheckPass(AuthClass->GetPassword())) {
+	if (!pUser) {
+		AuthClass->RefuseLogin("Invalid Password");
+		return;
+	}
+
+	// Calls FinishAuthUser(), possibly only after a later main loop iteration
+	m_pAuthQueue->Check(AuthClass, *pUser);
+}
+
+void CZNC::FinishAuthUser(CSmartPtr<CAuthBase> AuthClass, CUser* pUser, bool bValid) {
+	if (!pUser || !bValid) {
 		AuthClass->RefuseLogin("Invalid Password");
 		return;
 	}
@@ -1807,6 +2115,32 @@ private:
 	size_t m_uiPosNextUser;
 };
 
+class CConfigWriteTimer : public CCron {
+public:
+	CConfigWriteTimer(int iSecs) : CCron() {
+		SetName("Write config");
+		StartMaxCycles(iSecs, 1);
+	}
+	virtual ~CConfigWriteTimer() {}
+
+protected:
+	virtual void RunJob() {
+		CZNC& ZNC = CZNC::Get();
+
+		// Someone might have written the config in the mean time
+		if (ZNC.IsConfigWritePending() && !ZNC.WriteConfig()) {
+			ZNC.Broadcast("Writing the config file failed", true);
+		}
+	}
+};
+
+void CZNC::QueueConfigWrite() {
+	if (!m_bConfigWritePending) {
+		m_bConfigWritePending = true;
+		GetManager().AddCron(new CConfigWriteTimer(CONFIG_WRITE_DELAY));
+	}
+}
+
 void CZNC::SetConnectDelay(unsigned int i) {
 	if (m_uiConnectDelay != i && m_pConnectUserTimer != NULL) {
 		m_pConnectUserTimer->Start(i);
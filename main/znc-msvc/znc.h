@@ -14,6 +14,8 @@
 #include "Client.h"
 #include "Modules.h"
 #include "Socket.h"
+#include "MessageBus.h"
+#include "PerfStats.h"
 #include <map>
 
 using std::map;
@@ -21,6 +23,7 @@ using std::map;
 class CListener;
 class CUser;
 class CConnectUserTimer;
+class CAuthQueue;
 class CConfig;
 class CFile;
 
@@ -52,8 +55,19 @@ public:
 	bool OnBoot();
 	CString ExpandConfigPath(const CString& sConfigFile, bool bAllowMkDir = true);
 	bool WriteNewConfig(const CString& sConfigFile);
+	/** Writes znc.conf. Only users which have CUser::IsConfigChanged() set
+	 *  are serialized, the others are copied from the last write.
+	 */
 	bool WriteConfig();
+	/** Writes the config a few seconds later. Any number of calls in that
+	 *  time result in a single write.
+	 */
+	void QueueConfigWrite();
 	bool ParseConfig(const CString& sConfig, CString& sError);
+	/** Re-reads znc.conf and applies only what differs from the running
+	 *  state: unchanged listeners stay bound and unchanged users are not
+	 *  touched. GetRehashChanges() lists what was done.
+	 */
 	bool RehashConfig(CString& sError);
 	static CString GetVersion();
 	static CString GetTag(bool bIncludeVersion = true);
@@ -83,6 +97,10 @@ public:
 	// The result is passed back via callbacks to CAuthBase.
 	// CSmartPtr handles freeing this pointer!
 	void AuthUser(CSmartPtr<CAuthBase> AuthClass);
+	//! Called by CAuthQueue once the password has been checked.
+	void FinishAuthUser(CSmartPtr<CAuthBase> AuthClass, CUser* pUser, bool bValid);
+	//! Applies UserBufferLimit and the ClientSendQ limits, called once a second.
+	void EnforceMemoryLimits();
 
 	// Setters
 	void SetConfigState(enum ConfigState e) { m_eConfigState = e; }
@@ -92,13 +110,23 @@ public:
 	void SetAnonIPLimit(unsigned int i) { m_uiAnonIPLimit = i; }
 	void SetServerThrottle(unsigned int i) { m_sConnectThrottle.SetTTL(i*1000); }
 	void SetProtectWebSessions(bool b) { m_bProtectWebSessions = b; }
+	void SetPassHashIterations(unsigned int i) { m_uPassHashIterations = i; }
+	void SetMetricsToken(const CString& s) { m_sMetricsToken = s; }
+	void SetMetricsUserLabels(unsigned int i) { m_uMetricsUserLabels = i; }
+	void SetUserBufferLimit(size_t u) { m_uUserBufferLimit = u; }
+	void SetClientSendQSoftLimit(size_t u) { m_uClientSendQSoftLimit = u; }
+	void SetClientSendQHardLimit(size_t u) { m_uClientSendQHardLimit = u; }
+	void SetClientSendQHighWater(size_t u) { m_uClientSendQHighWater = u; }
 	void SetConnectDelay(unsigned int i);
 	// !Setters
 
 	// Getters
 	enum ConfigState GetConfigState() const { return m_eConfigState; }
+	bool IsConfigWritePending() const { return m_bConfigWritePending; }
 	CSockManager& GetManager() { return m_Manager; }
 	const CSockManager& GetManager() const { return m_Manager; }
+	CMessageBus& GetMessageBus() { return m_MessageBus; }
+	CPerfStats& GetPerfStats() { return m_PerfStats; }
 	CGlobalModules& GetModules() { return *m_pModules; }
 	size_t FilterUncommonModules(set<CModInfo>& ssModules);
 	CString GetSkinName() const { return m_sSkinName; }
@@ -114,12 +142,29 @@ public:
 	bool WritePemFile();
 	const VCString& GetBindHosts() const { return m_vsBindHosts; }
 	const vector<CListener*>& GetListeners() const { return m_vpListeners; }
+	//! The changes applied by the last (successful or not) rehash.
+	const VCString& GetRehashChanges() const { return m_vsRehashChanges; }
 	time_t TimeStarted() const { return m_TimeStarted; }
 	size_t GetMaxBufferSize() const { return m_uiMaxBufferSize; }
 	unsigned int GetAnonIPLimit() const { return m_uiAnonIPLimit; }
 	unsigned int GetServerThrottle() const { return m_sConnectThrottle.GetTTL() / 1000; }
 	unsigned int GetConnectDelay() const { return m_uiConnectDelay; }
 	bool GetProtectWebSessions() const { return m_bProtectWebSessions; }
+	//! PBKDF2 iterations older password hashes are upgraded to on login, 0 disables that.
+	unsigned int GetPassHashIterations() const { return m_uPassHashIterations; }
+	//! Secret which scrapers of /metrics have to send, empty disables the endpoint
+	const CString& GetMetricsToken() const { return m_sMetricsToken; }
+	//! Up to this many users get their own series on /metrics, 0 turns them off
+	unsigned int GetMetricsUserLabels() const { return m_uMetricsUserLabels; }
+	//! Bytes all buffers of one user may use, 0 means no limit
+	size_t GetUserBufferLimit() const { return m_uUserBufferLimit; }
+	//! Bytes queued to a client above which we stop reading from it, 0 means no limit
+	size_t GetClientSendQSoftLimit() const { return m_uClientSendQSoftLimit; }
+	//! Bytes queued to a client above which it is disconnected, 0 means no limit
+	size_t GetClientSendQHardLimit() const { return m_uClientSendQHardLimit; }
+	//! We stop reading from IRC while all of a user's clients have more than this queued, 0 never does
+	size_t GetClientSendQHighWater() const { return m_uClientSendQHighWater; }
+	CAuthQueue& GetAuthQueue() { return *m_pAuthQueue; }
 	// !Getters
 
 	// Static allocator
@@ -161,7 +206,7 @@ private:
 	// Returns true if something was done
 	bool HandleUserDeletion();
 	CString MakeConfigHeader();
-	bool AddListener(const CString& sLine, CString& sError);
+	bool AddListener(const CString& sLine, CString& sError, set<CListener*>* pssKeep = NULL);
 
 protected:
 	time_t                 m_TimeStarted;
@@ -171,6 +216,8 @@ protected:
 	map<CString,CUser*>    m_msUsers;
 	map<CString,CUser*>    m_msDelUsers;
 	CSockManager           m_Manager;
+	CMessageBus            m_MessageBus;
+	CPerfStats             m_PerfStats;
 
 	CString                m_sCurPath;
 	CString                m_sZNCPath;
@@ -192,6 +239,18 @@ protected:
 	CConnectUserTimer     *m_pConnectUserTimer;
 	TCacheMap<CString>     m_sConnectThrottle;
 	bool                   m_bProtectWebSessions;
+	unsigned int           m_uPassHashIterations;
+	CString                m_sMetricsToken;
+	unsigned int           m_uMetricsUserLabels;
+	size_t                 m_uUserBufferLimit;
+	size_t                 m_uClientSendQSoftLimit;
+	size_t                 m_uClientSendQHardLimit;
+	size_t                 m_uClientSendQHighWater;
+	CAuthQueue*            m_pAuthQueue;
+	map<CString,CString>   m_msUserConfigs;
+	CString                m_sUserConfigsPrefix;
+	bool                   m_bConfigWritePending;
+	VCString               m_vsRehashChanges;
 };
 
 #endif // !_ZNC_H